@@ -0,0 +1,232 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _ENVMAP_ALIAS_TABLE_H_INCLUDED_
+#define _ENVMAP_ALIAS_TABLE_H_INCLUDED_
+
+#include <nabla.h>
+
+#include <cfloat>
+#include <numeric>
+#include <thread>
+
+
+//! Walker/Vose alias table over the texels of an equirectangular envmap, O(1) sampling instead of two CDF bisections.
+//! Every entry is a single `uint32_t`, the alias texel index lives in the low `indexBits` and the acceptance threshold
+//! is quantized into the remaining high bits, so a 2048x1024 envmap leaves 11 bits of threshold precision.
+//! Because of the quantization the PDF we hand out is recomputed from the packed table, so sample and PDF always agree.
+class EnvmapAliasTable
+{
+	public:
+		//! smallest amount of threshold bits we accept, anything less would visibly skew the distribution
+		static inline constexpr uint32_t MinThresholdBits = 8u;
+
+		struct SSample
+		{
+			uint32_t texel;
+			// equirectangular coordinates in [0,1)^2, x maps to phi and y to theta
+			double uv[2];
+			// probability density with respect to solid angle
+			double pdf;
+		};
+
+		EnvmapAliasTable() = default;
+
+		//! `weights` is the unnormalized, sin(theta) weighted luminance of every texel as produced by `computeLuminancePdf`
+		//! the table gets built in `blockCount` independent blocks in parallel, then the leftovers of all blocks are paired up serially
+		inline bool build(const double* weights, const uint32_t width, const uint32_t height, uint32_t blockCount=0u)
+		{
+			m_width = width;
+			m_height = height;
+			const uint32_t texelCount = width*height;
+			if (texelCount<2u)
+				return false;
+
+			m_indexBits = core::findMSB(texelCount-1u)+1u;
+			if (m_indexBits+MinThresholdBits>32u)
+				return false;
+			m_thresholdBits = 32u-m_indexBits;
+
+			const double weightSum = std::reduce(core::execution::par_unseq,weights,weights+texelCount,0.0);
+			if (!(weightSum>0.0))
+				return false;
+			const double scale = double(texelCount)/weightSum;
+
+			// every cell starts out pointing at itself with a full threshold, so cells we never touch sample themselves
+			core::vector<double> threshold(texelCount);
+			core::vector<uint32_t> alias(texelCount);
+			std::transform(core::execution::par_unseq,weights,weights+texelCount,threshold.begin(),[scale](const double w){return w*scale;});
+			std::iota(alias.begin(),alias.end(),0u);
+
+			if (blockCount==0u)
+				blockCount = core::max(std::thread::hardware_concurrency(),1u);
+			blockCount = core::min(blockCount,(texelCount+MinBlockSize-1u)/MinBlockSize);
+			const uint32_t blockSize = (texelCount+blockCount-1u)/blockCount;
+
+			// Vose within each block against the global average, any residual lands in the per-block leftover lists
+			core::vector<core::vector<uint32_t>> leftoverSmall(blockCount),leftoverLarge(blockCount);
+			core::vector<uint32_t> blockIDs(blockCount);
+			std::iota(blockIDs.begin(),blockIDs.end(),0u);
+			std::for_each(core::execution::par_unseq,blockIDs.begin(),blockIDs.end(),[&](const uint32_t blockID)
+			{
+				const uint32_t begin = blockID*blockSize;
+				const uint32_t end = core::min(begin+blockSize,texelCount);
+				auto& small = leftoverSmall[blockID];
+				auto& large = leftoverLarge[blockID];
+				for (uint32_t i=begin; i<end; i++)
+					(threshold[i]<1.0 ? small:large).push_back(i);
+				pairUp(threshold.data(),alias.data(),small,large);
+			});
+
+			// the residual weights of the leftovers still sum up to their count, so plain Vose over them finishes the table
+			core::vector<uint32_t> small,large;
+			for (uint32_t blockID=0u; blockID<blockCount; blockID++)
+			{
+				small.insert(small.end(),leftoverSmall[blockID].begin(),leftoverSmall[blockID].end());
+				large.insert(large.end(),leftoverLarge[blockID].begin(),leftoverLarge[blockID].end());
+			}
+			pairUp(threshold.data(),alias.data(),small,large);
+			// whatever remains is only off from 1.0 due to floating point error
+			for (const auto i : small)
+				alias[i] = i;
+			for (const auto i : large)
+				alias[i] = i;
+
+			// pack and then derive the exact discrete distribution the packed table represents
+			m_entries.resize(texelCount);
+			const double thresholdMax = double(1ull<<m_thresholdBits);
+			std::for_each(core::execution::par_unseq,blockIDs.begin(),blockIDs.end(),[&](const uint32_t blockID)
+			{
+				const uint32_t begin = blockID*blockSize;
+				const uint32_t end = core::min(begin+blockSize,texelCount);
+				for (uint32_t i=begin; i<end; i++)
+				{
+					uint32_t quantized = getThresholdMask();
+					if (alias[i]!=i)
+						quantized = core::min(static_cast<uint32_t>(threshold[i]*thresholdMax+0.5),getThresholdMask());
+					m_entries[i] = (quantized<<m_indexBits)|alias[i];
+				}
+			});
+			computeProbabilities();
+			return true;
+		}
+
+		inline uint32_t getWidth() const { return m_width; }
+		inline uint32_t getHeight() const { return m_height; }
+		inline uint32_t getIndexBits() const { return m_indexBits; }
+		inline uint32_t getThresholdBits() const { return m_thresholdBits; }
+		//! packed entries, ready to be uploaded as an R32_UINT texel buffer
+		inline const core::vector<uint32_t>& getPackedEntries() const { return m_entries; }
+		//! discrete probability of every texel as represented by the packed table, sums to 1
+		inline const core::vector<float>& getTexelProbabilities() const { return m_probability; }
+
+		//! O(1), `xi` in [0,1)^2, the first dimension picks the cell and is then reused for the x coordinate within the texel
+		inline SSample sample(const double xi[2]) const
+		{
+			const uint32_t texelCount = m_entries.size();
+			const double scaled = xi[0]*double(texelCount);
+			const uint32_t cell = core::min(static_cast<uint32_t>(scaled),texelCount-1u);
+			const uint32_t entry = m_entries[cell];
+			const double thresholdMax = double(1ull<<m_thresholdBits);
+			const double u = (scaled-double(cell))*thresholdMax;
+			const double threshold = double(entry>>m_indexBits);
+
+			SSample retval;
+			const uint32_t aliasTexel = entry&getIndexMask();
+			double remappedU;
+			if (aliasTexel==cell)
+			{
+				retval.texel = cell;
+				remappedU = u/thresholdMax;
+			}
+			else if (u<threshold)
+			{
+				retval.texel = cell;
+				remappedU = u/threshold;
+			}
+			else
+			{
+				retval.texel = aliasTexel;
+				remappedU = (u-threshold)/(thresholdMax-threshold);
+			}
+			const uint32_t x = retval.texel%m_width;
+			const uint32_t y = retval.texel/m_width;
+			retval.uv[0] = (double(x)+core::min(remappedU,1.0-DBL_EPSILON))/double(m_width);
+			retval.uv[1] = (double(y)+xi[1])/double(m_height);
+			retval.pdf = pdf(retval.texel,retval.uv[1]);
+			return retval;
+		}
+
+		//! solid angle PDF of a direction given by its equirectangular coordinates
+		inline double pdf(const double uv[2]) const
+		{
+			const uint32_t x = core::min(static_cast<uint32_t>(uv[0]*double(m_width)),m_width-1u);
+			const uint32_t y = core::min(static_cast<uint32_t>(uv[1]*double(m_height)),m_height-1u);
+			return pdf(y*m_width+x,uv[1]);
+		}
+
+	private:
+		static inline constexpr uint32_t MinBlockSize = 0x1u<<14u;
+
+		inline uint32_t getIndexMask() const { return (0x1u<<m_indexBits)-1u; }
+		inline uint32_t getThresholdMask() const { return (0x1u<<m_thresholdBits)-1u; }
+
+		inline double pdf(const uint32_t texel, const double v) const
+		{
+			const double sinTheta = core::sin(v*core::PI<double>());
+			if (sinTheta<=0.0)
+				return 0.0;
+			// texel probability times texel count is the density over [0,1)^2, the jacobian of the equirect mapping is 2 PI^2 sin(theta)
+			const double uvDensity = double(m_probability[texel])*double(m_entries.size());
+			return uvDensity/(2.0*core::PI<double>()*core::PI<double>()*sinTheta);
+		}
+
+		static inline void pairUp(double* threshold, uint32_t* alias, core::vector<uint32_t>& small, core::vector<uint32_t>& large)
+		{
+			while (!small.empty() && !large.empty())
+			{
+				const uint32_t s = small.back();
+				small.pop_back();
+				const uint32_t l = large.back();
+				alias[s] = l;
+				threshold[l] -= 1.0-threshold[s];
+				if (threshold[l]<1.0)
+				{
+					large.pop_back();
+					small.push_back(l);
+				}
+			}
+		}
+
+		inline void computeProbabilities()
+		{
+			const uint32_t texelCount = m_entries.size();
+			const double thresholdMax = double(1ull<<m_thresholdBits);
+			core::vector<double> mass(texelCount,0.0);
+			for (uint32_t i=0u; i<texelCount; i++)
+			{
+				const uint32_t aliasTexel = m_entries[i]&getIndexMask();
+				if (aliasTexel==i)
+				{
+					mass[i] += 1.0;
+					continue;
+				}
+				const double accept = double(m_entries[i]>>m_indexBits)/thresholdMax;
+				mass[i] += accept;
+				mass[aliasTexel] += 1.0-accept;
+			}
+			m_probability.resize(texelCount);
+			const double rcpTexelCount = 1.0/double(texelCount);
+			std::transform(core::execution::par_unseq,mass.begin(),mass.end(),m_probability.begin(),[rcpTexelCount](const double m){return float(m*rcpTexelCount);});
+		}
+
+		core::vector<uint32_t> m_entries;
+		core::vector<float> m_probability;
+		uint32_t m_width = 0u;
+		uint32_t m_height = 0u;
+		uint32_t m_indexBits = 0u;
+		uint32_t m_thresholdBits = 0u;
+};
+
+#endif
@@ -0,0 +1,211 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _ENVMAP_MIP_WARP_H_INCLUDED_
+#define _ENVMAP_MIP_WARP_H_INCLUDED_
+
+#include <nabla.h>
+
+#include <cfloat>
+#include <numeric>
+
+#include "EnvmapAliasTable.h"
+
+
+//! Hierarchical sample warping over a luminance mip pyramid, every level of the descent consumes and rescales the same 2D uniform sample
+//! so neighbouring points of a stratified sequence stay neighbours after the warp, which two CDF inversions or an alias table can't guarantee.
+//! The pyramid is built on the next power of two extent (padding has zero weight), the coarsest level is `aspect`x1 or 1x`aspect` texels.
+//! Changing a region of the envmap only needs its footprint in every level recomputed, see `update`.
+class EnvmapMipWarp
+{
+	public:
+		using SSample = EnvmapAliasTable::SSample;
+
+		EnvmapMipWarp() = default;
+
+		//! `weights` is the unnormalized, sin(theta) weighted luminance of every texel as produced by `computeLuminancePdf`
+		inline bool build(const double* weights, const uint32_t width, const uint32_t height)
+		{
+			if (width==0u || height==0u)
+				return false;
+			m_width = width;
+			m_height = height;
+
+			const uint32_t levelCountX = core::findMSB(core::roundUpToPoT(width))+1u;
+			const uint32_t levelCountY = core::findMSB(core::roundUpToPoT(height))+1u;
+			const uint32_t levelCount = core::min(levelCountX,levelCountY);
+			m_levels.resize(levelCount);
+			for (uint32_t i=0u; i<levelCount; i++)
+			{
+				auto& level = m_levels[i];
+				level.width = core::roundUpToPoT(width)>>i;
+				level.height = core::roundUpToPoT(height)>>i;
+				level.sums.resize(level.width*level.height,0.0);
+			}
+
+			auto& base = m_levels.front();
+			core::vector<uint32_t> rows(height);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				std::copy_n(weights+y*width,width,base.sums.data()+y*base.width);
+			});
+			if (!(std::reduce(core::execution::par_unseq,weights,weights+width*height,0.0)>0.0))
+				return false;
+
+			for (uint32_t i=1u; i<levelCount; i++)
+				downsample(i,0u,0u,m_levels[i].width,m_levels[i].height);
+			updateTotal();
+			return true;
+		}
+
+		//! replaces the weights of the texel rectangle [`offsetX`,`offsetX+extentX`)x[`offsetY`,`offsetY+extentY`), `weights` is tightly packed
+		inline void update(const double* weights, const uint32_t offsetX, const uint32_t offsetY, const uint32_t extentX, const uint32_t extentY)
+		{
+			auto& base = m_levels.front();
+			for (uint32_t y=0u; y<extentY; y++)
+				std::copy_n(weights+y*extentX,extentX,base.sums.data()+(offsetY+y)*base.width+offsetX);
+
+			uint32_t minX = offsetX, minY = offsetY;
+			uint32_t maxX = offsetX+extentX, maxY = offsetY+extentY;
+			for (uint32_t i=1u; i<m_levels.size(); i++)
+			{
+				minX >>= 1u;
+				minY >>= 1u;
+				maxX = (maxX+1u)>>1u;
+				maxY = (maxY+1u)>>1u;
+				downsample(i,minX,minY,maxX,maxY);
+			}
+			updateTotal();
+		}
+
+		inline uint32_t getWidth() const { return m_width; }
+		inline uint32_t getHeight() const { return m_height; }
+		inline uint32_t getLevelCount() const { return m_levels.size(); }
+
+		//! `xi` in [0,1)^2, the remainder of the sample after the last level places the point within the texel
+		inline SSample sample(const double xi[2]) const
+		{
+			double u = xi[0];
+			double v = xi[1];
+
+			// the coarsest level is a strip, pick the texel along it by inverting its tiny CDF
+			const auto& top = m_levels.back();
+			uint32_t x = 0u, y = 0u;
+			if (top.width>1u)
+				x = pickInStrip(top.sums.data(),top.width,1u,m_total,u);
+			else if (top.height>1u)
+				y = pickInStrip(top.sums.data(),top.height,top.width,m_total,v);
+
+			for (auto level=m_levels.rbegin()+1; level!=m_levels.rend(); level++)
+			{
+				x <<= 1u;
+				y <<= 1u;
+				const double* row0 = level->sums.data()+y*level->width+x;
+				const double* row1 = row0+level->width;
+				// choose the row first, then the column within it
+				if (warp(v,row0[0]+row0[1],row1[0]+row1[1]))
+				{
+					y++;
+					row0 = row1;
+				}
+				if (warp(u,row0[0],row0[1]))
+					x++;
+			}
+
+			SSample retval;
+			retval.texel = y*m_width+x;
+			retval.uv[0] = (double(x)+core::min(u,1.0-DBL_EPSILON))/double(m_width);
+			retval.uv[1] = (double(y)+core::min(v,1.0-DBL_EPSILON))/double(m_height);
+			retval.pdf = pdf(x,y,retval.uv[1]);
+			return retval;
+		}
+
+		//! solid angle PDF of a direction given by its equirectangular coordinates
+		inline double pdf(const double uv[2]) const
+		{
+			const uint32_t x = core::min(static_cast<uint32_t>(uv[0]*double(m_width)),m_width-1u);
+			const uint32_t y = core::min(static_cast<uint32_t>(uv[1]*double(m_height)),m_height-1u);
+			return pdf(x,y,uv[1]);
+		}
+
+	private:
+		struct SLevel
+		{
+			uint32_t width;
+			uint32_t height;
+			core::vector<double> sums;
+		};
+
+		inline void downsample(const uint32_t levelIx, const uint32_t minX, const uint32_t minY, const uint32_t maxX, const uint32_t maxY)
+		{
+			const auto& src = m_levels[levelIx-1u];
+			auto& dst = m_levels[levelIx];
+			core::vector<uint32_t> rows(maxY-minY);
+			std::iota(rows.begin(),rows.end(),minY);
+			std::for_each(core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				const double* row0 = src.sums.data()+(y<<1u)*src.width;
+				const double* row1 = row0+src.width;
+				for (uint32_t x=minX; x<maxX; x++)
+					dst.sums[y*dst.width+x] = row0[x<<1u]+row0[(x<<1u)+1u]+row1[x<<1u]+row1[(x<<1u)+1u];
+			});
+		}
+
+		//! returns true when the second option got picked, and remaps `xi` to [0,1) within the picked option
+		static inline bool warp(double& xi, const double first, const double second)
+		{
+			const double sum = first+second;
+			const double split = sum>0.0 ? first/sum:0.5;
+			if (xi<split)
+			{
+				xi = core::min(xi/split,1.0-DBL_EPSILON);
+				return false;
+			}
+			xi = core::min((xi-split)/(1.0-split),1.0-DBL_EPSILON);
+			return true;
+		}
+
+		static inline uint32_t pickInStrip(const double* sums, const uint32_t count, const uint32_t stride, const double total, double& xi)
+		{
+			double target = xi*total;
+			for (uint32_t i=0u; i<count-1u; i++)
+			{
+				const double w = sums[i*stride];
+				if (target<w)
+				{
+					xi = target/w;
+					return i;
+				}
+				target -= w;
+			}
+			const double w = sums[(count-1u)*stride];
+			xi = w>0.0 ? core::min(target/w,1.0-DBL_EPSILON):0.0;
+			return count-1u;
+		}
+
+		//! the sum of every weight, only changes with `build` and `update` so the PDF doesn't have to reduce the coarsest level for every sample
+		inline void updateTotal()
+		{
+			const auto& top = m_levels.back();
+			m_total = std::accumulate(top.sums.begin(),top.sums.end(),0.0);
+		}
+
+		inline double pdf(const uint32_t x, const uint32_t y, const double v) const
+		{
+			const double sinTheta = core::sin(v*core::PI<double>());
+			if (sinTheta<=0.0 || m_total<=0.0)
+				return 0.0;
+			const auto& base = m_levels.front();
+			const double uvDensity = base.sums[y*base.width+x]/m_total*double(m_width)*double(m_height);
+			return uvDensity/(2.0*core::PI<double>()*core::PI<double>()*sinTheta);
+		}
+
+		core::vector<SLevel> m_levels;
+		uint32_t m_width = 0u;
+		uint32_t m_height = 0u;
+		double m_total = 0.0;
+};
+
+#endif
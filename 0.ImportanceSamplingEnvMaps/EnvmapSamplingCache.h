@@ -0,0 +1,150 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _ENVMAP_SAMPLING_CACHE_H_INCLUDED_
+#define _ENVMAP_SAMPLING_CACHE_H_INCLUDED_
+
+#include <nabla.h>
+
+#include "../common/CacheFile.hpp"
+
+
+//! On-disk cache of the sampling tables built from an envmap, keyed on a hash of the texel data and of everything the build depends on.
+//! The file is a fixed header followed by 64 byte aligned sections, so once the header and checksum are verified
+//! the sections get used straight out of the mapping, without any parsing or copying.
+class EnvmapSamplingCache
+{
+	public:
+		//! bump whenever the format or anything in the way the tables get built changes
+		static inline constexpr uint32_t Version = 1u;
+		static inline constexpr uint32_t Magic = 0x53454e42u; // "BNES"
+		static inline constexpr uint64_t SectionAlignment = 64ull;
+
+		enum E_SECTION : uint32_t
+		{
+			ES_PHI_PDF_LUT,
+			ES_THETA_LUT,
+			ES_COUNT
+		};
+
+		struct SHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+			uint64_t payloadChecksum;
+			uint64_t payloadSize;
+			uint32_t width;
+			uint32_t height;
+			float normalizationFactor;
+			uint32_t padding;
+			//! how long building took when the cache got written, so a warm start can report what it saved
+			uint64_t buildTimeMicroseconds;
+			struct SSection
+			{
+				uint64_t offset;
+				uint64_t size;
+			} sections[ES_COUNT];
+		};
+		//! payload starts aligned too, mappings are page aligned so this carries over to memory
+		static inline constexpr uint64_t PayloadOffset = (sizeof(SHeader)+SectionAlignment-1ull)/SectionAlignment*SectionAlignment;
+
+		//! content hash of the envmap texels, salted with the format, extent and `Version`
+		static inline uint64_t computeKey(const asset::ICPUImage* envmap)
+		{
+			const auto& params = envmap->getCreationParameters();
+			const uint32_t salt[5] = { Version,static_cast<uint32_t>(params.format),params.extent.width,params.extent.height,params.extent.depth };
+			const auto* buffer = envmap->getBuffer();
+			return cache_file::hash(buffer->getPointer(),buffer->getSize(),cache_file::hash(salt,sizeof(salt)));
+		}
+
+		//! maps the cache and checks it can be used as is, on any failure (missing, stale, truncated, corrupted) nothing stays mapped
+		inline bool load(const std::string& path, const uint64_t key, const uint32_t width, const uint32_t height)
+		{
+			if (!m_file.open(path))
+				return false;
+
+			const char* rejection = nullptr;
+			const auto* header = getHeader();
+			if (m_file.size()<PayloadOffset)
+				rejection = "truncated header";
+			else if (header->magic!=Magic || header->version!=Version)
+				rejection = "different version";
+			else if (header->key!=key || header->width!=width || header->height!=height)
+				rejection = "stale, envmap changed";
+			else if (m_file.size()<PayloadOffset+header->payloadSize)
+				rejection = "truncated payload";
+			else if (cache_file::hash(m_file.data()+PayloadOffset,header->payloadSize)!=header->payloadChecksum)
+				rejection = "checksum mismatch";
+			else
+			{
+				const size_t expectedSizes[ES_COUNT] = { getPhiPdfLUTSize(width,height),getThetaLUTSize(height) };
+				for (auto i=0u; i<ES_COUNT; i++)
+				{
+					const auto& section = header->sections[i];
+					if (section.size!=expectedSizes[i] || section.offset%SectionAlignment || section.offset+section.size>header->payloadSize)
+						rejection = "malformed section table";
+				}
+			}
+
+			if (rejection)
+			{
+				printf("[INFO] Envmap sampling cache %s rejected: %s, rebuilding\n",path.c_str(),rejection);
+				m_file.close();
+				return false;
+			}
+			return true;
+		}
+
+		inline const SHeader* getHeader() const { return reinterpret_cast<const SHeader*>(m_file.data()); }
+		inline const void* getSection(const E_SECTION section) const
+		{
+			return m_file.data()+PayloadOffset+getHeader()->sections[section].offset;
+		}
+		inline size_t getSectionSize(const E_SECTION section) const
+		{
+			return getHeader()->sections[section].size;
+		}
+
+		static inline size_t getPhiPdfLUTSize(const uint32_t width, const uint32_t height) { return size_t(width)*height*2ull*sizeof(float); }
+		static inline size_t getThetaLUTSize(const uint32_t height) { return size_t(height)*sizeof(float); }
+
+		//! `sections` must be laid out in `E_SECTION` order and have the sizes `load` expects
+		static inline bool save(const std::string& path, const uint64_t key, const uint32_t width, const uint32_t height, const float normalizationFactor, const uint64_t buildTimeMicroseconds, const asset::ICPUBuffer* const sections[ES_COUNT])
+		{
+			SHeader header = {};
+			header.magic = Magic;
+			header.version = Version;
+			header.key = key;
+			header.width = width;
+			header.height = height;
+			header.normalizationFactor = normalizationFactor;
+			header.buildTimeMicroseconds = buildTimeMicroseconds;
+
+			core::vector<uint8_t> payload;
+			for (auto i=0u; i<ES_COUNT; i++)
+			{
+				header.sections[i].offset = core::roundUp(uint64_t(payload.size()),SectionAlignment);
+				header.sections[i].size = sections[i]->getSize();
+				payload.resize(header.sections[i].offset+header.sections[i].size,0u);
+				memcpy(payload.data()+header.sections[i].offset,sections[i]->getPointer(),header.sections[i].size);
+			}
+			header.payloadSize = payload.size();
+			header.payloadChecksum = cache_file::hash(payload.data(),payload.size());
+
+			return cache_file::writeAtomically(path,[&](std::ofstream& file) -> bool
+			{
+				const uint8_t zeroes[PayloadOffset-sizeof(SHeader)] = {};
+				file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+				file.write(reinterpret_cast<const char*>(zeroes),sizeof(zeroes));
+				file.write(reinterpret_cast<const char*>(payload.data()),payload.size());
+				return bool(file);
+			});
+		}
+
+	private:
+		cache_file::MappedFile m_file;
+};
+
+#endif
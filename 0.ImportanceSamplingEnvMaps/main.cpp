@@ -9,6 +9,10 @@
 #include "../common/Camera.hpp"
 #include "../common/CommonAPI.h"
 
+#include "EnvmapAliasTable.h"
+#include "EnvmapMipWarp.h"
+#include "EnvmapSamplingCache.h"
+
 using namespace nbl;
 using namespace asset;
 using namespace core;
@@ -74,6 +78,148 @@ static int32_t bisectionSearch(const double* arr, const uint32_t arrCount, const
 	return offset;
 }
 
+// Upper tail probability of the chi-square distribution, Wilson-Hilferty approximation is plenty for thousands of degrees of freedom
+static double chiSquarePValue(const double chiSquare, const uint32_t degreesOfFreedom)
+{
+	const double k = degreesOfFreedom;
+	const double z = (std::cbrt(chiSquare/k)-(1.0-2.0/(9.0*k)))/std::sqrt(2.0/(9.0*k));
+	return 0.5*std::erfc(z/std::sqrt(2.0));
+}
+
+// CPU reference of the two CDF inversion the phi/pdf and theta LUTs get baked from
+struct CDFSampler
+{
+	const double* marginalCdf;
+	const double* conditionalCdf;
+	const double* luminance;
+	double luminanceSum;
+	core::vector2d<uint32_t> extent;
+
+	EnvmapAliasTable::SSample sample(const double xi[2]) const
+	{
+		EnvmapAliasTable::SSample retval;
+		const uint32_t row = core::min<uint32_t>(bisectionSearch(marginalCdf,extent.Y,xi[1],retval.uv+1)+1,extent.Y-1u);
+		const uint32_t col = core::min<uint32_t>(bisectionSearch(conditionalCdf+row*extent.X,extent.X,xi[0],retval.uv)+1,extent.X-1u);
+		retval.texel = row*extent.X+col;
+		const double sinTheta = core::sin(retval.uv[1]*core::PI<double>());
+		retval.pdf = sinTheta>0.0 ? luminance[retval.texel]/luminanceSum*double(extent.X*extent.Y)/(2.0*core::PI<double>()*core::PI<double>()*sinTheta):0.0;
+		return retval;
+	}
+};
+
+// Compares a sampler against the two CDF inversion, both on distribution (two-sample chi-square on a coarse grid) and on throughput
+template<class Sampler>
+static bool validateAgainstCDF(const char* name, const Sampler& sampler, const CDFSampler& cdf)
+{
+	using sample_t = EnvmapAliasTable::SSample;
+	constexpr uint32_t SampleCount = 1u<<22u;
+
+	// pregenerated so the benchmark only measures the warp, the two samplers need independent streams or the chi-square test loses power
+	auto generateUniforms = [](const uint32_t seed)
+	{
+		core::vector<double> xis(SampleCount*2u);
+		core::RandomSampler rng(seed);
+		for (auto& xi : xis)
+			xi = double(rng.nextSample())/4294967296.0;
+		return xis;
+	};
+	const auto cdfXis = generateUniforms(0xbadc0ffeu);
+	const auto xis = generateUniforms(0xdeadbeefu);
+
+	const uint32_t binsX = core::min(64u,cdf.extent.X);
+	const uint32_t binsY = core::min(32u,cdf.extent.Y);
+	// the pdfs get summed and printed so their evaluation can't be optimized out of the timed loop, both samplers should agree on the mean
+	auto histogram = [&](const auto& _sampler, const core::vector<double>& uniforms, double& samplesPerSecond, double& meanPdf) -> core::vector<uint32_t>
+	{
+		core::vector<uint32_t> bins(binsX*binsY,0u);
+		double pdfChecksum = 0.0;
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i=0u; i<SampleCount; i++)
+		{
+			const sample_t s = _sampler.sample(uniforms.data()+i*2u);
+			pdfChecksum += s.pdf;
+			const uint32_t x = core::min<uint32_t>(s.uv[0]*binsX,binsX-1u);
+			const uint32_t y = core::min<uint32_t>(s.uv[1]*binsY,binsY-1u);
+			bins[y*binsX+x]++;
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now()-start;
+		samplesPerSecond = double(SampleCount)/elapsed.count();
+		meanPdf = pdfChecksum/double(SampleCount);
+		return bins;
+	};
+
+	double cdfSamplesPerSecond,samplesPerSecond,cdfMeanPdf,meanPdf;
+	const auto cdfBins = histogram(cdf,cdfXis,cdfSamplesPerSecond,cdfMeanPdf);
+	const auto bins = histogram(sampler,xis,samplesPerSecond,meanPdf);
+
+	double chiSquare = 0.0;
+	uint32_t degreesOfFreedom = 0u;
+	for (uint32_t i=0u; i<binsX*binsY; i++)
+	{
+		const double sum = double(cdfBins[i])+double(bins[i]);
+		if (sum==0.0)
+			continue;
+		const double diff = double(cdfBins[i])-double(bins[i]);
+		chiSquare += diff*diff/sum;
+		degreesOfFreedom++;
+	}
+	degreesOfFreedom = core::max(degreesOfFreedom,2u)-1u;
+	const double pValue = chiSquarePValue(chiSquare,degreesOfFreedom);
+
+	printf("[INFO] %s vs CDF sampler: chi-square = %f, dof = %d, p-value = %f\n",name,chiSquare,degreesOfFreedom,pValue);
+	printf("[INFO] CDF bisection sampling: %f MSamples/s, mean pdf = %f\n",cdfSamplesPerSecond*1e-6,cdfMeanPdf);
+	printf("[INFO] %s sampling: %f MSamples/s (x%f), mean pdf = %f\n",name,samplesPerSecond*1e-6,samplesPerSecond/cdfSamplesPerSecond,meanPdf);
+
+	constexpr double Significance = 0.001;
+	if (pValue<Significance)
+	{
+		std::cout << "[ERROR] " << name << " distribution differs from the CDF sampler!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Variance of the irradiance estimate for the 6 axis aligned normals, every trial is an independently Owen scrambled (0,2) sequence
+// so strategies which preserve stratification through the warp get rewarded.
+template<class Sampler>
+static double irradianceEstimatorVariance(const Sampler& sampler, const double* luminance, const core::vector2d<uint32_t>& extent)
+{
+	constexpr uint32_t TrialCount = 256u;
+	constexpr uint32_t SamplesPerTrial = 256u;
+	constexpr double Normals[6][3] = { {1.0,0.0,0.0},{-1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,-1.0,0.0},{0.0,0.0,1.0},{0.0,0.0,-1.0} };
+
+	double variance = 0.0;
+	for (const auto& normal : Normals)
+	{
+		double sum = 0.0, sumOfSquares = 0.0;
+		for (uint32_t trial=0u; trial<TrialCount; trial++)
+		{
+			core::OwenSampler sequence(2u,0xdeadbeefu+trial);
+			double estimate = 0.0;
+			for (uint32_t i=0u; i<SamplesPerTrial; i++)
+			{
+				const double xi[2] = { double(sequence.sample(0u,i))/4294967296.0,double(sequence.sample(1u,i))/4294967296.0 };
+				const auto s = sampler.sample(xi);
+				if (s.pdf<=0.0)
+					continue;
+				const double phi = s.uv[0]*2.0*core::PI<double>();
+				const double theta = s.uv[1]*core::PI<double>();
+				const double sinTheta = core::sin(theta);
+				const double cosine = normal[0]*sinTheta*core::cos(phi)+normal[1]*core::cos(theta)+normal[2]*sinTheta*core::sin(phi);
+				// `luminance` is premultiplied by sin(theta) of the texel center
+				const double texelSinTheta = core::sin(core::PI<double>()*((s.texel/extent.X)+0.5)/double(extent.Y));
+				estimate += luminance[s.texel]/texelSinTheta*core::max(cosine,0.0)/s.pdf;
+			}
+			estimate /= double(SamplesPerTrial);
+			sum += estimate;
+			sumOfSquares += estimate*estimate;
+		}
+		const double mean = sum/double(TrialCount);
+		variance += (sumOfSquares/double(TrialCount)-mean*mean)*double(TrialCount)/double(TrialCount-1u);
+	}
+	return variance/6.0;
+}
+
 class ImportanceSamplingEnvMaps : public ApplicationBase
 {
 	static constexpr uint32_t WIN_W = 2048;
@@ -219,6 +365,33 @@ public:
 		return logicalDevice->createImageView(std::move(viewParams));
 	}
 
+	static constexpr const char* SamplingCachePath = "EnvmapSamplingCache.bin";
+
+	//! uploads the LUTs an earlier run built for the envmap with `key` straight from the mapped cache file, false when there's no usable cache
+	bool loadCachedSamplingTables(const uint64_t key, const core::vector2d<uint32_t>& pdfDomainExtent, core::smart_refctd_ptr<IGPUImageView>& phiPdfLUTImageView, core::smart_refctd_ptr<IGPUImageView>& thetaLUTImageView)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		EnvmapSamplingCache samplingCache;
+		if (!samplingCache.load(SamplingCachePath, key, pdfDomainExtent.X, pdfDomainExtent.Y))
+			return false;
+		envmapNormalizationFactor = samplingCache.getHeader()->normalizationFactor;
+		// alias the read-only mapping, it outlives the upload below
+		auto aliasSection = [&](const EnvmapSamplingCache::E_SECTION section) -> core::smart_refctd_ptr<ICPUBuffer>
+		{
+			return core::make_smart_refctd_ptr<CCustomAllocatorCPUBuffer<core::null_allocator<uint8_t>>>(samplingCache.getSectionSize(section), const_cast<void*>(samplingCache.getSection(section)), core::adopt_memory);
+		};
+		auto phiPdfLUTBuffer = aliasSection(EnvmapSamplingCache::ES_PHI_PDF_LUT);
+		auto thetaLUTBuffer = aliasSection(EnvmapSamplingCache::ES_THETA_LUT);
+
+		const std::chrono::duration<double,std::milli> elapsed = std::chrono::high_resolution_clock::now()-start;
+		const double coldMilliseconds = double(samplingCache.getHeader()->buildTimeMicroseconds)*1e-3;
+		printf("[INFO] Warm start: envmap sampling tables mapped from %s in %f ms, the cold build took %f ms (x%f)\n", SamplingCachePath, elapsed.count(), coldMilliseconds, coldMilliseconds/elapsed.count());
+
+		phiPdfLUTImageView = getLUTGPUImageViewFromBuffer(phiPdfLUTBuffer, IGPUImage::ET_2D, asset::EF_R32G32_SFLOAT, { pdfDomainExtent.X, pdfDomainExtent.Y, 1 }, IGPUImageView::ET_2D);
+		thetaLUTImageView = getLUTGPUImageViewFromBuffer(thetaLUTBuffer, IGPUImage::ET_1D, asset::EF_R32_SFLOAT, { pdfDomainExtent.Y, 1, 1 }, IGPUImageView::ET_1D);
+		return true;
+	}
+
 	void setWindow(core::smart_refctd_ptr<nbl::ui::IWindow>&& wnd) override
 	{
 		window = std::move(wnd);
@@ -317,14 +490,14 @@ public:
 		core::smart_refctd_ptr<IGPUImageView> phiPdfLUTImageView = nullptr;
 		core::smart_refctd_ptr<IGPUImageView> thetaLUTImageView = nullptr;
 
+		// returns early when an earlier run cached the sampling tables of the same envmap, then only the upload is left
+		[&]() -> void
 		{
 			IAssetLoader::SAssetLoadParams lp(0ull, nullptr, IAssetLoader::ECF_DONT_CACHE_REFERENCES);
 			auto envmapImageBundle = assetManager->getAsset(envmapPath, lp);
 			auto envmapImage = core::smart_refctd_ptr_static_cast<asset::ICPUImage>(*envmapImageBundle.getContents().begin());
 			const uint32_t channelCount = getFormatChannelCount(envmapImage->getCreationParameters().format);
 
-			auto luminancePdfBuffer = computeLuminancePdf(envmapImage, &envmapNormalizationFactor);
-
 			ICPUImageView::SCreationParams viewParams;
 			viewParams.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
 			viewParams.image = envmapImage;
@@ -342,6 +515,14 @@ public:
 
 			const core::vector2d<uint32_t> pdfDomainExtent = { envmapImage->getCreationParameters().extent.width, envmapImage->getCreationParameters().extent.height };
 
+			// the tables only depend on the envmap texels, so reuse whatever an earlier run built for the same envmap
+			const uint64_t samplingCacheKey = EnvmapSamplingCache::computeKey(envmapImage.get());
+			if (loadCachedSamplingTables(samplingCacheKey, pdfDomainExtent, phiPdfLUTImageView, thetaLUTImageView))
+				return;
+
+			const auto samplingTablesStart = std::chrono::high_resolution_clock::now();
+			auto luminancePdfBuffer = computeLuminancePdf(envmapImage, &envmapNormalizationFactor);
+
 			core::smart_refctd_ptr<ICPUImage> conditionalCdfImage = nullptr;
 			core::smart_refctd_ptr<ICPUBuffer> conditionalIntegrals = nullptr;
 			{
@@ -544,9 +725,62 @@ public:
 				}
 			}
 
+			{
+				const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now()-samplingTablesStart);
+				printf("[INFO] Cold start: envmap sampling tables built in %f ms\n", double(elapsed.count())*1e-3);
+				const ICPUBuffer* sections[EnvmapSamplingCache::ES_COUNT] = { phiPdfLUTBuffer.get(), thetaLUTBuffer.get() };
+				if (!EnvmapSamplingCache::save(SamplingCachePath, samplingCacheKey, pdfDomainExtent.X, pdfDomainExtent.Y, envmapNormalizationFactor, elapsed.count(), sections))
+					std::cout << "[WARNING] Could not write the envmap sampling cache to " << SamplingCachePath << std::endl;
+			}
+
+			// CPU references of the alternative strategies, validated against the CDF inversion above whenever the tables get rebuilt
+			{
+				const double* luminance = (double*)luminancePdfBuffer->getPointer();
+				CDFSampler cdfSampler = { (double*)marginalCdfImage->getBuffer()->getPointer(), (double*)conditionalCdfImage->getBuffer()->getPointer(), luminance, marginalIntegral, pdfDomainExtent };
+
+				// O(1) alternative to the two bisections
+				EnvmapAliasTable aliasTable;
+				auto start = std::chrono::high_resolution_clock::now();
+				const bool aliasTableBuilt = aliasTable.build(luminance, pdfDomainExtent.X, pdfDomainExtent.Y);
+				if (aliasTableBuilt)
+				{
+					const std::chrono::duration<double,std::milli> elapsed = std::chrono::high_resolution_clock::now()-start;
+					printf("[INFO] Alias table with %d threshold bits built in %f ms\n", aliasTable.getThresholdBits(), elapsed.count());
+					validateAgainstCDF("Alias table", aliasTable, cdfSampler);
+				}
+				else
+					std::cout << "[ERROR] Envmap too large or black, could not build the alias table!" << std::endl;
+
+				// stratification preserving hierarchical warp
+				EnvmapMipWarp mipWarp;
+				start = std::chrono::high_resolution_clock::now();
+				const bool mipWarpBuilt = mipWarp.build(luminance, pdfDomainExtent.X, pdfDomainExtent.Y);
+				if (mipWarpBuilt)
+				{
+					const std::chrono::duration<double,std::milli> elapsed = std::chrono::high_resolution_clock::now()-start;
+					printf("[INFO] Mip warp pyramid with %d levels built in %f ms\n", mipWarp.getLevelCount(), elapsed.count());
+					validateAgainstCDF("Mip warp", mipWarp, cdfSampler);
+				}
+				else
+					std::cout << "[ERROR] Envmap is black, could not build the mip warp pyramid!" << std::endl;
+
+				const double cdfVariance = irradianceEstimatorVariance(cdfSampler, luminance, pdfDomainExtent);
+				printf("[INFO] CDF inversion irradiance estimator variance on %s: %e\n", envmapPath, cdfVariance);
+				if (aliasTableBuilt)
+				{
+					const double variance = irradianceEstimatorVariance(aliasTable, luminance, pdfDomainExtent);
+					printf("[INFO] Alias table irradiance estimator variance: %e (x%f of CDF)\n", variance, variance/cdfVariance);
+				}
+				if (mipWarpBuilt)
+				{
+					const double variance = irradianceEstimatorVariance(mipWarp, luminance, pdfDomainExtent);
+					printf("[INFO] Mip warp irradiance estimator variance: %e (x%f of CDF)\n", variance, variance/cdfVariance);
+				}
+			}
+
 			phiPdfLUTImageView = getLUTGPUImageViewFromBuffer(phiPdfLUTBuffer, IGPUImage::ET_2D, asset::EF_R32G32_SFLOAT, { pdfDomainExtent.X, pdfDomainExtent.Y, 1 }, IGPUImageView::ET_2D);
 			thetaLUTImageView = getLUTGPUImageViewFromBuffer(thetaLUTBuffer, IGPUImage::ET_1D, asset::EF_R32_SFLOAT, { pdfDomainExtent.Y, 1, 1 }, IGPUImageView::ET_1D);
-		}
+		}();
 
 		smart_refctd_ptr<IGPUBufferView> gpuSequenceBufferView;
 		{
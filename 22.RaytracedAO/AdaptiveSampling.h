@@ -0,0 +1,394 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _ADAPTIVE_SAMPLING_H_INCLUDED_
+#define _ADAPTIVE_SAMPLING_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <cfloat>
+#include <chrono>
+#include <numeric>
+
+
+//! Tile based adaptive sampling, the CPU side of it: error estimation and deciding which tiles get the next frame.
+//! A tile gets frames until the estimated relative error of its mean drops under the threshold and then stops for good,
+//! so every tile still being sampled has had all the frames dispatched so far and the GPU only needs to know the last frame of each tile.
+//! The estimate splits the samples of a tile at the previous evaluation, compares the mean of the earlier part (kept as a snapshot)
+//! to the mean of the later part (recovered from the current mean) and scales that to the error of the current mean,
+//! this way only the resolved image is needed and not a second moment of every sample.
+class AdaptiveSampling
+{
+	public:
+		//! multiple of the raygen workgroup size, so stopped tiles skip whole workgroups
+		static inline constexpr uint32_t TileDim = 32u;
+		//! last frame of a tile which is still being sampled
+		static inline constexpr uint32_t NoLastFrame = 0xffffffffu;
+		//! the error is relative to the tile mean plus this fraction of the image mean, so black tiles don't need infinite samples
+		static inline constexpr float MinLuminanceFraction = 0.1f;
+		//! how many times the budget a single tile can get, the renderer makes the sample sequence this much longer than the sensors ask for
+		static inline constexpr uint32_t BudgetHeadroom = 8u;
+
+		struct SParams
+		{
+			//! relative RMS error of a tile's pixel means under which it stops being sampled, 0 disables adaptive sampling
+			float threshold = 0.f;
+			//! no tile stops before this many frames, the estimate is too noisy before that
+			uint32_t minFrames = 16u;
+			//! frames worth of samples for every pixel, whatever the converged tiles don't use goes to the others
+			uint32_t budgetFrames = 0u;
+			//! no tile gets more frames than this, the sample sequence would repeat after
+			uint32_t maxFrames = NoLastFrame;
+		};
+
+		inline void init(const uint32_t width, const uint32_t height, const SParams& params)
+		{
+			m_width = width;
+			m_height = height;
+			m_tilesX = (width+TileDim-1u)/TileDim;
+			m_params = params;
+			m_params.minFrames = nbl::core::max(m_params.minFrames,2u);
+			m_lastFrames.resize(size_t(m_tilesX)*((height+TileDim-1u)/TileDim));
+			m_errors.resize(m_lastFrames.size());
+			m_snapshot.resize(size_t(width)*height);
+			reset();
+		}
+		//! starts over, for when the accumulation got restarted
+		inline void reset()
+		{
+			std::fill(m_lastFrames.begin(),m_lastFrames.end(),NoLastFrame);
+			std::fill(m_errors.begin(),m_errors.end(),FLT_MAX);
+			m_snapshotFrame = 0u;
+			m_nextEvaluation = m_params.minFrames/2u;
+			m_budget = uint64_t(m_width)*m_height*m_params.budgetFrames;
+			m_spent = 0ull;
+			m_activeTiles = getTileCount();
+			m_convergedTiles = 0u;
+		}
+
+		inline bool isEnabled() const { return m_params.threshold>0.f; }
+		//! no tile gets any more frames
+		inline bool isDone() const { return m_activeTiles==0u; }
+
+		inline bool needsEvaluation(const uint32_t frame) const { return isEnabled() && frame>=m_nextEvaluation; }
+		//! `luminance` is row-major and has the mean over all `frame` frames so far of every pixel
+		inline void evaluate(const uint32_t frame, const float* luminance)
+		{
+			if (m_snapshotFrame && frame>m_snapshotFrame)
+			{
+				const double imageMean = std::reduce(nbl::core::execution::par_unseq,luminance,luminance+m_snapshot.size(),0.0)/double(m_snapshot.size());
+				// variance of the current mean per pixel, see the derivation on `estimateTileError`
+				const double varianceScale = double(m_snapshotFrame)/double(frame-m_snapshotFrame);
+				nbl::core::vector<uint32_t> tiles(getTileCount());
+				std::iota(tiles.begin(),tiles.end(),0u);
+				std::for_each(nbl::core::execution::par_unseq,tiles.begin(),tiles.end(),[&](const uint32_t tile)
+				{
+					if (m_lastFrames[tile]==NoLastFrame)
+						m_errors[tile] = estimateTileError(tile,luminance,varianceScale,imageMean);
+				});
+			}
+			std::copy(nbl::core::execution::par_unseq,luminance,luminance+m_snapshot.size(),m_snapshot.begin());
+			m_snapshotFrame = frame;
+			m_nextEvaluation = nbl::core::max(frame+nbl::core::max(frame/2u,1u),m_params.minFrames);
+		}
+
+		//! call after every frame (and after `evaluate` if it was needed), stops the tiles which converged
+		//! and the ones which would overrun the budget on the next frame, returns whether any stopped
+		inline bool schedule(const uint32_t frame)
+		{
+			if (!isEnabled() || isDone())
+				return false;
+
+			const uint32_t activeBefore = m_activeTiles;
+			nbl::core::vector<uint32_t> active;
+			active.reserve(m_activeTiles);
+			for (uint32_t tile=0u; tile<getTileCount(); tile++)
+			if (m_lastFrames[tile]==NoLastFrame)
+			{
+				m_spent += getTilePixelCount(tile);
+				if (frame>=m_params.minFrames && m_errors[tile]<=m_params.threshold)
+				{
+					stop(tile,frame);
+					m_convergedTiles++;
+				}
+				else if (frame>=m_params.maxFrames)
+					stop(tile,frame);
+				else
+					active.push_back(tile);
+			}
+
+			// the tiles closest to converging give up their next frame first
+			uint64_t nextFrameCost = 0ull;
+			for (const auto tile : active)
+				nextFrameCost += getTilePixelCount(tile);
+			if (m_spent+nextFrameCost>m_budget)
+			{
+				std::sort(active.begin(),active.end(),[&](const uint32_t lhs, const uint32_t rhs) -> bool {return m_errors[lhs]<m_errors[rhs];});
+				for (auto it=active.begin(); it!=active.end() && m_spent+nextFrameCost>m_budget; it++)
+				{
+					nextFrameCost -= getTilePixelCount(*it);
+					stop(*it,frame);
+				}
+			}
+			return m_activeTiles!=activeBefore;
+		}
+
+		inline uint32_t getTileCount() const { return m_lastFrames.size(); }
+		inline uint32_t getTilesX() const { return m_tilesX; }
+		//! what the raygen shader reads to skip stopped tiles, a tile gets sampled on frames up to and including its entry
+		inline const uint32_t* getTileLastFrames() const { return m_lastFrames.data(); }
+		inline float getTileError(const uint32_t tile) const { return m_errors[tile]; }
+		inline uint32_t getConvergedTileCount() const { return m_convergedTiles; }
+		inline double getBudgetUsed() const { return m_budget ? double(m_spent)/double(m_budget):0.0; }
+
+		//! runs the estimator and scheduler on synthetic images with known means, mostly mild noise and a few heavy tailed "caustic" tiles,
+		//! checks the error estimates against the real errors and that the adaptive result beats uniform sampling for the same budget
+		static inline bool benchmark();
+
+	private:
+		inline uint32_t getTilePixelCount(const uint32_t tile) const
+		{
+			const uint32_t x = (tile%m_tilesX)*TileDim;
+			const uint32_t y = (tile/m_tilesX)*TileDim;
+			return nbl::core::min(TileDim,m_width-x)*nbl::core::min(TileDim,m_height-y);
+		}
+
+		inline void stop(const uint32_t tile, const uint32_t frame)
+		{
+			m_lastFrames[tile] = frame;
+			m_activeTiles--;
+		}
+
+		//! With `a` the snapshot mean over the first `Fs` frames and `m` the current mean over `F`, the mean of the later frames is
+		//! `b = (F*m-Fs*a)/(F-Fs)` and `a-b` has a variance of `s^2*(1/Fs+1/(F-Fs))` for a per-frame variance of `s^2`.
+		//! Solving for `s^2` and dividing by `F` gives the variance of `m` as `(m-a)^2*Fs/(F-Fs)`.
+		inline float estimateTileError(const uint32_t tile, const float* luminance, const double varianceScale, const double imageMean) const
+		{
+			const uint32_t x0 = (tile%m_tilesX)*TileDim;
+			const uint32_t y0 = (tile/m_tilesX)*TileDim;
+			const uint32_t x1 = nbl::core::min(x0+TileDim,m_width);
+			const uint32_t y1 = nbl::core::min(y0+TileDim,m_height);
+			double variance = 0.0, mean = 0.0;
+			for (uint32_t y=y0; y<y1; y++)
+			for (uint32_t x=x0; x<x1; x++)
+			{
+				const size_t pixel = size_t(y)*m_width+x;
+				const double delta = double(luminance[pixel])-double(m_snapshot[pixel]);
+				variance += delta*delta*varianceScale;
+				mean += luminance[pixel];
+			}
+			const double pixelCount = double((x1-x0)*(y1-y0));
+			return float(std::sqrt(variance/pixelCount)/(mean/pixelCount+MinLuminanceFraction*imageMean+DBL_MIN));
+		}
+
+		uint32_t m_width = 0u, m_height = 0u, m_tilesX = 0u;
+		SParams m_params = {};
+		nbl::core::vector<uint32_t> m_lastFrames;
+		nbl::core::vector<float> m_errors;
+		nbl::core::vector<float> m_snapshot;
+		uint32_t m_snapshotFrame = 0u, m_nextEvaluation = 0u;
+		uint64_t m_budget = 0ull, m_spent = 0ull;
+		uint32_t m_activeTiles = 0u, m_convergedTiles = 0u;
+};
+
+inline bool AdaptiveSampling::benchmark()
+{
+	constexpr uint32_t Width = 512u;
+	constexpr uint32_t Height = 384u;
+	constexpr float Threshold = 0.02f;
+	constexpr uint32_t BudgetFrames = 256u;
+	// same cap as the renderer's sample sequence puts on it
+	constexpr uint32_t MaxFrames = BudgetFrames*BudgetHeadroom;
+	// mild noise everywhere converges in well under the budget, the caustics would need thousands of frames
+	constexpr float MildSigma = 0.15f;
+	constexpr float CausticSpikeProbability = 0.02f;
+	constexpr float CausticSpike = 20.f;
+	constexpr uint32_t CausticTileStride = 11u;
+
+	const uint32_t tilesX = (Width+TileDim-1u)/TileDim;
+	auto isCaustic = [&](const uint32_t x, const uint32_t y) -> bool {return ((y/TileDim)*tilesX+x/TileDim)%CausticTileStride==0u;};
+	nbl::core::vector<float> truth(size_t(Width)*Height);
+	for (uint32_t y=0u; y<Height; y++)
+	for (uint32_t x=0u; x<Width; x++)
+		truth[size_t(y)*Width+x] = 0.05f+float(x)/float(Width)+0.5f*float(y)/float(Height);
+
+	// counter based so the uniform and adaptive runs see the same samples for the frames they share
+	auto uniform = [](uint64_t key) -> double
+	{
+		key += 0x9e3779b97f4a7c15ull;
+		key = (key^(key>>30u))*0xbf58476d1ce4e5b9ull;
+		key = (key^(key>>27u))*0x94d049bb133111ebull;
+		return double((key^(key>>31u))>>11u)*(1.0/double(0x1ull<<53u));
+	};
+	auto sample = [&](const uint32_t x, const uint32_t y, const uint32_t frame) -> float
+	{
+		const uint64_t key = ((uint64_t(frame)*Height+y)*Width+x)*2ull;
+		const double u0 = uniform(key);
+		// both have a mean of 1
+		double scale;
+		if (isCaustic(x,y))
+			scale = u0<CausticSpikeProbability ? CausticSpike:(1.0-CausticSpikeProbability*CausticSpike)/(1.0-CausticSpikeProbability);
+		else
+			scale = 1.0+MildSigma*std::sqrt(-2.0*std::log(nbl::core::max(u0,DBL_MIN)))*std::cos(2.0*nbl::core::PI<double>()*uniform(key+1ull));
+		return float(scale*truth[size_t(y)*Width+x]);
+	};
+	// the GPU hands over means through an RGBA16F image
+	auto roundToHalf = [](const float value) -> float
+	{
+		uint32_t bits;
+		memcpy(&bits,&value,sizeof(bits));
+		bits = (bits+0x1000u)&0xffffe000u;
+		float retval;
+		memcpy(&retval,&bits,sizeof(retval));
+		return retval;
+	};
+	auto realTileErrors = [&](const nbl::core::vector<double>& mean) -> nbl::core::vector<float>
+	{
+		const double imageMean = std::accumulate(truth.begin(),truth.end(),0.0)/double(truth.size());
+		nbl::core::vector<double> squaredError(size_t(tilesX)*((Height+TileDim-1u)/TileDim),0.0), tileMean(squaredError.size(),0.0), pixels(squaredError.size(),0.0);
+		for (uint32_t y=0u; y<Height; y++)
+		for (uint32_t x=0u; x<Width; x++)
+		{
+			const size_t pixel = size_t(y)*Width+x;
+			const uint32_t tile = (y/TileDim)*tilesX+x/TileDim;
+			squaredError[tile] += (mean[pixel]-truth[pixel])*(mean[pixel]-truth[pixel]);
+			tileMean[tile] += truth[pixel];
+			pixels[tile] += 1.0;
+		}
+		nbl::core::vector<float> retval(squaredError.size());
+		for (size_t tile=0u; tile<retval.size(); tile++)
+			retval[tile] = float(std::sqrt(squaredError[tile]/pixels[tile])/(tileMean[tile]/pixels[tile]+MinLuminanceFraction*imageMean));
+		return retval;
+	};
+
+	struct SResult
+	{
+		nbl::core::vector<float> errors;
+		nbl::core::vector<uint32_t> tileFrames;
+		uint32_t frames = 0u;
+		double budgetUsed = 0.0;
+		uint32_t convergedTiles = 0u;
+		// log of estimated over real error at every evaluation
+		double logRatioSum = 0.0;
+		uint32_t estimateCount = 0u;
+		double milliseconds = 0.0;
+	};
+	auto render = [&](const float threshold) -> SResult
+	{
+		const auto start = std::chrono::steady_clock::now();
+		AdaptiveSampling sampler;
+		sampler.init(Width,Height,{threshold,16u,BudgetFrames,MaxFrames});
+		nbl::core::vector<double> mean(truth.size(),0.0);
+		nbl::core::vector<float> resolved(truth.size());
+		nbl::core::vector<uint32_t> rows(Height);
+		std::iota(rows.begin(),rows.end(),0u);
+		SResult result;
+		for (uint32_t frame=1u; threshold>0.f ? !sampler.isDone():frame<=BudgetFrames; frame++)
+		{
+			std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				for (uint32_t x=0u; x<Width; x++)
+				{
+					if (sampler.getTileLastFrames()[(y/TileDim)*tilesX+x/TileDim]<frame)
+						continue;
+					const size_t pixel = size_t(y)*Width+x;
+					mean[pixel] += (double(sample(x,y,frame))-mean[pixel])/double(frame);
+					resolved[pixel] = roundToHalf(float(mean[pixel]));
+				}
+			});
+			result.frames = frame;
+			if (sampler.needsEvaluation(frame))
+			{
+				const bool hadSnapshot = sampler.m_snapshotFrame!=0u;
+				sampler.evaluate(frame,resolved.data());
+				if (hadSnapshot)
+				{
+					const auto real = realTileErrors(mean);
+					for (uint32_t tile=0u; tile<sampler.getTileCount(); tile++)
+					if (sampler.getTileLastFrames()[tile]==NoLastFrame)
+					{
+						result.logRatioSum += std::log(double(sampler.getTileError(tile))/double(real[tile]));
+						result.estimateCount++;
+					}
+				}
+			}
+			sampler.schedule(frame);
+		}
+		result.errors = realTileErrors(mean);
+		for (uint32_t tile=0u; tile<sampler.getTileCount(); tile++)
+			result.tileFrames.push_back(nbl::core::min(sampler.getTileLastFrames()[tile],result.frames));
+		result.budgetUsed = threshold>0.f ? sampler.getBudgetUsed():1.0;
+		result.convergedTiles = sampler.getConvergedTileCount();
+		result.milliseconds = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+		return result;
+	};
+
+	const SResult uniformResult = render(0.f);
+	const SResult adaptiveResult = render(Threshold);
+
+	auto report = [&](const char* name, const SResult& result) -> void
+	{
+		double mildWorst = 0.0, causticWorst = 0.0;
+		for (uint32_t tile=0u; tile<result.errors.size(); tile++)
+		{
+			auto& worst = isCaustic((tile%tilesX)*TileDim,(tile/tilesX)*TileDim) ? causticWorst:mildWorst;
+			worst = nbl::core::max(worst,double(result.errors[tile]));
+		}
+		printf("[INFO] Adaptive Sampling: %-8s | %5u frames | %5.1f%% budget | worst error mild %.4f caustic %.4f | %.1f ms\n",
+			name,result.frames,result.budgetUsed*100.0,mildWorst,causticWorst,result.milliseconds
+		);
+	};
+	report("uniform",uniformResult);
+	report("adaptive",adaptiveResult);
+
+	bool success = true;
+	// the estimate of each tile is noisy, but it shouldn't be biased
+	const double estimateBias = std::exp(adaptiveResult.logRatioSum/double(nbl::core::max(adaptiveResult.estimateCount,1u)));
+	printf("[INFO] Adaptive Sampling: %u tile error estimates are off from the real error by a factor of %.3f on average\n",adaptiveResult.estimateCount,estimateBias);
+	if (estimateBias<0.75 || estimateBias>1.333)
+	{
+		printf("[ERROR] Adaptive Sampling: biased error estimate\n");
+		success = false;
+	}
+	if (adaptiveResult.budgetUsed>1.0)
+	{
+		printf("[ERROR] Adaptive Sampling: overran the sample budget\n");
+		success = false;
+	}
+	// some tiles just sneak under the threshold, the real error of the ones deemed converged may only be a little over it
+	nbl::core::vector<float> convergedErrors;
+	for (uint32_t tile=0u; tile<adaptiveResult.errors.size(); tile++)
+	if (adaptiveResult.tileFrames[tile]<adaptiveResult.frames && !isCaustic((tile%tilesX)*TileDim,(tile/tilesX)*TileDim))
+		convergedErrors.push_back(adaptiveResult.errors[tile]);
+	std::sort(convergedErrors.begin(),convergedErrors.end());
+	if (convergedErrors.empty() || convergedErrors[convergedErrors.size()*95u/100u]>1.5f*Threshold)
+	{
+		printf("[ERROR] Adaptive Sampling: tiles stopped before reaching the error threshold\n");
+		success = false;
+	}
+	auto worstCaustic = [&](const SResult& result) -> float
+	{
+		float worst = 0.f;
+		for (uint32_t tile=0u; tile<result.errors.size(); tile++)
+		if (isCaustic((tile%tilesX)*TileDim,(tile/tilesX)*TileDim))
+			worst = nbl::core::max(worst,result.errors[tile]);
+		return worst;
+	};
+	// the point is handing the converged tiles' samples to the others, not just stopping early
+	const uint32_t mostTileFrames = *std::max_element(adaptiveResult.tileFrames.begin(),adaptiveResult.tileFrames.end());
+	printf("[INFO] Adaptive Sampling: the most sampled tile got %u frames out of a budget of %u\n",mostTileFrames,BudgetFrames);
+	if (mostTileFrames<=BudgetFrames)
+	{
+		printf("[ERROR] Adaptive Sampling: no tile got more than the uniform share of the budget\n");
+		success = false;
+	}
+	if (worstCaustic(adaptiveResult)>=worstCaustic(uniformResult))
+	{
+		printf("[ERROR] Adaptive Sampling: the caustic tiles didn't get any better for the same budget\n");
+		success = false;
+	}
+	return success;
+}
+
+#endif
@@ -0,0 +1,862 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _CPU_INTERSECTOR_H_INCLUDED_
+#define _CPU_INTERSECTOR_H_INCLUDED_
+
+#include "nabla.h"
+#include "nbl/ext/RadeonRays/RadeonRays.h"
+// pesky leaking defines
+#undef PI
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <thread>
+
+
+//! CPU stand-in for RadeonRays' `QueryIntersection`, consumes the same `::RadeonRays::ray` and produces the same `::RadeonRays::Intersection`.
+//! Every mesh gets its own binned SAH BVH (built in parallel across meshes) and the instances go into a top level binned SAH BVH,
+//! rays get transformed into object space at the instance leaves just like RadeonRays' instancing, so `t` stays the same in both spaces.
+//! Traversal splits the rays into fixed size streams which get spread over all threads, each ray walks the tree front to back on its own:
+//! after the first bounce the rays are too incoherent for packets to stay together.
+//! Only the origin, direction, `maxT` and the active flag of a ray get read, the renderer keeps its own data in all the other fields.
+//! Like in RadeonRays' kernels a ray is active when `extra.y` is not 0 and the mask in `extra.x` is not checked, no shape sets one.
+class CPUIntersector
+{
+	public:
+		static inline constexpr uint32_t BinCount = 16u;
+		static inline constexpr uint32_t MaxLeafTriangles = 4u;
+		//! a leaf bigger than this only gets made when the primitives can't be told apart
+		static inline constexpr uint32_t MaxForcedLeafSize = 16u;
+		//! below this depth splits stop looking at the SAH and halve the primitives, keeps the traversal stack bounded
+		static inline constexpr uint32_t MaxSAHDepth = 48u;
+		static inline constexpr uint32_t MaxStackSize = 128u;
+		//! rays handed to one task, enough to amortize the scheduling while still balancing the threads on incoherent bounces
+		static inline constexpr uint32_t StreamSize = 256u;
+		static inline constexpr int32_t NullID = -1;
+
+		struct SBox
+		{
+			float min[3] = {FLT_MAX,FLT_MAX,FLT_MAX};
+			float max[3] = {-FLT_MAX,-FLT_MAX,-FLT_MAX};
+
+			inline void extend(const float* point)
+			{
+				for (auto i=0u; i<3u; i++)
+				{
+					min[i] = nbl::core::min(min[i],point[i]);
+					max[i] = nbl::core::max(max[i],point[i]);
+				}
+			}
+			inline void extend(const SBox& other)
+			{
+				if (!other.valid())
+					return;
+				extend(other.min);
+				extend(other.max);
+			}
+			inline bool valid() const { return min[0]<=max[0] && min[1]<=max[1] && min[2]<=max[2]; }
+			inline float getArea() const
+			{
+				if (!valid())
+					return 0.f;
+				const float extent[3] = {max[0]-min[0],max[1]-min[1],max[2]-min[2]};
+				return 2.f*(extent[0]*extent[1]+extent[1]*extent[2]+extent[2]*extent[0]);
+			}
+			inline float getCentroid(const uint32_t axis) const { return (min[axis]+max[axis])*0.5f; }
+		};
+
+		struct SNode
+		{
+			float min[3];
+			//! interior nodes have their two children next to each other starting here, leaves their first primitive
+			uint32_t offset;
+			float max[3];
+			//! primitives in the leaf, zero for interior nodes
+			uint32_t count;
+		};
+
+		struct SStats
+		{
+			uint32_t meshCount = 0u;
+			uint32_t instanceCount = 0u;
+			uint64_t triangleCount = 0ull;
+			uint64_t nodeCount = 0ull;
+			double buildMs = 0.0;
+		};
+
+		//! positions are tightly packed 3 floats, the indices are relative to `positions`
+		template<typename IndexType>
+		inline uint32_t addMesh(const float* positions, const IndexType* indices, const uint32_t indexCount)
+		{
+			return addMesh(indexCount/3u,[positions,indices](const uint32_t triangle, float (&vertices)[3][3]) -> void
+			{
+				for (auto i=0u; i<3u; i++)
+				for (auto j=0u; j<3u; j++)
+					vertices[i][j] = positions[uint64_t(indices[triangle*3u+i])*3ull+j];
+			});
+		}
+		//! `getTriangle(triangleID,vertices)` fills the object space vertices of a triangle, the primitive IDs in the intersections are the triangle IDs
+		template<typename GetTriangleFunc>
+		inline uint32_t addMesh(const uint32_t triangleCount, GetTriangleFunc&& getTriangle)
+		{
+			auto& mesh = m_meshes.emplace_back();
+			mesh.triangles.resize(triangleCount);
+			for (auto i=0u; i<triangleCount; i++)
+			{
+				float vertices[3][3];
+				getTriangle(i,vertices);
+				auto& triangle = mesh.triangles[i];
+				for (auto j=0u; j<3u; j++)
+				{
+					triangle.v0[j] = vertices[0][j];
+					triangle.edges[0][j] = vertices[1][j]-vertices[0][j];
+					triangle.edges[1][j] = vertices[2][j]-vertices[0][j];
+				}
+				triangle.primID = i;
+			}
+			m_built = false;
+			return m_meshes.size()-1u;
+		}
+
+		//! `id` is what ends up in `shapeid`, same as `::RadeonRays::Shape::SetId`
+		inline void addInstance(const uint32_t mesh, const nbl::core::matrix3x4SIMD& objectToWorld, const int32_t id)
+		{
+			auto& instance = m_instances.emplace_back();
+			instance.mesh = mesh;
+			instance.id = id;
+			for (auto i=0u; i<3u; i++)
+			{
+				instance.objectToWorld[i][0] = objectToWorld.rows[i].x;
+				instance.objectToWorld[i][1] = objectToWorld.rows[i].y;
+				instance.objectToWorld[i][2] = objectToWorld.rows[i].z;
+				instance.objectToWorld[i][3] = objectToWorld.rows[i].w;
+			}
+			invert(instance.objectToWorld,instance.worldToObject);
+			m_built = false;
+		}
+
+		inline void clear()
+		{
+			m_meshes.clear();
+			m_instances.clear();
+			m_nodes.clear();
+			m_instanceOrder.clear();
+			m_stats = {};
+			m_built = false;
+		}
+
+		//! builds every mesh's BVH which isn't built yet, then the top level one over all instances
+		inline void build()
+		{
+			const auto start = std::chrono::steady_clock::now();
+			nbl::core::vector<uint32_t> meshIDs(m_meshes.size());
+			std::iota(meshIDs.begin(),meshIDs.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,meshIDs.begin(),meshIDs.end(),[&](const uint32_t meshID) -> void
+			{
+				auto& mesh = m_meshes[meshID];
+				if (!mesh.nodes.empty() || mesh.triangles.empty())
+					return;
+				nbl::core::vector<SBox> bounds(mesh.triangles.size());
+				for (size_t i=0u; i<bounds.size(); i++)
+					bounds[i] = mesh.triangles[i].getBound();
+				nbl::core::vector<uint32_t> order;
+				buildBVH(bounds.data(),bounds.size(),MaxLeafTriangles,mesh.nodes,order);
+				// store the triangles in leaf order so leaves read them contiguously
+				nbl::core::vector<STriangle> reordered(order.size());
+				for (size_t i=0u; i<order.size(); i++)
+					reordered[i] = mesh.triangles[order[i]];
+				mesh.triangles = std::move(reordered);
+				mesh.primitiveSlots.resize(order.size());
+				for (size_t i=0u; i<order.size(); i++)
+					mesh.primitiveSlots[mesh.triangles[i].primID] = i;
+				mesh.bound = bounds.empty() ? SBox{}:SBox{{mesh.nodes[0].min[0],mesh.nodes[0].min[1],mesh.nodes[0].min[2]},{mesh.nodes[0].max[0],mesh.nodes[0].max[1],mesh.nodes[0].max[2]}};
+			});
+
+			nbl::core::vector<SBox> instanceBounds(m_instances.size());
+			std::transform(nbl::core::execution::par_unseq,m_instances.begin(),m_instances.end(),instanceBounds.begin(),[&](SInstance& instance) -> SBox
+			{
+				instance.bound = transformBox(m_meshes[instance.mesh].bound,instance.objectToWorld);
+				return instance.bound;
+			});
+			m_nodes.clear();
+			buildBVH(instanceBounds.data(),instanceBounds.size(),1u,m_nodes,m_instanceOrder);
+
+			m_stats.meshCount = m_meshes.size();
+			m_stats.instanceCount = m_instances.size();
+			m_stats.triangleCount = 0ull;
+			m_stats.nodeCount = m_nodes.size();
+			for (const auto& mesh : m_meshes)
+			{
+				m_stats.triangleCount += mesh.triangles.size();
+				m_stats.nodeCount += mesh.nodes.size();
+			}
+			m_stats.buildMs = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+			m_built = true;
+		}
+		inline bool isBuilt() const { return m_built; }
+		inline const SStats& getStats() const { return m_stats; }
+		inline SBox getBound() const
+		{
+			if (m_nodes.empty())
+				return {};
+			return {{m_nodes[0].min[0],m_nodes[0].min[1],m_nodes[0].min[2]},{m_nodes[0].max[0],m_nodes[0].max[1],m_nodes[0].max[2]}};
+		}
+
+		//! Same contract as RadeonRays: misses get `NullID` shape and primitive, hits the instance's ID, the triangle ID,
+		//! the barycentrics of the second and third vertex in `uvwt.xy` and the distance in `uvwt.w`.
+		//! `padding0` gets the index of the instance in the order of `addInstance`, which nothing on the GPU reads.
+		inline void intersect(const ::RadeonRays::ray* rays, ::RadeonRays::Intersection* intersections, const uint32_t count) const
+		{
+			nbl::core::vector<uint32_t> streams((count+StreamSize-1u)/StreamSize);
+			std::iota(streams.begin(),streams.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,streams.begin(),streams.end(),[&](const uint32_t stream) -> void
+			{
+				const uint32_t end = nbl::core::min((stream+1u)*StreamSize,count);
+				for (uint32_t i=stream*StreamSize; i<end; i++)
+				{
+					// RadeonRays leaves whatever an earlier query wrote for inactive rays, a miss is the deterministic version of that
+					if (rays[i].extra.y)
+						intersections[i] = intersect(rays[i]);
+					else
+						intersections[i] = SHit(0.f).get();
+				}
+			});
+		}
+		inline ::RadeonRays::Intersection intersect(const ::RadeonRays::ray& ray) const
+		{
+			SHit hit(ray.o.w);
+			if (m_nodes.empty())
+				return hit.get();
+			const float origin[3] = {ray.o.x,ray.o.y,ray.o.z};
+			const float direction[3] = {ray.d.x,ray.d.y,ray.d.z};
+			float rcpDirection[3];
+			getReciprocal(direction,rcpDirection);
+			traverse(m_nodes.data(),origin,rcpDirection,hit.t,[&](const uint32_t first, const uint32_t count) -> void
+			{
+				for (auto i=first; i<first+count; i++)
+					intersectInstance(m_instanceOrder[i],origin,direction,hit);
+			});
+			return hit.get();
+		}
+
+		//! tests every triangle of every instance, the reference for validating the BVHs
+		inline ::RadeonRays::Intersection intersectBruteForce(const ::RadeonRays::ray& ray) const
+		{
+			SHit hit(ray.o.w);
+			const float origin[3] = {ray.o.x,ray.o.y,ray.o.z};
+			const float direction[3] = {ray.d.x,ray.d.y,ray.d.z};
+			for (uint32_t instanceIx=0u; instanceIx<m_instances.size(); instanceIx++)
+			{
+				const auto& instance = m_instances[instanceIx];
+				float localOrigin[3], localDirection[3];
+				transformRay(instance.worldToObject,origin,direction,localOrigin,localDirection);
+				const auto& triangles = m_meshes[instance.mesh].triangles;
+				for (const auto& triangle : triangles)
+				if (triangle.intersect(localOrigin,localDirection,hit))
+				{
+					hit.instance = instanceIx;
+					hit.primID = triangle.primID;
+					hit.id = instance.id;
+				}
+			}
+			return hit.get();
+		}
+
+		//! world space geometric normal of a hit, not normalized, zero for misses
+		inline void getGeometricNormal(const ::RadeonRays::Intersection& intersection, float (&normal)[3]) const
+		{
+			normal[0] = normal[1] = normal[2] = 0.f;
+			if (intersection.shapeid==NullID || uint32_t(intersection.padding0)>=m_instances.size())
+				return;
+			const auto& instance = m_instances[intersection.padding0];
+			const auto& mesh = m_meshes[instance.mesh];
+			if (uint32_t(intersection.primid)>=mesh.primitiveSlots.size())
+				return;
+			const auto& triangle = mesh.triangles[mesh.primitiveSlots[intersection.primid]];
+			float local[3];
+			cross(triangle.edges[0],triangle.edges[1],local);
+			// normals transform with the inverse transpose
+			for (auto i=0u; i<3u; i++)
+				normal[i] = instance.worldToObject[0][i]*local[0]+instance.worldToObject[1][i]*local[1]+instance.worldToObject[2][i]*local[2];
+		}
+
+		struct SThroughput
+		{
+			uint64_t rays = 0ull;
+			uint64_t hits = 0ull;
+			double ms = 0.0;
+
+			inline double getMraysPerSecond() const { return ms>0.0 ? double(rays)/(ms*1000.0):0.0; }
+		};
+		struct SValidation
+		{
+			uint32_t checked = 0u;
+			uint32_t mismatches = 0u;
+
+			//! grazing hits on shared edges can legitimately go either way
+			inline bool passed() const { return mismatches*200u<=checked; }
+		};
+
+		//! compares `sampleCount` rays spread evenly over `rays` against the brute force reference, hit or miss and the distance have to agree
+		inline SValidation validate(const ::RadeonRays::ray* rays, const ::RadeonRays::Intersection* intersections, const uint32_t count, const uint32_t sampleCount) const
+		{
+			SValidation retval;
+			if (!count)
+				return retval;
+			nbl::core::vector<uint32_t> samples(nbl::core::min(sampleCount,count));
+			for (uint32_t i=0u; i<samples.size(); i++)
+				samples[i] = uint32_t(uint64_t(i)*count/samples.size());
+			retval.checked = samples.size();
+			retval.mismatches = std::count_if(nbl::core::execution::par_unseq,samples.begin(),samples.end(),[&](const uint32_t i) -> bool
+			{
+				const auto reference = intersectBruteForce(rays[i]);
+				const auto& tested = intersections[i];
+				if ((reference.shapeid==NullID)!=(tested.shapeid==NullID))
+					return true;
+				return reference.shapeid!=NullID && nbl::core::abs(reference.uvwt.w-tested.uvwt.w)>1e-4f*nbl::core::max(reference.uvwt.w,1.f);
+			});
+			return retval;
+		}
+
+		//! Headless throughput test: primary rays through every pixel of the view, then one cosine distributed bounce off every primary hit.
+		//! The view is a perspective camera at `cameraPosition` looking through `viewProjInverse`, the secondary rays are a fixed function of the pixel.
+		static inline bool benchmark(const CPUIntersector& intersector, const nbl::core::matrix4SIMD& viewProjInverse, const float (&cameraPosition)[3], const uint32_t width, const uint32_t height, const uint32_t iterations=4u)
+		{
+			const auto& stats = intersector.getStats();
+			printf("[INFO] CPU Intersector: %u meshes, %u instances, %llu triangles, %llu nodes, built in %.1f ms\n",
+				stats.meshCount,stats.instanceCount,static_cast<unsigned long long>(stats.triangleCount),static_cast<unsigned long long>(stats.nodeCount),stats.buildMs
+			);
+			const auto bound = intersector.getBound();
+			if (!bound.valid())
+			{
+				printf("[ERROR] CPU Intersector: empty scene\n");
+				return false;
+			}
+
+			const uint32_t rayCount = width*height;
+			nbl::core::vector<::RadeonRays::ray> rays(rayCount);
+			nbl::core::vector<::RadeonRays::Intersection> intersections(rayCount);
+			auto run = [&](const uint32_t count, const char* name) -> SThroughput
+			{
+				SThroughput retval;
+				retval.rays = uint64_t(count)*iterations;
+				// first pass warms the caches and the thread pool
+				intersector.intersect(rays.data(),intersections.data(),count);
+				const auto start = std::chrono::steady_clock::now();
+				for (auto i=0u; i<iterations; i++)
+					intersector.intersect(rays.data(),intersections.data(),count);
+				retval.ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+				retval.hits = uint64_t(std::count_if(intersections.begin(),intersections.begin()+count,[](const auto& hit){return hit.shapeid!=NullID;}))*iterations;
+				printf("[INFO] CPU Intersector: %s %u rays, %.1f%% hit, %.2f Mrays/s\n",name,count,count ? double(retval.hits)*100.0/double(retval.rays):0.0,retval.getMraysPerSecond());
+				return retval;
+			};
+			constexpr uint32_t ValidationSamples = 1024u;
+			bool passed = true;
+			auto check = [&](const char* name, const uint32_t count) -> void
+			{
+				const auto validation = intersector.validate(rays.data(),intersections.data(),count,ValidationSamples);
+				printf("[INFO] CPU Intersector: %s rays, %u of %u sampled differ from brute force\n",name,validation.mismatches,validation.checked);
+				if (!validation.passed())
+				{
+					printf("[ERROR] CPU Intersector: %s rays don't match the brute force reference\n",name);
+					passed = false;
+				}
+			};
+
+			// primary
+			std::for_each(nbl::core::execution::par_unseq,intersections.begin(),intersections.end(),[&](::RadeonRays::Intersection& intersection) -> void
+			{
+				const uint32_t i = &intersection-intersections.data();
+				const float ndc[2] = {(float(i%width)+0.5f)/float(width)*2.f-1.f,1.f-(float(i/width)+0.5f)/float(height)*2.f};
+				// any depth inside the clip volume lies on the pixel's line of sight
+				float target[4];
+				for (auto r=0u; r<4u; r++)
+					target[r] = viewProjInverse.rows[r][0]*ndc[0]+viewProjInverse.rows[r][1]*ndc[1]+viewProjInverse.rows[r][2]*0.5f+viewProjInverse.rows[r][3];
+				float direction[3];
+				for (auto j=0u; j<3u; j++)
+					direction[j] = target[j]/target[3]-cameraPosition[j];
+				normalize(direction);
+				rays[i] = makeRay(cameraPosition,direction,FLT_MAX);
+			});
+			const auto primary = run(rayCount,"primary");
+			check("primary",rayCount);
+
+			// secondary, compacted like the renderer does
+			const float extent[3] = {bound.max[0]-bound.min[0],bound.max[1]-bound.min[1],bound.max[2]-bound.min[2]};
+			const float originOffset = 1e-5f*nbl::core::max(nbl::core::max(extent[0],extent[1]),extent[2]);
+			nbl::core::vector<::RadeonRays::ray> secondary(rayCount);
+			nbl::core::vector<uint8_t> generated(rayCount);
+			std::for_each(nbl::core::execution::par_unseq,generated.begin(),generated.end(),[&](uint8_t& valid) -> void
+			{
+				const uint32_t i = &valid-generated.data();
+				valid = 0u;
+				const auto& hit = intersections[i];
+				if (hit.shapeid==NullID)
+					return;
+				float normal[3];
+				intersector.getGeometricNormal(hit,normal);
+				if (!normalize(normal))
+					return;
+				const float* direction = &rays[i].d.x;
+				if (dot(normal,direction)>0.f)
+				for (auto j=0u; j<3u; j++)
+					normal[j] = -normal[j];
+				float origin[3];
+				for (auto j=0u; j<3u; j++)
+					origin[j] = (&rays[i].o.x)[j]+direction[j]*hit.uvwt.w+normal[j]*originOffset;
+				// cosine weighted about the normal
+				const uint32_t hash = pcgHash(i);
+				const float u = float(hash&0xffffu)/65536.f, v = float(pcgHash(hash)&0xffffu)/65536.f;
+				const float r = nbl::core::sqrt(u), phi = 2.f*nbl::core::PI<float>()*v;
+				float tangent[3], bitangent[3];
+				const float helper[3] = {nbl::core::abs(normal[0])>0.9f ? 0.f:1.f,nbl::core::abs(normal[0])>0.9f ? 1.f:0.f,0.f};
+				cross(normal,helper,tangent);
+				normalize(tangent);
+				cross(normal,tangent,bitangent);
+				float bounce[3];
+				const float x = r*cosf(phi), y = r*sinf(phi), z = nbl::core::sqrt(nbl::core::max(1.f-u,0.f));
+				for (auto j=0u; j<3u; j++)
+					bounce[j] = tangent[j]*x+bitangent[j]*y+normal[j]*z;
+				secondary[i] = makeRay(origin,bounce,FLT_MAX);
+				valid = 1u;
+			});
+			uint32_t secondaryCount = 0u;
+			for (uint32_t i=0u; i<rayCount; i++)
+			if (generated[i])
+				rays[secondaryCount++] = secondary[i];
+			const auto bounce = run(secondaryCount,"secondary");
+			check("secondary",secondaryCount);
+
+			printf("[INFO] CPU Intersector: %.2f Mrays/s primary, %.2f Mrays/s secondary on %u threads\n",primary.getMraysPerSecond(),bounce.getMraysPerSecond(),std::thread::hardware_concurrency());
+			return passed;
+		}
+
+	private:
+		struct SHit
+		{
+			SHit(const float maxT) : t(maxT) {}
+
+			inline ::RadeonRays::Intersection get() const
+			{
+				::RadeonRays::Intersection retval;
+				const bool found = instance!=~0u;
+				retval.shapeid = found ? id:NullID;
+				retval.primid = found ? int32_t(primID):NullID;
+				retval.padding0 = found ? int32_t(instance):NullID;
+				retval.padding1 = 0;
+				retval.uvwt.x = u;
+				retval.uvwt.y = v;
+				retval.uvwt.z = 0.f;
+				retval.uvwt.w = found ? t:0.f;
+				return retval;
+			}
+
+			float t;
+			float u = 0.f, v = 0.f;
+			uint32_t instance = ~0u;
+			uint32_t primID = 0u;
+			int32_t id = NullID;
+		};
+
+		struct STriangle
+		{
+			float v0[3];
+			float edges[2][3];
+			uint32_t primID;
+
+			inline SBox getBound() const
+			{
+				SBox retval;
+				retval.extend(v0);
+				for (auto i=0u; i<2u; i++)
+				{
+					const float vertex[3] = {v0[0]+edges[i][0],v0[1]+edges[i][1],v0[2]+edges[i][2]};
+					retval.extend(vertex);
+				}
+				return retval;
+			}
+
+			//! Moller-Trumbore without culling, records into `hit` only if closer
+			inline bool intersect(const float (&origin)[3], const float (&direction)[3], SHit& hit) const
+			{
+				float p[3];
+				cross(direction,edges[1],p);
+				const float determinant = dot(edges[0],p);
+				if (determinant==0.f)
+					return false;
+				const float rcpDeterminant = 1.f/determinant;
+				const float s[3] = {origin[0]-v0[0],origin[1]-v0[1],origin[2]-v0[2]};
+				const float u = dot(s,p)*rcpDeterminant;
+				if (u<0.f || u>1.f)
+					return false;
+				float q[3];
+				cross(s,edges[0],q);
+				const float v = dot(direction,q)*rcpDeterminant;
+				if (v<0.f || u+v>1.f)
+					return false;
+				const float t = dot(edges[1],q)*rcpDeterminant;
+				if (t<=0.f || t>=hit.t)
+					return false;
+				hit.t = t;
+				hit.u = u;
+				hit.v = v;
+				return true;
+			}
+		};
+
+		struct SMesh
+		{
+			//! in leaf order after the build
+			nbl::core::vector<STriangle> triangles;
+			//! where each primitive ID ended up in `triangles`
+			nbl::core::vector<uint32_t> primitiveSlots;
+			nbl::core::vector<SNode> nodes;
+			SBox bound;
+		};
+
+		struct SInstance
+		{
+			float objectToWorld[3][4];
+			float worldToObject[3][4];
+			SBox bound;
+			uint32_t mesh;
+			int32_t id;
+		};
+
+		inline void intersectInstance(const uint32_t instanceIx, const float (&origin)[3], const float (&direction)[3], SHit& hit) const
+		{
+			const auto& instance = m_instances[instanceIx];
+			const auto& mesh = m_meshes[instance.mesh];
+			if (mesh.nodes.empty())
+				return;
+			float localOrigin[3], localDirection[3], rcpDirection[3];
+			transformRay(instance.worldToObject,origin,direction,localOrigin,localDirection);
+			getReciprocal(localDirection,rcpDirection);
+			traverse(mesh.nodes.data(),localOrigin,rcpDirection,hit.t,[&](const uint32_t first, const uint32_t count) -> void
+			{
+				for (auto i=first; i<first+count; i++)
+				if (mesh.triangles[i].intersect(localOrigin,localDirection,hit))
+				{
+					hit.instance = instanceIx;
+					hit.primID = mesh.triangles[i].primID;
+					hit.id = instance.id;
+				}
+			});
+		}
+
+		//! slab test, the far distance is padded a few ULPs so rounding can't cull a box the ray grazes
+		static inline bool intersectBox(const SNode& node, const float (&origin)[3], const float (&rcpDirection)[3], const float maxT, float& entry)
+		{
+			float tNear = 0.f, tFar = maxT;
+			for (auto i=0u; i<3u; i++)
+			{
+				const float t0 = (node.min[i]-origin[i])*rcpDirection[i];
+				const float t1 = (node.max[i]-origin[i])*rcpDirection[i];
+				tNear = nbl::core::max(tNear,nbl::core::min(t0,t1));
+				tFar = nbl::core::min(tFar,nbl::core::max(t0,t1)*1.00000024f);
+			}
+			entry = tNear;
+			return tNear<=tFar;
+		}
+
+		//! front to back, `leaf(first,count)` may shrink `maxT` which culls the nodes still on the stack
+		template<typename LeafFunc>
+		static inline void traverse(const SNode* nodes, const float (&origin)[3], const float (&rcpDirection)[3], const float& maxT, LeafFunc&& leaf)
+		{
+			struct SStackEntry
+			{
+				uint32_t node;
+				float entry;
+			};
+			SStackEntry stack[MaxStackSize];
+			uint32_t stackSize = 0u;
+
+			float entry;
+			if (!intersectBox(nodes[0],origin,rcpDirection,maxT,entry))
+				return;
+			uint32_t current = 0u;
+			while (true)
+			{
+				const SNode& node = nodes[current];
+				if (node.count)
+					leaf(node.offset,node.count);
+				else
+				{
+					float entries[2];
+					const bool hits[2] = {
+						intersectBox(nodes[node.offset],origin,rcpDirection,maxT,entries[0]),
+						intersectBox(nodes[node.offset+1u],origin,rcpDirection,maxT,entries[1])
+					};
+					if (hits[0] && hits[1])
+					{
+						const uint32_t nearer = entries[1]<entries[0] ? 1u:0u;
+						stack[stackSize++] = {node.offset+(nearer^1u),entries[nearer^1u]};
+						current = node.offset+nearer;
+						continue;
+					}
+					else if (hits[0] || hits[1])
+					{
+						current = node.offset+(hits[0] ? 0u:1u);
+						continue;
+					}
+				}
+				// pop the next node which is still in front of the closest hit
+				do
+				{
+					if (!stackSize)
+						return;
+					stackSize--;
+				} while (stack[stackSize].entry>maxT);
+				current = stack[stackSize].node;
+			}
+		}
+
+		//! binned SAH over the primitive bounds, `order` maps the leaves' primitive ranges back to the input primitives
+		static inline void buildBVH(const SBox* bounds, const uint32_t count, const uint32_t maxLeafSize, nbl::core::vector<SNode>& nodes, nbl::core::vector<uint32_t>& order)
+		{
+			order.resize(count);
+			std::iota(order.begin(),order.end(),0u);
+			nodes.clear();
+			if (!count)
+				return;
+			nodes.reserve(2u*count);
+			nodes.emplace_back();
+
+			struct STask
+			{
+				uint32_t node;
+				uint32_t begin;
+				uint32_t end;
+				uint32_t depth;
+			};
+			nbl::core::vector<STask> tasks = {{0u,0u,count,0u}};
+			while (!tasks.empty())
+			{
+				const auto task = tasks.back();
+				tasks.pop_back();
+
+				SBox bound, centroidBound;
+				for (auto i=task.begin; i<task.end; i++)
+				{
+					const auto& box = bounds[order[i]];
+					bound.extend(box);
+					const float centroid[3] = {box.getCentroid(0u),box.getCentroid(1u),box.getCentroid(2u)};
+					centroidBound.extend(centroid);
+				}
+				auto& node = nodes[task.node];
+				std::copy_n(bound.min,3u,node.min);
+				std::copy_n(bound.max,3u,node.max);
+				const uint32_t primCount = task.end-task.begin;
+				auto makeLeaf = [&]() -> void
+				{
+					nodes[task.node].offset = task.begin;
+					nodes[task.node].count = primCount;
+				};
+				if (primCount<=maxLeafSize)
+				{
+					makeLeaf();
+					continue;
+				}
+
+				// evaluate every bin boundary on every axis
+				uint32_t bestAxis = ~0u, bestSplit = 0u;
+				float bestCost = FLT_MAX;
+				if (task.depth<MaxSAHDepth)
+				for (auto axis=0u; axis<3u; axis++)
+				{
+					const float extent = centroidBound.max[axis]-centroidBound.min[axis];
+					if (!(extent>0.f))
+						continue;
+					const float scale = float(BinCount)/extent;
+					SBox binBounds[BinCount];
+					uint32_t binCounts[BinCount] = {};
+					for (auto i=task.begin; i<task.end; i++)
+					{
+						const auto& box = bounds[order[i]];
+						const uint32_t bin = nbl::core::min<uint32_t>((box.getCentroid(axis)-centroidBound.min[axis])*scale,BinCount-1u);
+						binBounds[bin].extend(box);
+						binCounts[bin]++;
+					}
+					float rightAreas[BinCount];
+					uint32_t rightCounts[BinCount];
+					{
+						SBox right;
+						uint32_t rightCount = 0u;
+						for (auto bin=BinCount-1u; bin>0u; bin--)
+						{
+							right.extend(binBounds[bin]);
+							rightCount += binCounts[bin];
+							rightAreas[bin] = right.getArea();
+							rightCounts[bin] = rightCount;
+						}
+					}
+					SBox left;
+					uint32_t leftCount = 0u;
+					for (auto split=1u; split<BinCount; split++)
+					{
+						left.extend(binBounds[split-1u]);
+						leftCount += binCounts[split-1u];
+						if (!leftCount || !rightCounts[split])
+							continue;
+						const float cost = left.getArea()*float(leftCount)+rightAreas[split]*float(rightCounts[split]);
+						if (cost<bestCost)
+						{
+							bestCost = cost;
+							bestAxis = axis;
+							bestSplit = split;
+						}
+					}
+				}
+
+				uint32_t middle;
+				if (bestAxis<3u)
+				{
+					// traversal step against testing everything in a leaf
+					const float area = bound.getArea();
+					const float splitCost = 1.f+(area>0.f ? bestCost/area:0.f);
+					if (splitCost>=float(primCount) && primCount<=MaxForcedLeafSize)
+					{
+						makeLeaf();
+						continue;
+					}
+					const float scale = float(BinCount)/(centroidBound.max[bestAxis]-centroidBound.min[bestAxis]);
+					const float minCentroid = centroidBound.min[bestAxis];
+					middle = std::partition(order.begin()+task.begin,order.begin()+task.end,[&](const uint32_t prim) -> bool
+					{
+						return nbl::core::min<uint32_t>((bounds[prim].getCentroid(bestAxis)-minCentroid)*scale,BinCount-1u)<bestSplit;
+					})-order.begin();
+				}
+				else
+				{
+					// centroids all in one spot or too deep for the SAH to be trusted
+					if (primCount<=MaxForcedLeafSize && task.depth<MaxSAHDepth)
+					{
+						makeLeaf();
+						continue;
+					}
+					middle = task.begin+primCount/2u;
+					const float extent[3] = {centroidBound.max[0]-centroidBound.min[0],centroidBound.max[1]-centroidBound.min[1],centroidBound.max[2]-centroidBound.min[2]};
+					const uint32_t axis = extent[0]>=extent[1] ? (extent[0]>=extent[2] ? 0u:2u):(extent[1]>=extent[2] ? 1u:2u);
+					std::nth_element(order.begin()+task.begin,order.begin()+middle,order.begin()+task.end,[&](const uint32_t lhs, const uint32_t rhs) -> bool
+					{
+						return bounds[lhs].getCentroid(axis)<bounds[rhs].getCentroid(axis);
+					});
+				}
+				if (middle==task.begin || middle==task.end)
+					middle = task.begin+primCount/2u;
+
+				const uint32_t children = nodes.size();
+				nodes[task.node].offset = children;
+				nodes[task.node].count = 0u;
+				nodes.emplace_back();
+				nodes.emplace_back();
+				tasks.push_back({children+1u,middle,task.end,task.depth+1u});
+				tasks.push_back({children,task.begin,middle,task.depth+1u});
+			}
+		}
+
+		static inline void invert(const float (&m)[3][4], float (&out)[3][4])
+		{
+			const double a = m[0][0], b = m[0][1], c = m[0][2];
+			const double d = m[1][0], e = m[1][1], f = m[1][2];
+			const double g = m[2][0], h = m[2][1], i = m[2][2];
+			const double cofactors[3][3] = {
+				{e*i-f*h,c*h-b*i,b*f-c*e},
+				{f*g-d*i,a*i-c*g,c*d-a*f},
+				{d*h-e*g,b*g-a*h,a*e-b*d}
+			};
+			const double determinant = a*cofactors[0][0]+b*cofactors[1][0]+c*cofactors[2][0];
+			const double rcpDeterminant = determinant!=0.0 ? 1.0/determinant:0.0;
+			for (auto r=0u; r<3u; r++)
+			{
+				double translation = 0.0;
+				for (auto col=0u; col<3u; col++)
+				{
+					out[r][col] = float(cofactors[r][col]*rcpDeterminant);
+					translation -= cofactors[r][col]*rcpDeterminant*m[col][3];
+				}
+				out[r][3] = float(translation);
+			}
+		}
+		static inline SBox transformBox(const SBox& box, const float (&m)[3][4])
+		{
+			SBox retval;
+			if (!box.valid())
+				return retval;
+			for (auto corner=0u; corner<8u; corner++)
+			{
+				const float point[3] = {corner&0x1u ? box.max[0]:box.min[0],corner&0x2u ? box.max[1]:box.min[1],corner&0x4u ? box.max[2]:box.min[2]};
+				float transformed[3];
+				for (auto r=0u; r<3u; r++)
+					transformed[r] = m[r][0]*point[0]+m[r][1]*point[1]+m[r][2]*point[2]+m[r][3];
+				retval.extend(transformed);
+			}
+			return retval;
+		}
+		static inline void transformRay(const float (&m)[3][4], const float (&origin)[3], const float (&direction)[3], float (&outOrigin)[3], float (&outDirection)[3])
+		{
+			for (auto r=0u; r<3u; r++)
+			{
+				outOrigin[r] = m[r][0]*origin[0]+m[r][1]*origin[1]+m[r][2]*origin[2]+m[r][3];
+				outDirection[r] = m[r][0]*direction[0]+m[r][1]*direction[1]+m[r][2]*direction[2];
+			}
+		}
+		//! zero components get a tiny stand-in so the slabs never see `0*inf`
+		static inline void getReciprocal(const float (&direction)[3], float (&out)[3])
+		{
+			for (auto i=0u; i<3u; i++)
+				out[i] = 1.f/(nbl::core::abs(direction[i])>1e-20f ? direction[i]:std::copysign(1e-20f,direction[i]));
+		}
+
+		static inline float dot(const float* a, const float* b) { return a[0]*b[0]+a[1]*b[1]+a[2]*b[2]; }
+		static inline void cross(const float* a, const float* b, float* out)
+		{
+			out[0] = a[1]*b[2]-a[2]*b[1];
+			out[1] = a[2]*b[0]-a[0]*b[2];
+			out[2] = a[0]*b[1]-a[1]*b[0];
+		}
+		static inline bool normalize(float* v)
+		{
+			const float length = nbl::core::sqrt(dot(v,v));
+			if (!(length>0.f))
+				return false;
+			for (auto i=0u; i<3u; i++)
+				v[i] /= length;
+			return true;
+		}
+		static inline uint32_t pcgHash(const uint32_t input)
+		{
+			const uint32_t state = input*747796405u+2891336453u;
+			const uint32_t word = ((state>>((state>>28u)+4u))^state)*277803737u;
+			return (word>>22u)^word;
+		}
+		static inline ::RadeonRays::ray makeRay(const float* origin, const float* direction, const float maxT)
+		{
+			::RadeonRays::ray retval = {};
+			retval.o.x = origin[0];
+			retval.o.y = origin[1];
+			retval.o.z = origin[2];
+			retval.o.w = maxT;
+			retval.d.x = direction[0];
+			retval.d.y = direction[1];
+			retval.d.z = direction[2];
+			retval.d.w = 0.f;
+			retval.extra.x = -1;
+			retval.extra.y = 1;
+			return retval;
+		}
+
+		nbl::core::vector<SMesh> m_meshes;
+		nbl::core::vector<SInstance> m_instances;
+		//! top level, over the instances
+		nbl::core::vector<SNode> m_nodes;
+		nbl::core::vector<uint32_t> m_instanceOrder;
+		SStats m_stats;
+		bool m_built = false;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include "CommandLineHandler.hpp"
 
 #include <algorithm>
+#include <cstdlib>
 #include <filesystem>
 #include <iostream>
 
@@ -14,12 +15,6 @@ using namespace core;
 
 CommandLineHandler::CommandLineHandler(const std::vector<std::string>& argv)
 {
-	if(argv.size() > MaxRayTracerCommandLineArgs)
-	{
-		std::cout << helpMessage.data() << std::endl;
-		return;
-	}
-	
 	auto logError = [&](const std::string message)
 	{
 		std::cout << "ERROR (" + std::to_string(__LINE__) + " line): " + message << std::endl;
@@ -158,9 +153,13 @@ CommandLineHandler::CommandLineHandler(const std::vector<std::string>& argv)
 	}
 
 	if (!validateParameters() || !success)
+	{
+		std::cout << helpMessage.data() << std::endl;
 		return;
+	}
 
 	performFinalAssignmentStepForUsefulVariables();
+	valid = true;
 }
 
 bool CommandLineHandler::validateParameters()
@@ -169,6 +168,19 @@ bool CommandLineHandler::validateParameters()
 	{
 		std::cout << "ERROR (" + std::to_string(__LINE__) + " line): " + message << std::endl;
 	};
+	// the whole value has to parse, "64x" or "1e" shouldn't quietly become something else
+	auto isPositiveInteger = [](const std::string& value) -> bool
+	{
+		char* end;
+		const long long parsed = std::strtoll(value.c_str(),&end,10);
+		return end!=value.c_str() && *end=='\0' && parsed>0ll && parsed<=0xffffffffll;
+	};
+	auto isPositiveFloat = [](const std::string& value) -> bool
+	{
+		char* end;
+		const float parsed = std::strtof(value.c_str(),&end);
+		return end!=value.c_str() && *end=='\0' && parsed>0.f;
+	};
 
 	if(rawVariables[REA_SCENE].has_value())
 	{
@@ -179,6 +191,38 @@ bool CommandLineHandler::validateParameters()
 			return false;
 		}
 	}
+	if(rawVariables[REA_ADAPTIVE_SAMPLING].has_value())
+	{
+		const auto& threshold = rawVariables[REA_ADAPTIVE_SAMPLING].value();
+		if(threshold.size()!=1u || !isPositiveFloat(threshold[0]))
+		{
+			logError("Expected one positive value for ADAPTIVE_SAMPLING");
+			return false;
+		}
+	}
+	if(rawVariables[REA_RENDER_TILE_SIZE].has_value())
+	{
+		const auto& tileSize = rawVariables[REA_RENDER_TILE_SIZE].value();
+		if(tileSize.size()!=1u || !isPositiveInteger(tileSize[0]))
+		{
+			logError("Expected one positive integer value for RENDER_TILE_SIZE");
+			return false;
+		}
+	}
+	if(rawVariables[REA_BENCHMARK_CSV].has_value() && rawVariables[REA_BENCHMARK_CSV].value().size()!=1u)
+	{
+		logError("Expected one path without spaces for BENCHMARK_CSV");
+		return false;
+	}
+	if(rawVariables[REA_BENCHMARK_SAMPLES].has_value())
+	{
+		const auto& samples = rawVariables[REA_BENCHMARK_SAMPLES].value();
+		if(samples.size()!=1u || !isPositiveInteger(samples[0]))
+		{
+			logError("Expected one positive integer value for BENCHMARK_SAMPLES");
+			return false;
+		}
+	}
 
 	return true;
 }
\ No newline at end of file
@@ -17,6 +17,25 @@ constexpr std::string_view helpMessage = R"(
 Parameters:
 -SCENE=sceneMitsubaXMLPathOrZipAndXML
 -TERMINATE
+-BENCHMARK_SAMPLE_SEQUENCE
+-BENCHMARK_LIGHT_SAMPLING
+-BENCHMARK_CUBEMAP_LAYOUT
+-BENCHMARK_MESH_PACKING
+-STRIP_VERTEX_ATTRIBUTES
+-BENCHMARK_SCENE_CACHE
+-STAGE_TIMINGS
+-BENCHMARK_ADAPTIVE_SAMPLING
+-ADAPTIVE_SAMPLING=threshold
+-RENDER_TILE_SIZE=N
+-RAY_REORDERING
+-BENCHMARK_RAY_REORDERING
+-BENCHMARK_SHADER_CACHE
+-CPU_INTERSECTION
+-BENCHMARK_CPU_INTERSECTION
+-BENCHMARK_SCRAMBLE_KEYS
+-BENCHMARK_CSV=path
+-BENCHMARK_SAMPLES=N
+-NO_SCENE_CACHE
 
 Description and usage: 
 
@@ -25,6 +44,66 @@ Description and usage:
 
 -TERMINATE:
 	which will make the app stop when the required amount of samples has been renderered (its in the Mitsuba Scene metadata) and obviously take screenshot when quitting
+
+-BENCHMARK_SAMPLE_SEQUENCE:
+	times the serial and multithreaded generation of the Low Discrepancy Sample Sequence for the default path depth, checks they and the paged upload match and exits
+
+-BENCHMARK_LIGHT_SAMPLING:
+	compares variance and cost of light selection with the CDF, an alias table and a light tree on synthetic scenes of 1 to 100k lights and exits
+
+-BENCHMARK_CUBEMAP_LAYOUT:
+	round trips the faces of a cubemap through the 3x2, cross and strip layouts in memory, times that against going through EXR files and exits
+
+-BENCHMARK_MESH_PACKING:
+	loads the -SCENE, packs its meshes both in parallel and serially, reports the timings and exits with 1 if the packed buffers differ
+	or, together with -STRIP_VERTEX_ATTRIBUTES, if any triangle would shade differently than without stripping
+
+-STRIP_VERTEX_ATTRIBUTES:
+	packs UVs only for meshbuffers whose materials sample textures and normals only for smooth shaded ones, reports the memory saved
+
+-BENCHMARK_SCENE_CACHE:
+	loads the -SCENE, initializes it once without and once from the scene cache, reports both timings and exits with 1 if the second one did not hit the cache or differs
+
+-STAGE_TIMINGS:
+	times cull, visibility buffer, raygen, intersection, closest hit and resolve per bounce on the CPU and GPU, writes a json and csv report next to every -TERMINATE render and the last view
+
+-BENCHMARK_ADAPTIVE_SAMPLING:
+	runs the adaptive sampling error estimate and tile scheduler on synthetic images, compares against uniform sampling and exits
+
+-ADAPTIVE_SAMPLING=threshold:
+	relative error threshold, with -TERMINATE tiles stop getting samples once their error estimate is below it and the samples they didn't use go to the rest (a tile can get up to 8 times the sensor's sample count), the render ends when all tiles converged or the sensor's sample budget is spent
+
+-RENDER_TILE_SIZE=N:
+	renders sensors wider or taller than N pixels in NxN tiles which get assembled into the output images, bounding the screen sized GPU resources (default: off),
+	the output images get assembled in RAM at 36 bytes a pixel so they can have at most 8192x8192 pixels
+
+-RAY_REORDERING:
+	sorts the rays of every bounce by a Morton code of their origin and direction before intersecting them
+
+-BENCHMARK_RAY_REORDERING:
+	times the CPU reference ray sort, then renders the first sensor with and without ray reordering, checks the GPU sort against the CPU reference and reports per bounce whether the intersection speedup pays for the sort, then exits
+
+-BENCHMARK_SHADER_CACHE:
+	runs the SPIR-V cache self test with a stand-in compiler (restarts, key inputs, corrupted entries, LRU eviction, concurrent instances), needs no GPU, then exits
+
+-CPU_INTERSECTION:
+	intersects rays on the CPU with a SAH BVH instead of RadeonRays, slow but needs no OpenCL
+
+-BENCHMARK_CPU_INTERSECTION:
+	measures the CPU intersector's primary and secondary Mrays/s on the scene without a GPU, then exits
+
+-BENCHMARK_SCRAMBLE_KEYS:
+	times and cross checks serial, parallel and tiled per pixel scramble key generation at 1080p, 4K and 8K, needs no GPU, then exits
+
+-BENCHMARK_CSV=path:
+	renders every sensor like -TERMINATE with the fixed scramble seed, adaptive sampling, denoising and the scene and shader caches off, and appends a row per sensor with the scene's load time, time to first sample, rays/s and total time to the CSV at this path (creating it with a header), see benchmark.bat for running it over test_scenes.txt
+
+-BENCHMARK_SAMPLES=N:
+	samples per pixel every sensor gets with -BENCHMARK_CSV instead of the scene's own sample count
+
+-NO_SCENE_CACHE:
+	neither loads nor writes the packed scene in SceneCache/, which otherwise keeps the least recently used scenes under 4GB
+	(only the mesh packing gets cached, the scene is still loaded in full)
 	
 Example Usages :
 	raytracedao.exe -SCENE=../../media/kitchen.zip scene.xml -TERMINATE
@@ -37,13 +116,49 @@ Example Usages :
 constexpr std::string_view SCENE_VAR_NAME						= "SCENE";
 constexpr std::string_view SCREENSHOT_OUTPUT_FOLDER_VAR_NAME	= "SCREENSHOT_OUTPUT_FOLDER";
 constexpr std::string_view TERMINATE_VAR_NAME					= "TERMINATE";
-
-constexpr uint32_t MaxRayTracerCommandLineArgs = 8;
+constexpr std::string_view BENCHMARK_SAMPLE_SEQUENCE_VAR_NAME	= "BENCHMARK_SAMPLE_SEQUENCE";
+constexpr std::string_view BENCHMARK_LIGHT_SAMPLING_VAR_NAME		= "BENCHMARK_LIGHT_SAMPLING";
+constexpr std::string_view BENCHMARK_CUBEMAP_LAYOUT_VAR_NAME	= "BENCHMARK_CUBEMAP_LAYOUT";
+constexpr std::string_view BENCHMARK_MESH_PACKING_VAR_NAME		= "BENCHMARK_MESH_PACKING";
+constexpr std::string_view STRIP_VERTEX_ATTRIBUTES_VAR_NAME		= "STRIP_VERTEX_ATTRIBUTES";
+constexpr std::string_view BENCHMARK_SCENE_CACHE_VAR_NAME		= "BENCHMARK_SCENE_CACHE";
+constexpr std::string_view STAGE_TIMINGS_VAR_NAME				= "STAGE_TIMINGS";
+constexpr std::string_view BENCHMARK_ADAPTIVE_SAMPLING_VAR_NAME	= "BENCHMARK_ADAPTIVE_SAMPLING";
+constexpr std::string_view ADAPTIVE_SAMPLING_VAR_NAME			= "ADAPTIVE_SAMPLING";
+constexpr std::string_view RENDER_TILE_SIZE_VAR_NAME			= "RENDER_TILE_SIZE";
+constexpr std::string_view RAY_REORDERING_VAR_NAME				= "RAY_REORDERING";
+constexpr std::string_view BENCHMARK_RAY_REORDERING_VAR_NAME	= "BENCHMARK_RAY_REORDERING";
+constexpr std::string_view BENCHMARK_SHADER_CACHE_VAR_NAME		= "BENCHMARK_SHADER_CACHE";
+constexpr std::string_view CPU_INTERSECTION_VAR_NAME			= "CPU_INTERSECTION";
+constexpr std::string_view BENCHMARK_CPU_INTERSECTION_VAR_NAME	= "BENCHMARK_CPU_INTERSECTION";
+constexpr std::string_view BENCHMARK_SCRAMBLE_KEYS_VAR_NAME		= "BENCHMARK_SCRAMBLE_KEYS";
+constexpr std::string_view BENCHMARK_CSV_VAR_NAME				= "BENCHMARK_CSV";
+constexpr std::string_view BENCHMARK_SAMPLES_VAR_NAME			= "BENCHMARK_SAMPLES";
+constexpr std::string_view NO_SCENE_CACHE_VAR_NAME				= "NO_SCENE_CACHE";
 
 enum RaytracerExampleArguments
 {
 	REA_SCENE,
 	REA_TERMINATE,
+	REA_BENCHMARK_SAMPLE_SEQUENCE,
+	REA_BENCHMARK_LIGHT_SAMPLING,
+	REA_BENCHMARK_CUBEMAP_LAYOUT,
+	REA_BENCHMARK_MESH_PACKING,
+	REA_STRIP_VERTEX_ATTRIBUTES,
+	REA_BENCHMARK_SCENE_CACHE,
+	REA_STAGE_TIMINGS,
+	REA_BENCHMARK_ADAPTIVE_SAMPLING,
+	REA_ADAPTIVE_SAMPLING,
+	REA_RENDER_TILE_SIZE,
+	REA_RAY_REORDERING,
+	REA_BENCHMARK_RAY_REORDERING,
+	REA_BENCHMARK_SHADER_CACHE,
+	REA_CPU_INTERSECTION,
+	REA_BENCHMARK_CPU_INTERSECTION,
+	REA_BENCHMARK_SCRAMBLE_KEYS,
+	REA_BENCHMARK_CSV,
+	REA_BENCHMARK_SAMPLES,
+	REA_NO_SCENE_CACHE,
 	REA_COUNT,
 };
 
@@ -65,12 +180,132 @@ class CommandLineHandler
 			return terminate;
 		}
 
+		auto& getBenchmarkSampleSequence() const
+		{
+			return benchmarkSampleSequence;
+		}
+
+		auto& getBenchmarkLightSampling() const
+		{
+			return benchmarkLightSampling;
+		}
+
+		auto& getBenchmarkCubemapLayout() const
+		{
+			return benchmarkCubemapLayout;
+		}
+
+		auto& getBenchmarkMeshPacking() const
+		{
+			return benchmarkMeshPacking;
+		}
+
+		auto& getStripVertexAttributes() const
+		{
+			return stripVertexAttributes;
+		}
+
+		auto& getBenchmarkSceneCache() const
+		{
+			return benchmarkSceneCache;
+		}
+
+		auto& getStageTimings() const
+		{
+			return stageTimings;
+		}
+
+		auto& getBenchmarkAdaptiveSampling() const
+		{
+			return benchmarkAdaptiveSampling;
+		}
+
+		auto& getAdaptiveSamplingThreshold() const
+		{
+			return adaptiveSamplingThreshold;
+		}
+
+		auto& getRenderTileSize() const
+		{
+			return renderTileSize;
+		}
+
+		auto& getRayReordering() const
+		{
+			return rayReordering;
+		}
+
+		auto& getBenchmarkRayReordering() const
+		{
+			return benchmarkRayReordering;
+		}
+
+		auto& getBenchmarkShaderCache() const
+		{
+			return benchmarkShaderCache;
+		}
+
+		auto& getCPUIntersection() const
+		{
+			return cpuIntersection;
+		}
+
+		auto& getBenchmarkCPUIntersection() const
+		{
+			return benchmarkCPUIntersection;
+		}
+
+		auto& getBenchmarkScrambleKeys() const
+		{
+			return benchmarkScrambleKeys;
+		}
+
+		auto& getBenchmarkCSV() const
+		{
+			return benchmarkCSV;
+		}
+
+		auto& getBenchmarkSamples() const
+		{
+			return benchmarkSamples;
+		}
+
+		auto& getNoSceneCache() const
+		{
+			return noSceneCache;
+		}
+
+		//! false when the command line had an unknown, repeated or malformed option, none of the options get applied then
+		bool isValid() const
+		{
+			return valid;
+		}
+
 	private:
 
 		void initializeMatchingMap()
 		{
 			rawVariables[REA_SCENE];
 			rawVariables[REA_TERMINATE];
+			rawVariables[REA_BENCHMARK_SAMPLE_SEQUENCE];
+			rawVariables[REA_BENCHMARK_LIGHT_SAMPLING];
+			rawVariables[REA_BENCHMARK_CUBEMAP_LAYOUT];
+			rawVariables[REA_BENCHMARK_MESH_PACKING];
+			rawVariables[REA_STRIP_VERTEX_ATTRIBUTES];
+			rawVariables[REA_BENCHMARK_SCENE_CACHE];
+			rawVariables[REA_STAGE_TIMINGS];
+			rawVariables[REA_BENCHMARK_ADAPTIVE_SAMPLING];
+			rawVariables[REA_ADAPTIVE_SAMPLING];
+			rawVariables[REA_RENDER_TILE_SIZE];
+			rawVariables[REA_RAY_REORDERING];
+			rawVariables[REA_BENCHMARK_RAY_REORDERING];
+			rawVariables[REA_BENCHMARK_SHADER_CACHE];
+			rawVariables[REA_CPU_INTERSECTION];
+			rawVariables[REA_BENCHMARK_CPU_INTERSECTION];
+			rawVariables[REA_BENCHMARK_SCRAMBLE_KEYS];
+			rawVariables[REA_BENCHMARK_CSV];
+			rawVariables[REA_BENCHMARK_SAMPLES];
+			rawVariables[REA_NO_SCENE_CACHE];
 		}
 
 		RaytracerExampleArguments getMatchedVariableMapID(const std::string& variableName)
@@ -79,6 +314,44 @@ class CommandLineHandler
 				return REA_SCENE;
 			else if (variableName == TERMINATE_VAR_NAME)
 				return REA_TERMINATE;
+			else if (variableName == BENCHMARK_SAMPLE_SEQUENCE_VAR_NAME)
+				return REA_BENCHMARK_SAMPLE_SEQUENCE;
+			else if (variableName == BENCHMARK_LIGHT_SAMPLING_VAR_NAME)
+				return REA_BENCHMARK_LIGHT_SAMPLING;
+			else if (variableName == BENCHMARK_CUBEMAP_LAYOUT_VAR_NAME)
+				return REA_BENCHMARK_CUBEMAP_LAYOUT;
+			else if (variableName == BENCHMARK_MESH_PACKING_VAR_NAME)
+				return REA_BENCHMARK_MESH_PACKING;
+			else if (variableName == STRIP_VERTEX_ATTRIBUTES_VAR_NAME)
+				return REA_STRIP_VERTEX_ATTRIBUTES;
+			else if (variableName == BENCHMARK_SCENE_CACHE_VAR_NAME)
+				return REA_BENCHMARK_SCENE_CACHE;
+			else if (variableName == STAGE_TIMINGS_VAR_NAME)
+				return REA_STAGE_TIMINGS;
+			else if (variableName == BENCHMARK_ADAPTIVE_SAMPLING_VAR_NAME)
+				return REA_BENCHMARK_ADAPTIVE_SAMPLING;
+			else if (variableName == ADAPTIVE_SAMPLING_VAR_NAME)
+				return REA_ADAPTIVE_SAMPLING;
+			else if (variableName == RENDER_TILE_SIZE_VAR_NAME)
+				return REA_RENDER_TILE_SIZE;
+			else if (variableName == RAY_REORDERING_VAR_NAME)
+				return REA_RAY_REORDERING;
+			else if (variableName == BENCHMARK_RAY_REORDERING_VAR_NAME)
+				return REA_BENCHMARK_RAY_REORDERING;
+			else if (variableName == BENCHMARK_SHADER_CACHE_VAR_NAME)
+				return REA_BENCHMARK_SHADER_CACHE;
+			else if (variableName == CPU_INTERSECTION_VAR_NAME)
+				return REA_CPU_INTERSECTION;
+			else if (variableName == BENCHMARK_CPU_INTERSECTION_VAR_NAME)
+				return REA_BENCHMARK_CPU_INTERSECTION;
+			else if (variableName == BENCHMARK_SCRAMBLE_KEYS_VAR_NAME)
+				return REA_BENCHMARK_SCRAMBLE_KEYS;
+			else if (variableName == BENCHMARK_CSV_VAR_NAME)
+				return REA_BENCHMARK_CSV;
+			else if (variableName == BENCHMARK_SAMPLES_VAR_NAME)
+				return REA_BENCHMARK_SAMPLES;
+			else if (variableName == NO_SCENE_CACHE_VAR_NAME)
+				return REA_NO_SCENE_CACHE;
 			else
 				return REA_COUNT;
 		}
@@ -91,6 +364,44 @@ class CommandLineHandler
 				sceneDirectory = rawVariables[REA_SCENE].value();
 			if(rawVariables[REA_TERMINATE].has_value())
 				terminate = true;
+			if(rawVariables[REA_BENCHMARK_SAMPLE_SEQUENCE].has_value())
+				benchmarkSampleSequence = true;
+			if(rawVariables[REA_BENCHMARK_LIGHT_SAMPLING].has_value())
+				benchmarkLightSampling = true;
+			if(rawVariables[REA_BENCHMARK_CUBEMAP_LAYOUT].has_value())
+				benchmarkCubemapLayout = true;
+			if(rawVariables[REA_BENCHMARK_MESH_PACKING].has_value())
+				benchmarkMeshPacking = true;
+			if(rawVariables[REA_STRIP_VERTEX_ATTRIBUTES].has_value())
+				stripVertexAttributes = true;
+			if(rawVariables[REA_BENCHMARK_SCENE_CACHE].has_value())
+				benchmarkSceneCache = true;
+			if(rawVariables[REA_STAGE_TIMINGS].has_value())
+				stageTimings = true;
+			if(rawVariables[REA_BENCHMARK_ADAPTIVE_SAMPLING].has_value())
+				benchmarkAdaptiveSampling = true;
+			if(rawVariables[REA_ADAPTIVE_SAMPLING].has_value())
+				adaptiveSamplingThreshold = std::stof(rawVariables[REA_ADAPTIVE_SAMPLING].value()[0]);
+			if(rawVariables[REA_RENDER_TILE_SIZE].has_value())
+				renderTileSize = std::stoul(rawVariables[REA_RENDER_TILE_SIZE].value()[0]);
+			if(rawVariables[REA_RAY_REORDERING].has_value())
+				rayReordering = true;
+			if(rawVariables[REA_BENCHMARK_RAY_REORDERING].has_value())
+				benchmarkRayReordering = true;
+			if(rawVariables[REA_BENCHMARK_SHADER_CACHE].has_value())
+				benchmarkShaderCache = true;
+			if(rawVariables[REA_CPU_INTERSECTION].has_value())
+				cpuIntersection = true;
+			if(rawVariables[REA_BENCHMARK_CPU_INTERSECTION].has_value())
+				benchmarkCPUIntersection = true;
+			if(rawVariables[REA_BENCHMARK_SCRAMBLE_KEYS].has_value())
+				benchmarkScrambleKeys = true;
+			if(rawVariables[REA_BENCHMARK_CSV].has_value())
+				benchmarkCSV = rawVariables[REA_BENCHMARK_CSV].value()[0];
+			if(rawVariables[REA_BENCHMARK_SAMPLES].has_value())
+				benchmarkSamples = std::stoul(rawVariables[REA_BENCHMARK_SAMPLES].value()[0]);
+			if(rawVariables[REA_NO_SCENE_CACHE].has_value())
+				noSceneCache = true;
 		}
 
 		variablesType rawVariables;
@@ -99,6 +410,26 @@ class CommandLineHandler
 		std::vector<std::string> sceneDirectory; // [0] zip [1] optional xml in zip
 		std::string outputScreenshotsFolderPath;
 		bool terminate = false;
+		bool benchmarkSampleSequence = false;
+		bool benchmarkLightSampling = false;
+		bool benchmarkCubemapLayout = false;
+		bool benchmarkMeshPacking = false;
+		bool stripVertexAttributes = false;
+		bool benchmarkSceneCache = false;
+		bool stageTimings = false;
+		bool benchmarkAdaptiveSampling = false;
+		float adaptiveSamplingThreshold = 0.f;
+		uint32_t renderTileSize = 0u;
+		bool rayReordering = false;
+		bool benchmarkRayReordering = false;
+		bool benchmarkShaderCache = false;
+		bool cpuIntersection = false;
+		bool benchmarkCPUIntersection = false;
+		bool benchmarkScrambleKeys = false;
+		std::string benchmarkCSV;
+		uint32_t benchmarkSamples = 0u;
+		bool noSceneCache = false;
+		bool valid = false;
 };
 
 #endif // _DENOISER_TONEMAPPER_COMMAND_LINE_HANDLER_
\ No newline at end of file
@@ -0,0 +1,345 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _CUBEMAP_LAYOUT_H_INCLUDED_
+#define _CUBEMAP_LAYOUT_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <random>
+
+
+//! Places the six faces of a cubemap render into one 2D image and takes them back out, so they can get post processed together.
+//! Every face sits in a cell with `padding` texels of its own edge replicated around it, this keeps the denoiser and bloom
+//! from pulling in texels of whatever unrelated face happens to be the neighbouring cell.
+//! Faces are in the order the cubemap sensors get rendered in, +X -X +Y -Y +Z -Z.
+//! Works on raw texels of any uncompressed format, rows get copied on all threads.
+class CubemapLayout
+{
+	public:
+		enum E_TYPE : uint32_t
+		{
+			//! +X -X +Y on top, -Y +Z -Z below, what the old merge scripts produced
+			ET_3X2,
+			//! -X +Z +X -Z in the middle row, +Y above and -Y below +Z, unused cells are zero
+			ET_HORIZONTAL_CROSS,
+			//! all faces in one row
+			ET_HORIZONTAL_STRIP,
+			ET_COUNT
+		};
+		static inline const char* getTypeName(const E_TYPE type)
+		{
+			constexpr const char* names[ET_COUNT] = {"3x2","horizontal cross","horizontal strip"};
+			return names[type];
+		}
+
+		struct STexels
+		{
+			uint8_t* data;
+			//! in bytes
+			size_t rowPitch;
+		};
+		struct SConstTexels
+		{
+			const uint8_t* data;
+			size_t rowPitch;
+		};
+
+		CubemapLayout(const E_TYPE type, const uint32_t faceSize, const uint32_t padding=0u) : m_type(type), m_faceSize(faceSize), m_padding(padding) {}
+
+		inline uint32_t getCellSize() const { return m_faceSize+2u*m_padding; }
+		inline uint32_t getWidth() const { return getCellSize()*getGrid()[0]; }
+		inline uint32_t getHeight() const { return getCellSize()*getGrid()[1]; }
+
+		//! top left texel of the face itself, not of its padding
+		inline void getFaceOrigin(const uint32_t face, uint32_t& x, uint32_t& y) const
+		{
+			constexpr uint32_t cells[ET_COUNT][6][2] = {
+				{{0u,0u},{1u,0u},{2u,0u},{0u,1u},{1u,1u},{2u,1u}},
+				{{2u,1u},{0u,1u},{1u,0u},{1u,2u},{1u,1u},{3u,1u}},
+				{{0u,0u},{1u,0u},{2u,0u},{3u,0u},{4u,0u},{5u,0u}}
+			};
+			x = cells[m_type][face][0]*getCellSize()+m_padding;
+			y = cells[m_type][face][1]*getCellSize()+m_padding;
+		}
+
+		//! `out` needs to be `getWidth()` x `getHeight()` and zeroed if the layout has unused cells
+		inline void merge(const SConstTexels faces[6], const uint32_t texelSize, const STexels out) const
+		{
+			const uint32_t cellSize = getCellSize();
+			const size_t faceRowSize = size_t(m_faceSize)*texelSize;
+			forEachRow(6u*cellSize,[&](const uint32_t row)
+			{
+				const uint32_t face = row/cellSize;
+				const uint32_t cellRow = row%cellSize;
+				uint32_t x,y;
+				getFaceOrigin(face,x,y);
+				// clamp to the edge rows of the face within the padding
+				const uint32_t srcRow = nbl::core::min(uint32_t(nbl::core::max(int32_t(cellRow)-int32_t(m_padding),0)),m_faceSize-1u);
+				const uint8_t* src = faces[face].data+srcRow*faces[face].rowPitch;
+				uint8_t* dst = out.data+(size_t(y)-m_padding+cellRow)*out.rowPitch+(size_t(x)-m_padding)*texelSize;
+				for (uint32_t i=0u; i<m_padding; i++)
+					memcpy(dst+size_t(i)*texelSize,src,texelSize);
+				memcpy(dst+size_t(m_padding)*texelSize,src,faceRowSize);
+				for (uint32_t i=0u; i<m_padding; i++)
+					memcpy(dst+size_t(m_padding+m_faceSize+i)*texelSize,src+faceRowSize-texelSize,texelSize);
+			});
+		}
+
+		//! copies the face without its padding and `crop` texels off every side, so `out` needs to be `getFaceSize()-2*crop` square
+		inline void extract(const SConstTexels merged, const uint32_t face, const uint32_t crop, const uint32_t texelSize, const STexels out) const
+		{
+			uint32_t x,y;
+			getFaceOrigin(face,x,y);
+			const uint32_t size = m_faceSize-2u*crop;
+			forEachRow(size,[&](const uint32_t row)
+			{
+				memcpy(out.data+row*out.rowPitch,merged.data+(size_t(y)+crop+row)*merged.rowPitch+(size_t(x)+crop)*texelSize,size_t(size)*texelSize);
+			});
+		}
+
+		inline uint32_t getFaceSize() const { return m_faceSize; }
+		inline uint32_t getPadding() const { return m_padding; }
+		inline E_TYPE getType() const { return m_type; }
+
+		//! `ICPUImage` versions of the above, the faces need to be square, same size and format, the result has tightly packed rows
+		inline nbl::core::smart_refctd_ptr<nbl::asset::ICPUImage> merge(const nbl::asset::ICPUImage* const faces[6]) const
+		{
+			const auto format = faces[0]->getCreationParameters().format;
+			const uint32_t texelSize = nbl::asset::getTexelOrBlockBytesize(format);
+			SConstTexels texels[6];
+			for (auto f=0u; f<6u; f++)
+			{
+				assert(faces[f]->getCreationParameters().format==format);
+				assert(faces[f]->getCreationParameters().extent.width==m_faceSize && faces[f]->getCreationParameters().extent.height==m_faceSize);
+				texels[f] = getTexels(faces[f]);
+			}
+			auto retval = createImage(format,getWidth(),getHeight());
+			auto* data = reinterpret_cast<uint8_t*>(retval->getBuffer()->getPointer());
+			memset(data,0,retval->getBuffer()->getSize());
+			merge(texels,texelSize,{data,size_t(getWidth())*texelSize});
+			return retval;
+		}
+		inline nbl::core::smart_refctd_ptr<nbl::asset::ICPUImage> extract(const nbl::asset::ICPUImage* merged, const uint32_t face, const uint32_t crop) const
+		{
+			const auto format = merged->getCreationParameters().format;
+			const uint32_t texelSize = nbl::asset::getTexelOrBlockBytesize(format);
+			const uint32_t size = m_faceSize-2u*crop;
+			auto retval = createImage(format,size,size);
+			extract(getTexels(merged),face,crop,texelSize,{reinterpret_cast<uint8_t*>(retval->getBuffer()->getPointer()),size_t(size)*texelSize});
+			return retval;
+		}
+
+		//! Round trips random faces through every layout in memory, and times that against the path through files the renderer used to take
+		//! (write the faces, read them back, merge, write the merged image, read it back, extract and write the faces), returns false on any mismatch
+		static inline bool benchmark(nbl::asset::IAssetManager* assetManager, const uint32_t faceSize, const uint32_t crop)
+		{
+			using namespace nbl;
+			using namespace nbl::asset;
+			constexpr auto Format = EF_R16G16B16A16_SFLOAT;
+			const uint32_t texelSize = getTexelOrBlockBytesize(Format);
+
+			core::smart_refctd_ptr<ICPUImage> faces[6];
+			const ICPUImage* facePtrs[6];
+			{
+				std::mt19937 rng(0xc0be3a9u);
+				std::uniform_real_distribution<double> dist(0.0,16.0);
+				for (auto f=0u; f<6u; f++)
+				{
+					faces[f] = createImage(Format,faceSize,faceSize);
+					auto* data = reinterpret_cast<uint8_t*>(faces[f]->getBuffer()->getPointer());
+					for (size_t i=0u; i<size_t(faceSize)*faceSize; i++)
+					{
+						const double texel[4] = {dist(rng),dist(rng),dist(rng),1.0};
+						encodePixelsRuntime(Format,data+i*texelSize,texel);
+					}
+					facePtrs[f] = faces[f].get();
+				}
+			}
+			auto matchesFace = [&](const ICPUImage* extracted, const uint32_t face) -> bool
+			{
+				const auto* expected = reinterpret_cast<const uint8_t*>(faces[face]->getBuffer()->getPointer());
+				const auto* actual = reinterpret_cast<const uint8_t*>(extracted->getBuffer()->getPointer());
+				const uint32_t size = faceSize-2u*crop;
+				if (extracted->getCreationParameters().extent.width!=size || extracted->getCreationParameters().extent.height!=size)
+					return false;
+				for (uint32_t y=0u; y<size; y++)
+				if (memcmp(actual+size_t(y)*size*texelSize,expected+((size_t(y)+crop)*faceSize+crop)*texelSize,size_t(size)*texelSize)!=0)
+					return false;
+				return true;
+			};
+			auto time = [](auto&& func) -> double
+			{
+				const auto start = std::chrono::steady_clock::now();
+				func();
+				return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+			};
+
+			bool success = true;
+			for (auto type=0u; type<ET_COUNT; type++)
+			for (const uint32_t padding : {0u,32u})
+			{
+				const CubemapLayout layout(static_cast<E_TYPE>(type),faceSize,padding);
+				core::smart_refctd_ptr<ICPUImage> merged,extracted[6];
+				const double ms = time([&]()
+				{
+					merged = layout.merge(facePtrs);
+					for (auto f=0u; f<6u; f++)
+						extracted[f] = layout.extract(merged.get(),f,crop);
+				});
+				bool roundTrips = true;
+				for (auto f=0u; f<6u; f++)
+					roundTrips = roundTrips && matchesFace(extracted[f].get(),f);
+				// the padding has to be the replicated face edge, check the corner of +Z
+				if (padding)
+				{
+					uint32_t x,y;
+					layout.getFaceOrigin(4u,x,y);
+					const auto* data = reinterpret_cast<const uint8_t*>(merged->getBuffer()->getPointer());
+					const auto* corner = reinterpret_cast<const uint8_t*>(faces[4]->getBuffer()->getPointer());
+					roundTrips = roundTrips && memcmp(data+(size_t(y-padding)*layout.getWidth()+x-padding)*texelSize,corner,texelSize)==0;
+				}
+				printf("[INFO] Cubemap %s layout with %d texel padding, %dx%d: in-memory merge and extract of %d^2 faces %.2f ms, round trip %s\n",
+					getTypeName(layout.getType()),padding,layout.getWidth(),layout.getHeight(),faceSize,ms,roundTrips ? "matches":"MISMATCH");
+				success = success && roundTrips;
+			}
+
+			// what denoiseCubemapFaces used to do minus the ImageMagick processes it spawned, so the real cost was even higher
+			{
+				const CubemapLayout layout(ET_3X2,faceSize);
+				const std::string prefix = "cubemap_layout_benchmark";
+				core::smart_refctd_ptr<ICPUImage> extracted[6];
+				asset::IAssetLoader::SAssetLoadParams lp(0ull,nullptr);
+				auto load = [&](const std::string& path) -> core::smart_refctd_ptr<ICPUImage>
+				{
+					auto bundle = assetManager->getAsset(path,lp);
+					if (bundle.getContents().empty())
+						return nullptr;
+					return core::smart_refctd_ptr_static_cast<ICPUImage>(bundle.getContents().begin()[0]);
+				};
+				bool loaded = true;
+				const double ms = time([&]()
+				{
+					for (auto f=0u; f<6u; f++)
+						write(assetManager,faces[f].get(),prefix+"_face"+std::to_string(f)+".exr");
+					core::smart_refctd_ptr<ICPUImage> reloaded[6];
+					const ICPUImage* reloadedPtrs[6];
+					for (auto f=0u; f<6u; f++)
+					{
+						reloaded[f] = load(prefix+"_face"+std::to_string(f)+".exr");
+						loaded = loaded && reloaded[f] && reloaded[f]->getCreationParameters().format==Format;
+						reloadedPtrs[f] = reloaded[f].get();
+					}
+					if (!loaded)
+						return;
+					write(assetManager,layout.merge(reloadedPtrs).get(),prefix+"_merged.exr");
+					auto merged = load(prefix+"_merged.exr");
+					if (!(loaded = merged && merged->getCreationParameters().format==Format))
+						return;
+					for (auto f=0u; f<6u; f++)
+					{
+						extracted[f] = layout.extract(merged.get(),f,crop);
+						write(assetManager,extracted[f].get(),prefix+"_face"+std::to_string(f)+"_extracted.exr");
+					}
+				});
+				for (auto f=0u; f<6u; f++)
+				{
+					std::error_code ec;
+					std::filesystem::remove(prefix+"_face"+std::to_string(f)+".exr",ec);
+					std::filesystem::remove(prefix+"_face"+std::to_string(f)+"_extracted.exr",ec);
+				}
+				std::error_code ec;
+				std::filesystem::remove(prefix+"_merged.exr",ec);
+
+				if (!loaded)
+				{
+					printf("[ERROR] Cubemap disk path could not read back the EXRs it wrote!\n");
+					return false;
+				}
+				bool roundTrips = true;
+				for (auto f=0u; f<6u; f++)
+					roundTrips = roundTrips && matchesFace(extracted[f].get(),f);
+				printf("[INFO] Cubemap 3x2 layout through files: %.2f ms, round trip %s\n",ms,roundTrips ? "matches":"MISMATCH");
+				success = success && roundTrips;
+			}
+			return success;
+		}
+
+	private:
+		inline const uint32_t* getGrid() const
+		{
+			static constexpr uint32_t grids[ET_COUNT][2] = {{3u,2u},{4u,3u},{6u,1u}};
+			return grids[m_type];
+		}
+
+		template<typename F>
+		static inline void forEachRow(const uint32_t rowCount, F&& func)
+		{
+			nbl::core::vector<uint32_t> rows(rowCount);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),func);
+		}
+
+		static inline SConstTexels getTexels(const nbl::asset::ICPUImage* image)
+		{
+			const auto& params = image->getCreationParameters();
+			const auto& region = image->getRegions().begin()[0];
+			const uint32_t rowLength = region.bufferRowLength ? region.bufferRowLength:params.extent.width;
+			return {reinterpret_cast<const uint8_t*>(image->getBuffer()->getPointer())+region.bufferOffset,size_t(rowLength)*nbl::asset::getTexelOrBlockBytesize(params.format)};
+		}
+
+		static inline nbl::core::smart_refctd_ptr<nbl::asset::ICPUImage> createImage(const nbl::asset::E_FORMAT format, const uint32_t width, const uint32_t height)
+		{
+			using namespace nbl::asset;
+			ICPUImage::SCreationParams imgParams;
+			imgParams.flags = static_cast<ICPUImage::E_CREATE_FLAGS>(0u);
+			imgParams.type = ICPUImage::ET_2D;
+			imgParams.format = format;
+			imgParams.extent = {width,height,1u};
+			imgParams.mipLevels = 1u;
+			imgParams.arrayLayers = 1u;
+			imgParams.samples = ICPUImage::ESCF_1_BIT;
+
+			auto regions = nbl::core::make_refctd_dynamic_array<nbl::core::smart_refctd_dynamic_array<ICPUImage::SBufferCopy>>(1u);
+			{
+				auto& region = regions->front();
+				region.bufferOffset = 0u;
+				region.bufferRowLength = width;
+				region.bufferImageHeight = height;
+				region.imageSubresource.mipLevel = 0u;
+				region.imageSubresource.baseArrayLayer = 0u;
+				region.imageSubresource.layerCount = 1u;
+				region.imageOffset = {0u,0u,0u};
+				region.imageExtent = imgParams.extent;
+			}
+			auto buffer = nbl::core::make_smart_refctd_ptr<ICPUBuffer>(size_t(width)*height*getTexelOrBlockBytesize(format));
+			auto image = ICPUImage::create(std::move(imgParams));
+			image->setBufferAndRegions(std::move(buffer),regions);
+			return image;
+		}
+
+		static inline void write(nbl::asset::IAssetManager* assetManager, nbl::asset::ICPUImage* image, const std::string& path)
+		{
+			using namespace nbl::asset;
+			ICPUImageView::SCreationParams viewParams;
+			viewParams.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
+			viewParams.format = image->getCreationParameters().format;
+			viewParams.image = nbl::core::smart_refctd_ptr<ICPUImage>(image);
+			viewParams.viewType = ICPUImageView::ET_2D;
+			viewParams.subresourceRange = {static_cast<IImage::E_ASPECT_FLAGS>(0u),0u,1u,0u,1u};
+			auto imageView = ICPUImageView::create(std::move(viewParams));
+			IAssetWriter::SAssetWriteParams wp(imageView.get());
+			assetManager->writeAsset(path,wp);
+		}
+
+		E_TYPE m_type;
+		uint32_t m_faceSize;
+		uint32_t m_padding;
+};
+
+#endif
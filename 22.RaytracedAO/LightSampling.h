@@ -0,0 +1,445 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _LIGHT_SAMPLING_H_INCLUDED_
+#define _LIGHT_SAMPLING_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <cfloat>
+#include <chrono>
+#include <numeric>
+
+
+//! CPU reference implementations of the light selection strategies, all of them hand out the probability of the light they picked
+//! so the estimators can be compared on variance as well as on cost, see `LightSamplingBenchmark`.
+
+//! The quantized uint32 CDF `Renderer::finalizeScene` uploads, selection is a binary search
+class LightCDFSampler
+{
+	public:
+		//! the last entry is never searched, any `xi` past the second to last entry picks the last light,
+		//! `outCDF` may alias the weights like it does in `Renderer::InitializationData`, every weight is read before its entry gets written
+		template<typename WeightIt, typename CDFIt>
+		static inline void computeCDF(WeightIt weightBegin, WeightIt weightEnd, CDFIt outCDF)
+		{
+			const double weightSum = std::accumulate(weightBegin,weightEnd,0.0);
+			assert(weightSum>FLT_MIN);
+
+			constexpr double UINT_MAX_DOUBLE = double(0x1ull<<32ull);
+			const double weightSumRcp = UINT_MAX_DOUBLE/weightSum;
+
+			double partialSum = 0.0;
+			for (; weightBegin!=weightEnd; weightBegin++,outCDF++)
+			{
+				partialSum += double(*weightBegin);
+				const double exactCDF = weightSumRcp*partialSum+double(FLT_MIN);
+				if (exactCDF<UINT_MAX_DOUBLE)
+					*outCDF = static_cast<uint32_t>(exactCDF);
+				else
+				{
+					assert(exactCDF<UINT_MAX_DOUBLE+1.0);
+					*outCDF = 0xdeadbeefu;
+				}
+			}
+		}
+
+		inline bool build(const float* weights, const uint32_t count)
+		{
+			if (count==0u || !(std::accumulate(weights,weights+count,0.0)>FLT_MIN))
+				return false;
+			m_cdf.resize(count);
+			computeCDF(weights,weights+count,m_cdf.begin());
+			return true;
+		}
+
+		inline uint32_t sample(const double xi, double& pdf) const
+		{
+			const uint32_t xi32 = static_cast<uint32_t>(nbl::core::min(xi,1.0-DBL_EPSILON)*double(0x1ull<<32ull));
+			const uint32_t light = std::upper_bound(m_cdf.begin(),m_cdf.end()-1,xi32)-m_cdf.begin();
+			pdf = this->pdf(light);
+			return light;
+		}
+
+		inline double pdf(const uint32_t light) const
+		{
+			const uint64_t end = light+1u<m_cdf.size() ? m_cdf[light]:(0x1ull<<32ull);
+			const uint64_t begin = light ? m_cdf[light-1u]:0ull;
+			return double(end-begin)/double(0x1ull<<32ull);
+		}
+
+		inline size_t getByteSize() const { return m_cdf.size()*sizeof(uint32_t); }
+
+	private:
+		nbl::core::vector<uint32_t> m_cdf;
+};
+
+//! Walker/Vose alias table, O(1) selection with one fetch of an (acceptance threshold, alias) pair,
+//! the threshold is quantized to 32 bits and the PDFs are derived from the quantized table so they agree with what gets sampled
+class LightAliasTable
+{
+	public:
+		struct SEntry
+		{
+			uint32_t threshold;
+			uint32_t alias;
+		};
+
+		inline bool build(const float* weights, const uint32_t count)
+		{
+			const double weightSum = std::accumulate(weights,weights+count,0.0);
+			if (count==0u || !(weightSum>FLT_MIN))
+				return false;
+
+			const double scale = double(count)/weightSum;
+			nbl::core::vector<double> threshold(count);
+			nbl::core::vector<uint32_t> small,large;
+			m_entries.resize(count);
+			for (uint32_t i=0u; i<count; i++)
+			{
+				threshold[i] = double(weights[i])*scale;
+				m_entries[i].alias = i;
+				(threshold[i]<1.0 ? small:large).push_back(i);
+			}
+			while (!small.empty() && !large.empty())
+			{
+				const uint32_t s = small.back();
+				small.pop_back();
+				const uint32_t l = large.back();
+				m_entries[s].alias = l;
+				threshold[l] -= 1.0-threshold[s];
+				if (threshold[l]<1.0)
+				{
+					large.pop_back();
+					small.push_back(l);
+				}
+			}
+			// whatever remains is only off from 1.0 due to floating point error and samples itself
+			for (const auto i : small)
+				m_entries[i].alias = i;
+			for (const auto i : large)
+				m_entries[i].alias = i;
+
+			constexpr double ThresholdMax = double(0x1ull<<32ull);
+			nbl::core::vector<double> mass(count,0.0);
+			for (uint32_t i=0u; i<count; i++)
+			{
+				auto& entry = m_entries[i];
+				if (entry.alias==i)
+				{
+					entry.threshold = ~0u;
+					mass[i] += 1.0;
+					continue;
+				}
+				entry.threshold = static_cast<uint32_t>(nbl::core::min(threshold[i]*ThresholdMax+0.5,ThresholdMax-1.0));
+				const double accept = double(entry.threshold)/ThresholdMax;
+				mass[i] += accept;
+				mass[entry.alias] += 1.0-accept;
+			}
+			m_probability.resize(count);
+			std::transform(mass.begin(),mass.end(),m_probability.begin(),[count](const double m){return m/double(count);});
+			return true;
+		}
+
+		inline uint32_t sample(const double xi, double& pdf) const
+		{
+			const uint32_t count = m_entries.size();
+			const double scaled = xi*double(count);
+			const uint32_t cell = nbl::core::min(static_cast<uint32_t>(scaled),count-1u);
+			const auto& entry = m_entries[cell];
+			const uint32_t light = entry.alias==cell || (scaled-double(cell))*double(0x1ull<<32ull)<double(entry.threshold) ? cell:entry.alias;
+			pdf = m_probability[light];
+			return light;
+		}
+
+		inline double pdf(const uint32_t light) const { return m_probability[light]; }
+
+		//! ready to be uploaded as an R32G32_UINT texel buffer
+		inline const nbl::core::vector<SEntry>& getEntries() const { return m_entries; }
+		inline size_t getByteSize() const { return m_entries.size()*sizeof(SEntry); }
+
+	private:
+		nbl::core::vector<SEntry> m_entries;
+		nbl::core::vector<double> m_probability;
+};
+
+//! Binary BVH over the lights where every node keeps the bounds and total flux of its subtree, traversal picks a child
+//! with probability proportional to a conservative estimate of its contribution to the shading point, so unlike the two
+//! above the distribution adapts to where we're shading and far away lights stop stealing samples from close ones.
+class LightTree
+{
+	public:
+		struct SLight
+		{
+			float minEdge[3];
+			float maxEdge[3];
+			float flux;
+		};
+
+		inline bool build(const SLight* lights, const uint32_t count)
+		{
+			if (count==0u)
+				return false;
+			m_nodes.clear();
+			m_nodes.reserve(count*2u-1u);
+			m_leafOfLight.resize(count);
+
+			nbl::core::vector<uint32_t> order(count);
+			std::iota(order.begin(),order.end(),0u);
+			buildNode(lights,order.data(),order.data()+count,InvalidNode);
+			return m_nodes.front().flux>FLT_MIN;
+		}
+
+		inline uint32_t sample(const float shadingPoint[3], double xi, double& pdf) const
+		{
+			pdf = 1.0;
+			uint32_t nodeIx = 0u;
+			while (!m_nodes[nodeIx].isLeaf())
+			{
+				const auto& node = m_nodes[nodeIx];
+				const double leftProb = computeLeftProbability(node,shadingPoint);
+				if (xi<leftProb)
+				{
+					xi = nbl::core::min(xi/leftProb,1.0-DBL_EPSILON);
+					pdf *= leftProb;
+					nodeIx = node.children[0];
+				}
+				else
+				{
+					xi = nbl::core::min((xi-leftProb)/(1.0-leftProb),1.0-DBL_EPSILON);
+					pdf *= 1.0-leftProb;
+					nodeIx = node.children[1];
+				}
+			}
+			return m_nodes[nodeIx].children[1];
+		}
+
+		//! walks from the light's leaf up to the root, O(log N)
+		inline double pdf(const float shadingPoint[3], const uint32_t light) const
+		{
+			double pdf = 1.0;
+			for (uint32_t nodeIx=m_leafOfLight[light]; m_nodes[nodeIx].parent!=InvalidNode; nodeIx=m_nodes[nodeIx].parent)
+			{
+				const auto& parent = m_nodes[m_nodes[nodeIx].parent];
+				const double leftProb = computeLeftProbability(parent,shadingPoint);
+				pdf *= parent.children[0]==nodeIx ? leftProb:(1.0-leftProb);
+			}
+			return pdf;
+		}
+
+		inline size_t getByteSize() const { return m_nodes.size()*sizeof(SNode); }
+
+	private:
+		static inline constexpr uint32_t InvalidNode = ~0u;
+
+		struct SNode
+		{
+			inline bool isLeaf() const { return children[0]==InvalidNode; }
+
+			float minEdge[3];
+			float maxEdge[3];
+			float flux;
+			uint32_t parent;
+			// leaves store the light in the second child
+			uint32_t children[2];
+		};
+
+		inline uint32_t buildNode(const SLight* lights, uint32_t* begin, uint32_t* end, const uint32_t parent)
+		{
+			const uint32_t nodeIx = m_nodes.size();
+			auto& node = m_nodes.emplace_back();
+			node.parent = parent;
+			node.flux = 0.f;
+			float centroidMin[3],centroidMax[3];
+			for (auto i=0; i<3; i++)
+			{
+				node.minEdge[i] = centroidMin[i] = FLT_MAX;
+				node.maxEdge[i] = centroidMax[i] = -FLT_MAX;
+			}
+			for (auto it=begin; it!=end; it++)
+			{
+				const auto& light = lights[*it];
+				for (auto i=0; i<3; i++)
+				{
+					node.minEdge[i] = nbl::core::min(node.minEdge[i],light.minEdge[i]);
+					node.maxEdge[i] = nbl::core::max(node.maxEdge[i],light.maxEdge[i]);
+					const float centroid = (light.minEdge[i]+light.maxEdge[i])*0.5f;
+					centroidMin[i] = nbl::core::min(centroidMin[i],centroid);
+					centroidMax[i] = nbl::core::max(centroidMax[i],centroid);
+				}
+				node.flux += light.flux;
+			}
+
+			if (end-begin==1)
+			{
+				node.children[0] = InvalidNode;
+				node.children[1] = *begin;
+				m_leafOfLight[*begin] = nodeIx;
+				return nodeIx;
+			}
+
+			// median split along the longest axis of the centroid bounds
+			int axis = 0;
+			for (auto i=1; i<3; i++)
+			if (centroidMax[i]-centroidMin[i]>centroidMax[axis]-centroidMin[axis])
+				axis = i;
+			auto* middle = begin+(end-begin)/2;
+			std::nth_element(begin,middle,end,[lights,axis](const uint32_t a, const uint32_t b)
+			{
+				return lights[a].minEdge[axis]+lights[a].maxEdge[axis]<lights[b].minEdge[axis]+lights[b].maxEdge[axis];
+			});
+			// `node` dangles once children get emplaced
+			const uint32_t left = buildNode(lights,begin,middle,nodeIx);
+			const uint32_t right = buildNode(lights,middle,end,nodeIx);
+			m_nodes[nodeIx].children[0] = left;
+			m_nodes[nodeIx].children[1] = right;
+			return nodeIx;
+		}
+
+		//! flux over squared distance to the bounds' center, clamped to the bounds' squared radius so we never blow up inside a cluster
+		static inline double computeImportance(const SNode& node, const float shadingPoint[3])
+		{
+			double distanceSq = 0.0, radiusSq = 0.0;
+			for (auto i=0; i<3; i++)
+			{
+				const double center = (double(node.minEdge[i])+double(node.maxEdge[i]))*0.5;
+				const double halfExtent = (double(node.maxEdge[i])-double(node.minEdge[i]))*0.5;
+				distanceSq += (double(shadingPoint[i])-center)*(double(shadingPoint[i])-center);
+				radiusSq += halfExtent*halfExtent;
+			}
+			return double(node.flux)/nbl::core::max(nbl::core::max(distanceSq,radiusSq),double(FLT_MIN));
+		}
+
+		inline double computeLeftProbability(const SNode& node, const float shadingPoint[3]) const
+		{
+			const double left = computeImportance(m_nodes[node.children[0]],shadingPoint);
+			const double right = computeImportance(m_nodes[node.children[1]],shadingPoint);
+			const double sum = left+right;
+			return sum>0.0 ? left/sum:0.5;
+		}
+
+		nbl::core::vector<SNode> m_nodes;
+		nbl::core::vector<uint32_t> m_leafOfLight;
+};
+
+//! Synthetic scenes of 1 to 100k emitters scattered in a box, the estimator is unoccluded flux over squared distance at random shading points,
+//! reports relative variance (lower is better) and the cost of a selection for every strategy
+class LightSamplingBenchmark
+{
+	public:
+		static inline bool run()
+		{
+			bool success = true;
+			printf("[INFO] %8s | %-10s | %12s | %10s | %10s\n","lights","strategy","rel variance","ns/sample","bytes");
+			for (const uint32_t count : {1u,10u,100u,1000u,10000u,100000u})
+				success = runScene(count) && success;
+			return success;
+		}
+
+	private:
+		static inline constexpr uint32_t ShadingPointCount = 64u;
+		static inline constexpr uint32_t SamplesPerShadingPoint = 0x1u<<12u;
+		static inline constexpr float SceneHalfExtent = 100.f;
+
+		static inline bool runScene(const uint32_t count)
+		{
+			nbl::core::RandomSampler rng(0xbadc0ffeu+count);
+			auto uniform = [&rng]() -> double {return double(rng.nextSample())/double(0x1ull<<32ull);};
+
+			nbl::core::vector<LightTree::SLight> lights(count);
+			nbl::core::vector<float> flux(count);
+			for (uint32_t l=0u; l<count; l++)
+			{
+				const float halfSize = 0.05f+0.95f*float(uniform());
+				for (auto i=0; i<3; i++)
+				{
+					const float center = SceneHalfExtent*float(uniform()*2.0-1.0);
+					lights[l].minEdge[i] = center-halfSize;
+					lights[l].maxEdge[i] = center+halfSize;
+				}
+				// three orders of magnitude of spread in emitted power
+				flux[l] = lights[l].flux = nbl::core::exp(float(uniform())*nbl::core::log(1000.f));
+			}
+			float shadingPoints[ShadingPointCount][3];
+			for (auto p=0u; p<ShadingPointCount; p++)
+			for (auto i=0; i<3; i++)
+				shadingPoints[p][i] = SceneHalfExtent*float(uniform()*2.0-1.0);
+
+			LightCDFSampler cdf;
+			LightAliasTable aliasTable;
+			LightTree tree;
+			if (!cdf.build(flux.data(),count) || !aliasTable.build(flux.data(),count) || !tree.build(lights.data(),count))
+			{
+				printf("[ERROR] Failed to build light sampling structures for %d lights\n",count);
+				return false;
+			}
+
+			auto contribution = [&](const float p[3], const uint32_t l) -> double
+			{
+				double distanceSq = 0.0;
+				for (auto i=0; i<3; i++)
+				{
+					const double d = double(p[i])-0.5*(double(lights[l].minEdge[i])+double(lights[l].maxEdge[i]));
+					distanceSq += d*d;
+				}
+				return double(lights[l].flux)/nbl::core::max(distanceSq,1.0);
+			};
+			bool success = true;
+			auto measure = [&](const char* name, const size_t byteSize, auto&& sample) -> void
+			{
+				double relativeVariance = 0.0;
+				double sink = 0.0;
+				const auto start = std::chrono::steady_clock::now();
+				for (auto p=0u; p<ShadingPointCount; p++)
+				{
+					nbl::core::RandomSampler xiRng(0xdeadbeefu+p);
+					double sum = 0.0, sumSq = 0.0;
+					for (auto s=0u; s<SamplesPerShadingPoint; s++)
+					{
+						double pdf;
+						const uint32_t light = sample(shadingPoints[p],double(xiRng.nextSample())/double(0x1ull<<32ull),pdf);
+						if (!(pdf>0.0))
+						{
+							success = false;
+							continue;
+						}
+						const double estimate = contribution(shadingPoints[p],light)/pdf;
+						sum += estimate;
+						sumSq += estimate*estimate;
+						sink += pdf;
+					}
+					const double mean = sum/double(SamplesPerShadingPoint);
+					relativeVariance += (sumSq/double(SamplesPerShadingPoint)-mean*mean)/(mean*mean);
+				}
+				const double elapsed = std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+				printf("[INFO] %8d | %-10s | %12.4g | %10.1f | %10d\n",count,name,relativeVariance/double(ShadingPointCount),
+					elapsed/double(ShadingPointCount*SamplesPerShadingPoint),static_cast<int>(byteSize));
+				if (!std::isfinite(sink))
+					success = false;
+			};
+			measure("cdf",cdf.getByteSize(),[&](const float*, const double xi, double& pdf){return cdf.sample(xi,pdf);});
+			measure("alias",aliasTable.getByteSize(),[&](const float*, const double xi, double& pdf){return aliasTable.sample(xi,pdf);});
+			measure("light tree",tree.getByteSize(),[&](const float* p, const double xi, double& pdf){return tree.sample(p,xi,pdf);});
+
+			// every strategy's PDF has to integrate to 1 and agree with what sampling hands out
+			const float* p = shadingPoints[0];
+			double cdfSum = 0.0, aliasSum = 0.0, treeSum = 0.0;
+			for (uint32_t l=0u; l<count; l++)
+			{
+				cdfSum += cdf.pdf(l);
+				aliasSum += aliasTable.pdf(l);
+				treeSum += tree.pdf(p,l);
+			}
+			double treePdf;
+			const uint32_t treeLight = tree.sample(p,0.5,treePdf);
+			if (nbl::core::abs(cdfSum-1.0)>1e-6 || nbl::core::abs(aliasSum-1.0)>1e-6 || nbl::core::abs(treeSum-1.0)>1e-6 || nbl::core::abs(tree.pdf(p,treeLight)-treePdf)>1e-9*treePdf)
+			{
+				printf("[ERROR] Light sampling PDFs for %d lights are inconsistent, sums: cdf %f alias %f tree %f\n",count,cdfSum,aliasSum,treeSum);
+				success = false;
+			}
+			return success;
+		}
+};
+
+#endif
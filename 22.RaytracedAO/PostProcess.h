@@ -0,0 +1,275 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _POST_PROCESS_H_INCLUDED_
+#define _POST_PROCESS_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <sstream>
+#include <string>
+
+#include "../common/CPUBloom.hpp"
+
+
+//! CPU version of what 39.DenoiserTonemapper does to a render (denoise, bloom, autoexpose and tonemap),
+//! working on images already in memory so the renderer doesn't have to round trip through files and a separate process.
+//! Everything works on linear RGB float triplets, decoding from and encoding to actual image formats is the caller's business.
+class PostProcess
+{
+	public:
+		struct SImage
+		{
+			SImage() = default;
+			SImage(const uint32_t _width, const uint32_t _height) : width(_width), height(_height), rgb(size_t(_width)*_height*3u,0.f) {}
+
+			inline float* texel(const uint32_t x, const uint32_t y) { return rgb.data()+(size_t(y)*width+x)*3u; }
+			inline const float* texel(const uint32_t x, const uint32_t y) const { return rgb.data()+(size_t(y)*width+x)*3u; }
+			inline bool empty() const { return rgb.empty(); }
+
+			uint32_t width = 0u;
+			uint32_t height = 0u;
+			nbl::core::vector<float> rgb;
+		};
+
+		enum E_TONEMAPPER : uint32_t
+		{
+			ET_REINHARD,
+			ET_ACES,
+			//! only autoexposure, for further processing of the HDR output
+			ET_NONE
+		};
+
+		struct SParams
+		{
+			//! same syntax as the `-TONEMAPPER` argument of 39.DenoiserTonemapper, "ACES=key,gamma", "REINHARD=key,whiteLevel" or "NONE=key",
+			//! where the NONE key can be "AutoexposureOff", returns false and leaves the params alone if `args` can't be parsed
+			inline bool parseTonemapper(const std::string& args)
+			{
+				const auto separator = args.find('=');
+				const auto name = args.substr(0u,separator);
+				E_TONEMAPPER op;
+				if (name=="REINHARD")
+					op = ET_REINHARD;
+				else if (name=="ACES")
+					op = ET_ACES;
+				else if (name=="NONE")
+					op = ET_NONE;
+				else
+					return false;
+
+				float values[2] = {0.18f,op==ET_REINHARD ? 16.f:1.f};
+				bool autoexpose = true;
+				if (separator!=std::string::npos)
+				{
+					std::istringstream stream(args.substr(separator+1u));
+					std::string value;
+					for (auto i=0u; i<2u && std::getline(stream,value,','); i++)
+					{
+						if (op==ET_NONE && i==0u && value=="AutoexposureOff")
+						{
+							autoexpose = false;
+							continue;
+						}
+						char* end;
+						values[i] = std::strtof(value.c_str(),&end);
+						if (end==value.c_str())
+							return false;
+					}
+				}
+
+				tonemapper = op;
+				key = values[0];
+				extraParameter = values[1];
+				autoexposure = autoexpose;
+				return true;
+			}
+
+			//! guided by albedo and normals when they are given
+			bool denoise = true;
+			//! kernel size relative to the smaller image dimension and blend factor, 39.DenoiserTonemapper semantics
+			float bloomScale = 0.1f;
+			float bloomIntensity = 0.1f;
+			E_TONEMAPPER tonemapper = ET_ACES;
+			float key = 0.4f;
+			//! white level for Reinhard, gamma for ACES
+			float extraParameter = 0.8f;
+			bool autoexposure = true;
+		};
+
+		//! runs the whole chain on `color`, `bloomPSF` may be empty in which case there's no bloom
+		static inline void process(SImage& color, const SImage* albedo, const SImage* normal, const SImage& bloomPSF, const SParams& params)
+		{
+			if (params.denoise)
+				denoise(color,albedo,normal);
+			if (!bloomPSF.empty() && params.bloomIntensity>0.f)
+				bloom(color,bloomPSF,params.bloomScale,params.bloomIntensity);
+			tonemap(color,params);
+		}
+
+		//! Edge-avoiding A-Trous wavelet filter (Dammertz et al. 2010) standing in for the OptiX denoiser.
+		//! Lighting gets demodulated by the albedo first so texture detail survives, and the filter is stopped by normal, albedo and relative luminance differences.
+		static inline void denoise(SImage& color, const SImage* albedo, const SImage* normal)
+		{
+			constexpr uint32_t Iterations = 5u;
+			constexpr float AlbedoEpsilon = 1.f/1024.f;
+			constexpr float NormalPower = 64.f;
+			constexpr float AlbedoSigma2 = 0.01f;
+			constexpr float LuminanceSigma = 1.f;
+			constexpr float Taps[5] = {1.f/16.f,1.f/4.f,3.f/8.f,1.f/4.f,1.f/16.f};
+
+			const uint32_t width = color.width, height = color.height;
+			if (albedo)
+			for (size_t i=0u; i<color.rgb.size(); i++)
+				color.rgb[i] /= albedo->rgb[i]+AlbedoEpsilon;
+
+			nbl::core::vector<float> unitNormals;
+			if (normal)
+			{
+				unitNormals = normal->rgb;
+				for (size_t i=0u; i<unitNormals.size(); i+=3u)
+				{
+					const float len = std::sqrt(unitNormals[i]*unitNormals[i]+unitNormals[i+1u]*unitNormals[i+1u]+unitNormals[i+2u]*unitNormals[i+2u]);
+					const float rcpLen = len>0.f ? 1.f/len:0.f;
+					for (auto c=0u; c<3u; c++)
+						unitNormals[i+c] *= rcpLen;
+				}
+			}
+
+			SImage scratch(width,height);
+			nbl::core::vector<uint32_t> rows(height);
+			std::iota(rows.begin(),rows.end(),0u);
+			for (uint32_t iteration=0u; iteration<Iterations; iteration++)
+			{
+				const int32_t step = 0x1<<iteration;
+				std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+				{
+					for (uint32_t x=0u; x<width; x++)
+					{
+						const size_t center = (size_t(y)*width+x)*3u;
+						const float* c0 = color.rgb.data()+center;
+						const float l0 = luma(c0);
+						float sum[3] = {0.f,0.f,0.f};
+						float weightSum = 0.f;
+						for (int32_t j=-2; j<=2; j++)
+						for (int32_t i=-2; i<=2; i++)
+						{
+							const int32_t sx = int32_t(x)+i*step, sy = int32_t(y)+j*step;
+							if (sx<0 || sy<0 || sx>=int32_t(width) || sy>=int32_t(height))
+								continue;
+							const size_t tap = (size_t(sy)*width+sx)*3u;
+							const float* c1 = color.rgb.data()+tap;
+
+							float weight = Taps[i+2]*Taps[j+2];
+							weight *= std::exp(-std::abs(l0-luma(c1))/(LuminanceSigma*nbl::core::max(l0,luma(c1))+FLT_MIN));
+							if (normal)
+							{
+								const float* n0 = unitNormals.data()+center;
+								const float* n1 = unitNormals.data()+tap;
+								weight *= std::pow(nbl::core::max(n0[0]*n1[0]+n0[1]*n1[1]+n0[2]*n1[2],0.f),NormalPower);
+							}
+							if (albedo)
+							{
+								const float* a0 = albedo->rgb.data()+center;
+								const float* a1 = albedo->rgb.data()+tap;
+								float dist2 = 0.f;
+								for (auto c=0u; c<3u; c++)
+									dist2 += (a0[c]-a1[c])*(a0[c]-a1[c]);
+								weight *= std::exp(-dist2/AlbedoSigma2);
+							}
+							for (auto c=0u; c<3u; c++)
+								sum[c] += c1[c]*weight;
+							weightSum += weight;
+						}
+						// the center tap has weight `Taps[2]*Taps[2]` unless the normal is degenerate, so don't divide by zero for sky pixels
+						for (auto c=0u; c<3u; c++)
+							scratch.rgb[center+c] = weightSum>0.f ? sum[c]/weightSum:c0[c];
+					}
+				});
+				std::swap(color.rgb,scratch.rgb);
+			}
+
+			if (albedo)
+			for (size_t i=0u; i<color.rgb.size(); i++)
+				color.rgb[i] *= albedo->rgb[i]+AlbedoEpsilon;
+		}
+
+		//! Convolution with the bloom point spread function through the FFT, same semantics as 39.DenoiserTonemapper, see `cpu_fft::CBloom`
+		static inline void bloom(SImage& color, const SImage& psf, const float relativeScale, const float intensity)
+		{
+			if (cpu_fft::CBloom::getKernelScale(psf.width,psf.height,color.width,color.height,relativeScale)>1.f)
+				printf("[WARNING] Bloom Kernel loose sharpness, increase resolution of bloom kernel or reduce its relative scale!\n");
+			const auto kernel = cpu_fft::CBloom::scaleKernel(psf.rgb.data(),psf.width,psf.height,color.width,color.height,relativeScale);
+			cpu_fft::CBloom::convolve(color.rgb.data(),color.width,color.height,kernel,intensity);
+		}
+
+		//! autoexposure and tonemapping operator, output is linear sRGB which is what gets written to the EXR, clamped to non-negative
+		static inline void tonemap(SImage& color, const SParams& params)
+		{
+			// autoexposure brings the median luma to the key value
+			const float exposure = params.autoexposure ? params.key/measureLuma(color):1.f;
+
+			const float rcpWhite2 = 1.f/(params.extraParameter*params.extraParameter);
+			nbl::core::vector<uint32_t> rows(color.height);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				for (uint32_t x=0u; x<color.width; x++)
+				{
+					float* texel = color.texel(x,y);
+					for (auto c=0u; c<3u; c++)
+						texel[c] = nbl::core::max(texel[c],0.f)*exposure;
+					switch (params.tonemapper)
+					{
+						case ET_REINHARD:
+						{
+							const float l = luma(texel);
+							const float scale = l>0.f ? (1.f+l*rcpWhite2)/(1.f+l):0.f;
+							for (auto c=0u; c<3u; c++)
+								texel[c] *= scale;
+							break;
+						}
+						case ET_ACES:
+							for (auto c=0u; c<3u; c++)
+							{
+								// gamma acts as contrast around middle grey, then the filmic fit of the RRT+ODT by K. Narkowicz
+								const float v = 0.18f*std::pow(texel[c]/0.18f,params.extraParameter);
+								texel[c] = nbl::core::min((v*(2.51f*v+0.03f))/(v*(2.43f*v+0.59f)+0.14f),1.f);
+							}
+							break;
+						default:
+							break;
+					}
+				}
+			});
+		}
+
+		//! geometric mean of the luma between the 45th and 55th percentile, like the median luma meter of 39.DenoiserTonemapper
+		static inline float measureLuma(const SImage& color)
+		{
+			constexpr float MinLuma = 1.f/4096.f;
+			const size_t texelCount = size_t(color.width)*color.height;
+			if (texelCount==0u)
+				return 0.18f;
+			nbl::core::vector<float> logLuma(texelCount);
+			for (size_t i=0u; i<texelCount; i++)
+				logLuma[i] = std::log2(nbl::core::max(luma(color.rgb.data()+i*3u),MinLuma));
+			const size_t begin = texelCount*45u/100u;
+			const size_t end = nbl::core::max(texelCount*55u/100u,begin+1u);
+			std::nth_element(logLuma.begin(),logLuma.begin()+begin,logLuma.end());
+			std::nth_element(logLuma.begin()+begin,logLuma.begin()+end-1u,logLuma.end());
+			const double sum = std::accumulate(logLuma.begin()+begin,logLuma.begin()+end,0.0);
+			return std::exp2(float(sum/double(end-begin)));
+		}
+
+		static inline float luma(const float* rgb)
+		{
+			return rgb[0]*0.2126f+rgb[1]*0.7152f+rgb[2]*0.0722f;
+		}
+};
+
+#endif
@@ -0,0 +1,283 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _RAY_REORDERING_H_INCLUDED_
+#define _RAY_REORDERING_H_INCLUDED_
+
+#include "nabla.h"
+#include "nbl/ext/RadeonRays/RadeonRays.h"
+// pesky leaking defines
+#undef PI
+
+#include <cfloat>
+#include <chrono>
+#include <numeric>
+#include <random>
+
+
+//! CPU reference of the ray reordering `Renderer::traceBounce` can do before handing rays to RadeonRays.
+//! Every ray gets a 30 bit Morton code interleaving its origin quantized within the scene bound and its direction
+//! quantized on the octahedral map, 6 bits each, then rays get stably radix sorted by it.
+//! The rays carry their pixel and path state, so the intersections of the sorted rays need no scattering back.
+//! `rayKeys.comp` computes the same keys on the GPU and has to be kept in sync.
+class RayReordering
+{
+	public:
+		static inline constexpr uint32_t BitsPerDimension = 6u;
+		static inline constexpr uint32_t Dimensions = 5u;
+		static inline constexpr uint32_t KeyBits = BitsPerDimension*Dimensions;
+
+		//! layout of the key buffer `ext::RadixSort` sorts
+		struct SKeyAndIndex
+		{
+			uint32_t key;
+			uint32_t index;
+		};
+
+		struct SQuantization
+		{
+			float boundMin[3];
+			float rcpBoundExtent[3];
+
+			static inline SQuantization fromBound(const nbl::core::aabbox3df& bound)
+			{
+				SQuantization retval;
+				const float boundMin[3] = {bound.MinEdge.X,bound.MinEdge.Y,bound.MinEdge.Z};
+				const float boundMax[3] = {bound.MaxEdge.X,bound.MaxEdge.Y,bound.MaxEdge.Z};
+				for (auto i=0u; i<3u; i++)
+				{
+					retval.boundMin[i] = boundMin[i];
+					// flat scenes quantize to a single cell along that axis
+					const float extent = boundMax[i]-boundMin[i];
+					retval.rcpBoundExtent[i] = extent>0.f ? 1.f/extent:0.f;
+				}
+				return retval;
+			}
+		};
+
+		static inline uint32_t computeKey(const ::RadeonRays::ray& ray, const SQuantization& quantization)
+		{
+			constexpr uint32_t MaxCell = (0x1u<<BitsPerDimension)-1u;
+			auto quantize = [](const float unorm) -> uint32_t
+			{
+				const float clamped = nbl::core::min(nbl::core::max(unorm,0.f),1.f);
+				return nbl::core::min(uint32_t(clamped*float(MaxCell+1u)),MaxCell);
+			};
+
+			uint32_t cells[Dimensions];
+			const float origin[3] = {ray.o.x,ray.o.y,ray.o.z};
+			for (auto i=0u; i<3u; i++)
+				cells[i] = quantize((origin[i]-quantization.boundMin[i])*quantization.rcpBoundExtent[i]);
+			// octahedral map
+			const float rcpNorm = 1.f/(std::abs(ray.d.x)+std::abs(ray.d.y)+std::abs(ray.d.z));
+			float u = ray.d.x*rcpNorm, v = ray.d.y*rcpNorm;
+			if (ray.d.z<0.f)
+			{
+				const float foldedU = (1.f-std::abs(v))*(u>=0.f ? 1.f:-1.f);
+				v = (1.f-std::abs(u))*(v>=0.f ? 1.f:-1.f);
+				u = foldedU;
+			}
+			cells[3] = quantize(u*0.5f+0.5f);
+			cells[4] = quantize(v*0.5f+0.5f);
+
+			uint32_t key = 0u;
+			for (auto bit=0u; bit<BitsPerDimension; bit++)
+			for (auto dim=0u; dim<Dimensions; dim++)
+				key |= ((cells[dim]>>bit)&0x1u)<<(bit*Dimensions+dim);
+			return key;
+		}
+
+		//! `out` receives the rays in key order, equal keys keep their relative order
+		static inline void sortRays(const ::RadeonRays::ray* in, ::RadeonRays::ray* out, const uint32_t count, const SQuantization& quantization)
+		{
+			nbl::core::vector<SKeyAndIndex> keys(size_t(count)*2u);
+			computeKeys(in,keys.data(),count,quantization);
+			const SKeyAndIndex* sorted = nbl::core::radix_sort(keys.data(),keys.data()+count,count,KeyAccessor());
+			nbl::core::vector<uint32_t> indices(count);
+			std::iota(indices.begin(),indices.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,indices.begin(),indices.end(),[&](const uint32_t i)
+			{
+				out[i] = in[sorted[i].index];
+			});
+		}
+
+		//! What `Renderer::traceBounce` checks the GPU sort against, given the sorted key buffer and the reordered rays
+		struct SValidation
+		{
+			uint32_t rayCount = 0u;
+			//! keys smaller than the one before them
+			uint32_t unsortedKeys = 0u;
+			//! equal keys whose indices are out of order
+			uint32_t unstableKeys = 0u;
+			//! the indices are each ray exactly once
+			bool permutation = false;
+			//! GPU keys differing from `computeKey`, only allowed for the odd ray right on a cell boundary due to float precision
+			uint32_t keyMismatches = 0u;
+
+			inline bool passed() const
+			{
+				return rayCount && permutation && !unsortedKeys && !unstableKeys && uint64_t(keyMismatches)*1000ull<=rayCount;
+			}
+		};
+		static inline SValidation validate(const SKeyAndIndex* sorted, const ::RadeonRays::ray* reordered, const uint32_t count, const SQuantization& quantization)
+		{
+			SValidation retval;
+			retval.rayCount = count;
+			nbl::core::vector<bool> seen(count,false);
+			retval.permutation = true;
+			for (uint32_t i=0u; i<count; i++)
+			{
+				if (i && sorted[i].key<sorted[i-1u].key)
+					retval.unsortedKeys++;
+				if (i && sorted[i].key==sorted[i-1u].key && sorted[i].index<sorted[i-1u].index)
+					retval.unstableKeys++;
+				if (sorted[i].index>=count || seen[sorted[i].index])
+					retval.permutation = false;
+				else
+					seen[sorted[i].index] = true;
+				if (computeKey(reordered[i],quantization)!=sorted[i].key)
+					retval.keyMismatches++;
+			}
+			return retval;
+		}
+
+		//! times the reference on synthetic incoherent rays, checks it against `std::stable_sort` and how much more coherent the order gets
+		static inline bool benchmark();
+
+	private:
+		struct KeyAccessor
+		{
+			_NBL_STATIC_INLINE_CONSTEXPR size_t key_bit_count = KeyBits;
+
+			template<auto bit_offset, auto radix_mask>
+			inline decltype(radix_mask) operator()(const SKeyAndIndex& item) const
+			{
+				return static_cast<decltype(radix_mask)>(item.key>>static_cast<uint32_t>(bit_offset))&radix_mask;
+			}
+		};
+
+		static inline void computeKeys(const ::RadeonRays::ray* rays, SKeyAndIndex* keys, const uint32_t count, const SQuantization& quantization)
+		{
+			nbl::core::vector<uint32_t> indices(count);
+			std::iota(indices.begin(),indices.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,indices.begin(),indices.end(),[&](const uint32_t i)
+			{
+				keys[i] = {computeKey(rays[i],quantization),i};
+			});
+		}
+};
+
+inline bool RayReordering::benchmark()
+{
+	const nbl::core::aabbox3df bound(-8.f,-2.f,-5.f,8.f,6.f,5.f);
+	const auto quantization = SQuantization::fromBound(bound);
+	const uint32_t rayCounts[] = {0x1u<<18u,1920u*1080u,0x1u<<23u};
+
+	// secondary rays in pixel order: every pixel's hit point is somewhere else in the scene and bounces anywhere
+	auto makeRays = [&](const uint32_t count) -> nbl::core::vector<::RadeonRays::ray>
+	{
+		nbl::core::vector<::RadeonRays::ray> rays(count);
+		std::mt19937 rng(0xbadc0ffeu+count);
+		std::uniform_real_distribution<float> unit(0.f,1.f);
+		for (uint32_t i=0u; i<count; i++)
+		{
+			auto& ray = rays[i];
+			ray.o.x = bound.MinEdge.X+unit(rng)*(bound.MaxEdge.X-bound.MinEdge.X);
+			ray.o.y = bound.MinEdge.Y+unit(rng)*(bound.MaxEdge.Y-bound.MinEdge.Y);
+			ray.o.z = bound.MinEdge.Z+unit(rng)*(bound.MaxEdge.Z-bound.MinEdge.Z);
+			ray.o.w = FLT_MAX;
+			const float cosTheta = 2.f*unit(rng)-1.f;
+			const float sinTheta = std::sqrt(1.f-cosTheta*cosTheta);
+			const float phi = 2.f*nbl::core::PI<float>()*unit(rng);
+			ray.d.x = std::cos(phi)*sinTheta;
+			ray.d.y = std::sin(phi)*sinTheta;
+			ray.d.z = cosTheta;
+			// stand-in for the packed pixel location, so the checks can tell rays apart
+			ray.d.w = float(i);
+		}
+		return rays;
+	};
+	// mean distance between consecutive origins relative to the bound diagonal and mean angle between consecutive directions
+	auto incoherence = [&](const nbl::core::vector<::RadeonRays::ray>& rays, double& originDistance, double& directionAngle) -> void
+	{
+		const auto extent = bound.getExtent();
+		const double rcpDiagonal = 1.0/double(extent.getLength());
+		originDistance = directionAngle = 0.0;
+		for (size_t i=1u; i<rays.size(); i++)
+		{
+			const auto& a = rays[i-1u];
+			const auto& b = rays[i];
+			const double dx = b.o.x-a.o.x, dy = b.o.y-a.o.y, dz = b.o.z-a.o.z;
+			originDistance += std::sqrt(dx*dx+dy*dy+dz*dz)*rcpDiagonal;
+			const double cosAngle = nbl::core::min(nbl::core::max(double(a.d.x)*b.d.x+double(a.d.y)*b.d.y+double(a.d.z)*b.d.z,-1.0),1.0);
+			directionAngle += std::acos(cosAngle);
+		}
+		originDistance /= double(rays.size()-1u);
+		directionAngle /= double(rays.size()-1u);
+	};
+
+	bool passed = true;
+	for (const uint32_t count : rayCounts)
+	{
+		const auto rays = makeRays(count);
+		nbl::core::vector<::RadeonRays::ray> sorted(count);
+
+		// best of a few runs, the first one pays for page faults
+		double keysMs = DBL_MAX, sortMs = DBL_MAX, totalMs = DBL_MAX;
+		for (auto run=0u; run<3u; run++)
+		{
+			nbl::core::vector<SKeyAndIndex> keys(size_t(count)*2u);
+			const auto start = std::chrono::steady_clock::now();
+			computeKeys(rays.data(),keys.data(),count,quantization);
+			const auto keysDone = std::chrono::steady_clock::now();
+			nbl::core::radix_sort(keys.data(),keys.data()+count,count,KeyAccessor());
+			const auto sortDone = std::chrono::steady_clock::now();
+			keysMs = nbl::core::min(keysMs,std::chrono::duration<double,std::milli>(keysDone-start).count());
+			sortMs = nbl::core::min(sortMs,std::chrono::duration<double,std::milli>(sortDone-keysDone).count());
+
+			const auto sortRaysStart = std::chrono::steady_clock::now();
+			sortRays(rays.data(),sorted.data(),count,quantization);
+			totalMs = nbl::core::min(totalMs,std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-sortRaysStart).count());
+		}
+
+		// reference order
+		nbl::core::vector<SKeyAndIndex> expected(count);
+		computeKeys(rays.data(),expected.data(),count,quantization);
+		std::stable_sort(expected.begin(),expected.end(),[](const SKeyAndIndex& lhs, const SKeyAndIndex& rhs) -> bool {return lhs.key<rhs.key;});
+		uint32_t mismatches = 0u;
+		for (uint32_t i=0u; i<count; i++)
+		if (sorted[i].d.w!=rays[expected[i].index].d.w)
+			mismatches++;
+
+		// the same check the GPU sort goes through
+		nbl::core::vector<SKeyAndIndex> sortedKeys(count);
+		for (uint32_t i=0u; i<count; i++)
+			sortedKeys[i] = {computeKey(sorted[i],quantization),uint32_t(sorted[i].d.w)};
+		const auto validation = validate(sortedKeys.data(),sorted.data(),count,quantization);
+
+		double originBefore, angleBefore, originAfter, angleAfter;
+		incoherence(rays,originBefore,angleBefore);
+		incoherence(sorted,originAfter,angleAfter);
+
+		printf("[INFO] Ray Reordering: %8u rays, keys %.2f ms, radix sort %.2f ms, keys+sort+gather %.2f ms (%.1f Mrays/s)\n",
+			count,keysMs,sortMs,totalMs,double(count)/(totalMs*1000.0)
+		);
+		printf("[INFO] Ray Reordering:           consecutive rays %.3f -> %.3f of the scene diagonal apart, %.1f -> %.1f degrees apart\n",
+			originBefore,originAfter,angleBefore*180.0/nbl::core::PI<double>(),angleAfter*180.0/nbl::core::PI<double>()
+		);
+		if (mismatches || !validation.passed())
+		{
+			printf("[ERROR] Ray Reordering: %u rays out of place compared to std::stable_sort, %u unsorted, %u unstable keys\n",mismatches,validation.unsortedKeys,validation.unstableKeys);
+			passed = false;
+		}
+		if (originAfter>=originBefore || angleAfter>=angleBefore)
+		{
+			printf("[ERROR] Ray Reordering: the sorted rays are not more coherent\n");
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+#endif
@@ -1,9 +1,15 @@
 ﻿#include <numeric>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 
 #include "Renderer.h"
+#include "LightSampling.h"
+#include "CubemapLayout.h"
+#include "SceneCache.h"
+#include "../common/ShaderCache.hpp"
 
-#include "nbl/ext/ScreenShot/ScreenShot.h"
 #include "nbl/ext/FullScreenTriangle/FullScreenTriangle.h"
 #include "nbl/asset/filters/CFillImageFilter.h"
 #include "../source/Nabla/COpenCLHandler.h"
@@ -26,9 +32,41 @@ core::smart_refctd_ptr<ICPUSpecializedShader> specializedShaderFromFile(IAssetMa
 	auto bundle = assetManager->getAsset(path, {});
 	return core::smart_refctd_ptr_static_cast<ICPUSpecializedShader>(*bundle.getContents().begin());
 }
+//! shared by every compilation, they happen on `compileShadersFuture` as well as the main thread
+shader_cache::CCache& getShaderCache()
+{
+	static shader_cache::CCache cache("ShaderCache");
+	return cache;
+}
+//! see `Renderer::setShaderCacheEnabled`
+std::atomic_bool shaderCacheEnabled = true;
+//! Compiles the GLSL to SPIR-V ourselves so the result can come from the cache, the key is the source with the includes resolved
+//! which also covers `runtime_defines.glsl`. Anything which fails along the way is left for the driver to compile and report.
+core::smart_refctd_ptr<ICPUSpecializedShader> compileThroughShaderCache(IAssetManager* assetManager, core::smart_refctd_ptr<ICPUSpecializedShader>&& shader, const char* path)
+{
+	auto* unspecialized = shader->getUnspecialized();
+	if (!shaderCacheEnabled || !unspecialized->containsGLSL())
+		return std::move(shader);
+	const auto& info = shader->getSpecializationInfo();
+	auto* glslc = assetManager->getGLSLCompiler();
+	auto resolved = glslc->resolveIncludeDirectives(std::string(reinterpret_cast<const char*>(unspecialized->getContent()->getPointer())),info.shaderStage,path);
+	if (!resolved)
+		return std::move(shader);
+
+	static const uint64_t compilerIdentity = shader_cache::getCompilerIdentity();
+	const auto* source = resolved->getContent();
+	const auto key = shader_cache::CKeyBuilder().setSource(source->getPointer(),source->getSize()).setStage(info.shaderStage).setEntryPoint(info.entryPoint).setCompiler(compilerIdentity).build();
+	auto spirv = shader_cache::getOrCompileShader(getShaderCache(),key,[&]() -> core::smart_refctd_ptr<ICPUShader>
+	{
+		return glslc->createSPIRVFromGLSL(reinterpret_cast<const char*>(source->getPointer()),info.shaderStage,info.entryPoint.c_str(),path);
+	});
+	if (!spirv)
+		return std::move(shader);
+	return core::make_smart_refctd_ptr<ICPUSpecializedShader>(std::move(spirv),ISpecializedShader::SInfo(info));
+}
 core::smart_refctd_ptr<IGPUSpecializedShader> gpuSpecializedShaderFromFile(IAssetManager* assetManager, IVideoDriver* driver, const char* path)
 {
-	auto shader = specializedShaderFromFile(assetManager,path);
+	auto shader = compileThroughShaderCache(assetManager,specializedShaderFromFile(assetManager,path),path);
 	// TODO: @Crisspl find a way to stop the user from such insanity as moving from the bundle's dynamic array
 	//return std::move(driver->getGPUObjectsFromAssets<ICPUSpecializedShader>(&shader,&shader+1u)->operator[](0));
 	return driver->getGPUObjectsFromAssets<ICPUSpecializedShader>(&shader,&shader+1u)->operator[](0);
@@ -46,12 +84,17 @@ auto fillIotaDescriptorBindingDeclarations = [](auto* outBindings, uint32_t acce
 	}
 };
 
+void Renderer::setShaderCacheEnabled(const bool enable)
+{
+	shaderCacheEnabled = enable;
+}
+
 Renderer::Renderer(IVideoDriver* _driver, IAssetManager* _assetManager, scene::ISceneManager* _smgr, bool useDenoiser) :
 		m_useDenoiser(useDenoiser),	m_driver(_driver), m_smgr(_smgr), m_assetManager(_assetManager),
 		m_rrManager(ext::RadeonRays::Manager::create(m_driver)),
 		m_prevView(), m_prevCamTform(), m_sceneBound(FLT_MAX,FLT_MAX,FLT_MAX,-FLT_MAX,-FLT_MAX,-FLT_MAX),
 		m_framesDispatched(0u), m_rcpPixelSize{0.f,0.f},
-		m_staticViewData{{0u,0u},0u,0u}, m_raytraceCommonData{core::matrix4SIMD(), vec3(),0.f,0u,0u,0u,0.f},
+		m_staticViewData{{0u,0u},0u,0u}, m_raytraceCommonData{core::matrix4SIMD(), vec3(),0.f,0u,0u,0u,0.f,0u},
 		m_indirectDrawBuffers{nullptr},m_cullPushConstants{core::matrix4SIMD(),1.f,0u,0u,0u},m_cullWorkGroups(0u),
 		m_raygenWorkGroups{0u,0u},m_visibilityBuffer(nullptr),m_colorBuffer(nullptr)
 {
@@ -82,7 +125,7 @@ Renderer::Renderer(IVideoDriver* _driver, IAssetManager* _assetManager, scene::I
 		m_rasterInstanceDataDSLayout = m_driver->createDescriptorSetLayout(&binding,&binding+1u);
 	}
 	{
-		constexpr auto additionalGlobalDescriptorCount = 5u;
+		constexpr auto additionalGlobalDescriptorCount = 6u;
 		IGPUDescriptorSetLayout::SBinding bindings[additionalGlobalDescriptorCount];
 		fillIotaDescriptorBindingDeclarations(bindings,ISpecializedShader::ESS_COMPUTE|ISpecializedShader::ESS_VERTEX|ISpecializedShader::ESS_FRAGMENT,additionalGlobalDescriptorCount,asset::EDT_STORAGE_BUFFER);
 
@@ -139,12 +182,13 @@ Renderer::Renderer(IVideoDriver* _driver, IAssetManager* _assetManager, scene::I
 	samplerParams.CompareEnable = false;
 	auto sampler = m_driver->createSampler(samplerParams);
 	{
-		constexpr auto raygenDescriptorCount = 3u;
+		constexpr auto raygenDescriptorCount = 4u;
 		IGPUDescriptorSetLayout::SBinding bindings[raygenDescriptorCount];
 		fillIotaDescriptorBindingDeclarations(bindings,ISpecializedShader::ESS_COMPUTE,raygenDescriptorCount,EDT_COMBINED_IMAGE_SAMPLER);
 		bindings[0].samplers = &sampler;
 		bindings[1].samplers = &sampler;
 		bindings[2].type = asset::EDT_STORAGE_IMAGE;
+		bindings[3].type = asset::EDT_STORAGE_BUFFER;
 
 		m_raygenDSLayout = m_driver->createDescriptorSetLayout(bindings,bindings+raygenDescriptorCount);
 	}
@@ -180,7 +224,56 @@ Renderer::~Renderer()
 }
 
 
-Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& meshes)
+//! bytes per vertex of the combined normal and UV attribute for a `VERTEX_LAYOUT_*_BIT` combination
+static inline uint32_t getVertexLayoutByteSize(const uint32_t layout)
+{
+	return ((layout&VERTEX_LAYOUT_NORMAL_BIT) ? sizeof(uint32_t):0u)+((layout&VERTEX_LAYOUT_UV_BIT) ? sizeof(uint32_t):0u);
+}
+//! same as `nbl_glsl_decodeRGB10A2_SNORM`, the normals have already been made into raw `EF_R32_UINT` by the time we look at them
+static inline core::vectorSIMDf decodeRGB10A2_SNORM(const uint32_t encoded)
+{
+	core::vectorSIMDf retval;
+	for (auto i=0u; i<3u; i++)
+		retval.pointer[i] = core::max(float(int32_t(encoded<<(22u-i*10u))>>22)/511.f,-1.f);
+	return retval;
+}
+//! about 0.26 degrees, a bit more than the at most 0.1 degrees the 10bit quantization of a unit normal can be off by
+constexpr float FlatShadingMinCosine = 0.99999f;
+//! whether the shading normal never meaningfully differs from the geometric normal the shaders compute from the positions
+static bool isFlatShaded(const ICPUMeshBuffer* meshBuffer)
+{
+	if (meshBuffer->getPipeline()->getPrimitiveAssemblyParams().primitiveType!=EPT_TRIANGLE_LIST)
+		return false;
+	const auto posAttr = meshBuffer->getPositionAttributeIx();
+	const auto normalAttr = meshBuffer->getNormalAttributeIx();
+	for (uint32_t i=0u; i<meshBuffer->getIndexCount(); i+=3u)
+	{
+		core::vectorSIMDf positions[3];
+		uint32_t vertexIDs[3];
+		for (auto j=0u; j<3u; j++)
+		{
+			vertexIDs[j] = meshBuffer->getIndexValue(i+j);
+			meshBuffer->getAttribute(positions[j],posAttr,vertexIDs[j]);
+		}
+		const auto geomNormal = core::cross(positions[1]-positions[0],positions[2]-positions[0]);
+		const float lenSq = core::dot(geomNormal,geomNormal).x;
+		// degenerate triangles never get hit
+		if (lenSq<=FLT_MIN)
+			continue;
+		const auto normalizedGeomNormal = geomNormal*core::inversesqrt(lenSq);
+		for (auto j=0u; j<3u; j++)
+		{
+			uint32_t encoded;
+			meshBuffer->getAttribute(&encoded,normalAttr,vertexIDs[j]);
+			const auto normal = core::normalize(decodeRGB10A2_SNORM(encoded));
+			if (!(core::dot(normal,normalizedGeomNormal).x>=FlatShadingMinCosine))
+				return false;
+		}
+	}
+	return true;
+}
+
+Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& meshes, const SMeshPackingParams& meshPackingParams)
 {
 	constexpr bool meshPackerUsesSSBO = true;
 	using CPUMeshPacker = CCPUMeshPackerV2<DrawElementsIndirectCommand_t>;
@@ -277,9 +370,120 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 		{
 			auto contents = meshes.getContents();
 
-			core::vector<IMeshPackerBase::PackedMeshBufferData> pmbd;
-			// split into packed batches
+			// anything which changes what gets packed or how it's laid out has to be in here
+			const uint32_t sceneCacheOptions[] = {
+				meshPackingParams.stripVertexAttributes,MAX_TRIANGLES_IN_BATCH,
+				sizeof(ext::MitsubaLoader::instance_data_t),sizeof(CullData_t),sizeof(SLight),sizeof(DrawElementsIndirectCommand_t)
+			};
+			const uint64_t sceneCacheOptionsHash = cache_file::hash(sceneCacheOptions,sizeof(sceneCacheOptions));
+			SceneCache sceneCache;
+			m_sceneLoadedFromCache = !meshPackingParams.sceneCachePath.empty() && sceneCache.load(meshPackingParams.sceneCachePath,meshPackingParams.sceneHash,sceneCacheOptionsHash);
+			// same inputs whether the geometry got packed just now or came from the cache
+			auto setGeometryBuffers = [&](core::smart_refctd_ptr<IGPUBuffer>&& vertexBuffer, core::smart_refctd_ptr<IGPUBuffer>&& indexBuffer, core::smart_refctd_ptr<IGPUBuffer>&& mdiBuffer) -> void
+			{
+				m_indexBuffer = std::move(indexBuffer);
+				// set up descriptor set for the inputs
+				{
+					for (auto i=0u; i<writeBound; i++)
+					{
+						recordInfoBuffer(infos[i],core::smart_refctd_ptr(vertexBuffer));
+						recordSSBOWrite(writes[i],infos+i,i);
+					}
+					recordInfoBuffer(infos[1],core::smart_refctd_ptr(m_indexBuffer));
+
+					setDstSetOnAllWrites(m_additionalGlobalDS.get());
+					m_driver->updateDescriptorSets(writeBound,writes,0u,nullptr);
+					// normals or UVs on their own get fetched as single uints
+					recordInfoBuffer(infos[0],std::move(vertexBuffer));
+					recordSSBOWrite(writes[0],infos,5u);
+					m_driver->updateDescriptorSets(1u,writes,0u,nullptr);
+				}
+				// set up double buffering of MDI command buffers
+				{
+					m_indirectDrawBuffers[0] = std::move(mdiBuffer);
+					const auto mdiBufferSize = m_indirectDrawBuffers[0]->getSize();
+					m_indirectDrawBuffers[1] = m_driver->createDeviceLocalGPUBufferOnDedMem(mdiBufferSize);
+					m_driver->copyBuffer(m_indirectDrawBuffers[0].get(),m_indirectDrawBuffers[1].get(),0u,0u,mdiBufferSize);
+				}
+			};
+
+			if (m_sceneLoadedFromCache)
+			{
+				// the geometry gets uploaded straight out of the mapping
+				auto upload = [&](const SceneCache::E_SECTION section) -> core::smart_refctd_ptr<IGPUBuffer>
+				{
+					return m_driver->createFilledDeviceLocalBufferOnDedMem(sceneCache.getSectionSize(section),sceneCache.getSection(section));
+				};
+				setGeometryBuffers(upload(SceneCache::ES_VERTICES),upload(SceneCache::ES_INDICES),upload(SceneCache::ES_MDI));
+
+				auto newInstanceDataBuffer = core::make_smart_refctd_ptr<ICPUBuffer>(sceneCache.getSectionSize(SceneCache::ES_INSTANCE_DATA));
+				memcpy(newInstanceDataBuffer->getPointer(),sceneCache.getSection(SceneCache::ES_INSTANCE_DATA),newInstanceDataBuffer->getSize());
+				const auto* newInstanceData = reinterpret_cast<const ext::MitsubaLoader::instance_data_t*>(newInstanceDataBuffer->getPointer());
+				{
+					const auto* begin = sceneCache.getSection<CullData_t>(SceneCache::ES_CULL_DATA);
+					cullData.assign(begin,begin+sceneCache.getSectionCount<CullData_t>(SceneCache::ES_CULL_DATA));
+				}
+				{
+					const auto* begin = sceneCache.getSection<MDICall>(SceneCache::ES_MDI_CALLS);
+					m_mdiDrawCalls.assign(begin,begin+sceneCache.getSectionCount<MDICall>(SceneCache::ES_MDI_CALLS));
+				}
+				retval.lights.resize(sceneCache.getSectionCount<SLight>(SceneCache::ES_LIGHTS));
+				memcpy(retval.lights.data(),sceneCache.getSection(SceneCache::ES_LIGHTS),sceneCache.getSectionSize(SceneCache::ES_LIGHTS));
+				{
+					const auto* begin = sceneCache.getSection<float>(SceneCache::ES_LIGHT_PDF);
+					retval.lightPDF.assign(begin,begin+sceneCache.getSectionCount<float>(SceneCache::ES_LIGHT_PDF));
+				}
+				const auto& info = sceneCache.getInfo();
+				m_sceneBound = core::aabbox3df(info.boundMin[0],info.boundMin[1],info.boundMin[2],info.boundMax[0],info.boundMax[1],info.boundMax[2]);
+				m_cullPushConstants.maxDrawCommandCount = info.maxDrawCommandCount;
+
+				// BLASes don't get cached, only what's needed to make them again
+				{
+					const auto* vertexPtr = sceneCache.getSection<float>(SceneCache::ES_VERTICES);
+					const auto* indexPtr = sceneCache.getSection<uint16_t>(SceneCache::ES_INDICES);
+					const auto* batches = sceneCache.getSection<SceneCache::SBatch>(SceneCache::ES_BATCHES);
+					constexpr uint32_t kIndicesPerTriangle = 3u;
+					core::vector<int32_t> fatIndicesForRR(MAX_TRIANGLES_IN_BATCH*kIndicesPerTriangle);
+					uint32_t batchInstanceGUID = 0u;
+					for (auto i=0u; i<sceneCache.getSectionCount<SceneCache::SBatch>(SceneCache::ES_BATCHES); i++)
+					{
+						const auto& batch = batches[i];
+						std::copy_n(indexPtr+batch.firstIndex,batch.indexCount,fatIndicesForRR.data());
+						rrShapes.emplace_back() = rr->CreateMesh(
+							vertexPtr+batch.positionOffset,
+							batch.indexCount,
+							asset::getTexelOrBlockBytesize<asset::EF_R32G32B32_SFLOAT>(),
+							fatIndicesForRR.data(),
+							sizeof(uint32_t)*kIndicesPerTriangle,nullptr,
+							batch.indexCount/kIndicesPerTriangle
+						);
+						const auto thisShapeInstancesBeginIx = rrInstances.size();
+						for (auto j=0u; j<batch.instanceCount; j++,batchInstanceGUID++)
+						{
+							rrInstances.emplace_back() = rr->CreateInstance(rrShapes.back());
+							rrInstances.back()->SetId(batchInstanceGUID);
+							ext::RadeonRays::Manager::shapeSetTransform(rrInstances.back(),newInstanceData[batchInstanceGUID].tform);
+						}
+						for (auto j=thisShapeInstancesBeginIx; j!=rrInstances.size(); j++)
+							rr->AttachShape(rrInstances[j]);
+						if (m_cpuIntersection)
+						{
+							const auto mesh = m_cpuIntersector.addMesh(vertexPtr+batch.positionOffset,indexPtr+batch.firstIndex,batch.indexCount);
+							for (auto j=thisShapeInstancesBeginIx; j!=rrInstances.size(); j++)
+								m_cpuIntersector.addInstance(mesh,newInstanceData[j].tform,j);
+						}
+					}
+				}
+				printf("[INFO] Scene objects loaded from cache %s\n",meshPackingParams.sceneCachePath.c_str());
+
+				instanceDataDescPtr->buffer = {0u,newInstanceDataBuffer->getSize()};
+				instanceDataDescPtr->desc = std::move(newInstanceDataBuffer);
+			}
+			else // split into packed batches
 			{
+				core::vector<IMeshPackerBase::PackedMeshBufferData> pmbd;
+				// what the RadeonRays shapes get made from, for the cache
+				core::vector<SceneCache::SBatch> batches;
 				// one instance data per instance of a batch
 				core::smart_refctd_ptr<ICPUBuffer> newInstanceDataBuffer;
 
@@ -309,16 +513,26 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 				IMeshPackerV2Base::SupportedFormatsContainer formats;
 				formats.insert(EF_R32G32B32_SFLOAT);
 				formats.insert(EF_R32G32_UINT);
+				formats.insert(EF_R32_UINT);
 				auto cpump = core::make_smart_refctd_ptr<CCPUMeshPackerV2<>>(allocParams,formats,minTrisBatch,maxTrisBatch);
-				uint32_t mdiBoundMax=0u,batchInstanceBoundTotal=0u;
+				uint32_t batchInstanceBoundTotal=0u;
 				core::vector<CPUMeshPacker::ReservedAllocationMeshBuffers> allocData;
+				core::vector<const ICPUMeshBuffer*> meshBuffersToProcess;
+				// which of `VERTEX_LAYOUT_NORMAL_BIT` and `VERTEX_LAYOUT_UV_BIT` every entry of `meshBuffersToProcess` got packed with
+				core::vector<uint32_t> vertexLayouts;
+				// only for checking the stripped layouts, same as `vertexLayouts`
+				core::vector<core::smart_refctd_ptr<ICPUBuffer>> unstrippedNormalUVs;
+				// per mesh, where its meshbuffers start in `meshBuffersToProcess` and how many MDI structs it can produce at most
+				core::vector<uint32_t> meshBufferOffsets,mdiBounds;
 				// virtually allocate and size the storage
 				{
-					core::vector<const ICPUMeshBuffer*> meshBuffersToProcess;
+					const auto analysisStart = std::chrono::steady_clock::now();
 					meshBuffersToProcess.reserve(contents.size());
-					// TODO: Optimize! Check which triangles need normals, bin into two separate meshbuffers, dont have normals for meshbuffers where all(abs(transpose(normals)*cross(pos1-pos0,pos2-pos0))~=1.f) 
-					// TODO: Optimize! Check which materials use any textures, if meshbuffer doens't use any textures, its pipeline doesn't need UV coordinates
+					meshBufferOffsets.reserve(contents.size());
+					mdiBounds.reserve(contents.size());
 					// TODO: separate pipeline for stuff without UVs and separate out the barycentric derivative FBO attachment 
+					// but we'll pack normals and UVs together to save one SSBO binding (and quantize UVs to half floats)
+					constexpr auto freeBinding = 15u;
 					for (const auto& asset : contents)
 					{
 						auto cpumesh = static_cast<asset::ICPUMesh*>(asset.get());
@@ -331,60 +545,362 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 							auto meshBuffer = *mbIt;
 							assert(meshBuffer->getInstanceCount()==instanceCount);
 							// We'll disable certain attributes to ensure we only copy position, normal and uv attribute
+							// pipelines are shared between meshbuffers, so this has to happen on one thread before any packing
 							SVertexInputParams& vertexInput = meshBuffer->getPipeline()->getVertexInputParams();
-							// but we'll pack normals and UVs together to save one SSBO binding (and quantize UVs to half floats)
-							constexpr auto freeBinding = 15u;
 							vertexInput.attributes[combinedNormalUVAttributeIx].binding = freeBinding;
 							vertexInput.attributes[combinedNormalUVAttributeIx].format = EF_R32G32_UINT;
 							vertexInput.attributes[combinedNormalUVAttributeIx].relativeOffset = 0u;
 							vertexInput.enabledBindingFlags |= 0x1u<<freeBinding;
 							vertexInput.bindings[freeBinding].inputRate = EVIR_PER_VERTEX;
 							vertexInput.bindings[freeBinding].stride = 0u;
-							const auto approxVxCount = IMeshManipulator::upperBoundVertexID(meshBuffer)+meshBuffer->getBaseVertex();
-							struct CombinedNormalUV
+							vertexInput.attributes[meshBuffer->getNormalAttributeIx()].format = EF_R32_UINT;
+						}
+
+						meshBufferOffsets.push_back(meshBuffersToProcess.size());
+						meshBuffersToProcess.insert(meshBuffersToProcess.end(),meshBuffers.begin(),meshBuffers.end());
+					}
+
+					// every meshbuffer gets its own combined normal and UV buffer, so that's the part which can go wide
+					core::vector<ICPUMeshBuffer*> uniqueMeshBuffers(meshBuffersToProcess.size());
+					std::transform(meshBuffersToProcess.begin(),meshBuffersToProcess.end(),uniqueMeshBuffers.begin(),[](const ICPUMeshBuffer* mb){return const_cast<ICPUMeshBuffer*>(mb);});
+					std::sort(uniqueMeshBuffers.begin(),uniqueMeshBuffers.end());
+					uniqueMeshBuffers.erase(std::unique(uniqueMeshBuffers.begin(),uniqueMeshBuffers.end()),uniqueMeshBuffers.end());
+					core::vector<uint32_t> uniqueIDs(uniqueMeshBuffers.size());
+					std::iota(uniqueIDs.begin(),uniqueIDs.end(),0u);
+
+					// UVs are only ever read to run the texture prefetch stream, and a normal which always equals the geometric one can be recomputed from the positions
+					core::vector<uint32_t> uniqueLayouts(uniqueMeshBuffers.size(),VERTEX_LAYOUT_NORMAL_BIT|VERTEX_LAYOUT_UV_BIT);
+					if (meshPackingParams.stripVertexAttributes)
+					std::for_each(core::execution::par_unseq,uniqueIDs.begin(),uniqueIDs.end(),[&](const uint32_t i) -> void
+					{
+						const auto* meshBuffer = uniqueMeshBuffers[i];
+						const auto* instances = origInstanceData+meshBuffer->getBaseInstance();
+						bool usesTextures = false;
+						bool mirrored = false;
+						for (auto j=0u; j<meshBuffer->getInstanceCount(); j++)
+						{
+							const auto& material = instances[j].material;
+							usesTextures = usesTextures || material.front.prefetch_count || material.back.prefetch_count;
+							// the geometric normal of a mirrored instance points the other way than its transformed vertex normals would
+							mirrored = mirrored || (instances[j].determinantSignBit&0x80000000u);
+						}
+						if (!usesTextures)
+							uniqueLayouts[i] &= ~VERTEX_LAYOUT_UV_BIT;
+						if (!mirrored && isFlatShaded(meshBuffer))
+							uniqueLayouts[i] &= ~VERTEX_LAYOUT_NORMAL_BIT;
+					});
+
+					// a pipeline can't describe more than one layout, so meshbuffers which share one get a copy per layout
+					{
+						core::unordered_map<const ICPURenderpassIndependentPipeline*,core::smart_refctd_ptr<ICPURenderpassIndependentPipeline>> layoutPipelines[4];
+						for (size_t i=0u; i<uniqueMeshBuffers.size(); i++)
+						{
+							const auto layout = uniqueLayouts[i];
+							if (layout==(VERTEX_LAYOUT_NORMAL_BIT|VERTEX_LAYOUT_UV_BIT))
+								continue;
+							auto& pipeline = layoutPipelines[layout>>30u][uniqueMeshBuffers[i]->getPipeline()];
+							if (!pipeline)
 							{
-								uint32_t nml;
-								uint16_t u,v;
-							};
-							auto newBuff = core::make_smart_refctd_ptr<ICPUBuffer>(sizeof(CombinedNormalUV)*approxVxCount);
-							auto* dst = reinterpret_cast<CombinedNormalUV*>(newBuff->getPointer())+meshBuffer->getBaseVertex();
-							meshBuffer->setVertexBufferBinding({0u,newBuff},freeBinding);
-							// copy and pack data
-							const auto normalAttr = meshBuffer->getNormalAttributeIx();
-							vertexInput.attributes[normalAttr].format = EF_R32_UINT;
-							for (auto i=0u; i<approxVxCount; i++)
+								pipeline = core::smart_refctd_ptr_static_cast<ICPURenderpassIndependentPipeline>(uniqueMeshBuffers[i]->getPipeline()->clone(0u));
+								auto& vertexInput = pipeline->getVertexInputParams();
+								vertexInput.attributes[combinedNormalUVAttributeIx].format = EF_R32_UINT;
+								if (!layout)
+									vertexInput.enabledBindingFlags &= ~(0x1u<<freeBinding);
+							}
+							uniqueMeshBuffers[i]->setPipeline(core::smart_refctd_ptr(pipeline));
+						}
+					}
+					core::vector<uint32_t> uniqueIDOfMeshBuffer;
+					{
+						core::unordered_map<const ICPUMeshBuffer*,uint32_t> uniqueIDOf;
+						for (size_t i=0u; i<uniqueMeshBuffers.size(); i++)
+							uniqueIDOf[uniqueMeshBuffers[i]] = i;
+						uniqueIDOfMeshBuffer.reserve(meshBuffersToProcess.size());
+						vertexLayouts.reserve(meshBuffersToProcess.size());
+						for (auto meshBuffer : meshBuffersToProcess)
+						{
+							uniqueIDOfMeshBuffer.push_back(uniqueIDOf[meshBuffer]);
+							vertexLayouts.push_back(uniqueLayouts[uniqueIDOfMeshBuffer.back()]);
+						}
+					}
+
+					auto packNormalsAndUVs = [](const ICPUMeshBuffer* meshBuffer, const uint32_t layout) -> core::smart_refctd_ptr<ICPUBuffer>
+					{
+						if (!layout)
+							return nullptr;
+						const auto approxVxCount = IMeshManipulator::upperBoundVertexID(meshBuffer)+meshBuffer->getBaseVertex();
+						const uint32_t stride = getVertexLayoutByteSize(layout);
+						auto newBuff = core::make_smart_refctd_ptr<ICPUBuffer>(stride*approxVxCount);
+						auto* dst = reinterpret_cast<uint8_t*>(newBuff->getPointer())+stride*meshBuffer->getBaseVertex();
+						// copy and pack data, normal first if there is one
+						const auto normalAttr = meshBuffer->getNormalAttributeIx();
+						for (auto i=0u; i<approxVxCount; i++,dst+=stride)
+						{
+							uint32_t* out = reinterpret_cast<uint32_t*>(dst);
+							if (layout&VERTEX_LAYOUT_NORMAL_BIT)
+								meshBuffer->getAttribute(out++,normalAttr,i);
+							if (layout&VERTEX_LAYOUT_UV_BIT)
 							{
-								meshBuffer->getAttribute(&dst[i].nml,normalAttr,i);
 								core::vectorSIMDf uv;
 								meshBuffer->getAttribute(uv,2u,i);
-								dst[i].u = core::Float16Compressor::compress(uv.x);
-								dst[i].v = core::Float16Compressor::compress(uv.y);
+								*out = uint32_t(core::Float16Compressor::compress(uv.x))|(uint32_t(core::Float16Compressor::compress(uv.y))<<16u);
 							}
 						}
+						return newBuff;
+					};
+					core::vector<core::smart_refctd_ptr<ICPUBuffer>> combinedNormalUVs(uniqueMeshBuffers.size());
+					if (meshPackingParams.benchmark)
+					{
+						const auto serialStart = std::chrono::steady_clock::now();
+						for (auto i : uniqueIDs)
+							combinedNormalUVs[i] = packNormalsAndUVs(uniqueMeshBuffers[i],uniqueLayouts[i]);
+						const auto serialEnd = std::chrono::steady_clock::now();
+						core::vector<core::smart_refctd_ptr<ICPUBuffer>> parallel(uniqueMeshBuffers.size());
+						std::for_each(core::execution::par_unseq,uniqueIDs.begin(),uniqueIDs.end(),[&](const uint32_t i){parallel[i] = packNormalsAndUVs(uniqueMeshBuffers[i],uniqueLayouts[i]);});
+						const auto parallelEnd = std::chrono::steady_clock::now();
+						bool matches = true;
+						for (auto i : uniqueIDs)
+						if (parallel[i])
+							matches = matches && parallel[i]->getSize()==combinedNormalUVs[i]->getSize() && memcmp(parallel[i]->getPointer(),combinedNormalUVs[i]->getPointer(),parallel[i]->getSize())==0;
+						printf("[INFO] Mesh Packing: normal and UV packing of %d meshbuffers serial %.1f ms, parallel %.1f ms, %s\n",uint32_t(uniqueMeshBuffers.size()),
+							std::chrono::duration<double,std::milli>(serialEnd-serialStart).count(),std::chrono::duration<double,std::milli>(parallelEnd-serialEnd).count(),
+							matches ? "identical":"MISMATCH");
+						m_meshPackingChecksPassed = m_meshPackingChecksPassed && matches;
+					}
+					else
+						std::for_each(core::execution::par_unseq,uniqueIDs.begin(),uniqueIDs.end(),[&](const uint32_t i){combinedNormalUVs[i] = packNormalsAndUVs(uniqueMeshBuffers[i],uniqueLayouts[i]);});
+					if (meshPackingParams.stripVertexAttributes)
+					{
+						// what would have been packed without stripping, to check the stripped packing against
+						if (meshPackingParams.benchmark)
+						{
+							core::vector<core::smart_refctd_ptr<ICPUBuffer>> unstripped(uniqueMeshBuffers.size());
+							std::for_each(core::execution::par_unseq,uniqueIDs.begin(),uniqueIDs.end(),[&](const uint32_t i)
+							{
+								unstripped[i] = packNormalsAndUVs(uniqueMeshBuffers[i],VERTEX_LAYOUT_NORMAL_BIT|VERTEX_LAYOUT_UV_BIT);
+							});
+							unstrippedNormalUVs.reserve(meshBuffersToProcess.size());
+							for (auto id : uniqueIDOfMeshBuffer)
+								unstrippedNormalUVs.push_back(unstripped[id]);
+						}
 
-						const uint32_t mdiBound = cpump->calcMDIStructMaxCount(meshBuffers.begin(),meshBuffers.end());
-						mdiBoundMax = core::max(mdiBound,mdiBoundMax);
-						batchInstanceBoundTotal += mdiBound*instanceCount;
+						uint32_t layoutCounts[4] = {0u,0u,0u,0u};
+						size_t fullBytes=0ull,strippedBytes=0ull;
+						for (auto i : uniqueIDs)
+						{
+							const size_t vertexCount = IMeshManipulator::upperBoundVertexID(uniqueMeshBuffers[i]);
+							layoutCounts[uniqueLayouts[i]>>30u]++;
+							fullBytes += vertexCount*getVertexLayoutByteSize(VERTEX_LAYOUT_NORMAL_BIT|VERTEX_LAYOUT_UV_BIT);
+							strippedBytes += vertexCount*getVertexLayoutByteSize(uniqueLayouts[i]);
+						}
+						printf("[INFO] Mesh Packing: %d meshbuffers keep normals and UVs, %d only normals, %d only UVs, %d neither\n",
+							layoutCounts[(VERTEX_LAYOUT_NORMAL_BIT|VERTEX_LAYOUT_UV_BIT)>>30u],layoutCounts[VERTEX_LAYOUT_NORMAL_BIT>>30u],layoutCounts[VERTEX_LAYOUT_UV_BIT>>30u],layoutCounts[0]);
+						printf("[INFO] Mesh Packing: normal and UV attributes take %.2f MB instead of %.2f MB, %.2f MB saved\n",
+							double(strippedBytes)/double(0x1u<<20u),double(fullBytes)/double(0x1u<<20u),double(fullBytes-strippedBytes)/double(0x1u<<20u));
+					}
+					for (auto i : uniqueIDs)
+					if (combinedNormalUVs[i])
+						uniqueMeshBuffers[i]->setVertexBufferBinding({0u,std::move(combinedNormalUVs[i])},freeBinding);
 
-						meshBuffersToProcess.insert(meshBuffersToProcess.end(),meshBuffers.begin(),meshBuffers.end());
+					for (auto i : uniqueIDs)
+					{
+						auto& vertexInput = uniqueMeshBuffers[i]->getPipeline()->getVertexInputParams();
+						vertexInput.enabledAttribFlags = uniqueLayouts[i] ? newEnabledAttributeMask:(newEnabledAttributeMask&~(0x1u<<combinedNormalUVAttributeIx));
+					}
+					// the bound depends on which attributes are left
+					for (auto meshID=0u; meshID<contents.size(); meshID++)
+					{
+						auto meshBuffers = static_cast<asset::ICPUMesh*>(contents.begin()[meshID].get())->getMeshBuffers();
+						const uint32_t mdiBound = cpump->calcMDIStructMaxCount(meshBuffers.begin(),meshBuffers.end());
+						batchInstanceBoundTotal += mdiBound*(*meshBuffers.begin())->getInstanceCount();
+						mdiBounds.push_back(mdiBound);
 					}
-					for (auto meshBuffer : meshBuffersToProcess)
-						const_cast<ICPUMeshBuffer*>(meshBuffer)->getPipeline()->getVertexInputParams().enabledAttribFlags = newEnabledAttributeMask;
 
 					allocData.resize(meshBuffersToProcess.size());
 
 					cpump->alloc(allocData.data(),meshBuffersToProcess.begin(),meshBuffersToProcess.end());
 					cpump->shrinkOutputBuffersSize();
 					cpump->instantiateDataStorage();
+					if (meshPackingParams.stripVertexAttributes || meshPackingParams.benchmark)
+						printf("[INFO] Mesh Packing: packed vertex buffer takes %.2f MB\n",double(cpump->getPackerDataStore().vertexBuffer->getSize())/double(0x1u<<20u));
 
 					pmbd.resize(meshBuffersToProcess.size());
 					cullData.reserve(batchInstanceBoundTotal);
 
 					newInstanceDataBuffer = core::make_smart_refctd_ptr<ICPUBuffer>(sizeof(ext::MitsubaLoader::instance_data_t)*batchInstanceBoundTotal);
+					if (meshPackingParams.benchmark || meshPackingParams.verbose)
+						printf("[INFO] Mesh Packing: analysis and allocation took %.1f ms\n",std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-analysisStart).count());
+				}
+				// Commit the physical memory, every mesh writes its vertices and indices at the offsets it got allocated and nothing else,
+				// so all meshes get committed in parallel into their own scratch before the serial pass which needs them in order
+				struct SMeshCommit
+				{
+					uint32_t mdiCount = 0u;
+					core::vector<CPUMeshPacker::CombinedDataOffsetTable> cdot;
+					core::vector<core::aabbox3df> aabbs;
+				};
+				core::vector<SMeshCommit> meshCommits(contents.size());
+				{
+					core::vector<uint32_t> meshIDs(contents.size());
+					std::iota(meshIDs.begin(),meshIDs.end(),0u);
+					auto commitMesh = [&](auto* packer, IMeshPackerBase::PackedMeshBufferData* outPmbd, CPUMeshPacker::ReservedAllocationMeshBuffers* inAllocData, SMeshCommit& out, const uint32_t meshID) -> void
+					{
+						auto meshBuffers = static_cast<asset::ICPUMesh*>(contents.begin()[meshID].get())->getMeshBuffers();
+						out.cdot.resize(mdiBounds[meshID]);
+						out.aabbs.resize(mdiBounds[meshID]);
+						const auto offset = meshBufferOffsets[meshID];
+						out.mdiCount = packer->commit(outPmbd+offset,out.cdot.data(),out.aabbs.data(),inAllocData+offset,meshBuffers.begin(),meshBuffers.end());
+					};
+					const auto commitStart = std::chrono::steady_clock::now();
+					std::for_each(core::execution::par_unseq,meshIDs.begin(),meshIDs.end(),[&](const uint32_t meshID)
+					{
+						commitMesh(cpump.get(),pmbd.data(),allocData.data(),meshCommits[meshID],meshID);
+					});
+					const double commitTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-commitStart).count();
+					if (meshPackingParams.benchmark)
+					{
+						// same allocations in a second packer, committed the way it always used to be
+						auto reference = core::make_smart_refctd_ptr<CCPUMeshPackerV2<>>(allocParams,formats,minTrisBatch,maxTrisBatch);
+						core::vector<CPUMeshPacker::ReservedAllocationMeshBuffers> referenceAllocData(meshBuffersToProcess.size());
+						reference->alloc(referenceAllocData.data(),meshBuffersToProcess.begin(),meshBuffersToProcess.end());
+						reference->shrinkOutputBuffersSize();
+						reference->instantiateDataStorage();
+						core::vector<IMeshPackerBase::PackedMeshBufferData> referencePmbd(meshBuffersToProcess.size());
+						core::vector<SMeshCommit> referenceCommits(contents.size());
+						const auto serialStart = std::chrono::steady_clock::now();
+						for (auto meshID : meshIDs)
+							commitMesh(reference.get(),referencePmbd.data(),referenceAllocData.data(),referenceCommits[meshID],meshID);
+						const double serialTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-serialStart).count();
+
+						auto sameBuffer = [](const ICPUBuffer* a, const ICPUBuffer* b) -> bool
+						{
+							return a->getSize()==b->getSize() && memcmp(a->getPointer(),b->getPointer(),a->getSize())==0;
+						};
+						const auto& dataStore = cpump->getPackerDataStore();
+						const auto& referenceDataStore = reference->getPackerDataStore();
+						bool matches = sameBuffer(dataStore.vertexBuffer.get(),referenceDataStore.vertexBuffer.get());
+						matches = matches && sameBuffer(dataStore.indexBuffer.get(),referenceDataStore.indexBuffer.get());
+						matches = matches && sameBuffer(dataStore.MDIDataBuffer.get(),referenceDataStore.MDIDataBuffer.get());
+						matches = matches && memcmp(pmbd.data(),referencePmbd.data(),pmbd.size()*sizeof(IMeshPackerBase::PackedMeshBufferData))==0;
+						for (auto meshID : meshIDs)
+						{
+							const auto& actual = meshCommits[meshID];
+							const auto& expected = referenceCommits[meshID];
+							matches = matches && actual.mdiCount==expected.mdiCount;
+							matches = matches && memcmp(actual.cdot.data(),expected.cdot.data(),actual.mdiCount*sizeof(CPUMeshPacker::CombinedDataOffsetTable))==0;
+							matches = matches && memcmp(actual.aabbs.data(),expected.aabbs.data(),actual.mdiCount*sizeof(core::aabbox3df))==0;
+						}
+						printf("[INFO] Mesh Packing: commit of %d meshes serial %.1f ms, parallel %.1f ms, packed buffers %s\n",uint32_t(meshIDs.size()),serialTime,commitTime,matches ? "identical":"MISMATCH");
+						m_meshPackingChecksPassed = m_meshPackingChecksPassed && matches;
+
+						if (meshPackingParams.stripVertexAttributes)
+						{
+							// fetch every packed triangle the way the shaders do and compare it against the same triangle packed without stripping,
+							// the packer splits and reorders triangles into batches so they get matched up by their positions
+							const auto* packedIndices = reinterpret_cast<const uint16_t*>(dataStore.indexBuffer->getPointer());
+							const auto* packedVertices = reinterpret_cast<const uint8_t*>(dataStore.vertexBuffer->getPointer());
+							const auto* packedMDI = reinterpret_cast<const DrawElementsIndirectCommand_t*>(dataStore.MDIDataBuffer->getPointer());
+							struct STriangle
+							{
+								std::array<float,9> positions;
+								uint32_t normals[3];
+								uint32_t uvs[3];
+							};
+							struct PositionHash
+							{
+								inline size_t operator()(const std::array<float,9>& positions) const
+								{
+									return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(positions.data()),sizeof(positions)));
+								}
+							};
+							// cos(0.5 degrees), how far apart shading normals may be without it showing, on purpose not `FlatShadingMinCosine`
+							// so that a too loose flat shading threshold shows up as triangles that shade differently
+							constexpr float ShadedNormalMinCosine = 0.99996f;
+							std::atomic_uint32_t triangleCount=0u,mismatchCount=0u;
+							std::for_each(core::execution::par_unseq,meshIDs.begin(),meshIDs.end(),[&](const uint32_t meshID)
+							{
+								auto meshBuffers = static_cast<asset::ICPUMesh*>(contents.begin()[meshID].get())->getMeshBuffers();
+								auto cdotIt = meshCommits[meshID].cdot.begin();
+								for (uint32_t mbID=meshBufferOffsets[meshID]; mbID<meshBufferOffsets[meshID]+meshBuffers.size(); mbID++)
+								{
+									const auto* meshBuffer = meshBuffersToProcess[mbID];
+									const auto posAttr = meshBuffer->getPositionAttributeIx();
+									const auto* unstripped = reinterpret_cast<const uint32_t*>(unstrippedNormalUVs[mbID]->getPointer())+meshBuffer->getBaseVertex()*2u;
+									std::unordered_multimap<std::array<float,9>,STriangle,PositionHash> originalTriangles;
+									for (uint32_t i=0u; i<meshBuffer->getIndexCount(); i+=3u)
+									{
+										STriangle triangle;
+										for (auto j=0u; j<3u; j++)
+										{
+											const uint32_t vertexID = meshBuffer->getIndexValue(i+j);
+											core::vectorSIMDf position;
+											meshBuffer->getAttribute(position,posAttr,vertexID);
+											std::copy_n(position.pointer,3u,triangle.positions.data()+j*3u);
+											triangle.normals[j] = unstripped[vertexID*2u+0u];
+											triangle.uvs[j] = unstripped[vertexID*2u+1u];
+										}
+										originalTriangles.emplace(triangle.positions,triangle);
+									}
+
+									const uint32_t layout = vertexLayouts[mbID];
+									const uint32_t stride = getVertexLayoutByteSize(layout)/sizeof(uint32_t);
+									uint32_t localTriangleCount=0u,localMismatchCount=0u;
+									for (auto i=0u; i<pmbd[mbID].mdiParameterCount; i++,cdotIt++)
+									{
+										const auto& mdi = packedMDI[pmbd[mbID].mdiParameterOffset+i];
+										const auto* positions = reinterpret_cast<const float*>(packedVertices)+cdotIt->attribInfo[posAttr].getOffset()*3u;
+										const auto* normalUVs = reinterpret_cast<const uint32_t*>(packedVertices)+cdotIt->attribInfo[combinedNormalUVAttributeIx].getOffset()*stride;
+										for (auto j=0u; j<mdi.count; j+=3u)
+										{
+											std::array<float,9> key;
+											uint32_t vertexIDs[3];
+											for (auto k=0u; k<3u; k++)
+											{
+												vertexIDs[k] = packedIndices[mdi.firstIndex+j+k];
+												std::copy_n(positions+vertexIDs[k]*3u,3u,key.data()+k*3u);
+											}
+											auto position = [&key](const uint32_t k) -> core::vectorSIMDf
+											{
+												return core::vectorSIMDf(key[k*3u+0u],key[k*3u+1u],key[k*3u+2u]);
+											};
+											const auto geomNormal = core::cross(position(1u)-position(0u),position(2u)-position(0u));
+											const float lenSq = core::dot(geomNormal,geomNormal).x;
+											auto matches = [&](const STriangle& original) -> bool
+											{
+												for (auto k=0u; k<3u; k++)
+												{
+													const uint32_t* packed = normalUVs+vertexIDs[k]*stride;
+													if (layout&VERTEX_LAYOUT_NORMAL_BIT)
+													{
+														if (*(packed++)!=original.normals[k])
+															return false;
+													}
+													else if (lenSq>FLT_MIN && !(core::dot(core::normalize(decodeRGB10A2_SNORM(original.normals[k])),geomNormal*core::inversesqrt(lenSq)).x>=ShadedNormalMinCosine))
+														return false;
+													if ((layout&VERTEX_LAYOUT_UV_BIT) && *packed!=original.uvs[k])
+														return false;
+												}
+												return true;
+											};
+											const auto candidates = originalTriangles.equal_range(key);
+											if (std::none_of(candidates.first,candidates.second,[&](const auto& candidate){return matches(candidate.second);}))
+												localMismatchCount++;
+											localTriangleCount++;
+										}
+									}
+									triangleCount += localTriangleCount;
+									mismatchCount += localMismatchCount;
+								}
+							});
+							printf("[INFO] Mesh Packing: %d of %d triangles shade differently with stripped vertex attributes\n",mismatchCount.load(),triangleCount.load());
+							m_meshPackingChecksPassed = m_meshPackingChecksPassed && mismatchCount==0u;
+						}
+					}
+					else if (meshPackingParams.verbose)
+						printf("[INFO] Mesh Packing: commit took %.1f ms\n",commitTime);
 				}
-				// actually commit the physical memory, compute batches and set up instance data
+				// compute batches and set up instance data
 				{
-					auto allocDataIt = allocData.begin();
 					auto pmbdIt = pmbd.begin();
 					auto* indexPtr = reinterpret_cast<const uint16_t*>(cpump->getPackerDataStore().indexBuffer->getPointer());
 					auto* vertexPtr = reinterpret_cast<const float*>(cpump->getPackerDataStore().vertexBuffer->getPointer());
@@ -392,10 +908,9 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 					auto* newInstanceData = reinterpret_cast<ext::MitsubaLoader::instance_data_t*>(newInstanceDataBuffer->getPointer());
 
 					constexpr uint32_t kIndicesPerTriangle = 3u;
-					core::vector<CPUMeshPacker::CombinedDataOffsetTable> cdot(mdiBoundMax);
-					core::vector<core::aabbox3df> aabbs(mdiBoundMax);
 					MDICall* mdiCall = nullptr;
 					core::vector<int32_t> fatIndicesForRR(maxTrisBatch*kIndicesPerTriangle);
+					auto meshCommitIt = meshCommits.begin();
 					for (const auto& asset : contents)
 					{
 						auto cpumesh = static_cast<asset::ICPUMesh*>(asset.get());
@@ -404,9 +919,8 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 						const auto& instanceAuxData = meta->m_instanceAuxData;
 
 						auto meshBuffers = cpumesh->getMeshBuffers();
-						const uint32_t actualMdiCnt = cpump->commit(&*pmbdIt,cdot.data(),aabbs.data(),&*allocDataIt,meshBuffers.begin(),meshBuffers.end());
-						allocDataIt += meshBuffers.size();
-						if (actualMdiCnt==0u)
+						const auto& meshCommit = *(meshCommitIt++);
+						if (meshCommit.mdiCount==0u)
 						{
 							std::cout << "Commit failed" << std::endl;
 							_NBL_DEBUG_BREAK_IF(true);
@@ -416,8 +930,8 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 
 						const auto aabbMesh = cpumesh->getBoundingBox();
 						// meshbuffers
-						auto cdotIt = cdot.begin();
-						auto aabbsIt = aabbs.begin();
+						auto cdotIt = meshCommit.cdot.begin();
+						auto aabbsIt = meshCommit.aabbs.begin();
 						for (auto mb : meshBuffers)
 						{
 							assert(mb->getInstanceCount()==instanceData.size());
@@ -436,8 +950,12 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 								// set up BLAS
 								const auto indexCount = mdi.count;
 								std::copy_n(indexPtr+firstIndex,indexCount,fatIndicesForRR.data());
+								auto& batch = batches.emplace_back();
+								batch.positionOffset = cdotIt->attribInfo[posAttrID].getOffset()*sizeof(vec3)/sizeof(float);
+								batch.firstIndex = firstIndex;
+								batch.indexCount = indexCount;
 								rrShapes.emplace_back() = rr->CreateMesh(
-									vertexPtr+cdotIt->attribInfo[posAttrID].getOffset()*sizeof(vec3)/sizeof(float),
+									vertexPtr+batch.positionOffset,
 									mdi.count, // could be improved if mesh packer returned the `usedVertices.size()` for every batch in the cdot
 									asset::getTexelOrBlockBytesize<asset::EF_R32G32B32_SFLOAT>(),
 									fatIndicesForRR.data(),
@@ -454,7 +972,8 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 									const auto instanceID = std::distance(instanceAuxData.begin(),auxIt);
 									*newInstanceData = mbInstanceData[instanceID];
 									//assert(instanceData.begin()[instanceID].worldTform==newInstanceData->tform); TODO: later
-									newInstanceData->padding0 = firstIndex;
+									assert(firstIndex<=VERTEX_LAYOUT_FIRST_INDEX_MASK);
+									newInstanceData->padding0 = firstIndex|vertexLayouts[std::distance(pmbd.begin(),pmbdIt)];
 									newInstanceData->padding1 = reinterpret_cast<const uint32_t&>(cdotIt->attribInfo[posAttrID]);
 									newInstanceData->determinantSignBit = core::bitfieldInsert(
 										newInstanceData->determinantSignBit,
@@ -501,8 +1020,17 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 
 									newInstanceData++;
 								}
+								batches.back().instanceCount = rrInstances.size()-thisShapeInstancesBeginIx;
 								for (auto j=thisShapeInstancesBeginIx; j!=rrInstances.size(); j++)
 									rr->AttachShape(rrInstances[j]);
+								if (m_cpuIntersection)
+								{
+									const auto mesh = m_cpuIntersector.addMesh(vertexPtr+batch.positionOffset,indexPtr+firstIndex,indexCount);
+									// same as the GPU, instance data is indexed by `batchInstanceGUID`
+									const auto* instanceData = reinterpret_cast<const ext::MitsubaLoader::instance_data_t*>(newInstanceDataBuffer->getPointer());
+									for (auto j=thisShapeInstancesBeginIx; j!=rrInstances.size(); j++)
+										m_cpuIntersector.addInstance(mesh,instanceData[j].tform,j);
+								}
 								cdotIt++;
 								aabbsIt++;
 							}
@@ -527,34 +1055,46 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 					m_sceneBound.MaxEdge.Y,
 					m_sceneBound.MaxEdge.Z
 				);
+				m_cullPushConstants.maxDrawCommandCount = pmbd.back().mdiParameterOffset+pmbd.back().mdiParameterCount;
+				if (!meshPackingParams.sceneCachePath.empty())
+				{
+					const auto& dataStore = cpump->getPackerDataStore();
+					SceneCache::SSceneInfo info = {};
+					info.boundMin[0] = m_sceneBound.MinEdge.X;
+					info.boundMin[1] = m_sceneBound.MinEdge.Y;
+					info.boundMin[2] = m_sceneBound.MinEdge.Z;
+					info.boundMax[0] = m_sceneBound.MaxEdge.X;
+					info.boundMax[1] = m_sceneBound.MaxEdge.Y;
+					info.boundMax[2] = m_sceneBound.MaxEdge.Z;
+					info.maxDrawCommandCount = m_cullPushConstants.maxDrawCommandCount;
+					const SceneCache::SSectionData sections[SceneCache::ES_COUNT] = {
+						{dataStore.vertexBuffer->getPointer(),dataStore.vertexBuffer->getSize()},
+						{dataStore.indexBuffer->getPointer(),dataStore.indexBuffer->getSize()},
+						{dataStore.MDIDataBuffer->getPointer(),dataStore.MDIDataBuffer->getSize()},
+						{newInstanceDataBuffer->getPointer(),cullData.size()*sizeof(ext::MitsubaLoader::instance_data_t)},
+						{cullData.data(),cullData.size()*sizeof(CullData_t)},
+						{batches.data(),batches.size()*sizeof(SceneCache::SBatch)},
+						{m_mdiDrawCalls.data(),m_mdiDrawCalls.size()*sizeof(MDICall)},
+						{retval.lights.data(),retval.lights.size()*sizeof(SLight)},
+						{retval.lightPDF.data(),retval.lightPDF.size()*sizeof(float)}
+					};
+					if (!SceneCache::save(meshPackingParams.sceneCachePath,meshPackingParams.sceneHash,sceneCacheOptionsHash,info,sections))
+						printf("[ERROR] Could not write the scene cache %s\n",meshPackingParams.sceneCachePath.c_str());
+					// only a directory of its own gets trimmed, other caches sit next to the executable
+					const std::filesystem::path sceneCachePath(meshPackingParams.sceneCachePath);
+					if (meshPackingParams.sceneCacheMaxBytes && sceneCachePath.has_parent_path())
+					if (const auto evictions=SceneCache::trim(sceneCachePath.parent_path(),meshPackingParams.sceneCacheMaxBytes,sceneCachePath))
+						printf("[INFO] Scene cache evicted %d least recently used scenes to stay under %llu MB\n",evictions,static_cast<unsigned long long>(meshPackingParams.sceneCacheMaxBytes>>20ull));
+				}
+
 				instanceDataDescPtr->buffer = {0u,cullData.size()*sizeof(ext::MitsubaLoader::instance_data_t)};
 				instanceDataDescPtr->desc = std::move(newInstanceDataBuffer); // TODO: trim the buffer
 				{
 					auto gpump = core::make_smart_refctd_ptr<GPUMeshPacker>(m_driver,cpump.get());
 					const auto& dataStore = gpump->getPackerDataStore();
-					m_indexBuffer = dataStore.indexBuffer;
-					// set up descriptor set for the inputs
-					{
-						for (auto i=0u; i<writeBound; i++)
-						{
-							recordInfoBuffer(infos[i],core::smart_refctd_ptr(dataStore.vertexBuffer));
-							recordSSBOWrite(writes[i],infos+i,i);
-						}
-						recordInfoBuffer(infos[1],core::smart_refctd_ptr(m_indexBuffer));
-
-						setDstSetOnAllWrites(m_additionalGlobalDS.get());
-						m_driver->updateDescriptorSets(writeBound,writes,0u,nullptr);
-					}
-					// set up double buffering of MDI command buffers
-					{
-						m_indirectDrawBuffers[0] = dataStore.MDIDataBuffer;
-						const auto mdiBufferSize = m_indirectDrawBuffers[0]->getSize();
-						m_indirectDrawBuffers[1] = m_driver->createDeviceLocalGPUBufferOnDedMem(mdiBufferSize);
-						m_driver->copyBuffer(m_indirectDrawBuffers[0].get(),m_indirectDrawBuffers[1].get(),0u,0u,mdiBufferSize);
-					}
+					setGeometryBuffers(core::smart_refctd_ptr(dataStore.vertexBuffer),core::smart_refctd_ptr(dataStore.indexBuffer),core::smart_refctd_ptr(dataStore.MDIDataBuffer));
 				}
 			}
-			m_cullPushConstants.maxDrawCommandCount = pmbd.back().mdiParameterOffset+pmbd.back().mdiParameterCount;
 			m_cullPushConstants.maxGlobalInstanceCount = cullData.size();
 		}
 
@@ -565,6 +1105,12 @@ Renderer::InitializationData Renderer::initSceneObjects(const SAssetBundle& mesh
 		rr->SetOption("bvh.forceflat",1.f);
 		rr->SetOption("acc.type","fatbvh");
 		rr->Commit();
+		if (m_cpuIntersection)
+		{
+			m_cpuIntersector.build();
+			const auto& stats = m_cpuIntersector.getStats();
+			printf("[INFO] CPU BVH over %llu triangles and %u instances built in %.1f ms\n",static_cast<unsigned long long>(stats.triangleCount),stats.instanceCount,stats.buildMs);
+		}
 	}
 
 	m_cullPushConstants.currentCommandBufferIx = 0x0u;
@@ -793,36 +1339,8 @@ void Renderer::finalizeScene(Renderer::InitializationData& initData)
 		return;
 	m_staticViewData.lightCount = initData.lights.size();
 
-	const double weightSum = std::accumulate(initData.lightPDF.begin(),initData.lightPDF.end(),0.0);
-	assert(weightSum>FLT_MIN);
-
-	constexpr double UINT_MAX_DOUBLE = double(0x1ull<<32ull);
-	const double weightSumRcp = UINT_MAX_DOUBLE/weightSum;
-
-	auto outCDF = initData.lightCDF.begin();
-
-	auto inPDF = initData.lightPDF.begin();
-	double partialSum = *inPDF;
-
-	auto computeCDF = [UINT_MAX_DOUBLE,weightSumRcp,&partialSum,&outCDF](uint32_t prevCDF) -> void
-	{
-		const double exactCDF = weightSumRcp*partialSum+double(FLT_MIN);
-		if (exactCDF<UINT_MAX_DOUBLE)
-			*outCDF = static_cast<uint32_t>(exactCDF);
-		else
-		{
-			assert(exactCDF<UINT_MAX_DOUBLE+1.0);
-			*outCDF = 0xdeadbeefu;
-		}
-	};
-
-	computeCDF(0u);
-	for (auto prevCDF=outCDF++; outCDF!=initData.lightCDF.end(); prevCDF=outCDF++)
-	{
-		partialSum += double(*(++inPDF));
-
-		computeCDF(*prevCDF);
-	}
+	// converts in place, `lightPDF` and `lightCDF` share storage
+	LightCDFSampler::computeCDF(initData.lightPDF.begin(),initData.lightPDF.end(),initData.lightCDF.begin());
 }
 
 core::smart_refctd_ptr<IGPUImageView> Renderer::createScreenSizedTexture(E_FORMAT format, uint32_t layers)
@@ -853,57 +1371,97 @@ core::smart_refctd_ptr<IGPUImageView> Renderer::createScreenSizedTexture(E_FORMA
 }
 
 
-core::smart_refctd_ptr<asset::ICPUBuffer> Renderer::SampleSequence::createCPUBuffer(uint32_t quantizedDimensions, uint32_t sampleCount)
-{
-	const size_t bytesize = SampleSequence::QuantizedDimensionsBytesize*quantizedDimensions*sampleCount;
-	if (bytesize)
-		return core::make_smart_refctd_ptr<asset::ICPUBuffer>(bytesize);
-	else
-		return nullptr;
-}
-void Renderer::SampleSequence::createBufferView(IVideoDriver* driver, core::smart_refctd_ptr<asset::ICPUBuffer>&& buff)
+void Renderer::SampleSequence::createBufferView(IVideoDriver* driver, const std::string& cachePath, uint32_t _quantizedDimensions, uint32_t _sampleCount)
 {
-	auto gpubuf = driver->createFilledDeviceLocalBufferOnDedMem(buff->getSize(),buff->getPointer());
-	bufferView = driver->createBufferView(gpubuf.get(),asset::EF_R32G32_UINT);
-}
-core::smart_refctd_ptr<ICPUBuffer> Renderer::SampleSequence::createBufferView(IVideoDriver* driver, uint32_t quantizedDimensions, uint32_t sampleCount)
-{
-	constexpr auto DimensionsPerQuanta = 3u;
-	const auto dimensions = quantizedDimensions*DimensionsPerQuanta;
-	core::OwenSampler sampler(dimensions,0xdeadbeefu);
-
-	// Memory Order: 3 Dimensions, then multiple of sampling stragies per vertex, then depth, then sample ID
-	auto buff = createCPUBuffer(quantizedDimensions,sampleCount);
-	uint32_t(&pout)[][2] = *reinterpret_cast<uint32_t(*)[][2]>(buff->getPointer());
-	// the horrible order of iteration over output memory is caused by the fact that certain samplers like the 
-	// Owen Scramble sampler, have a large cache which needs to be generated separately for each dimension.
-	for (auto metadim=0u; metadim<quantizedDimensions; metadim++)
-	{
-		const auto trudim = metadim*DimensionsPerQuanta;
-		for (uint32_t i=0; i<sampleCount; i++)
-			pout[i*quantizedDimensions+metadim][0] = sampler.sample(trudim+0u,i);
-		for (uint32_t i=0; i<sampleCount; i++)
-			pout[i*quantizedDimensions+metadim][1] = sampler.sample(trudim+1u,i);
-		for (uint32_t i=0; i<sampleCount; i++)
+	quantizedDimensions = _quantizedDimensions;
+	sampleCount = _sampleCount;
+	committedSamples = 0u;
+	generated = nullptr;
+
+	// a cache with more samples or dimensions than we need is fine, we only gather what we need out of it
+	uint32_t cachedQuantizedDimensions = 0u;
+	uint32_t columnSampleCount = sampleCount;
+	if (cache.load(cachePath))
+	{
+		const auto* header = cache.getHeader();
+		if (header->sampleCount>=sampleCount)
 		{
-			const auto sample = sampler.sample(trudim+2u,i);
-			const auto out = pout[i*quantizedDimensions+metadim];
-			out[0] &= 0xFFFFF800u;
-			out[0] |= sample>>21;
-			out[1] &= 0xFFFFF800u;
-			out[1] |= (sample>>10)&0x07FFu;
+			cachedQuantizedDimensions = core::min(header->quantizedDimensions,quantizedDimensions);
+			columnSampleCount = header->sampleCount;
 		}
+		else
+		{
+			printf("[INFO] Sample Sequence cache %s only has %d samples, regenerating\n",cachePath.c_str(),header->sampleCount);
+			cache.close();
+		}
+	}
+
+	columns.resize(quantizedDimensions);
+	if (cachedQuantizedDimensions<quantizedDimensions)
+	{
+		const uint32_t missingDimensions = quantizedDimensions-cachedQuantizedDimensions;
+		printf("[INFO] Generating %d of %d Low Discrepancy Sample Sequence dimensions, please wait...\n",missingDimensions,quantizedDimensions);
+		generated.reset(new uint32_t[size_t(quantizedDimensions)*columnSampleCount][2]);
+		for (auto column=0u; column<cachedQuantizedDimensions; column++)
+			memcpy(generated[size_t(column)*columnSampleCount],cache.getColumn(column),SampleSequenceCache::getColumnSize(columnSampleCount));
+		cache.close();
+
+		const auto start = std::chrono::steady_clock::now();
+		const auto layout = SampleSequenceGenerator::SLayout::columns(columnSampleCount);
+		SampleSequenceGenerator::generate(generated.get()+size_t(cachedQuantizedDimensions)*columnSampleCount,layout,cachedQuantizedDimensions,missingDimensions,columnSampleCount);
+		const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count();
+		printf("[INFO] Generated %d quantized dimensions x %d samples in %d ms\n",missingDimensions,columnSampleCount,static_cast<int>(elapsed));
+
+		if (!SampleSequenceCache::save(cachePath,columnSampleCount,quantizedDimensions,generated.get()))
+			printf("[WARNING] Could not write the Sample Sequence cache to %s\n",cachePath.c_str());
+		for (auto column=0u; column<quantizedDimensions; column++)
+			columns[column] = generated.get()+size_t(column)*columnSampleCount;
 	}
-	// upload sequence to GPU
-	createBufferView(driver,core::smart_refctd_ptr(buff));
-	// return for caching
-	return buff;
+	else for (auto column=0u; column<quantizedDimensions; column++)
+		columns[column] = cache.getColumn(column);
+
+	// the buffer only ever holds the committed prefix, it starts with the first page
+	buffer = nullptr;
+	bufferView = nullptr;
+	bufferSamples = 0u;
+	commitSamples(driver,1u);
+}
+bool Renderer::SampleSequence::commitSamples(IVideoDriver* driver, uint32_t sampleEnd)
+{
+	sampleEnd = core::min(sampleEnd,sampleCount);
+	if (sampleEnd<=committedSamples)
+		return false;
+	// pages are committed in order, so everything below `committedSamples` is resident,
+	// a short preview never pays for gathering and uploading the whole sequence
+	const uint32_t firstSample = committedSamples;
+	const uint32_t lastSample = core::min(core::roundUp(sampleEnd,SampleSequenceGenerator::PageSampleCount),sampleCount);
+	const uint32_t pageSamples = lastSample-firstSample;
+
+	// grow geometrically so a long accumulation reallocates a logarithmic number of times, the resident prefix gets copied over on the GPU
+	const bool grow = lastSample>bufferSamples;
+	if (grow)
+	{
+		const uint32_t newBufferSamples = core::min(core::max(lastSample,bufferSamples*2u),sampleCount);
+		auto newBuffer = driver->createDeviceLocalGPUBufferOnDedMem(size_t(quantizedDimensions)*newBufferSamples*QuantizedDimensionsBytesize);
+		if (firstSample)
+			driver->copyBuffer(buffer.get(),newBuffer.get(),0u,0u,size_t(firstSample)*quantizedDimensions*QuantizedDimensionsBytesize);
+		buffer = std::move(newBuffer);
+		bufferView = driver->createBufferView(buffer.get(),asset::EF_R32G32_UINT);
+		bufferSamples = newBufferSamples;
+	}
+
+	core::vector<uint64_t> page(size_t(pageSamples)*quantizedDimensions);
+	SampleSequenceGenerator::interleave(reinterpret_cast<uint32_t(*)[2]>(page.data()),columns.data(),quantizedDimensions,firstSample,pageSamples);
+	// straight through the driver's streaming staging buffer, no dedicated allocation per page
+	driver->updateBufferRangeViaStagingBuffer(buffer.get(),size_t(firstSample)*quantizedDimensions*QuantizedDimensionsBytesize,page.size()*sizeof(uint64_t),page.data());
+	committedSamples = lastSample;
+	return grow;
 }
 
 //
 
 // TODO: be able to fail
-void Renderer::initSceneResources(SAssetBundle& meshes, nbl::io::path&& _sampleSequenceCachePath)
+void Renderer::initSceneResources(SAssetBundle& meshes, nbl::io::path&& _sampleSequenceCachePath, const SMeshPackingParams& meshPackingParams)
 {
 	deinitSceneResources();
 
@@ -912,7 +1470,7 @@ void Renderer::initSceneResources(SAssetBundle& meshes, nbl::io::path&& _sampleS
 	{
 		// captures m_globalBackendDataDS, creates m_indirectDrawBuffers, sets up m_mdiDrawCalls ranges
 		// creates m_additionalGlobalDS and m_cullDS, sets m_cullPushConstants and m_cullWorkgroups, creates m_perCameraRasterDS
-		auto initData = initSceneObjects(meshes);
+		auto initData = initSceneObjects(meshes,meshPackingParams);
 		{
 			initSceneNonAreaLights(initData);
 			finalizeScene(initData);
@@ -1023,24 +1581,7 @@ void Renderer::initSceneResources(SAssetBundle& meshes, nbl::io::path&& _sampleS
 		
 		// load sample cache
 		{
-			core::smart_refctd_ptr<ICPUBuffer> cachebuff;
-			uint32_t cachedQuantizedDimensions=0u,cachedSampleCount=0u;
-			{
-				sampleSequenceCachePath = std::move(_sampleSequenceCachePath);
-				io::IReadFile* cacheFile = m_assetManager->getFileSystem()->createAndOpenFile(sampleSequenceCachePath);
-				if (cacheFile)
-				{
-					cacheFile->read(&cachedQuantizedDimensions,sizeof(cachedQuantizedDimensions));
-					if (cachedQuantizedDimensions)
-					{
-						cachedSampleCount = (cacheFile->getSize()-cacheFile->getPos())/(cachedQuantizedDimensions*SampleSequence::QuantizedDimensionsBytesize);
-						cachebuff = sampleSequence.createCPUBuffer(cachedQuantizedDimensions,cachedSampleCount);
-						if (cachebuff)
-							cacheFile->read(cachebuff->getPointer(),cachebuff->getSize());
-					}
-					cacheFile->drop();
-				}
-			}
+			sampleSequenceCachePath = std::move(_sampleSequenceCachePath);
 			// lets keep path length within bounds of sanity
 			constexpr auto MaxPathDepth = 255u;
 			if (pathDepth==0)
@@ -1058,22 +1599,8 @@ void Renderer::initSceneResources(SAssetBundle& meshes, nbl::io::path&& _sampleS
 			// Mantissa is only 23 bits, and primary sample space low discrepancy sequence will start to produce duplicates
 			// near 1.0 with exponent -1 after the sample count passes 2^24 elements.
 			// Another limiting factor is our encoding of sample sequences, we only use 21bits per channel, so no duplicates till 2^21 samples.
-			maxSensorSamples = core::min(0x1<<21,maxSensorSamples);
-			if (cachedQuantizedDimensions>=quantizedDimensions && cachedSampleCount>=maxSensorSamples)
-				sampleSequence.createBufferView(m_driver,std::move(cachebuff));
-			else
-			{
-				printf("[INFO] Generating Low Discrepancy Sample Sequence Cache, please wait...\n");
-				cachebuff = sampleSequence.createBufferView(m_driver,quantizedDimensions,maxSensorSamples);
-				// save sequence
-				io::IWriteFile* cacheFile = m_assetManager->getFileSystem()->createAndWriteFile(sampleSequenceCachePath);
-				if (cacheFile)
-				{
-					cacheFile->write(&quantizedDimensions,sizeof(quantizedDimensions));
-					cacheFile->write(cachebuff->getPointer(),cachebuff->getSize());
-					cacheFile->drop();
-				}
-			}
+			maxSensorSamples = core::min<uint64_t>(0x1<<21,uint64_t(maxSensorSamples)*m_adaptiveSamplingHeadroom);
+			sampleSequence.createBufferView(m_driver,sampleSequenceCachePath.c_str(),quantizedDimensions,maxSensorSamples);
 			std::cout << "\tpathDepth = " << pathDepth << std::endl;
 			std::cout << "\tnoRussianRouletteDepth = " << noRussianRouletteDepth << std::endl;
 			std::cout << "\tmaxSamples = " << maxSensorSamples << std::endl;
@@ -1109,7 +1636,7 @@ void Renderer::deinitSceneResources()
 	m_indirectDrawBuffers[1] = m_indirectDrawBuffers[0] = nullptr;
 	m_indexBuffer = nullptr;
 
-	m_raytraceCommonData = {core::matrix4SIMD(),vec3(),0.f,0,0,0,0.f};
+	m_raytraceCommonData = {core::matrix4SIMD(),vec3(),0.f,0,0,0,0.f,0};
 	m_sceneBound = core::aabbox3df(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
 	
 	m_finalEnvmap = nullptr;
@@ -1126,6 +1653,7 @@ void Renderer::deinitSceneResources()
 	for (auto shape : rrShapes)
 		rr->DeleteShape(shape);
 	rrShapes.clear();
+	m_cpuIntersector.clear();
 
 	pathDepth = DefaultPathDepth;
 	noRussianRouletteDepth = 5u;
@@ -1136,6 +1664,8 @@ void Renderer::initScreenSizedResources(uint32_t width, uint32_t height)
 {
 	m_staticViewData.imageDimensions = {width, height};
 	m_rcpPixelSize = { 2.f/float(m_staticViewData.imageDimensions.x),-2.f/float(m_staticViewData.imageDimensions.y) };
+	m_renderRegion = {{0u,0u},{width,height}};
+	m_renderRegionCrop = core::matrix4SIMD();
 
 	// figure out dispatch sizes
 	m_raygenWorkGroups[0] = (m_staticViewData.imageDimensions.x-1u)/WORKGROUP_DIM+1u;
@@ -1313,41 +1843,24 @@ void Renderer::initScreenSizedResources(uint32_t width, uint32_t height)
 	// set up m_raygenDS
 	core::smart_refctd_ptr<IGPUImageView> visibilityBuffer = createScreenSizedTexture(EF_R32G32B32A32_UINT);
 	{
-		{
-			constexpr auto ScrambleStateChannels = 2u;
-			auto tmpBuff = m_driver->createCPUSideGPUVisibleGPUBufferOnDedMem(sizeof(uint32_t)*ScrambleStateChannels*renderPixelCount);
-			// generate (maybe let's improve the scramble key beginning distribution)
-			{
-				core::RandomSampler rng(0xbadc0ffeu);
-				auto it = reinterpret_cast<uint32_t*>(tmpBuff->getBoundMemory()->mapMemoryRange(
-					IDeviceMemoryAllocation::EMCAF_WRITE,
-					IDeviceMemoryAllocation::MemoryRange(0u,tmpBuff->getSize())
-				));
-				for (auto end=it+ScrambleStateChannels*renderPixelCount; it!=end; it++)
-					*it = rng.nextSample();
-				tmpBuff->getBoundMemory()->unmapMemory();
-			}
-			scrambleBufferSize = tmpBuff->getSize();
-			// upload
-			IGPUImage::SBufferCopy region;
-			//region.imageSubresource.aspectMask = ;
-			region.imageSubresource.baseArrayLayer = 0u;
-			region.imageSubresource.layerCount = 1u;
-			region.imageExtent = {m_staticViewData.imageDimensions.x,m_staticViewData.imageDimensions.y,0u};
-			auto scrambleKeys = createScreenSizedTexture(EF_R32G32_UINT);
-			m_driver->copyBufferToImage(tmpBuff.get(),scrambleKeys->getCreationParameters().image.get(),1u,&region);
-			setImageInfo(infos+0,asset::EIL_SHADER_READ_ONLY_OPTIMAL,std::move(scrambleKeys));
-		}
+		m_scrambleKeys = createScreenSizedTexture(EF_R32G32_UINT);
+		uploadScrambleKeys();
+		scrambleBufferSize = sizeof(uint32_t)*2u*renderPixelCount;
+		setImageInfo(infos+0,asset::EIL_SHADER_READ_ONLY_OPTIMAL,core::smart_refctd_ptr(m_scrambleKeys));
 		setImageInfo(infos+1,asset::EIL_SHADER_READ_ONLY_OPTIMAL,core::smart_refctd_ptr(visibilityBuffer));
 		setImageInfo(infos+2,asset::EIL_GENERAL,core::smart_refctd_ptr(m_tonemapOutput));
+		// every tile gets sampled until adaptive sampling gets turned on
+		m_adaptiveSampling.init(width,height,{});
+		m_tileLastFrameBuffer = createFilledBufferAndSetUpInfo(infos+3,m_adaptiveSampling.getTileCount()*sizeof(uint32_t),m_adaptiveSampling.getTileLastFrames());
 
 		setDstSetAndDescTypesOnWrites(m_raygenDS.get(),writes,infos,{
 			EDT_COMBINED_IMAGE_SAMPLER,
 			EDT_COMBINED_IMAGE_SAMPLER,
-			EDT_STORAGE_IMAGE
+			EDT_STORAGE_IMAGE,
+			EDT_STORAGE_BUFFER
 		});
 	}
-	m_driver->updateDescriptorSets(3u,writes,0u,nullptr);
+	m_driver->updateDescriptorSets(4u,writes,0u,nullptr);
 
 	// set up m_closestHitDS
 	for (auto i=0u; i<2u; i++)
@@ -1364,6 +1877,24 @@ void Renderer::initScreenSizedResources(uint32_t width, uint32_t height)
 		m_driver->updateDescriptorSets(2u,writes,0u,nullptr);
 	}
 
+	if (m_rayReordering)
+		initRayReorderingResources();
+
+	// the CPU intersector writes its hits straight into this every bounce
+	if (m_cpuIntersection)
+	{
+		IDeviceMemoryBacked::SDeviceMemoryRequirements reqs;
+		reqs.vulkanReqs.size = intersectionBufferSize;
+		reqs.vulkanReqs.alignment = alignof(::RadeonRays::Intersection);
+		reqs.vulkanReqs.memoryTypeBits = ~0u;
+		reqs.memoryHeapLocation = IDeviceMemoryAllocation::ESMT_NOT_DEVICE_LOCAL;
+		reqs.mappingCapability = IDeviceMemoryAllocation::EMCF_COHERENT|IDeviceMemoryAllocation::EMCF_CAN_MAP_FOR_WRITE;
+		reqs.prefersDedicatedAllocation = 0u;
+		reqs.requiresDedicatedAllocation = 0u;
+		m_cpuIntersectionUploadBuffer = m_driver->createGPUBufferOnDedMem(reqs);
+		m_cpuIntersectionUploadBuffer->getBoundMemory()->mapMemoryRange(IDeviceMemoryAllocation::EMCAF_WRITE,{0,intersectionBufferSize});
+	}
+
 	// set up m_resolveDS
 	{
 		infos[0].buffer = {0u,_staticViewDataBuffer->getSize()};
@@ -1440,7 +1971,12 @@ void Renderer::deinitScreenSizedResources()
 	}
 	m_accumulation = m_tonemapOutput = nullptr;
 	m_albedoAcc = m_albedoRslv = nullptr;
+	m_tileLastFrameBuffer = nullptr;
 	m_normalAcc = m_normalRslv = nullptr;
+	m_scrambleKeys = nullptr;
+	m_rayReorderDS[0] = m_rayReorderDS[1] = nullptr;
+	m_rayKeyBuffer = m_rayKeyScratchBuffer = m_rayKeyHistogramBuffer = nullptr;
+	m_cpuIntersectionUploadBuffer = nullptr;
 
 	glFinish();
 	
@@ -1480,10 +2016,239 @@ void Renderer::resetSampleAndFrameCounters()
 {
 	m_totalRaysCast = 0ull;
 	m_framesDispatched = 0u;
+	// so every render (and every tile of one) starts at the same place in the sample sequence
+	m_raytraceCommonData.samplesComputed = 0u;
 	std::fill_n(m_prevView.pointer(),12u,0.f);
 	m_prevCamTform = nbl::core::matrix4x3();
 }
 
+//! covers the reach of the denoiser's widest A-Trous step
+constexpr uint32_t CubemapDenoisePadding = 32u;
+
+//! decodes any format `decodePixelsRuntime` handles to linear RGB, alpha gets dropped
+static PostProcess::SImage decodeTexels(const E_FORMAT format, const uint8_t* data, const uint32_t rowLength, const uint32_t width, const uint32_t height)
+{
+	PostProcess::SImage retval(width,height);
+	const auto texelSize = getTexelOrBlockBytesize(format);
+	core::vector<uint32_t> rows(height);
+	std::iota(rows.begin(),rows.end(),0u);
+	std::for_each(core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+	{
+		for (uint32_t x=0u; x<width; x++)
+		{
+			const void* src = data+(size_t(y)*rowLength+x)*texelSize;
+			double decoded[4] = {0.0,0.0,0.0,1.0};
+			core::vectorSIMDu32 dummy;
+			decodePixelsRuntime(format,&src,decoded,dummy.x,dummy.y);
+			float* out = retval.texel(x,y);
+			for (auto c=0u; c<3u; c++)
+				out[c] = static_cast<float>(decoded[c]);
+		}
+	});
+	return retval;
+}
+
+PostProcess::SImage Renderer::downloadImage(const IGPUImageView* imageView)
+{
+	const auto* image = imageView->getCreationParameters().image.get();
+	const auto& params = image->getCreationParameters();
+	const size_t imageByteSize = size_t(params.extent.width)*params.extent.height*getTexelOrBlockBytesize(params.format);
+	if (imageByteSize>std::numeric_limits<uint32_t>::max())
+	{
+		printf("[ERROR] Could not download the %dx%d image from the GPU, it's bigger than 4GB!\n",params.extent.width,params.extent.height);
+		return {};
+	}
+	const uint32_t byteSize = static_cast<uint32_t>(imageByteSize);
+
+	auto downloadStagingArea = m_driver->getDefaultDownStreamingBuffer();
+	uint32_t address = std::remove_pointer<decltype(downloadStagingArea)>::type::invalid_address; // remember without initializing the address to be allocated to invalid_address you won't get an allocation!
+	constexpr uint64_t timeoutInNanoSeconds = 300000000000u;
+	{
+		const auto waitPoint = std::chrono::high_resolution_clock::now()+std::chrono::nanoseconds(timeoutInNanoSeconds);
+		const uint32_t alignment = 4096u; // common page size
+		if (downloadStagingArea->multi_alloc(waitPoint,1u,&address,&byteSize,&alignment))
+		{
+			printf("[ERROR] Could not download the image from the GPU, staging buffer full!\n");
+			return {};
+		}
+	}
+
+	IImage::SBufferCopy region = {};
+	region.imageSubresource.layerCount = 1u;
+	region.imageExtent = params.extent;
+	m_driver->copyImageToBuffer(image,downloadStagingArea->getBuffer(),1u,&region);
+	auto downloadFence = m_driver->placeFence(true);
+
+	PostProcess::SImage retval;
+	const auto result = downloadFence->waitCPU(timeoutInNanoSeconds,true);
+	if (result==E_DRIVER_FENCE_RETVAL::EDFR_TIMEOUT_EXPIRED||result==E_DRIVER_FENCE_RETVAL::EDFR_FAIL)
+		printf("[ERROR] Could not download the image from the GPU, fence not signalled!\n");
+	else
+	{
+		if (downloadStagingArea->needsManualFlushOrInvalidate())
+			m_driver->invalidateMappedMemoryRanges({{downloadStagingArea->getBuffer()->getBoundMemory(),address,byteSize}});
+		const auto* data = reinterpret_cast<const uint8_t*>(downloadStagingArea->getBufferPointer())+address;
+		retval = decodeTexels(params.format,data,params.extent.width,params.extent.width,params.extent.height);
+	}
+	// no fence, we've already waited on it
+	downloadStagingArea->multi_free(1u,&address,&byteSize,nullptr);
+	return retval;
+}
+
+core::vector<uint8_t> Renderer::downloadBuffer(IGPUBuffer* buffer, const size_t size)
+{
+	auto downloadStagingArea = m_driver->getDefaultDownStreamingBuffer();
+	constexpr uint64_t timeoutInNanoSeconds = 300000000000u;
+	// the staging buffer is much smaller than the ray buffers
+	constexpr uint32_t MaxChunkSize = 16u<<20u;
+	core::vector<uint8_t> retval(size);
+	for (size_t offset=0u; offset<size; offset+=MaxChunkSize)
+	{
+		const uint32_t chunkSize = static_cast<uint32_t>(core::min<size_t>(size-offset,MaxChunkSize));
+		uint32_t address = std::remove_pointer<decltype(downloadStagingArea)>::type::invalid_address;
+		{
+			const auto waitPoint = std::chrono::high_resolution_clock::now()+std::chrono::nanoseconds(timeoutInNanoSeconds);
+			const uint32_t alignment = 4096u; // common page size
+			if (downloadStagingArea->multi_alloc(waitPoint,1u,&address,&chunkSize,&alignment))
+			{
+				printf("[ERROR] Could not download the buffer from the GPU, staging buffer full!\n");
+				return {};
+			}
+		}
+		m_driver->copyBuffer(buffer,downloadStagingArea->getBuffer(),offset,address,chunkSize);
+		auto downloadFence = m_driver->placeFence(true);
+		const auto result = downloadFence->waitCPU(timeoutInNanoSeconds,true);
+		const bool signalled = result!=E_DRIVER_FENCE_RETVAL::EDFR_TIMEOUT_EXPIRED && result!=E_DRIVER_FENCE_RETVAL::EDFR_FAIL;
+		if (signalled)
+		{
+			if (downloadStagingArea->needsManualFlushOrInvalidate())
+				m_driver->invalidateMappedMemoryRanges({{downloadStagingArea->getBuffer()->getBoundMemory(),address,chunkSize}});
+			memcpy(retval.data()+offset,reinterpret_cast<const uint8_t*>(downloadStagingArea->getBufferPointer())+address,chunkSize);
+		}
+		// no fence, we've already waited on it
+		downloadStagingArea->multi_free(1u,&address,&chunkSize,nullptr);
+		if (!signalled)
+		{
+			printf("[ERROR] Could not download the buffer from the GPU, fence not signalled!\n");
+			return {};
+		}
+	}
+	return retval;
+}
+
+PostProcess::SImage Renderer::loadImage(const std::string& path)
+{
+	asset::IAssetLoader::SAssetLoadParams lp(0ull,nullptr);
+	auto bundle = m_assetManager->getAsset(path,lp);
+	if (bundle.getContents().empty())
+	{
+		printf("[ERROR] Could not load the image %s!\n",path.c_str());
+		return {};
+	}
+	auto image = core::smart_refctd_ptr_static_cast<ICPUImage>(bundle.getContents().begin()[0]);
+	const auto& params = image->getCreationParameters();
+	const auto& region = image->getRegions().begin()[0];
+	const uint32_t rowLength = region.bufferRowLength ? region.bufferRowLength:params.extent.width;
+	const auto* data = reinterpret_cast<const uint8_t*>(image->getBuffer()->getPointer())+region.bufferOffset;
+	return decodeTexels(params.format,data,rowLength,params.extent.width,params.extent.height);
+}
+
+void Renderer::writeImage(const PostProcess::SImage& image, const std::string& pathWithoutExtension, bool ldr)
+{
+	auto writeAs = [&](const E_FORMAT format, std::initializer_list<const char*> extensions) -> void
+	{
+		ICPUImage::SCreationParams imgParams;
+		imgParams.flags = static_cast<ICPUImage::E_CREATE_FLAGS>(0u);
+		imgParams.type = ICPUImage::ET_2D;
+		imgParams.format = format;
+		imgParams.extent = {image.width,image.height,1u};
+		imgParams.mipLevels = 1u;
+		imgParams.arrayLayers = 1u;
+		imgParams.samples = ICPUImage::ESCF_1_BIT;
+
+		const auto texelSize = getTexelOrBlockBytesize(format);
+		auto buffer = core::make_smart_refctd_ptr<ICPUBuffer>(size_t(image.width)*image.height*texelSize);
+		auto* data = reinterpret_cast<uint8_t*>(buffer->getPointer());
+		core::vector<uint32_t> rows(image.height);
+		std::iota(rows.begin(),rows.end(),0u);
+		std::for_each(core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+		{
+			for (uint32_t x=0u; x<image.width; x++)
+			{
+				const float* texel = image.texel(x,y);
+				double encoded[4] = {texel[0],texel[1],texel[2],1.0};
+				if (ldr)
+				for (auto c=0u; c<3u; c++)
+					encoded[c] = core::clamp(encoded[c],0.0,1.0);
+				encodePixelsRuntime(format,data+(size_t(y)*image.width+x)*texelSize,encoded);
+			}
+		});
+
+		auto regions = core::make_refctd_dynamic_array<core::smart_refctd_dynamic_array<ICPUImage::SBufferCopy>>(1u);
+		{
+			auto& region = regions->front();
+			region.bufferOffset = 0u;
+			region.bufferRowLength = image.width;
+			region.bufferImageHeight = image.height;
+			region.imageSubresource.mipLevel = 0u;
+			region.imageSubresource.baseArrayLayer = 0u;
+			region.imageSubresource.layerCount = 1u;
+			region.imageOffset = {0u,0u,0u};
+			region.imageExtent = imgParams.extent;
+		}
+		auto cpuImage = ICPUImage::create(std::move(imgParams));
+		cpuImage->setBufferAndRegions(std::move(buffer),regions);
+
+		ICPUImageView::SCreationParams viewParams;
+		viewParams.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
+		viewParams.format = format;
+		viewParams.image = std::move(cpuImage);
+		viewParams.viewType = ICPUImageView::ET_2D;
+		viewParams.subresourceRange = {static_cast<IImage::E_ASPECT_FLAGS>(0u),0u,1u,0u,1u};
+		auto imageView = ICPUImageView::create(std::move(viewParams));
+
+		IAssetWriter::SAssetWriteParams wp(imageView.get());
+		for (const auto* extension : extensions)
+			m_assetManager->writeAsset(pathWithoutExtension+extension,wp);
+	};
+	// we always save 16bit HDR to EXR, same as the screenshots always were
+	writeAs(EF_R16G16B16A16_SFLOAT,{".exr"});
+	if (ldr)
+		writeAs(EF_R8G8B8_SRGB,{".png",".jpg"});
+}
+
+// what a sensor's denoiser arguments default to
+const std::string defaultBloomFile = "../../media/kernels/physical_flare_512.exr";
+const std::string defaultTonemapperArgs = "ACES=0.4,0.8";
+constexpr auto defaultBloomScale = 0.1f;
+constexpr auto defaultBloomIntensity = 0.1f;
+
+PostProcess::SParams Renderer::getPostProcessParams(const DenoiserArgs& denoiserArgs)
+{
+	PostProcess::SParams params;
+	params.bloomScale = defaultBloomScale;
+	params.bloomIntensity = defaultBloomIntensity;
+	if (denoiserArgs.bloomScale!=0.0f)
+		params.bloomScale = denoiserArgs.bloomScale;
+	if (denoiserArgs.bloomIntensity!=0.0f)
+		params.bloomIntensity = denoiserArgs.bloomIntensity;
+	const auto& tonemapperArgs = denoiserArgs.tonemapperArgs.empty() ? defaultTonemapperArgs:denoiserArgs.tonemapperArgs;
+	if (!params.parseTonemapper(tonemapperArgs))
+	{
+		printf("[WARNING] Could not parse tonemapper arguments \"%s\", using \"%s\"\n",tonemapperArgs.c_str(),defaultTonemapperArgs.c_str());
+		params.parseTonemapper(defaultTonemapperArgs);
+	}
+
+	// the PSF only gets reloaded when a sensor asks for a different one
+	const auto bloomFilePath = denoiserArgs.bloomFilePath.string().empty() ? defaultBloomFile:denoiserArgs.bloomFilePath.string();
+	if (bloomFilePath!=m_bloomPSFPath)
+	{
+		m_bloomPSF = loadImage(bloomFilePath);
+		m_bloomPSFPath = bloomFilePath;
+	}
+	return params;
+}
+
 void Renderer::takeAndSaveScreenShot(const std::filesystem::path& screenshotFilePath, bool denoise, const DenoiserArgs& denoiserArgs)
 {
 	auto commandQueue = m_rrManager->getCLCommandQueue();
@@ -1491,46 +2256,134 @@ void Renderer::takeAndSaveScreenShot(const std::filesystem::path& screenshotFile
 
 	glFinish();
 
-	// we always decode to 16bit HDR because thats what the denoiser takes
-	// if we save to PNG instead of EXR, it will be converted and clamped once more automagically
-	const asset::E_FORMAT format = asset::EF_R16G16B16A16_SFLOAT;
-
 	auto filename_wo_ext = screenshotFilePath;
 	filename_wo_ext.replace_extension();
+
+	SCapture capture;
+	capture.pathWithoutExtension = filename_wo_ext.string();
 	if (m_tonemapOutput)
-		ext::ScreenShot::createScreenShot(m_driver,m_assetManager,m_tonemapOutput.get(),filename_wo_ext.string()+".exr",format);
+		capture.color = downloadImage(m_tonemapOutput.get());
 	if (m_albedoRslv)
-		ext::ScreenShot::createScreenShot(m_driver,m_assetManager,m_albedoRslv.get(),filename_wo_ext.string()+"_albedo.exr",format);
+		capture.albedo = downloadImage(m_albedoRslv.get());
 	if (m_normalRslv)
-		ext::ScreenShot::createScreenShot(m_driver,m_assetManager,m_normalRslv.get(),filename_wo_ext.string()+"_normal.exr",format);
-
-	if(denoise)
-	{
-		const std::string defaultBloomFile = "../../media/kernels/physical_flare_512.exr";
-		const std::string defaultTonemapperArgs = "ACES=0.4,0.8";
-		constexpr auto defaultBloomScale = 0.1f;
-		constexpr auto defaultBloomIntensity = 0.1f;
-		auto bloomFilePathStr = (denoiserArgs.bloomFilePath.string().empty()) ? defaultBloomFile : denoiserArgs.bloomFilePath.string();
-		auto bloomScale = (denoiserArgs.bloomScale == 0.0f) ? defaultBloomScale : denoiserArgs.bloomScale;
-		auto bloomIntensity = (denoiserArgs.bloomIntensity == 0.0f) ? defaultBloomIntensity : denoiserArgs.bloomIntensity;
-		auto tonemapperArgs = (denoiserArgs.tonemapperArgs.empty()) ? defaultTonemapperArgs : denoiserArgs.tonemapperArgs;
-
-		std::ostringstream denoiserCmd;
-		// 1.ColorFile 2.AlbedoFile 3.NormalFile 4.BloomPsfFilePath(STRING) 5.BloomScale(FLOAT) 6.BloomIntensity(FLOAT) 7.TonemapperArgs(STRING)
-		denoiserCmd << "call ../denoiser_hook.bat";
-		denoiserCmd << " \"" << filename_wo_ext.string() << ".exr" << "\"";
-		denoiserCmd << " \"" << filename_wo_ext.string() << "_albedo.exr" << "\"";
-		denoiserCmd << " \"" << filename_wo_ext.string() << "_normal.exr" << "\"";
-		denoiserCmd << " \"" << bloomFilePathStr << "\"";
-		denoiserCmd << " " << bloomScale;
-		denoiserCmd << " " << bloomIntensity;
-		denoiserCmd << " " << "\"" << tonemapperArgs << "\"";
-		// NOTE/TODO/FIXME : Do as I say, not as I do
-		// https://wiki.sei.cmu.edu/confluence/pages/viewpage.action?pageId=87152177
-		std::cout << "\n---[DENOISER_BEGIN]---" << std::endl;
-		std::system(denoiserCmd.str().c_str());
-		std::cout << "\n---[DENOISER_END]---" << std::endl;
+		capture.normal = downloadImage(m_normalRslv.get());
+	saveCapture(std::move(capture),denoise,denoiserArgs);
+}
+
+void Renderer::setRenderRegion(const uint32_t offsetX, const uint32_t offsetY, const uint32_t fullWidth, const uint32_t fullHeight)
+{
+	const uint32_t width = m_staticViewData.imageDimensions.x;
+	const uint32_t height = m_staticViewData.imageDimensions.y;
+	const SRenderRegion region = {{offsetX,offsetY},{fullWidth,fullHeight}};
+	if (std::equal(region.offset,region.offset+2,m_renderRegion.offset) && std::equal(region.fullExtent,region.fullExtent+2,m_renderRegion.fullExtent))
+		return;
+	m_renderRegion = region;
+
+	// NDC of the full image's pixel centers `(2(x+0.5)/fullWidth-1,1-2(y+0.5)/fullHeight)` to the same for the region's pixels
+	const float scaleX = float(fullWidth)/float(width);
+	const float scaleY = float(fullHeight)/float(height);
+	m_renderRegionCrop = core::matrix4SIMD();
+	m_renderRegionCrop.rows[0] = core::vectorSIMDf(scaleX,0.f,0.f,scaleX-1.f-2.f*float(offsetX)/float(width));
+	m_renderRegionCrop.rows[1] = core::vectorSIMDf(0.f,scaleY,0.f,1.f-scaleY+2.f*float(offsetY)/float(height));
+
+	uploadScrambleKeys();
+}
+
+void Renderer::uploadScrambleKeys()
+{
+	const uint32_t width = m_staticViewData.imageDimensions.x;
+	const uint32_t height = m_staticViewData.imageDimensions.y;
+	auto tmpBuff = m_driver->createCPUSideGPUVisibleGPUBufferOnDedMem(sizeof(uint32_t)*ScrambleKeys::Channels*width*height);
+	{
+		auto* keys = reinterpret_cast<uint32_t*>(tmpBuff->getBoundMemory()->mapMemoryRange(
+			IDeviceMemoryAllocation::EMCAF_WRITE,
+			IDeviceMemoryAllocation::MemoryRange(0u,tmpBuff->getSize())
+		));
+		ScrambleKeys::generate(keys,m_renderRegion.offset[0],m_renderRegion.offset[1],width,height,m_renderRegion.fullExtent[0],m_renderRegion.fullExtent[1]);
+		tmpBuff->getBoundMemory()->unmapMemory();
+	}
+	// upload
+	IGPUImage::SBufferCopy region;
+	//region.imageSubresource.aspectMask = ;
+	region.imageSubresource.baseArrayLayer = 0u;
+	region.imageSubresource.layerCount = 1u;
+	region.imageExtent = {width,height,0u};
+	m_driver->copyBufferToImage(tmpBuff.get(),m_scrambleKeys->getCreationParameters().image.get(),1u,&region);
+}
+
+void Renderer::finishAllWork()
+{
+	ocl::COpenCLHandler::ocl.pclFinish(m_rrManager->getCLCommandQueue());
+	glFinish();
+}
+
+void Renderer::addRegionToCapture()
+{
+	finishAllWork();
+
+	const uint32_t fullWidth = m_renderRegion.fullExtent[0];
+	const uint32_t fullHeight = m_renderRegion.fullExtent[1];
+	if (uint64_t(fullWidth)*fullHeight>MaxTiledCapturePixels)
+	{
+		printf("[ERROR] A %dx%d capture would take %.1f GB of RAM, tiled captures are limited to %llu pixels\n",fullWidth,fullHeight,
+			double(uint64_t(fullWidth)*fullHeight*sizeof(float)*9ull)/double(0x1ull<<30ull),static_cast<unsigned long long>(MaxTiledCapturePixels));
+		return;
 	}
+	auto add = [&](PostProcess::SImage& assembled, const IGPUImageView* imageView) -> void
+	{
+		if (!imageView)
+			return;
+		const auto region = downloadImage(imageView);
+		if (region.empty())
+			return;
+		if (assembled.width!=fullWidth || assembled.height!=fullHeight)
+			assembled = PostProcess::SImage(fullWidth,fullHeight);
+		const uint32_t columnBegin = core::min(m_renderRegion.offset[0],fullWidth);
+		const uint32_t rowBegin = core::min(m_renderRegion.offset[1],fullHeight);
+		const uint32_t columns = core::min(columnBegin+region.width,fullWidth)-columnBegin;
+		const uint32_t rows = core::min(rowBegin+region.height,fullHeight)-rowBegin;
+		for (uint32_t y=0u; y<rows; y++)
+			std::copy_n(region.texel(0u,y),columns*3u,assembled.texel(columnBegin,rowBegin+y));
+	};
+	add(m_tiledCapture.color,m_tonemapOutput.get());
+	add(m_tiledCapture.albedo,m_albedoRslv.get());
+	add(m_tiledCapture.normal,m_normalRslv.get());
+}
+
+void Renderer::saveTiledCapture(const std::filesystem::path& screenshotFilePath, bool denoise, const DenoiserArgs& denoiserArgs)
+{
+	auto filename_wo_ext = screenshotFilePath;
+	filename_wo_ext.replace_extension();
+
+	SCapture capture = std::move(m_tiledCapture);
+	m_tiledCapture = {};
+	capture.pathWithoutExtension = filename_wo_ext.string();
+	saveCapture(std::move(capture),denoise,denoiserArgs);
+}
+
+void Renderer::saveCapture(SCapture&& capture, bool denoise, const DenoiserArgs& denoiserArgs)
+{
+	if (!capture.color.empty())
+		writeImage(capture.color,capture.pathWithoutExtension,false);
+	if (!capture.albedo.empty())
+		writeImage(capture.albedo,capture.pathWithoutExtension+"_albedo",false);
+	if (!capture.normal.empty())
+		writeImage(capture.normal,capture.pathWithoutExtension+"_normal",false);
+
+	if (denoise && !capture.color.empty())
+	{
+		const auto params = getPostProcessParams(denoiserArgs);
+		PostProcess::SImage output = capture.color;
+		PostProcess::process(output,capture.albedo.empty() ? nullptr:&capture.albedo,capture.normal.empty() ? nullptr:&capture.normal,m_bloomPSF,params);
+		writeImage(output,capture.pathWithoutExtension+"_denoised",true);
+	}
+
+	// only square renders can be cubemap faces
+	if (capture.color.empty() || capture.color.width!=capture.color.height)
+		return;
+	if (m_recentCaptures.size()>=MaxRetainedCaptures)
+		m_recentCaptures.erase(m_recentCaptures.begin());
+	m_recentCaptures.push_back(std::move(capture));
 }
 
 void Renderer::denoiseCubemapFaces(
@@ -1539,90 +2392,67 @@ void Renderer::denoiseCubemapFaces(
 	int borderPixels,
 	const DenoiserArgs& denoiserArgs)
 {
-	auto commandQueue = m_rrManager->getCLCommandQueue();
-	ocl::COpenCLHandler::ocl.pclFinish(commandQueue);
-
-	glFinish();
+	// faces rendered just before are still in memory, anything older has to come from the files written with it
+	SCapture faces[6];
+	for (uint32_t i=0; i<6; ++i)
+	{
+		const auto pathWithoutExtension = filePaths[i].replace_extension().string();
+		auto found = std::find_if(m_recentCaptures.begin(),m_recentCaptures.end(),[&](const SCapture& capture) -> bool {return capture.pathWithoutExtension==pathWithoutExtension;});
+		if (found!=m_recentCaptures.end())
+		{
+			faces[i] = std::move(*found);
+			m_recentCaptures.erase(found);
+		}
+		else
+		{
+			faces[i].pathWithoutExtension = pathWithoutExtension;
+			faces[i].color = loadImage(pathWithoutExtension+".exr");
+			faces[i].albedo = loadImage(pathWithoutExtension+"_albedo.exr");
+			faces[i].normal = loadImage(pathWithoutExtension+"_normal.exr");
+		}
+		if (faces[i].color.empty() || faces[i].color.width!=faces[0].color.width || faces[i].color.height!=faces[i].color.width)
+		{
+			printf("[ERROR] Cubemap face %s is missing or not square and the same size as the others, skipping the cubemap denoise\n",pathWithoutExtension.c_str());
+			return;
+		}
+	}
+	if (borderPixels<0 || 2u*uint32_t(borderPixels)>=faces[0].color.width)
+	{
+		printf("[ERROR] Cubemap border of %d pixels leaves nothing of the %d pixel faces, skipping the cubemap denoise\n",borderPixels,faces[0].color.width);
+		return;
+	}
 
-	std::string renderFilePaths[6] = {};
-	std::string albedoFilePaths[6] = {};
-	std::string normalFilePaths[6] = {};
-	for(uint32_t i = 0; i < 6; ++i)
-		renderFilePaths[i] = filePaths[i].replace_extension().string() + ".exr";
-	for(uint32_t i = 0; i < 6; ++i)
-		albedoFilePaths[i] = filePaths[i].replace_extension().string() + "_albedo.exr";
-	for(uint32_t i = 0; i < 6; ++i)
-		normalFilePaths[i] = filePaths[i].replace_extension().string() + "_normal.exr";
-	
-	std::string mergedRenderFilePath = mergedFileName + ".exr";
-	std::string mergedAlbedoFilePath = mergedFileName + "_albedo.exr";
-	std::string mergedNormalFilePath = mergedFileName + "_normal.exr";
-	std::string mergedDenoisedFilePath = mergedFileName + "_denoised.exr";
-	
-	std::ostringstream mergeRendersCmd;
-	mergeRendersCmd << "call ../mergeCubemap.bat";
-	for(uint32_t i = 0; i < 6; ++i)
-		mergeRendersCmd << " " << renderFilePaths[i];
-	mergeRendersCmd << " " << mergedRenderFilePath;
-	std::system(mergeRendersCmd.str().c_str());
-
-	std::ostringstream mergeAlbedosCmd;
-	mergeAlbedosCmd << "call ../mergeCubemap.bat ";
-	for(uint32_t i = 0; i < 6; ++i)
-		mergeAlbedosCmd << " " << albedoFilePaths[i];
-	mergeAlbedosCmd << " " << mergedAlbedoFilePath;
-	std::system(mergeAlbedosCmd.str().c_str());
-	
-	std::ostringstream mergeNormalsCmd;
-	mergeNormalsCmd << "call ../mergeCubemap.bat ";
-	for(uint32_t i = 0; i < 6; ++i)
-		mergeNormalsCmd << " " << normalFilePaths[i];
-	mergeNormalsCmd << " " << mergedNormalFilePath;
-	std::system(mergeNormalsCmd.str().c_str());
-
-	const std::string defaultBloomFile = "../../media/kernels/physical_flare_512.exr";
-	const std::string defaultTonemapperArgs = "ACES=0.4,0.8";
-	constexpr auto defaultBloomScale = 0.1f;
-	constexpr auto defaultBloomIntensity = 0.1f;
-	auto bloomFilePathStr = (denoiserArgs.bloomFilePath.string().empty()) ? defaultBloomFile : denoiserArgs.bloomFilePath.string();
-	auto bloomScale = (denoiserArgs.bloomScale == 0.0f) ? defaultBloomScale : denoiserArgs.bloomScale;
-	auto bloomIntensity = (denoiserArgs.bloomIntensity == 0.0f) ? defaultBloomIntensity : denoiserArgs.bloomIntensity;
-	auto tonemapperArgs = (denoiserArgs.tonemapperArgs.empty()) ? defaultTonemapperArgs : denoiserArgs.tonemapperArgs;
-	
-	std::ostringstream denoiserCmd;
-	// 1.ColorFile 2.AlbedoFile 3.NormalFile 4.BloomPsfFilePath(STRING) 5.BloomScale(FLOAT) 6.BloomIntensity(FLOAT) 7.TonemapperArgs(STRING)
-	denoiserCmd << "call ../denoiser_hook.bat";
-	denoiserCmd << " \"" << mergedRenderFilePath << "\"";
-	denoiserCmd << " \"" << mergedAlbedoFilePath << "\"";
-	denoiserCmd << " \"" << mergedNormalFilePath << "\"";
-	denoiserCmd << " \"" << bloomFilePathStr << "\"";
-	denoiserCmd << " " << bloomScale;
-	denoiserCmd << " " << bloomIntensity;
-	denoiserCmd << " " << "\"" << tonemapperArgs << "\"";
-	// NOTE/TODO/FIXME : Do as I say, not as I do
-	// https://wiki.sei.cmu.edu/confluence/pages/viewpage.action?pageId=87152177
-	std::cout << "\n---[DENOISER_BEGIN]---" << std::endl;
-	std::system(denoiserCmd.str().c_str());
-	std::cout << "\n---[DENOISER_END]---" << std::endl;
-	
-	auto extractCubemapFaces = [&](const std::string& extension) -> void
-	{
-		std::ostringstream extractImagesCmd;
-		auto mergedDenoisedWithoutExtension = std::filesystem::path(mergedDenoisedFilePath).replace_extension().string();
-		extractImagesCmd << "call ../extractCubemap.bat ";
-		extractImagesCmd << " " << std::to_string(borderPixels);
-		extractImagesCmd << " " << mergedDenoisedWithoutExtension + extension;
-		for(uint32_t i = 0; i < 6; ++i)
+	// denoise, bloom and expose all faces at once so the exposure matches, the padding keeps unrelated neighbouring cells from bleeding in
+	constexpr uint32_t TexelSize = sizeof(float)*3u;
+	const CubemapLayout layout(CubemapLayout::ET_3X2,faces[0].color.width,CubemapDenoisePadding);
+	auto merge = [&](PostProcess::SImage SCapture::* member) -> PostProcess::SImage
+	{
+		CubemapLayout::SConstTexels texels[6];
+		for (uint32_t i=0; i<6; ++i)
 		{
-			auto renderFilePathWithoutExtension = std::filesystem::path(renderFilePaths[i]).replace_extension().string();
-			extractImagesCmd << " " << renderFilePathWithoutExtension + "_denoised" + extension;
+			const auto& image = faces[i].*member;
+			if (image.width!=layout.getFaceSize() || image.height!=layout.getFaceSize())
+				return {};
+			texels[i] = {reinterpret_cast<const uint8_t*>(image.rgb.data()),size_t(image.width)*TexelSize};
 		}
-		std::system(extractImagesCmd.str().c_str());
+		PostProcess::SImage merged(layout.getWidth(),layout.getHeight());
+		layout.merge(texels,TexelSize,{reinterpret_cast<uint8_t*>(merged.rgb.data()),size_t(merged.width)*TexelSize});
+		return merged;
 	};
+	PostProcess::SImage merged = merge(&SCapture::color);
+	const PostProcess::SImage mergedAlbedo = merge(&SCapture::albedo);
+	const PostProcess::SImage mergedNormal = merge(&SCapture::normal);
 
-	extractCubemapFaces(".exr");
-	extractCubemapFaces(".png");
-	extractCubemapFaces(".jpg");
+	const auto params = getPostProcessParams(denoiserArgs);
+	PostProcess::process(merged,mergedAlbedo.empty() ? nullptr:&mergedAlbedo,mergedNormal.empty() ? nullptr:&mergedNormal,m_bloomPSF,params);
+	writeImage(merged,mergedFileName+"_denoised",true);
+
+	for (uint32_t i=0; i<6; ++i)
+	{
+		PostProcess::SImage face(layout.getFaceSize()-2u*borderPixels,layout.getFaceSize()-2u*borderPixels);
+		layout.extract({reinterpret_cast<const uint8_t*>(merged.rgb.data()),size_t(merged.width)*TexelSize},i,borderPixels,TexelSize,{reinterpret_cast<uint8_t*>(face.rgb.data()),size_t(face.width)*TexelSize});
+		writeImage(face,faces[i].pathWithoutExtension+"_denoised",true);
+	}
 }
 
 // one day it will just work like that
@@ -1632,6 +2462,8 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 {
 	if (m_cullPushConstants.maxGlobalInstanceCount==0u)
 		return true;
+	// the previous frame's queries are done by now
+	m_stageTimings.collect();
 
 	auto camera = m_smgr->getActiveCamera();
 	camera->OnAnimate(std::chrono::duration_cast<std::chrono::milliseconds>(timer->getTime()).count());
@@ -1662,6 +2494,12 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 			m_framesDispatched = 0u;		
 			m_prevView = camera->getViewMatrix();
 			m_prevCamTform = tform;
+			// all tiles start over together
+			if (m_adaptiveSampling.isEnabled())
+			{
+				m_adaptiveSampling.reset();
+				uploadTileLastFrames();
+			}
 		}
 		else // need this to stop mouse cursor drift
 			camera->setRelativeTransformationMatrix(m_prevCamTform);
@@ -1672,6 +2510,8 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 	if(compileShadersFuture.valid())
 	{
 		bool compiledShaders = compileShadersFuture.get();
+		if (shaderCacheEnabled)
+			getShaderCache().printMetrics("Shader Cache");
 		if(compiledShaders)
 		{
 			m_cullPipeline = m_driver->createComputePipeline(nullptr,core::smart_refctd_ptr(m_cullPipelineLayout), core::smart_refctd_ptr(m_cullGPUShader));
@@ -1705,50 +2545,58 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 			core::matrix4SIMD jitterMatrix;
 			jitterMatrix.rows[0][3] = cosPhi*r*m_rcpPixelSize.x;
 			jitterMatrix.rows[1][3] = sinPhi*r*m_rcpPixelSize.y;
-			return core::concatenateBFollowedByA(jitterMatrix,core::concatenateBFollowedByA(camera->getProjectionMatrix(),m_prevView));
+			const auto regionViewProj = core::concatenateBFollowedByA(m_renderRegionCrop,core::concatenateBFollowedByA(camera->getProjectionMatrix(),m_prevView));
+			return core::concatenateBFollowedByA(jitterMatrix,regionViewProj);
 		}(m_framesDispatched);
 		m_raytraceCommonData.rcpFramesDispatched = 1.f/float(m_framesDispatched);
+		m_raytraceCommonData.framesDispatched = m_framesDispatched;
 		m_raytraceCommonData.textureFootprintFactor = core::inversesqrt(core::min<float>(m_framesDispatched,Renderer::AntiAliasingSequenceLength));
 		if(!modifiedViewProj.getInverseTransform<core::matrix4SIMD::E_MATRIX_INVERSE_PRECISION::EMIP_64BBIT>(m_raytraceCommonData.viewProjMatrixInverse))
 			std::cout << "Couldn't calculate viewProjection matrix's inverse. something is wrong." << std::endl;
 		// for (auto i=0u; i<3u; i++)
 		// 	m_raytraceCommonData.ndcToV.rows[i] = inverseMVP.rows[3]*cameraPosition[i]-inverseMVP.rows[i];
 		// cull batches
-		m_driver->bindComputePipeline(m_cullPipeline.get());
 		{
-			const auto* _cullPipelineLayout = m_cullPipeline->getLayout();
+			StageTimings::CScope timing(m_stageTimings,StageTimings::ES_CULL);
+			m_driver->bindComputePipeline(m_cullPipeline.get());
+			{
+				const auto* _cullPipelineLayout = m_cullPipeline->getLayout();
 
-			IGPUDescriptorSet* descriptorSets[] = { m_globalBackendDataDS.get(),m_cullDS.get() };
-			m_driver->bindDescriptorSets(EPBP_COMPUTE,_cullPipelineLayout,0u,2u,descriptorSets,nullptr);
-			
-			m_cullPushConstants.viewProjMatrix = modifiedViewProj;
-			m_cullPushConstants.viewProjDeterminant = core::determinant(modifiedViewProj);
-			m_driver->pushConstants(_cullPipelineLayout,ISpecializedShader::ESS_COMPUTE,0u,sizeof(CullShaderData_t),&m_cullPushConstants);
-		}
-		// TODO: Occlusion Culling against HiZ Buffer
-		m_driver->dispatch(m_cullWorkGroups, 1u, 1u);
-		COpenGLExtensionHandler::pGlMemoryBarrier(GL_COMMAND_BARRIER_BIT|GL_SHADER_STORAGE_BARRIER_BIT);
-
-		m_driver->setRenderTarget(m_visibilityBuffer);
-		{ // clear
-			m_driver->clearZBuffer();
-			uint32_t clearTriangleID[4] = {0xffffffffu,0,0,0};
-			m_driver->clearColorBuffer(EFAP_COLOR_ATTACHMENT0, clearTriangleID);
-		}
-		// all batches draw with the same pipeline
-		m_driver->bindGraphicsPipeline(m_visibilityBufferFillPipeline.get());
-		{
-			IGPUDescriptorSet* descriptorSets[] = { m_rasterInstanceDataDS.get(),m_additionalGlobalDS.get(),m_cullDS.get() };
-			m_driver->bindDescriptorSets(EPBP_GRAPHICS,m_visibilityBufferFillPipeline->getLayout(),0u,3u,descriptorSets,nullptr);
+				IGPUDescriptorSet* descriptorSets[] = { m_globalBackendDataDS.get(),m_cullDS.get() };
+				m_driver->bindDescriptorSets(EPBP_COMPUTE,_cullPipelineLayout,0u,2u,descriptorSets,nullptr);
+				
+				m_cullPushConstants.viewProjMatrix = modifiedViewProj;
+				m_cullPushConstants.viewProjDeterminant = core::determinant(modifiedViewProj);
+				m_driver->pushConstants(_cullPipelineLayout,ISpecializedShader::ESS_COMPUTE,0u,sizeof(CullShaderData_t),&m_cullPushConstants);
+			}
+			// TODO: Occlusion Culling against HiZ Buffer
+			m_driver->dispatch(m_cullWorkGroups, 1u, 1u);
+			COpenGLExtensionHandler::pGlMemoryBarrier(GL_COMMAND_BARRIER_BIT|GL_SHADER_STORAGE_BARRIER_BIT);
 		}
-		for (const auto& call : m_mdiDrawCalls)
+
 		{
-			const asset::SBufferBinding<IGPUBuffer> nullBindings[IGPUMeshBuffer::MAX_ATTR_BUF_BINDING_COUNT] = {};
-			m_driver->drawIndexedIndirect(
-				nullBindings,EPT_TRIANGLE_LIST,EIT_16BIT,m_indexBuffer.get(),
-				m_indirectDrawBuffers[m_cullPushConstants.currentCommandBufferIx].get(),
-				call.mdiOffset*sizeof(DrawElementsIndirectCommand_t),call.mdiCount,sizeof(DrawElementsIndirectCommand_t)
-			);
+			StageTimings::CScope timing(m_stageTimings,StageTimings::ES_VISIBILITY_BUFFER);
+			m_driver->setRenderTarget(m_visibilityBuffer);
+			{ // clear
+				m_driver->clearZBuffer();
+				uint32_t clearTriangleID[4] = {0xffffffffu,0,0,0};
+				m_driver->clearColorBuffer(EFAP_COLOR_ATTACHMENT0, clearTriangleID);
+			}
+			// all batches draw with the same pipeline
+			m_driver->bindGraphicsPipeline(m_visibilityBufferFillPipeline.get());
+			{
+				IGPUDescriptorSet* descriptorSets[] = { m_rasterInstanceDataDS.get(),m_additionalGlobalDS.get(),m_cullDS.get() };
+				m_driver->bindDescriptorSets(EPBP_GRAPHICS,m_visibilityBufferFillPipeline->getLayout(),0u,3u,descriptorSets,nullptr);
+			}
+			for (const auto& call : m_mdiDrawCalls)
+			{
+				const asset::SBufferBinding<IGPUBuffer> nullBindings[IGPUMeshBuffer::MAX_ATTR_BUF_BINDING_COUNT] = {};
+				m_driver->drawIndexedIndirect(
+					nullBindings,EPT_TRIANGLE_LIST,EIT_16BIT,m_indexBuffer.get(),
+					m_indirectDrawBuffers[m_cullPushConstants.currentCommandBufferIx].get(),
+					call.mdiOffset*sizeof(DrawElementsIndirectCommand_t),call.mdiCount,sizeof(DrawElementsIndirectCommand_t)
+				);
+			}
 		}
 		// flip MDI buffers
 		m_cullPushConstants.currentCommandBufferIx ^= 0x01u;
@@ -1759,8 +2607,27 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 		m_raytraceCommonData.camPos.y = cameraPosition.y;
 		m_raytraceCommonData.camPos.z = cameraPosition.z;
 	}
+	// make sure the samples this dispatch reads are resident
+	if (sampleSequence.commitSamples(m_driver,m_raytraceCommonData.samplesComputed+getSamplesPerPixelPerDispatch()))
+	{
+		// the sequence outgrew its buffer, both common descriptor sets read it through binding 1
+		IGPUDescriptorSet::SDescriptorInfo info;
+		info.desc = sampleSequence.getBufferView();
+		IGPUDescriptorSet::SWriteDescriptorSet writes[2];
+		for (auto i=0u; i<2u; i++)
+		{
+			writes[i].dstSet = m_commonRaytracingDS[i].get();
+			writes[i].binding = 1u;
+			writes[i].arrayElement = 0u;
+			writes[i].count = 1u;
+			writes[i].descriptorType = EDT_UNIFORM_TEXEL_BUFFER;
+			writes[i].info = &info;
+		}
+		m_driver->updateDescriptorSets(2u,writes,0u,nullptr);
+	}
 	// raygen
 	{
+		StageTimings::CScope timing(m_stageTimings,StageTimings::ES_RAYGEN);
 		// vertex 0 is camera
 		m_raytraceCommonData.depth = beauty ? 0u:(~0u);
 
@@ -1791,6 +2658,7 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 	// resolve pseudo-MSAA
 	if (beauty)
 	{
+		StageTimings::CScope timing(m_stageTimings,StageTimings::ES_RESOLVE);
 		m_driver->bindDescriptorSets(EPBP_COMPUTE,m_resolvePipeline->getLayout(),0u,1u,&m_resolveDS.get(),nullptr);
 		m_driver->bindComputePipeline(m_resolvePipeline.get());
 		if (transformNormals)
@@ -1807,11 +2675,49 @@ bool Renderer::render(nbl::ITimer* timer, const bool transformNormals, const boo
 		);
 		m_raytraceCommonData.samplesComputed = (m_raytraceCommonData.samplesComputed+getSamplesPerPixelPerDispatch())%maxSensorSamples;
 	}
+	if (beauty && m_adaptiveSampling.isEnabled())
+		updateAdaptiveSampling();
 
+	m_stageTimings.frameDone();
 	// TODO: autoexpose properly
 	return true;
 }
 
+void Renderer::setAdaptiveSampling(AdaptiveSampling::SParams params)
+{
+	params.maxFrames = core::min<uint32_t>(params.maxFrames,maxSensorSamples/getSamplesPerPixelPerDispatch());
+	m_adaptiveSampling.init(m_staticViewData.imageDimensions.x,m_staticViewData.imageDimensions.y,params);
+	uploadTileLastFrames();
+}
+
+void Renderer::updateAdaptiveSampling()
+{
+	static_assert(AdaptiveSampling::TileDim==ADAPTIVE_SAMPLING_TILE_DIM && AdaptiveSampling::TileDim%WORKGROUP_DIM==0u);
+	// stalls, but evaluations get further apart the longer the render goes
+	if (m_adaptiveSampling.needsEvaluation(m_framesDispatched))
+	{
+		const auto resolved = downloadImage(m_tonemapOutput.get());
+		if (!resolved.empty())
+		{
+			core::vector<float> luminance(size_t(resolved.width)*resolved.height);
+			for (size_t i=0u; i<luminance.size(); i++)
+				luminance[i] = 0.2126f*resolved.rgb[i*3u+0u]+0.7152f*resolved.rgb[i*3u+1u]+0.0722f*resolved.rgb[i*3u+2u];
+			m_adaptiveSampling.evaluate(m_framesDispatched,luminance.data());
+		}
+	}
+	if (m_adaptiveSampling.schedule(m_framesDispatched))
+		uploadTileLastFrames();
+}
+
+void Renderer::uploadTileLastFrames()
+{
+	if (!m_tileLastFrameBuffer)
+		return;
+	const size_t size = m_adaptiveSampling.getTileCount()*sizeof(uint32_t);
+	auto staging = m_driver->createFilledDeviceLocalBufferOnDedMem(size,m_adaptiveSampling.getTileLastFrames());
+	m_driver->copyBuffer(staging.get(),m_tileLastFrameBuffer.get(),0u,0u,size);
+}
+
 void Renderer::preDispatch(const video::IGPUPipelineLayout* pipelineLayout, video::IGPUDescriptorSet*const *const lastDS)
 {
 	// increment depth
@@ -1826,6 +2732,169 @@ void Renderer::preDispatch(const video::IGPUPipelineLayout* pipelineLayout, vide
 	m_driver->bindDescriptorSets(EPBP_COMPUTE,pipelineLayout,0u,4u,descriptorSets,nullptr);
 }
 
+//! what `ext::RadixSort::RadixSort::sort` needs to sort a given number of keys
+struct SRayKeySortParameters
+{
+	using RadixSortClass = ext::RadixSort::RadixSort;
+	using ScanClass = ext::RadixSort::ScanClass;
+
+	SRayKeySortParameters(const uint32_t keyCount)
+	{
+		totalScanPassCount = RadixSortClass::buildParameters(keyCount,WORKGROUP_SIZE,nullptr,nullptr,nullptr,nullptr);
+		upsweepPassCount = totalScanPassCount/2u+1u;
+		scan.resize(upsweepPassCount);
+		scanDispatch.resize(upsweepPassCount);
+		RadixSortClass::buildParameters(keyCount,WORKGROUP_SIZE,sort,&sortDispatch,scan.data(),scanDispatch.data());
+	}
+
+	inline size_t getHistogramSize() const { return size_t(sortDispatch.wg_count[0])*RadixSortClass::BUCKETS_COUNT*sizeof(uint32_t); }
+
+	uint32_t totalScanPassCount,upsweepPassCount;
+	RadixSortClass::Parameters_t sort[RadixSortClass::PASS_COUNT];
+	RadixSortClass::DispatchInfo_t sortDispatch;
+	core::vector<ScanClass::Parameters_t> scan;
+	core::vector<ScanClass::DispatchInfo_t> scanDispatch;
+};
+
+void Renderer::setRayReordering(const bool enable)
+{
+	m_rayReordering = enable;
+	if (m_rayReordering)
+		initRayReorderingResources();
+}
+
+void Renderer::initRayReorderingResources()
+{
+	if (!m_rayKeySorter)
+	{
+		m_rayKeySorter = core::make_smart_refctd_ptr<ext::RadixSort::RadixSort>(m_driver,WORKGROUP_SIZE);
+		for (auto& ds : m_rayKeySortDS)
+			ds = m_driver->createDescriptorSet(core::smart_refctd_ptr<const IGPUDescriptorSetLayout>(m_rayKeySorter->getDefaultSortDescriptorSetLayout()));
+		m_rayKeyScanDS = m_driver->createDescriptorSet(core::smart_refctd_ptr<const IGPUDescriptorSetLayout>(m_rayKeySorter->getDefaultScanDescriptorSetLayout()));
+
+		{
+			constexpr auto rayReorderDescriptorCount = 3u;
+			IGPUDescriptorSetLayout::SBinding bindings[rayReorderDescriptorCount];
+			fillIotaDescriptorBindingDeclarations(bindings,ISpecializedShader::ESS_COMPUTE,rayReorderDescriptorCount,EDT_STORAGE_BUFFER);
+			m_rayReorderDSLayout = m_driver->createDescriptorSetLayout(bindings,bindings+rayReorderDescriptorCount);
+		}
+		SPushConstantRange range{ISpecializedShader::ESS_COMPUTE,0u,sizeof(RayReorderShaderData_t)};
+		auto layout = m_driver->createPipelineLayout(&range,&range+1u,core::smart_refctd_ptr(m_rayReorderDSLayout),nullptr,nullptr,nullptr);
+		m_rayKeysPipeline = m_driver->createComputePipeline(nullptr,core::smart_refctd_ptr(layout),gpuSpecializedShaderFromFile(m_assetManager,m_driver,"../rayKeys.comp"));
+		m_rayReorderPipeline = m_driver->createComputePipeline(nullptr,std::move(layout),gpuSpecializedShaderFromFile(m_assetManager,m_driver,"../rayReorder.comp"));
+	}
+
+	// the rest waits for the screen sized resources
+	if (m_rayKeyBuffer || !m_rayBuffer[0].buffer)
+		return;
+	const uint32_t maxRayCount = m_rayBuffer[0].buffer->getSize()/sizeof(::RadeonRays::ray);
+	const size_t keyBufferSize = size_t(maxRayCount)*sizeof(RayReordering::SKeyAndIndex);
+	m_rayKeyBuffer = m_driver->createDeviceLocalGPUBufferOnDedMem(keyBufferSize);
+	m_rayKeyScratchBuffer = m_driver->createDeviceLocalGPUBufferOnDedMem(keyBufferSize);
+	m_rayKeyHistogramBuffer = m_driver->createDeviceLocalGPUBufferOnDedMem(SRayKeySortParameters(maxRayCount).getHistogramSize());
+
+	for (auto i=0u; i<2u; i++)
+	{
+		IGPUDescriptorSet::SDescriptorInfo infos[3];
+		IGPUDescriptorSet::SWriteDescriptorSet writes[3];
+		const core::smart_refctd_ptr<IGPUBuffer> buffers[3] = {m_rayBuffer[i].buffer,m_rayKeyBuffer,m_rayBuffer[i^0x1u].buffer};
+		m_rayReorderDS[i] = m_driver->createDescriptorSet(core::smart_refctd_ptr(m_rayReorderDSLayout));
+		for (auto j=0u; j<3u; j++)
+		{
+			infos[j].desc = buffers[j];
+			infos[j].buffer.offset = 0u;
+			infos[j].buffer.size = buffers[j]->getSize();
+			writes[j].dstSet = m_rayReorderDS[i].get();
+			writes[j].binding = j;
+			writes[j].arrayElement = 0u;
+			writes[j].count = 1u;
+			writes[j].descriptorType = EDT_STORAGE_BUFFER;
+			writes[j].info = infos+j;
+		}
+		m_driver->updateDescriptorSets(3u,writes,0u,nullptr);
+	}
+}
+
+void Renderer::reorderRays(const uint32_t descSetIx, const uint32_t rayCount)
+{
+	auto* rays = m_rayBuffer[descSetIx].buffer.get();
+	// the other ray buffer only gets written by the closest hit of this bounce, until then it can hold the unsorted rays
+	auto* unsortedRays = m_rayBuffer[descSetIx^0x1u].buffer.get();
+	const auto quantization = RayReordering::SQuantization::fromBound(m_sceneBound);
+	RayReorderShaderData_t pushConstants;
+	pushConstants.boundMin = {quantization.boundMin[0],quantization.boundMin[1],quantization.boundMin[2]};
+	pushConstants.rayCount = rayCount;
+	pushConstants.rcpBoundExtent = {quantization.rcpBoundExtent[0],quantization.rcpBoundExtent[1],quantization.rcpBoundExtent[2]};
+	pushConstants.padding = 0u;
+	const uint32_t workgroupCount = (rayCount-1u)/WORKGROUP_SIZE+1u;
+	auto dispatch = [&](const IGPUComputePipeline* pipeline) -> void
+	{
+		m_driver->bindComputePipeline(pipeline);
+		m_driver->bindDescriptorSets(EPBP_COMPUTE,pipeline->getLayout(),0u,1u,&m_rayReorderDS[descSetIx].get(),nullptr);
+		m_driver->pushConstants(pipeline->getLayout(),ISpecializedShader::ESS_COMPUTE,0u,sizeof(pushConstants),&pushConstants);
+		m_driver->dispatch(workgroupCount,1u,1u);
+	};
+
+	dispatch(m_rayKeysPipeline.get());
+	COpenGLExtensionHandler::pGlMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	{
+		using RadixSortClass = SRayKeySortParameters::RadixSortClass;
+		SRayKeySortParameters params(rayCount);
+		auto makeRange = [](const core::smart_refctd_ptr<IGPUBuffer>& buffer, const size_t size) -> SBufferRange<IGPUBuffer>
+		{
+			SBufferRange<IGPUBuffer> range = {0};
+			range.offset = 0u;
+			range.size = size;
+			range.buffer = buffer;
+			return range;
+		};
+		const auto keyRange = makeRange(m_rayKeyBuffer,size_t(rayCount)*sizeof(RayReordering::SKeyAndIndex));
+		const auto scratchRange = makeRange(m_rayKeyScratchBuffer,keyRange.size);
+		const auto histogramRange = makeRange(m_rayKeyHistogramBuffer,params.getHistogramSize());
+		RadixSortClass::updateDescriptorSet(m_rayKeyScanDS.get(),&histogramRange,1u,m_driver);
+		RadixSortClass::updateDescriptorSetsPingPong(m_rayKeySortDS,keyRange,scratchRange,m_driver);
+		RadixSortClass::sort(
+			m_rayKeySorter->getDefaultHistogramPipeline(),m_rayKeySorter->getDefaultUpsweepPipeline(),
+			m_rayKeySorter->getDefaultDownsweepPipeline(),m_rayKeySorter->getDefaultScatterPipeline(),
+			m_rayKeyScanDS.get(),m_rayKeySortDS,params.scan.data(),params.sort,params.scanDispatch.data(),&params.sortDispatch,
+			params.totalScanPassCount,params.upsweepPassCount,m_driver
+		);
+	}
+
+	COpenGLExtensionHandler::pGlMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT|GL_BUFFER_UPDATE_BARRIER_BIT);
+	m_driver->copyBuffer(rays,unsortedRays,0u,0u,size_t(rayCount)*sizeof(::RadeonRays::ray));
+	COpenGLExtensionHandler::pGlMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	dispatch(m_rayReorderPipeline.get());
+	COpenGLExtensionHandler::pGlMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+	if (m_rayReorderingValidationPending)
+	{
+		m_rayReorderingValidationPending = false;
+		const auto keys = downloadBuffer(m_rayKeyBuffer.get(),size_t(rayCount)*sizeof(RayReordering::SKeyAndIndex));
+		const auto reordered = downloadBuffer(rays,size_t(rayCount)*sizeof(::RadeonRays::ray));
+		if (keys.empty() || reordered.empty())
+			return;
+		m_rayReorderingValidation = RayReordering::validate(
+			reinterpret_cast<const RayReordering::SKeyAndIndex*>(keys.data()),
+			reinterpret_cast<const ::RadeonRays::ray*>(reordered.data()),
+			rayCount,quantization
+		);
+	}
+}
+
+bool Renderer::intersectOnCPU(const uint32_t descSetIx, const uint32_t rayCount)
+{
+	const auto rays = downloadBuffer(m_rayBuffer[descSetIx].buffer.get(),size_t(rayCount)*sizeof(::RadeonRays::ray));
+	if (rays.empty())
+		return false;
+	// `traceBounce` waited for GL before downloading the rays, so the copy out of the last bounce's hits is done
+	auto* intersections = reinterpret_cast<::RadeonRays::Intersection*>(m_cpuIntersectionUploadBuffer->getBoundMemory()->getMappedPointer());
+	m_cpuIntersector.intersect(reinterpret_cast<const ::RadeonRays::ray*>(rays.data()),intersections,rayCount);
+	m_driver->copyBuffer(m_cpuIntersectionUploadBuffer.get(),m_intersectionBuffer[descSetIx].buffer.get(),0u,0u,size_t(rayCount)*sizeof(::RadeonRays::Intersection));
+	return true;
+}
+
 bool Renderer::traceBounce(uint32_t& raycount)
 {
 	// probably wise to flush all caches (in the future can optimize to texture_fetch|shader_image_access|shader_storage_buffer|blit|texture_download|...)
@@ -1839,57 +2908,90 @@ bool Renderer::traceBounce(uint32_t& raycount)
 
 	if (raycount)
 	{
+		// the rays out of the rasterized hits are bounce 0
+		const uint32_t bounce = m_raytraceCommonData.depth-1u;
+		const uint32_t descSetIx = m_raytraceCommonData.depth&0x1u;
+		// not worth the dispatches for a handful of rays
+		if (m_rayReordering && raycount>WORKGROUP_SIZE)
+		{
+			{
+				StageTimings::CScope timing(m_stageTimings,StageTimings::ES_RAY_SORT,bounce);
+				timing.setRays(raycount);
+				reorderRays(descSetIx,raycount);
+			}
+			// OpenCL can only acquire the rays once GL is done writing them
+			glFinish();
+		}
 		// trace rays
 		m_totalRaysCast += raycount;
 		{
-			const uint32_t descSetIx = m_raytraceCommonData.depth&0x1u;
+			StageTimings::CScope timing(m_stageTimings,StageTimings::ES_INTERSECT,bounce,false);
+			timing.setRays(raycount);
 
-			auto commandQueue = m_rrManager->getCLCommandQueue();
-			const cl_mem clObjects[] = {m_rayBuffer[descSetIx].asRRBuffer.second,m_intersectionBuffer[descSetIx].asRRBuffer.second};
-			const auto objCount = sizeof(clObjects)/sizeof(cl_mem);
-			cl_event acquired=nullptr, raycastDone=nullptr;
-			// run the raytrace queries
+			if (m_cpuIntersection)
 			{
-				ocl::COpenCLHandler::ocl.pclEnqueueAcquireGLObjects(commandQueue,objCount,clObjects,0u,nullptr,&acquired);
-
-				clEnqueueWaitForEvents(commandQueue,1u,&acquired);
-				m_rrManager->getRadeonRaysAPI()->QueryIntersection(
-					m_rayBuffer[descSetIx].asRRBuffer.first,raycount,
-					m_intersectionBuffer[descSetIx].asRRBuffer.first,nullptr,nullptr
-				);
-				clEnqueueMarker(commandQueue,&raycastDone);
+				if (!intersectOnCPU(descSetIx,raycount))
+					return false;
 			}
-
-			// sync CPU to CL
-			cl_event released;
-			ocl::COpenCLHandler::ocl.pclEnqueueReleaseGLObjects(commandQueue, objCount, clObjects, 1u, &raycastDone, &released);
-			ocl::COpenCLHandler::ocl.pclFlush(commandQueue);
-
-			cl_int retval = -1;
-			auto startWait = std::chrono::steady_clock::now();
-			constexpr auto timeoutInSeconds = 20ull;
-			bool timedOut = false;
-			do {
-				const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-startWait).count();
-				if (elapsed > timeoutInSeconds * 1'000'000ull)
+			else
+			{
+				auto commandQueue = m_rrManager->getCLCommandQueue();
+				const cl_mem clObjects[] = {m_rayBuffer[descSetIx].asRRBuffer.second,m_intersectionBuffer[descSetIx].asRRBuffer.second};
+				const auto objCount = sizeof(clObjects)/sizeof(cl_mem);
+				cl_event acquired=nullptr, raycastDone=nullptr;
+				// run the raytrace queries
 				{
-					timedOut = true;
-					break;
+					ocl::COpenCLHandler::ocl.pclEnqueueAcquireGLObjects(commandQueue,objCount,clObjects,0u,nullptr,&acquired);
+
+					clEnqueueWaitForEvents(commandQueue,1u,&acquired);
+					m_rrManager->getRadeonRaysAPI()->QueryIntersection(
+						m_rayBuffer[descSetIx].asRRBuffer.first,raycount,
+						m_intersectionBuffer[descSetIx].asRRBuffer.first,nullptr,nullptr
+					);
+					clEnqueueMarker(commandQueue,&raycastDone);
 				}
 
-				std::this_thread::yield();
-				ocl::COpenCLHandler::ocl.pclGetEventInfo(released, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &retval, nullptr);
-			} while(retval != CL_COMPLETE);
+				// sync CPU to CL
+				cl_event released;
+				ocl::COpenCLHandler::ocl.pclEnqueueReleaseGLObjects(commandQueue, objCount, clObjects, 1u, &raycastDone, &released);
+				ocl::COpenCLHandler::ocl.pclFlush(commandQueue);
+
+				cl_int retval = -1;
+				auto startWait = std::chrono::steady_clock::now();
+				constexpr auto timeoutInSeconds = 20ull;
+				bool timedOut = false;
+				do {
+					const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-startWait).count();
+					if (elapsed > timeoutInSeconds * 1'000'000ull)
+					{
+						timedOut = true;
+						break;
+					}
+
+					std::this_thread::yield();
+					ocl::COpenCLHandler::ocl.pclGetEventInfo(released, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &retval, nullptr);
+				} while(retval != CL_COMPLETE);
 		
-			if(timedOut)
-			{
-				std::cout << "[ERROR] RadeonRays Timed Out" << std::endl;
-				return false;
+				if(timedOut)
+				{
+					std::cout << "[ERROR] RadeonRays Timed Out" << std::endl;
+					return false;
+				}
+				// only there if RadeonRays made its queue with profiling enabled
+				if (m_stageTimings.isEnabled())
+				{
+					cl_ulong begin,end;
+					if (clGetEventProfilingInfo(acquired,CL_PROFILING_COMMAND_END,sizeof(begin),&begin,nullptr)==CL_SUCCESS &&
+						clGetEventProfilingInfo(raycastDone,CL_PROFILING_COMMAND_END,sizeof(end),&end,nullptr)==CL_SUCCESS)
+						timing.setQueueTime(double(end-begin)*1e-6);
+				}
 			}
 		}
 	
 		// compute bounce (accumulate contributions and optionally generate rays)
 		{
+			StageTimings::CScope timing(m_stageTimings,StageTimings::ES_CLOSEST_HIT,bounce);
+			timing.setRays(raycount);
 			preDispatch(m_closestHitPipeline->getLayout(),&m_closestHitDS->get());
 
 			m_driver->bindComputePipeline(m_closestHitPipeline.get());
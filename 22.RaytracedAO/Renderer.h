@@ -7,6 +7,7 @@
 #undef PI
 
 #include "nbl/ext/MitsubaLoader/CMitsubaLoader.h"
+#include "nbl/ext/RadixSort/RadixSort.h"
 
 #include <ISceneManager.h>
 
@@ -18,6 +19,14 @@
 #include <future>
 #include <filesystem>
 
+#include "SampleSequenceCache.h"
+#include "PostProcess.h"
+#include "StageTimings.h"
+#include "AdaptiveSampling.h"
+#include "RayReordering.h"
+#include "CPUIntersector.h"
+#include "ScrambleKeys.h"
+
 class Renderer : public nbl::core::IReferenceCounted, public nbl::core::InterfaceUnmovable
 {
     public:
@@ -40,7 +49,28 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 
 		Renderer(nbl::video::IVideoDriver* _driver, nbl::asset::IAssetManager* _assetManager, nbl::scene::ISceneManager* _smgr, bool useDenoiser = true);
 
-		void initSceneResources(nbl::asset::SAssetBundle& meshes, nbl::io::path&& _sampleSequenceCachePath="");
+		//! On by default, when off the driver compiles every shader from GLSL. The constructor compiles shaders already, so set it before.
+		static void setShaderCacheEnabled(const bool enable);
+
+		struct SMeshPackingParams
+		{
+			//! don't pack UVs for meshbuffers whose materials sample no textures, or normals for flat shaded ones
+			bool stripVertexAttributes = false;
+			//! also pack serially and compare, and check the stripped attributes against unstripped ones, see `meshPackingChecksPassed`
+			bool benchmark = false;
+			//! report how long the packing steps took, always on with `benchmark`
+			bool verbose = false;
+			//! where the packed scene gets loaded from and saved to, empty disables the cache
+			std::string sceneCachePath = "";
+			//! `SceneCache::hashScene` of the scene the meshes came from
+			uint64_t sceneHash = 0ull;
+			//! the least recently used caches in the directory of `sceneCachePath` get evicted beyond this, see `SceneCache::trim`, 0 keeps all
+			uint64_t sceneCacheMaxBytes = 0ull;
+		};
+		void initSceneResources(nbl::asset::SAssetBundle& meshes, nbl::io::path&& _sampleSequenceCachePath="", const SMeshPackingParams& meshPackingParams={});
+
+		inline bool meshPackingChecksPassed() const { return m_meshPackingChecksPassed; }
+		inline bool sceneLoadedFromCache() const { return m_sceneLoadedFromCache; }
 
 		void deinitSceneResources();
 		
@@ -51,10 +81,24 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 		void resetSampleAndFrameCounters();
 
 		void takeAndSaveScreenShot(const std::filesystem::path& screenshotFilePath, bool denoise = false, const DenoiserArgs& denoiserArgs = {});
+
+		//! Tiled rendering of outputs bigger than what the screen sized resources can afford: `initScreenSizedResources` with the tile size,
+		//! then for every tile `resetSampleAndFrameCounters`, `setRenderRegion`, render until done and `addRegionToCapture`,
+		//! finally `saveTiledCapture` writes what `takeAndSaveScreenShot` would have for the whole image.
+		//! Every pixel gets the same scramble key, jitter and sample indices as it would in an untiled render.
+		//! The whole image gets assembled in RAM as float color, albedo and normal, 36 bytes a pixel, and saving it needs about as much again
+		//! for the post process and the EXR encode. So `addRegionToCapture` refuses images over `MaxTiledCapturePixels`, which is 8K x 8K or
+		//! about 2.4GB before saving, 16K x 16K would be 9.6GB.
+		static inline constexpr uint64_t MaxTiledCapturePixels = 8192ull*8192ull;
+		void setRenderRegion(const uint32_t offsetX, const uint32_t offsetY, const uint32_t fullWidth, const uint32_t fullHeight);
+		void addRegionToCapture();
+		void saveTiledCapture(const std::filesystem::path& screenshotFilePath, bool denoise = false, const DenoiserArgs& denoiserArgs = {});
 		
 		void denoiseCubemapFaces(std::filesystem::path filePaths[6], const std::string& mergedFileName, int borderPixels, const DenoiserArgs& denoiserArgs = {});
 
 		bool render(nbl::ITimer* timer, const bool transformNormals, const bool beauty=true);
+		//! blocks until the GPU and OpenCL finished everything submitted so far, for timing
+		void finishAllWork();
 
 		auto* getColorBuffer() { return m_colorBuffer; }
 
@@ -80,6 +124,35 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 			return m_totalRaysCast;
 		}
 
+		//! off until given a driver with `StageTimings::setDriver`
+		StageTimings& getStageTimings() { return m_stageTimings; }
+
+		//! call after `initScreenSizedResources` and `resetSampleAndFrameCounters`, the default params turn adaptive sampling off,
+		//! `maxFrames` gets clamped to the length of the sample sequence
+		void setAdaptiveSampling(AdaptiveSampling::SParams params);
+		const AdaptiveSampling& getAdaptiveSampling() const { return m_adaptiveSampling; }
+		//! The sample sequence is made `headroom` times longer than the sensors need, so adaptive sampling can give the unconverged tiles
+		//! more than the sensor's sample count, has to be set before `initSceneResources`.
+		void setAdaptiveSamplingHeadroom(const uint32_t headroom) { m_adaptiveSamplingHeadroom = nbl::core::max(headroom,1u); }
+
+		//! Sorts every bounce's rays by `RayReordering`'s Morton code before they get intersected,
+		//! costs two more buffers of 8 bytes per ray and a copy of the rays.
+		void setRayReordering(const bool enable);
+		bool getRayReordering() const { return m_rayReordering; }
+		//! the next bounce that gets sorted is downloaded and checked against the CPU reference
+		void requestRayReorderingValidation()
+		{
+			m_rayReorderingValidation = {};
+			m_rayReorderingValidationPending = true;
+		}
+		const RayReordering::SValidation& getRayReorderingValidation() const { return m_rayReorderingValidation; }
+
+		//! Intersects with `CPUIntersector` instead of RadeonRays, has to be set before `initSceneResources` so the BVHs get built.
+		//! Every bounce's rays get downloaded and the intersections uploaded, so it's for checking RadeonRays and not for speed.
+		void setCPUIntersection(const bool enable) { m_cpuIntersection = enable; }
+		bool getCPUIntersection() const { return m_cpuIntersection; }
+		const CPUIntersector& getCPUIntersector() const { return m_cpuIntersector; }
+
 		//! Brief guideline to good path depth limits
 		// Want to see stuff with indirect lighting on the other side of a pane of glass
 		// 5 = glass frontface->glass backface->diffuse surface->diffuse surface->light
@@ -87,7 +160,6 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 		// 7 = glass frontface->glass backface->glass frontface->glass backface->diffuse surface->diffuse surface->light
 		// pick higher numbers for better GI and less bias
 		static inline constexpr uint32_t DefaultPathDepth = 8u;
-		// TODO: Upload only a subsection of the sample sequence to the GPU, so we can use more samples without trashing VRAM
 		static inline constexpr uint32_t MaxFreeviewSamples = 0x10000u;
 
 		//
@@ -119,15 +191,34 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 				nbl::core::vector<uint32_t> lightCDF;
 			};
 		};
-		InitializationData initSceneObjects(const nbl::asset::SAssetBundle& meshes);
+		InitializationData initSceneObjects(const nbl::asset::SAssetBundle& meshes, const SMeshPackingParams& meshPackingParams);
 		void initSceneNonAreaLights(InitializationData& initData);
 		void finalizeScene(InitializationData& initData);
 
 		//
 		nbl::core::smart_refctd_ptr<nbl::video::IGPUImageView> createScreenSizedTexture(nbl::asset::E_FORMAT format, uint32_t layers=0u);
 
+		//! Post processing of screenshots happens in-process on the CPU, the resolved images get downloaded once and never read back from disk
+		struct SCapture
+		{
+			std::string pathWithoutExtension;
+			PostProcess::SImage color,albedo,normal;
+		};
+		PostProcess::SImage downloadImage(const nbl::video::IGPUImageView* imageView);
+		nbl::core::vector<uint8_t> downloadBuffer(nbl::video::IGPUBuffer* buffer, const size_t size);
+		void saveCapture(SCapture&& capture, bool denoise, const DenoiserArgs& denoiserArgs);
+		PostProcess::SImage loadImage(const std::string& path);
+		void writeImage(const PostProcess::SImage& image, const std::string& pathWithoutExtension, bool ldr);
+		PostProcess::SParams getPostProcessParams(const DenoiserArgs& denoiserArgs);
+
 		//
 		void preDispatch(const nbl::video::IGPUPipelineLayout* layout, nbl::video::IGPUDescriptorSet*const *const lastDS);
+		void updateAdaptiveSampling();
+		void uploadTileLastFrames();
+		void uploadScrambleKeys();
+		void initRayReorderingResources();
+		void reorderRays(const uint32_t descSetIx, const uint32_t rayCount);
+		bool intersectOnCPU(const uint32_t descSetIx, const uint32_t rayCount);
 		bool traceBounce(uint32_t& inoutRayCount);
 
 		//
@@ -173,32 +264,59 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 
 				// one less because first path vertex uses a different sequence 
 				static inline uint32_t computeQuantizedDimensions(uint32_t maxPathDepth) {return (maxPathDepth-1)*SAMPLING_STRATEGY_COUNT;}
-				nbl::core::smart_refctd_ptr<nbl::asset::ICPUBuffer> createCPUBuffer(uint32_t quantizedDimensions, uint32_t sampleCount);
 
-				// from cache
-				void createBufferView(nbl::video::IVideoDriver* driver, nbl::core::smart_refctd_ptr<nbl::asset::ICPUBuffer>&& buff);
-				// regenerate
-				nbl::core::smart_refctd_ptr<nbl::asset::ICPUBuffer> createBufferView(nbl::video::IVideoDriver* driver, uint32_t quantizedDimensions, uint32_t sampleCount);
+				// loads from cache, generating and appending to the cache only the dimensions it lacks, then commits the first page
+				void createBufferView(nbl::video::IVideoDriver* driver, const std::string& cachePath, uint32_t quantizedDimensions, uint32_t sampleCount);
+				// uploads every page overlapping [0,sampleEnd) which isn't resident yet, growing the buffer when they don't fit,
+				// returns true when that replaced the buffer view so the descriptor sets need to be pointed at the new one
+				bool commitSamples(nbl::video::IVideoDriver* driver, uint32_t sampleEnd);
 
 				auto getBufferView() const {return bufferView;}
+				uint32_t getCommittedSampleCount() const {return committedSamples;}
 
 			private:
+				// per-dimension columns of the sequence, either straight out of the mapped cache or freshly generated
+				SampleSequenceCache cache;
+				std::unique_ptr<uint32_t[][2]> generated;
+				nbl::core::vector<const uint32_t(*)[2]> columns;
+				uint32_t quantizedDimensions = 0u;
+				uint32_t sampleCount = 0u;
+				uint32_t committedSamples = 0u;
+				uint32_t bufferSamples = 0u;
+
+				nbl::core::smart_refctd_ptr<nbl::video::IGPUBuffer> buffer;
 				nbl::core::smart_refctd_ptr<nbl::video::IGPUBufferView> bufferView;
 		} sampleSequence;
 		uint16_t pathDepth;
 		uint16_t noRussianRouletteDepth;
 		uint32_t maxSensorSamples;
+		uint32_t m_adaptiveSamplingHeadroom = 1u;
 
 		// scene specific data
 		nbl::core::vector<::RadeonRays::Shape*> rrShapes;
 		nbl::core::vector<::RadeonRays::Shape*> rrInstances;
+		bool m_cpuIntersection = false;
+		CPUIntersector m_cpuIntersector;
+		//! persistently mapped, as big as one intersection buffer
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUBuffer> m_cpuIntersectionUploadBuffer;
 
 		nbl::core::matrix3x4SIMD m_prevView;
 		nbl::core::matrix4x3 m_prevCamTform;
 		nbl::core::aabbox3df m_sceneBound;
 		uint32_t m_framesDispatched;
 		vec2 m_rcpPixelSize;
+		//! the part of the full image the screen sized resources currently cover
+		struct SRenderRegion
+		{
+			uint32_t offset[2];
+			uint32_t fullExtent[2];
+		} m_renderRegion;
+		//! maps the region's part of the full image's clip space onto the whole viewport
+		nbl::core::matrix4SIMD m_renderRegionCrop;
 		uint64_t m_totalRaysCast;
+		StageTimings m_stageTimings;
+		AdaptiveSampling m_adaptiveSampling;
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUBuffer> m_tileLastFrameBuffer;
 		StaticViewData_t m_staticViewData;
 		RaytraceShaderCommonData_t m_raytraceCommonData;
 
@@ -229,9 +347,21 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 		};
 		InteropBuffer m_rayBuffer[2];
 		InteropBuffer m_intersectionBuffer[2];
+
+		bool m_rayReordering = false;
+		bool m_rayReorderingValidationPending = false;
+		RayReordering::SValidation m_rayReorderingValidation;
+		nbl::core::smart_refctd_ptr<nbl::ext::RadixSort::RadixSort> m_rayKeySorter;
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUDescriptorSet> m_rayKeySortDS[2],m_rayKeyScanDS;
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUDescriptorSetLayout> m_rayReorderDSLayout;
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUComputePipeline> m_rayKeysPipeline,m_rayReorderPipeline;
+		//! one per ray buffer, the other one is the scratch the unsorted rays get copied to
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUDescriptorSet> m_rayReorderDS[2];
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUBuffer> m_rayKeyBuffer,m_rayKeyScratchBuffer,m_rayKeyHistogramBuffer;
 		nbl::core::smart_refctd_ptr<nbl::video::IGPUImageView> m_accumulation,m_tonemapOutput;
 		nbl::core::smart_refctd_ptr<nbl::video::IGPUImageView> m_albedoAcc,m_albedoRslv;
 		nbl::core::smart_refctd_ptr<nbl::video::IGPUImageView> m_normalAcc,m_normalRslv;
+		nbl::core::smart_refctd_ptr<nbl::video::IGPUImageView> m_scrambleKeys;
 		nbl::video::IFrameBuffer* m_visibilityBuffer,* m_colorBuffer;
 		
 		// Resources used for blending environmental maps
@@ -242,6 +372,17 @@ class Renderer : public nbl::core::IReferenceCounted, public nbl::core::Interfac
 		nbl::core::smart_refctd_ptr<nbl::video::IGPUImageView> m_finalEnvmap;
 
 		std::future<bool> compileShadersFuture;
+
+		// the faces of a cubemap get rendered one after another and then denoised together, so the last few screenshots stay around
+		static inline constexpr uint32_t MaxRetainedCaptures = 6u;
+		nbl::core::vector<SCapture> m_recentCaptures;
+		//! the full image being assembled out of tiles
+		SCapture m_tiledCapture;
+		std::string m_bloomPSFPath;
+		PostProcess::SImage m_bloomPSF;
+
+		bool m_meshPackingChecksPassed = true;
+		bool m_sceneLoadedFromCache = false;
 };
 
 #endif
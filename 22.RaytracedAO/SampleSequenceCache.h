@@ -0,0 +1,161 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _SAMPLE_SEQUENCE_CACHE_H_INCLUDED_
+#define _SAMPLE_SEQUENCE_CACHE_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <numeric>
+
+#include "../common/CacheFile.hpp"
+#include "SampleSequenceGenerator.h"
+
+
+//! On-disk cache of the low discrepancy sample sequence.
+//! Unlike the layout the path tracer reads, the file stores every quantized dimension as its own 64 byte aligned column of `sampleCount` uint32 pairs,
+//! so a deeper path only needs the missing dimensions generated and the columns of any sample range can be gathered straight out of the mapping.
+//! The header and the column table are covered by one checksum and every column by its own, so truncation and corruption get caught on load.
+class SampleSequenceCache
+{
+	public:
+		//! bump whenever the file layout changes
+		static inline constexpr uint32_t Version = 1u;
+		static inline constexpr uint32_t Magic = 0x5153444cu; // "LDSQ"
+		static inline constexpr uint64_t ColumnAlignment = 64ull;
+
+		enum E_SAMPLER_TYPE : uint32_t
+		{
+			EST_OWEN_SCRAMBLED_SOBOL
+		};
+		enum E_PACKING : uint32_t
+		{
+			//! 3 dimensions in an R32G32_UINT texel, 21 bits each for the first two and the third split 11/10 into their low bits
+			EP_RG32_21_21_11_10
+		};
+
+		struct SHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			E_SAMPLER_TYPE samplerType;
+			E_PACKING packing;
+			uint32_t seed;
+			uint32_t sampleCount;
+			uint32_t quantizedDimensions;
+			uint32_t padding;
+			//! hash of this header (with the field zeroed) and the column checksum table that follows it
+			uint64_t headerChecksum;
+		};
+
+		static inline size_t getColumnSize(const uint32_t sampleCount) { return sampleCount*sizeof(uint32_t[2]); }
+		static inline uint64_t getPayloadOffset(const uint32_t quantizedDimensions)
+		{
+			return nbl::core::roundUp(uint64_t(sizeof(SHeader)+quantizedDimensions*sizeof(uint64_t)),ColumnAlignment);
+		}
+		static inline uint64_t getColumnOffset(const uint32_t sampleCount, const uint32_t quantizedDimensions, const uint32_t column)
+		{
+			return getPayloadOffset(quantizedDimensions)+column*nbl::core::roundUp(uint64_t(getColumnSize(sampleCount)),ColumnAlignment);
+		}
+
+		//! maps the cache and verifies every column, on any failure (missing, other sampler, truncated, corrupted) nothing stays mapped
+		inline bool load(const std::string& path)
+		{
+			if (!m_file.open(path))
+				return false;
+
+			const char* rejection = nullptr;
+			const auto* header = getHeader();
+			if (m_file.size()<sizeof(SHeader))
+				rejection = "truncated header";
+			else if (header->magic!=Magic || header->version!=Version)
+				rejection = "different version";
+			else if (header->samplerType!=EST_OWEN_SCRAMBLED_SOBOL || header->packing!=EP_RG32_21_21_11_10 || header->seed!=SampleSequenceGenerator::Seed)
+				rejection = "different sampler";
+			else if (header->sampleCount==0u || header->quantizedDimensions==0u)
+				rejection = "empty";
+			else if (m_file.size()<getColumnOffset(header->sampleCount,header->quantizedDimensions,header->quantizedDimensions))
+				rejection = "truncated";
+			else if (computeHeaderChecksum(*header,getColumnChecksums())!=header->headerChecksum)
+				rejection = "header checksum mismatch";
+			else
+			{
+				nbl::core::vector<uint32_t> columns(header->quantizedDimensions);
+				std::iota(columns.begin(),columns.end(),0u);
+				const bool allValid = std::all_of(nbl::core::execution::par_unseq,columns.begin(),columns.end(),[&](const uint32_t column) -> bool
+				{
+					return cache_file::hash(getColumn(column),getColumnSize(header->sampleCount))==getColumnChecksums()[column];
+				});
+				if (!allValid)
+					rejection = "column checksum mismatch";
+			}
+
+			if (rejection)
+			{
+				printf("[INFO] Sample Sequence cache %s rejected: %s, regenerating\n",path.c_str(),rejection);
+				m_file.close();
+				return false;
+			}
+			return true;
+		}
+		inline void close() { m_file.close(); }
+
+		inline const SHeader* getHeader() const { return reinterpret_cast<const SHeader*>(m_file.data()); }
+		inline const uint32_t (*getColumn(const uint32_t column) const)[2]
+		{
+			const auto* header = getHeader();
+			return reinterpret_cast<const uint32_t(*)[2]>(m_file.data()+getColumnOffset(header->sampleCount,header->quantizedDimensions,column));
+		}
+
+		//! `columns` holds `quantizedDimensions` columns of `sampleCount` entries back to back
+		static inline bool save(const std::string& path, const uint32_t sampleCount, const uint32_t quantizedDimensions, const uint32_t (*columns)[2])
+		{
+			SHeader header = {};
+			header.magic = Magic;
+			header.version = Version;
+			header.samplerType = EST_OWEN_SCRAMBLED_SOBOL;
+			header.packing = EP_RG32_21_21_11_10;
+			header.seed = SampleSequenceGenerator::Seed;
+			header.sampleCount = sampleCount;
+			header.quantizedDimensions = quantizedDimensions;
+
+			const size_t columnSize = getColumnSize(sampleCount);
+			nbl::core::vector<uint64_t> checksums(quantizedDimensions);
+			nbl::core::vector<uint32_t> columnIDs(quantizedDimensions);
+			std::iota(columnIDs.begin(),columnIDs.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,columnIDs.begin(),columnIDs.end(),[&](const uint32_t column)
+			{
+				checksums[column] = cache_file::hash(columns+size_t(column)*sampleCount,columnSize);
+			});
+			header.headerChecksum = computeHeaderChecksum(header,checksums.data());
+
+			return cache_file::writeAtomically(path,[&](std::ofstream& file) -> bool
+			{
+				const uint8_t zeroes[ColumnAlignment] = {};
+				file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+				file.write(reinterpret_cast<const char*>(checksums.data()),checksums.size()*sizeof(uint64_t));
+				file.write(reinterpret_cast<const char*>(zeroes),getPayloadOffset(quantizedDimensions)-sizeof(header)-checksums.size()*sizeof(uint64_t));
+				const auto columnPadding = getColumnOffset(sampleCount,quantizedDimensions,1u)-getColumnOffset(sampleCount,quantizedDimensions,0u)-columnSize;
+				for (auto column=0u; column<quantizedDimensions; column++)
+				{
+					file.write(reinterpret_cast<const char*>(columns+size_t(column)*sampleCount),columnSize);
+					file.write(reinterpret_cast<const char*>(zeroes),columnPadding);
+				}
+				return bool(file);
+			});
+		}
+
+	private:
+		inline const uint64_t* getColumnChecksums() const { return reinterpret_cast<const uint64_t*>(m_file.data()+sizeof(SHeader)); }
+
+		static inline uint64_t computeHeaderChecksum(SHeader header, const uint64_t* columnChecksums)
+		{
+			header.headerChecksum = 0ull;
+			return cache_file::hash(columnChecksums,header.quantizedDimensions*sizeof(uint64_t),cache_file::hash(&header,sizeof(header)));
+		}
+
+		cache_file::MappedFile m_file;
+};
+
+#endif
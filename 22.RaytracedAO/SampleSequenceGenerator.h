@@ -0,0 +1,182 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _SAMPLE_SEQUENCE_GENERATOR_H_INCLUDED_
+#define _SAMPLE_SEQUENCE_GENERATOR_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+
+//! Fills the Owen scrambled Sobol sample sequence used by the path tracer.
+//! Memory Order: 3 Dimensions, then multiple of sampling stragies per vertex, then depth, then sample ID,
+//! every 3 dimensions get packed into two uint32s, the first two keep their top 21 bits and the third is split 11/10 into their low bits.
+//! The Owen sampler has a large cache which is generated separately for each dimension and a sample only depends on its dimension and index,
+//! so work is split into (quantized dimension, sample block) items each with its own sampler and the output is bit-exact regardless of thread count.
+//! Any range of quantized dimensions can be generated on its own, which lets a cache get extended with only the dimensions it lacks.
+class SampleSequenceGenerator
+{
+	public:
+		static inline constexpr uint32_t DimensionsPerQuanta = 3u;
+		static inline constexpr uint32_t Seed = 0xdeadbeefu;
+		//! the renderer uploads the sequence to the GPU in pages of this many samples as accumulation reaches them
+		static inline constexpr uint32_t PageSampleCount = 0x1u<<12u;
+
+		//! where the sample `i` of the `j`-th generated quantized dimension goes, `out[i*sampleStride+j*dimensionStride]`
+		struct SLayout
+		{
+			uint32_t sampleStride;
+			uint32_t dimensionStride;
+
+			//! the layout the path tracer reads, all dimensions of a sample next to each other
+			static inline SLayout interleaved(const uint32_t quantizedDimensions) { return {quantizedDimensions,1u}; }
+			//! every dimension contiguous, the layout of the cache file
+			static inline SLayout columns(const uint32_t sampleCount) { return {1u,sampleCount}; }
+		};
+
+		//! `out` holds `sampleCount*quantizedDimensions` uint32 pairs, `threadCount==1u` is the plain serial reference path, `0u` uses all hardware threads
+		static inline void generate(uint32_t (*out)[2], const uint32_t quantizedDimensions, const uint32_t sampleCount, uint32_t threadCount=0u)
+		{
+			generate(out,SLayout::interleaved(quantizedDimensions),0u,quantizedDimensions,sampleCount,threadCount);
+		}
+		//! generates only the quantized dimensions [`firstQuantizedDimension`,`firstQuantizedDimension+quantizedDimensions`)
+		static inline void generate(uint32_t (*out)[2], const SLayout layout, const uint32_t firstQuantizedDimension, const uint32_t quantizedDimensions, const uint32_t sampleCount, uint32_t threadCount=0u)
+		{
+			// the sampler needs to know about all dimensions up to the last one we generate
+			const uint32_t samplerDimensions = (firstQuantizedDimension+quantizedDimensions)*DimensionsPerQuanta;
+			if (threadCount==0u)
+				threadCount = nbl::core::max(std::thread::hardware_concurrency(),1u);
+			if (threadCount==1u || quantizedDimensions==0u)
+			{
+				nbl::core::OwenSampler sampler(samplerDimensions,Seed);
+				for (auto j=0u; j<quantizedDimensions; j++)
+					generate(sampler,out+j*layout.dimensionStride,layout.sampleStride,firstQuantizedDimension+j,0u,sampleCount);
+				return;
+			}
+
+			// only split dimensions into sample blocks when there's not enough of them to keep every thread busy,
+			// each block has to regenerate the dimension's scramble cache so we want as few as possible
+			const uint32_t blocksPerDimension = nbl::core::min((threadCount+quantizedDimensions-1u)/quantizedDimensions,nbl::core::max(sampleCount/MinBlockSize,1u));
+			const uint32_t blockSize = (sampleCount+blocksPerDimension-1u)/blocksPerDimension;
+			const uint32_t workItemCount = quantizedDimensions*blocksPerDimension;
+
+			std::atomic_uint32_t nextWorkItem = 0u;
+			auto worker = [&]() -> void
+			{
+				nbl::core::OwenSampler sampler(samplerDimensions,Seed);
+				for (uint32_t item=nextWorkItem++; item<workItemCount; item=nextWorkItem++)
+				{
+					const uint32_t j = item/blocksPerDimension;
+					const uint32_t begin = (item%blocksPerDimension)*blockSize;
+					const uint32_t end = nbl::core::min(begin+blockSize,sampleCount);
+					generate(sampler,out+j*layout.dimensionStride,layout.sampleStride,firstQuantizedDimension+j,begin,end);
+				}
+			};
+			nbl::core::vector<std::thread> threads;
+			threads.reserve(threadCount-1u);
+			for (auto i=1u; i<nbl::core::min(threadCount,workItemCount); i++)
+				threads.emplace_back(worker);
+			worker();
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		//! gathers the samples [`firstSample`,`firstSample+sampleCount`) of per-dimension columns into the interleaved layout, `out` starts at `firstSample`
+		static inline void interleave(uint32_t (*out)[2], const uint32_t (*const *columns)[2], const uint32_t quantizedDimensions, const uint32_t firstSample, const uint32_t sampleCount)
+		{
+			constexpr uint32_t BlockSize = 0x1u<<10u;
+			nbl::core::vector<uint32_t> blocks((sampleCount+BlockSize-1u)/BlockSize);
+			std::iota(blocks.begin(),blocks.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,blocks.begin(),blocks.end(),[&](const uint32_t block)
+			{
+				const uint32_t begin = block*BlockSize;
+				const uint32_t end = nbl::core::min(begin+BlockSize,sampleCount);
+				for (uint32_t i=begin; i<end; i++)
+				for (uint32_t column=0u; column<quantizedDimensions; column++)
+					memcpy(out[size_t(i)*quantizedDimensions+column],columns[column][firstSample+i],sizeof(uint32_t[2]));
+			});
+		}
+
+		//! times the serial and parallel paths against each other and checks they, and the paged upload path, produce identical output, returns false on any mismatch
+		static inline bool benchmark(const uint32_t quantizedDimensions, const uint32_t sampleCount)
+		{
+			const size_t entryCount = size_t(quantizedDimensions)*sampleCount;
+			auto serial = std::make_unique<uint32_t[][2]>(entryCount);
+			auto parallel = std::make_unique<uint32_t[][2]>(entryCount);
+
+			auto time = [](auto&& func) -> double
+			{
+				const auto start = std::chrono::steady_clock::now();
+				func();
+				return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+			};
+			const double serialTime = time([&](){generate(serial.get(),quantizedDimensions,sampleCount,1u);});
+			const auto threadCount = nbl::core::max(std::thread::hardware_concurrency(),1u);
+			const double parallelTime = time([&](){generate(parallel.get(),quantizedDimensions,sampleCount,threadCount);});
+
+			printf("[INFO] Sample Sequence of %d quantized dimensions x %d samples: serial %.1f ms, %d threads %.1f ms (%.2fx)\n",
+				quantizedDimensions,sampleCount,serialTime,threadCount,parallelTime,serialTime/parallelTime);
+			if (memcmp(serial.get(),parallel.get(),entryCount*sizeof(uint32_t[2]))!=0)
+			{
+				printf("[ERROR] Parallel Sample Sequence generation does not match the serial one!\n");
+				return false;
+			}
+
+			// the paged upload path: per-dimension columns as stored in the cache, interleaved a page at a time in uneven increments like accumulation does
+			std::unique_ptr<uint32_t[][2]> columnStorage(new uint32_t[entryCount][2]);
+			generate(columnStorage.get(),SLayout::columns(sampleCount),0u,quantizedDimensions,sampleCount);
+			nbl::core::vector<const uint32_t(*)[2]> columns(quantizedDimensions);
+			for (auto column=0u; column<quantizedDimensions; column++)
+				columns[column] = columnStorage.get()+size_t(column)*sampleCount;
+			auto paged = std::make_unique<uint32_t[][2]>(entryCount);
+			uint32_t pageCount = 0u;
+			for (uint32_t committed=0u,sampleEnd=1u; committed<sampleCount; sampleEnd+=sampleEnd/2u+1u)
+			{
+				const uint32_t last = nbl::core::min(nbl::core::roundUp(sampleEnd,PageSampleCount),sampleCount);
+				if (last<=committed)
+					continue;
+				interleave(paged.get()+size_t(committed)*quantizedDimensions,columns.data(),quantizedDimensions,committed,last-committed);
+				committed = last;
+				pageCount++;
+			}
+			if (memcmp(serial.get(),paged.get(),entryCount*sizeof(uint32_t[2]))!=0)
+			{
+				printf("[ERROR] Paged Sample Sequence does not match the monolithic one!\n");
+				return false;
+			}
+			printf("[INFO] Paged Sample Sequence matches the monolithic one over %d commits\n",pageCount);
+			return true;
+		}
+
+	private:
+		//! smallest sample range worth rebuilding a dimension's scramble cache for
+		static inline constexpr uint32_t MinBlockSize = 0x1u<<16u;
+
+		template<class Sampler>
+		static inline void generate(Sampler& sampler, uint32_t (*out)[2], const uint32_t sampleStride, const uint32_t metadim, const uint32_t begin, const uint32_t end)
+		{
+			const auto trudim = metadim*DimensionsPerQuanta;
+			for (uint32_t i=begin; i<end; i++)
+				out[i*sampleStride][0] = sampler.sample(trudim+0u,i);
+			for (uint32_t i=begin; i<end; i++)
+				out[i*sampleStride][1] = sampler.sample(trudim+1u,i);
+			for (uint32_t i=begin; i<end; i++)
+			{
+				const auto sample = sampler.sample(trudim+2u,i);
+				const auto entry = out[i*sampleStride];
+				entry[0] &= 0xFFFFF800u;
+				entry[0] |= sample>>21;
+				entry[1] &= 0xFFFFF800u;
+				entry[1] |= (sample>>10)&0x07FFu;
+			}
+		}
+};
+
+#endif
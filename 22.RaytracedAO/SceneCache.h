@@ -0,0 +1,354 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _SCENE_CACHE_H_INCLUDED_
+#define _SCENE_CACHE_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <numeric>
+#include <optional>
+#include <string_view>
+
+#include "../common/CacheFile.hpp"
+
+
+//! On-disk cache of everything `Renderer::initSceneObjects` derives from the loaded meshes:
+//! the packed vertex, index and MDI blobs, the batch instance data (with the materials), culling data and the area light tables.
+//! A file is only valid for the scene contents and renderer options it was made with, both hashes are in the header and checked on load.
+//! Every section is 64 byte aligned and covered by its own checksum so it can be used straight out of the mapping.
+//! Only the packing gets cached, the Mitsuba loader still parses the scene and loads its textures on every start.
+//! The directory is kept under a byte budget by `trim`, a load bumps the modification time which serves as the LRU timestamp.
+class SceneCache
+{
+	public:
+		//! bump whenever the file layout or anything the sections hold changes
+		static inline constexpr uint32_t Version = 1u;
+		static inline constexpr uint32_t Magic = 0x4e435352u; // "RSCN"
+		static inline constexpr uint64_t SectionAlignment = 64ull;
+		//! a packed scene takes about as much as its geometry, so this keeps a handful of big ones
+		static inline constexpr uint64_t DefaultMaxBytes = 4ull<<30ull;
+		static inline constexpr const char* Extension = ".bin";
+
+		enum E_SECTION : uint32_t
+		{
+			ES_VERTICES,
+			ES_INDICES,
+			ES_MDI,
+			ES_INSTANCE_DATA,
+			ES_CULL_DATA,
+			ES_BATCHES,
+			ES_MDI_CALLS,
+			ES_LIGHTS,
+			ES_LIGHT_PDF,
+			ES_COUNT
+		};
+
+		//! one RadeonRays shape, its instances are the next `instanceCount` entries of the cull data
+		struct SBatch
+		{
+			//! in floats from the start of the vertex blob
+			uint32_t positionOffset;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			uint32_t instanceCount;
+		};
+
+		struct SSceneInfo
+		{
+			float boundMin[3];
+			float boundMax[3];
+			uint32_t maxDrawCommandCount;
+			uint32_t padding;
+		};
+
+		struct SSection
+		{
+			uint64_t offset;
+			uint64_t size;
+			uint64_t checksum;
+		};
+
+		struct SHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sceneHash;
+			uint64_t optionsHash;
+			SSceneInfo info;
+			SSection sections[ES_COUNT];
+			//! hash of this header with the field zeroed
+			uint64_t headerChecksum;
+		};
+
+		//! hashes the contents of the scene file, a loose XML also gets the sizes and modification times of the files it references
+		//! (serialized shapes, textures, PSFs and included XMLs, recursively) since those can change without the XML changing.
+		//! Only the references count, so nothing this program writes next to the scene (caches, renders) can change the key.
+		static inline uint64_t hashScene(const std::string& filePath, const std::string& extraPath)
+		{
+			cache_file::MappedFile file;
+			if (!file.open(filePath))
+				return 0ull;
+			uint64_t retval = cache_file::hash(file.data(),file.size());
+			retval = cache_file::hash(extraPath.data(),extraPath.size(),retval);
+
+			const std::filesystem::path path(filePath);
+			if (path.extension()==".xml")
+			{
+				const auto sceneDirectory = path.parent_path();
+				nbl::core::vector<std::filesystem::path> pending = {path};
+				nbl::core::set<std::filesystem::path> visited = {path.lexically_normal()};
+				while (!pending.empty())
+				{
+					const auto xmlPath = std::move(pending.back());
+					pending.pop_back();
+					cache_file::MappedFile xml;
+					if (xml.open(xmlPath.string()))
+					for (const auto& reference : getReferencedFiles(reinterpret_cast<const char*>(xml.data()),xml.size()))
+					{
+						// relative to the including XML first, the loader's working directory is the top level scene's
+						std::error_code ec;
+						auto referencedPath = (xmlPath.parent_path()/reference).lexically_normal();
+						if (!std::filesystem::is_regular_file(referencedPath,ec))
+							referencedPath = (sceneDirectory/reference).lexically_normal();
+						if (!visited.insert(referencedPath).second)
+							continue;
+
+						// a missing file hashes differently from one that's there, so it showing up later invalidates the cache
+						uint64_t stats[2] = {~0ull,~0ull};
+						if (std::filesystem::is_regular_file(referencedPath,ec))
+						{
+							stats[0] = std::filesystem::file_size(referencedPath,ec);
+							stats[1] = uint64_t(std::filesystem::last_write_time(referencedPath,ec).time_since_epoch().count());
+							if (referencedPath.extension()==".xml")
+								pending.push_back(referencedPath);
+						}
+						retval = cache_file::hash(reference.data(),reference.size(),retval);
+						retval = cache_file::hash(stats,sizeof(stats),retval);
+					}
+				}
+			}
+			return retval;
+		}
+
+		//! maps the cache and verifies it, on any failure (missing, other scene or options, truncated, corrupted) nothing stays mapped
+		inline bool load(const std::string& path, const uint64_t sceneHash, const uint64_t optionsHash)
+		{
+			// before mapping, some platforms won't change the timestamps of a mapped file, a rejected one gets overwritten anyway
+			{
+				std::error_code ec;
+				if (std::filesystem::exists(path,ec))
+					std::filesystem::last_write_time(path,std::filesystem::file_time_type::clock::now(),ec);
+			}
+			if (!m_file.open(path))
+				return false;
+
+			const char* rejection = nullptr;
+			const auto* header = getHeader();
+			if (m_file.size()<sizeof(SHeader))
+				rejection = "truncated header";
+			else if (header->magic!=Magic || header->version!=Version)
+				rejection = "different version";
+			else if (header->sceneHash!=sceneHash)
+				rejection = "scene changed";
+			else if (header->optionsHash!=optionsHash)
+				rejection = "different renderer options";
+			else if (computeHeaderChecksum(*header)!=header->headerChecksum)
+				rejection = "header checksum mismatch";
+			else if (std::any_of(header->sections,header->sections+ES_COUNT,[&](const SSection& section){return section.offset+section.size>m_file.size();}))
+				rejection = "truncated";
+			else
+			{
+				nbl::core::vector<uint32_t> sections(ES_COUNT);
+				std::iota(sections.begin(),sections.end(),0u);
+				const bool allValid = std::all_of(nbl::core::execution::par_unseq,sections.begin(),sections.end(),[&](const uint32_t section) -> bool
+				{
+					return cache_file::hash(m_file.data()+header->sections[section].offset,header->sections[section].size)==header->sections[section].checksum;
+				});
+				if (!allValid)
+					rejection = "section checksum mismatch";
+			}
+
+			if (rejection)
+			{
+				printf("[INFO] Scene cache %s rejected: %s, repacking\n",path.c_str(),rejection);
+				m_file.close();
+				return false;
+			}
+			return true;
+		}
+		inline void close() { m_file.close(); }
+
+		inline const SHeader* getHeader() const { return reinterpret_cast<const SHeader*>(m_file.data()); }
+		inline const SSceneInfo& getInfo() const { return getHeader()->info; }
+		inline const uint8_t* getSection(const E_SECTION section) const { return m_file.data()+getHeader()->sections[section].offset; }
+		inline size_t getSectionSize(const E_SECTION section) const { return getHeader()->sections[section].size; }
+		template<typename T>
+		inline const T* getSection(const E_SECTION section) const { return reinterpret_cast<const T*>(getSection(section)); }
+		template<typename T>
+		inline size_t getSectionCount(const E_SECTION section) const { return getSectionSize(section)/sizeof(T); }
+
+		struct SSectionData
+		{
+			const void* data = nullptr;
+			size_t size = 0ull;
+		};
+		static inline bool save(const std::string& path, const uint64_t sceneHash, const uint64_t optionsHash, const SSceneInfo& info, const SSectionData (&sections)[ES_COUNT])
+		{
+			SHeader header = {};
+			header.magic = Magic;
+			header.version = Version;
+			header.sceneHash = sceneHash;
+			header.optionsHash = optionsHash;
+			header.info = info;
+			uint64_t offset = nbl::core::roundUp(uint64_t(sizeof(SHeader)),SectionAlignment);
+			for (auto i=0u; i<ES_COUNT; i++)
+			{
+				header.sections[i].offset = offset;
+				header.sections[i].size = sections[i].size;
+				offset = nbl::core::roundUp(offset+sections[i].size,SectionAlignment);
+			}
+			nbl::core::vector<uint32_t> sectionIDs(ES_COUNT);
+			std::iota(sectionIDs.begin(),sectionIDs.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,sectionIDs.begin(),sectionIDs.end(),[&](const uint32_t i)
+			{
+				header.sections[i].checksum = cache_file::hash(sections[i].data,sections[i].size);
+			});
+			header.headerChecksum = computeHeaderChecksum(header);
+
+			return cache_file::writeAtomically(path,[&](std::ofstream& file) -> bool
+			{
+				const uint8_t zeroes[SectionAlignment] = {};
+				file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+				uint64_t written = sizeof(header);
+				for (auto i=0u; i<ES_COUNT; i++)
+				{
+					file.write(reinterpret_cast<const char*>(zeroes),header.sections[i].offset-written);
+					file.write(reinterpret_cast<const char*>(sections[i].data),sections[i].size);
+					written = header.sections[i].offset+sections[i].size;
+				}
+				return bool(file);
+			});
+		}
+
+		//! Evicts the least recently used caches in `directory` until it fits in `maxBytes`, except `keep` which was just written,
+		//! also sweeps temporaries left behind by crashed writers. Returns how many caches got evicted.
+		static inline uint32_t trim(const std::filesystem::path& directory, const uint64_t maxBytes, const std::filesystem::path& keep)
+		{
+			struct SEntry
+			{
+				std::filesystem::path path;
+				std::filesystem::file_time_type lastUse;
+				uint64_t size;
+			};
+			nbl::core::vector<SEntry> entries;
+			uint64_t totalSize = 0ull;
+
+			std::error_code ec;
+			const auto now = std::filesystem::file_time_type::clock::now();
+			for (const auto& entry : std::filesystem::directory_iterator(directory,ec))
+			{
+				std::error_code entryEC;
+				if (!entry.is_regular_file(entryEC))
+					continue;
+				const auto& path = entry.path();
+				const auto lastUse = entry.last_write_time(entryEC);
+				if (entryEC)
+					continue;
+				if (path.extension()==".tmp")
+				{
+					// writing even a big scene takes well under a minute
+					if (now-lastUse>std::chrono::minutes(10))
+						std::filesystem::remove(path,entryEC);
+					continue;
+				}
+				if (path.extension()!=Extension)
+					continue;
+				const uint64_t size = entry.file_size(entryEC);
+				if (entryEC)
+					continue;
+				totalSize += size;
+				if (!std::filesystem::equivalent(path,keep,entryEC))
+					entries.push_back({path,lastUse,size});
+			}
+			if (totalSize<=maxBytes)
+				return 0u;
+
+			std::sort(entries.begin(),entries.end(),[](const SEntry& lhs, const SEntry& rhs) -> bool
+			{
+				if (lhs.lastUse!=rhs.lastUse)
+					return lhs.lastUse<rhs.lastUse;
+				return lhs.path<rhs.path;
+			});
+			uint32_t evictions = 0u;
+			for (auto it=entries.begin(); it!=entries.end() && totalSize>maxBytes; it++)
+			{
+				totalSize -= it->size;
+				// another instance may have it mapped or already removed it
+				std::error_code removeEC;
+				if (std::filesystem::remove(it->path,removeEC))
+					evictions++;
+			}
+			return evictions;
+		}
+
+	private:
+		//! Mitsuba references files with `<include filename="..."/>` and `<string name="filename" value="..."/>`, in document order
+		static inline nbl::core::vector<std::string> getReferencedFiles(const char* xml, const size_t size)
+		{
+			nbl::core::vector<std::string> retval;
+			const std::string_view text(xml,size);
+			auto getAttribute = [](const std::string_view tag, const std::string_view name) -> std::optional<std::string_view>
+			{
+				for (size_t pos=0ull; (pos=tag.find(name,pos))!=std::string_view::npos; pos+=name.size())
+				{
+					// whole attribute names only, so `filename` doesn't match inside `myfilename`
+					if (pos==0ull || !std::isspace(static_cast<unsigned char>(tag[pos-1ull])))
+						continue;
+					auto valuePos = pos+name.size();
+					while (valuePos<tag.size() && std::isspace(static_cast<unsigned char>(tag[valuePos])))
+						valuePos++;
+					if (valuePos+1ull>=tag.size() || tag[valuePos]!='=')
+						continue;
+					valuePos++;
+					while (valuePos<tag.size() && std::isspace(static_cast<unsigned char>(tag[valuePos])))
+						valuePos++;
+					if (valuePos>=tag.size() || (tag[valuePos]!='"' && tag[valuePos]!='\''))
+						continue;
+					const auto end = tag.find(tag[valuePos],valuePos+1ull);
+					if (end==std::string_view::npos)
+						return std::nullopt;
+					return tag.substr(valuePos+1ull,end-valuePos-1ull);
+				}
+				return std::nullopt;
+			};
+			for (size_t begin=0ull; (begin=text.find('<',begin))!=std::string_view::npos; )
+			{
+				const auto end = text.find('>',begin);
+				if (end==std::string_view::npos)
+					break;
+				const auto tag = text.substr(begin,end-begin);
+				begin = end;
+				auto filename = getAttribute(tag,"filename");
+				if (!filename.has_value() && getAttribute(tag,"name")==std::optional<std::string_view>("filename"))
+					filename = getAttribute(tag,"value");
+				if (filename.has_value())
+					retval.emplace_back(filename.value());
+			}
+			return retval;
+		}
+
+		static inline uint64_t computeHeaderChecksum(SHeader header)
+		{
+			header.headerChecksum = 0ull;
+			return cache_file::hash(&header,sizeof(header));
+		}
+
+		cache_file::MappedFile m_file;
+};
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _SCRAMBLE_KEYS_H_INCLUDED_
+#define _SCRAMBLE_KEYS_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+
+
+//! The per pixel starting state of the xoroshiro64* generator `raygen.comp` reads from the scramble key texture.
+//! Every key is a hash of the pixel's index in the full image (splitmix64's finalizer over a Weyl sequence), not the next output
+//! of one RNG stream, so any region of the image can be generated on its own, rows in parallel and columns vectorized,
+//! and the keys come out the same no matter the thread count or how the image is tiled.
+class ScrambleKeys
+{
+	public:
+		static inline constexpr uint32_t Seed = 0xbadc0ffeu;
+		static inline constexpr uint32_t Channels = 2u;
+
+		//! both channels of a pixel, low 32 bits go into the first one
+		static inline uint64_t getKey(const uint64_t pixel)
+		{
+			uint64_t key = (pixel+1ull)*0x9e3779b97f4a7c15ull+(uint64_t(Seed)<<32u);
+			key = (key^(key>>30u))*0xbf58476d1ce4e5b9ull;
+			key = (key^(key>>27u))*0x94d049bb133111ebull;
+			key ^= key>>31u;
+			// the hash is a bijection so exactly one pixel would get the all zero state xoroshiro never leaves
+			return key ? key:uint64_t(Seed);
+		}
+
+		//! Fills the keys of the `width` by `height` region at `offsetX,offsetY` of a `fullWidth` by `fullHeight` image,
+		//! `out` is tightly packed, pixels of the region hanging over the image get zero keys since they never get written out.
+		template<class ExecutionPolicy>
+		static inline void generate(ExecutionPolicy&& policy, uint32_t* out, const uint32_t offsetX, const uint32_t offsetY, const uint32_t width, const uint32_t height, const uint32_t fullWidth, const uint32_t fullHeight)
+		{
+			const uint32_t columnBegin = nbl::core::min(offsetX,fullWidth);
+			const uint32_t columns = nbl::core::min(offsetX+width,fullWidth)-columnBegin;
+			nbl::core::vector<uint32_t> rows(height);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(policy,rows.begin(),rows.end(),[&](const uint32_t y) -> void
+			{
+				uint32_t* row = out+size_t(y)*width*Channels;
+				if (offsetY+y>=fullHeight)
+				{
+					std::fill_n(row,width*Channels,0u);
+					return;
+				}
+				const uint64_t firstPixel = uint64_t(offsetY+y)*fullWidth+columnBegin;
+				for (uint32_t x=0u; x<columns; x++)
+				{
+					const uint64_t key = getKey(firstPixel+x);
+					row[x*Channels+0u] = static_cast<uint32_t>(key);
+					row[x*Channels+1u] = static_cast<uint32_t>(key>>32u);
+				}
+				std::fill(row+columns*Channels,row+width*Channels,0u);
+			});
+		}
+		static inline void generate(uint32_t* out, const uint32_t offsetX, const uint32_t offsetY, const uint32_t width, const uint32_t height, const uint32_t fullWidth, const uint32_t fullHeight)
+		{
+			generate(nbl::core::execution::par_unseq,out,offsetX,offsetY,width,height,fullWidth,fullHeight);
+		}
+
+		static inline bool benchmark();
+};
+
+inline bool ScrambleKeys::benchmark()
+{
+	constexpr uint32_t Resolutions[][2] = {{1920u,1080u},{3840u,2160u},{7680u,4320u}};
+	constexpr uint32_t Iterations = 3u;
+	constexpr uint32_t TileDim = 1000u;
+
+	bool passed = true;
+	for (const auto& resolution : Resolutions)
+	{
+		const uint32_t width = resolution[0];
+		const uint32_t height = resolution[1];
+		const size_t keyCount = size_t(width)*height*Channels;
+		nbl::core::vector<uint32_t> serial(keyCount), parallel(keyCount);
+
+		auto time = [&](auto&& generate) -> double
+		{
+			double best = DBL_MAX;
+			for (auto i=0u; i<Iterations; i++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				generate();
+				best = nbl::core::min(best,std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count());
+			}
+			return best;
+		};
+		// what the renderer used to do, one RNG stream in scanline order
+		const double streamMs = time([&]() -> void
+		{
+			nbl::core::RandomSampler rng(Seed);
+			for (auto& key : serial)
+				key = rng.nextSample();
+		});
+		const double serialMs = time([&]() -> void {generate(nbl::core::execution::seq,serial.data(),0u,0u,width,height,width,height);});
+		const double parallelMs = time([&]() -> void {generate(parallel.data(),0u,0u,width,height,width,height);});
+		bool matches = serial==parallel;
+
+		// tiles hanging over the bottom and right edge have to agree with the untiled keys too
+		nbl::core::vector<uint32_t> tile(size_t(TileDim)*TileDim*Channels);
+		for (uint32_t tileY=0u; matches && tileY<height; tileY+=TileDim)
+		for (uint32_t tileX=0u; matches && tileX<width; tileX+=TileDim)
+		{
+			generate(tile.data(),tileX,tileY,TileDim,TileDim,width,height);
+			for (uint32_t y=0u; y<TileDim; y++)
+			for (uint32_t x=0u; x<TileDim; x++)
+			{
+				const bool inside = tileX+x<width && tileY+y<height;
+				for (auto c=0u; c<Channels; c++)
+				{
+					const uint32_t expected = inside ? serial[(size_t(tileY+y)*width+tileX+x)*Channels+c]:0u;
+					matches = matches && tile[(size_t(y)*TileDim+x)*Channels+c]==expected;
+				}
+			}
+		}
+
+		const double megaPixels = double(width)*double(height)*1e-6;
+		printf("[INFO] Scramble Keys: %ux%u RNG stream %.1f ms, hashed serial %.1f ms, hashed parallel %.1f ms (%.0f Mpixels/s, %.1fx the stream)%s\n",
+			width,height,streamMs,serialMs,parallelMs,megaPixels*1000.0/parallelMs,streamMs/parallelMs,matches ? "":", keys differ between serial, parallel and tiled generation!"
+		);
+		passed = passed && matches;
+	}
+	if (!passed)
+		printf("[ERROR] Scramble Keys: the generated keys depend on how they were generated\n");
+	return passed;
+}
+
+#endif
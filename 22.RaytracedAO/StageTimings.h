@@ -0,0 +1,242 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _STAGE_TIMINGS_H_INCLUDED_
+#define _STAGE_TIMINGS_H_INCLUDED_
+
+#include "nabla.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+
+//! Accumulates how long each stage of `Renderer::render` takes, per bounce for the ones which run once per bounce.
+//! CPU time is what the calling thread spends recording or waiting on the stage, queue time is what the GPU (GL elapsed time queries)
+//! or the OpenCL queue (event profiling, only if the queue was made with profiling) reports for executing it.
+//! GL queries get read back on `collect`, which `Renderer::render` calls at the start of the next frame so no syncs get added mid-frame.
+class StageTimings
+{
+	public:
+		enum E_STAGE : uint32_t
+		{
+			ES_CULL,
+			ES_VISIBILITY_BUFFER,
+			ES_RAYGEN,
+			ES_RAY_SORT,
+			ES_INTERSECT,
+			ES_CLOSEST_HIT,
+			ES_RESOLVE,
+			ES_COUNT
+		};
+		static inline const char* getStageName(const E_STAGE stage)
+		{
+			constexpr const char* names[ES_COUNT] = {"cull","visibility_buffer","raygen","ray_sort","intersect","closest_hit","resolve"};
+			return names[stage];
+		}
+
+		struct SStat
+		{
+			uint64_t calls = 0ull;
+			double cpuMs = 0.0;
+			//! stages which had no queue timing available (OpenCL without profiling) don't count here
+			uint64_t queueCalls = 0ull;
+			double queueMs = 0.0;
+			uint64_t rays = 0ull;
+
+			//! prefers the queue time, falls back to the CPU time
+			inline double getRaysPerSecond() const
+			{
+				const double ms = queueCalls==calls ? queueMs:cpuMs;
+				return ms>0.0 ? double(rays)*1000.0/ms:0.0;
+			}
+		};
+
+		//! passing `nullptr` turns the timings off, which makes every `CScope` a no-op
+		inline void setDriver(nbl::video::IVideoDriver* driver)
+		{
+			collect();
+			m_driver = driver;
+		}
+		inline bool isEnabled() const { return m_driver; }
+
+		//! times from construction to destruction, the GL work recorded in between gets an elapsed time query around it
+		class CScope
+		{
+			public:
+				inline CScope(StageTimings& timings, const E_STAGE stage, const uint32_t bounce=0u, const bool glQuery=true) :
+					m_timings(timings.isEnabled() ? &timings:nullptr), m_stage(stage), m_bounce(bounce)
+				{
+					if (!m_timings)
+						return;
+					if (glQuery)
+					{
+						m_query = m_timings->acquireQuery();
+						m_timings->m_driver->beginQuery(m_query.get());
+					}
+					m_start = std::chrono::steady_clock::now();
+				}
+				inline ~CScope()
+				{
+					if (!m_timings)
+						return;
+					auto& stat = m_timings->getStat(m_stage,m_bounce);
+					stat.calls++;
+					stat.cpuMs += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-m_start).count();
+					stat.rays += m_rays;
+					if (m_query)
+					{
+						m_timings->m_driver->endQuery(m_query.get());
+						m_timings->m_pending.push_back({std::move(m_query),m_stage,m_bounce});
+					}
+					else if (m_queueMs>=0.0)
+					{
+						stat.queueCalls++;
+						stat.queueMs += m_queueMs;
+					}
+				}
+
+				inline void setRays(const uint64_t rays) { m_rays = rays; }
+				//! for work outside of GL, negative means unavailable
+				inline void setQueueTime(const double ms) { m_queueMs = ms; }
+
+			private:
+				StageTimings* m_timings;
+				E_STAGE m_stage;
+				uint32_t m_bounce;
+				nbl::core::smart_refctd_ptr<nbl::video::IQueryObject> m_query;
+				std::chrono::steady_clock::time_point m_start;
+				uint64_t m_rays = 0ull;
+				double m_queueMs = -1.0;
+		};
+
+		//! reads back the finished GL queries, blocks on the ones which are not yet
+		inline void collect()
+		{
+			for (auto& pending : m_pending)
+			{
+				// the 32bit result wraps after 4.29 seconds, which one dispatch of a big scene or a slow GPU can take
+				uint64_t nanoseconds = 0ull;
+				pending.query->getQueryResult(&nanoseconds);
+				auto& stat = getStat(pending.stage,pending.bounce);
+				stat.queueCalls++;
+				stat.queueMs += double(nanoseconds)*1e-6;
+				m_freeQueries.push_back(std::move(pending.query));
+			}
+			m_pending.clear();
+		}
+
+		inline void frameDone() { m_frames++; }
+
+		inline void reset()
+		{
+			collect();
+			m_stats.clear();
+			m_frames = 0ull;
+		}
+
+		inline uint32_t getBounceCount() const { return m_stats.size(); }
+		inline const SStat& getStat(const E_STAGE stage, const uint32_t bounce) const { return m_stats[bounce][stage]; }
+		inline uint64_t getFrameCount() const { return m_frames; }
+
+		//! writes `pathWithoutExtension` + ".json" and ".csv", one entry per stage and bounce that ran
+		inline bool writeReport(const std::string& pathWithoutExtension, const std::string& label)
+		{
+			collect();
+			FILE* json = fopen((pathWithoutExtension+".json").c_str(),"w");
+			FILE* csv = fopen((pathWithoutExtension+".csv").c_str(),"w");
+			if (!json || !csv)
+			{
+				if (json)
+					fclose(json);
+				if (csv)
+					fclose(csv);
+				return false;
+			}
+
+			fprintf(json,"{\n\t\"label\": \"%s\",\n\t\"frames\": %llu,\n\t\"stages\": [",escapeJSON(label).c_str(),static_cast<unsigned long long>(m_frames));
+			fprintf(csv,"label,stage,bounce,calls,cpu_ms,queue_ms,rays,rays_per_second\n");
+			const char* separator = "\n";
+			for (uint32_t bounce=0u; bounce<getBounceCount(); bounce++)
+			for (uint32_t stage=0u; stage<ES_COUNT; stage++)
+			{
+				const auto& stat = m_stats[bounce][stage];
+				if (!stat.calls)
+					continue;
+				const char* name = getStageName(static_cast<E_STAGE>(stage));
+				// an empty field means no queue timings were available
+				char queueMs[32] = "";
+				if (stat.queueCalls)
+					sprintf(queueMs,"%.6f",stat.queueMs);
+				fprintf(json,"%s\t\t{\"stage\": \"%s\", \"bounce\": %u, \"calls\": %llu, \"cpu_ms\": %.6f, \"queue_ms\": %s, \"rays\": %llu, \"rays_per_second\": %.1f}",
+					separator,name,bounce,static_cast<unsigned long long>(stat.calls),stat.cpuMs,stat.queueCalls ? queueMs:"null",static_cast<unsigned long long>(stat.rays),stat.getRaysPerSecond()
+				);
+				fprintf(csv,"\"%s\",%s,%u,%llu,%.6f,%s,%llu,%.1f\n",
+					escapeCSV(label).c_str(),name,bounce,static_cast<unsigned long long>(stat.calls),stat.cpuMs,queueMs,static_cast<unsigned long long>(stat.rays),stat.getRaysPerSecond()
+				);
+				separator = ",\n";
+			}
+			fprintf(json,"\n\t]\n}\n");
+
+			const bool success = !ferror(json) && !ferror(csv);
+			fclose(json);
+			fclose(csv);
+			return success;
+		}
+
+	private:
+		inline SStat& getStat(const E_STAGE stage, const uint32_t bounce)
+		{
+			if (bounce>=m_stats.size())
+				m_stats.resize(bounce+1u);
+			return m_stats[bounce][stage];
+		}
+
+		inline nbl::core::smart_refctd_ptr<nbl::video::IQueryObject> acquireQuery()
+		{
+			if (m_freeQueries.empty())
+				return nbl::core::smart_refctd_ptr<nbl::video::IQueryObject>(m_driver->createElapsedTimeQuery(),nbl::core::dont_grab);
+			auto retval = std::move(m_freeQueries.back());
+			m_freeQueries.pop_back();
+			return retval;
+		}
+
+		static inline std::string escapeJSON(const std::string& str)
+		{
+			std::string retval;
+			for (const char c : str)
+			{
+				if (c=='"' || c=='\\')
+					retval += '\\';
+				retval += c;
+			}
+			return retval;
+		}
+		static inline std::string escapeCSV(const std::string& str)
+		{
+			std::string retval;
+			for (const char c : str)
+			{
+				if (c=='"')
+					retval += '"';
+				retval += c;
+			}
+			return retval;
+		}
+
+		struct SPendingQuery
+		{
+			nbl::core::smart_refctd_ptr<nbl::video::IQueryObject> query;
+			E_STAGE stage;
+			uint32_t bounce;
+		};
+
+		nbl::video::IVideoDriver* m_driver = nullptr;
+		nbl::core::vector<std::array<SStat,ES_COUNT>> m_stats;
+		nbl::core::vector<SPendingQuery> m_pending;
+		nbl::core::vector<nbl::core::smart_refctd_ptr<nbl::video::IQueryObject>> m_freeQueries;
+		uint64_t m_frames = 0ull;
+};
+
+#endif
@@ -0,0 +1,40 @@
+@echo off
+
+set pathtracer="%~dp0/bin/raytracedao.exe"
+set scenesInput="%~dp0/test_scenes.txt"
+set benchmarkCSV="%~dp0/bin/benchmark.csv"
+REM samples per pixel for every sensor, leave empty to use the scenes' own sample counts
+set benchmarkSamples=64
+
+pushd bin
+if NOT EXIST %pathtracer% (
+    echo BatchScriptError: Pathtracer Executable does not exist. ^(at %pathtracer%^)
+    popd
+    EXIT /B 0
+)
+if EXIST %benchmarkCSV% del %benchmarkCSV%
+popd
+
+set failed=0
+for /f "tokens=*" %%s in ('findstr /v /c:";" %scenesInput%') do (
+    REM echo %%s
+    Call :benchmark %%s
+)
+
+EXIT /B %failed%
+
+:benchmark
+
+pushd bin
+
+set samplesArg=
+if NOT "%benchmarkSamples%"=="" set samplesArg=-BENCHMARK_SAMPLES=%benchmarkSamples%
+
+@echo on
+%pathtracer% -SCENE=%1 -BENCHMARK_CSV=benchmark.csv %samplesArg%
+@echo off
+if ERRORLEVEL 1 set failed=1
+
+popd
+
+EXIT /B 0
@@ -7,6 +7,11 @@
 
 #define MAX_TRIANGLES_IN_BATCH 16384
 
+// the top bits of a batch instance's `padding0` say which of the normal and UV got packed, the rest is the first index of the batch
+#define VERTEX_LAYOUT_NORMAL_BIT 0x80000000u
+#define VERTEX_LAYOUT_UV_BIT 0x40000000u
+#define VERTEX_LAYOUT_FIRST_INDEX_MASK 0x3fffffffu
+
 // need to bump to 2 in case of NEE + MIS, 3 in case of Path Guiding
 #define SAMPLING_STRATEGY_COUNT 1
 
@@ -16,6 +16,11 @@
 
 #include "CSceneNodeAnimatorCameraModifiedMaya.h"
 #include "Renderer.h"
+#include "SampleSequenceGenerator.h"
+#include "LightSampling.h"
+#include "CubemapLayout.h"
+#include "SceneCache.h"
+#include "../common/ShaderCache.hpp"
 
 using namespace nbl;
 using namespace core;
@@ -133,12 +138,31 @@ int main(int argc, char** argv)
 	};
 #endif
 	
+	const auto processStart = std::chrono::steady_clock::now();
 	CommandLineHandler cmdHandler = CommandLineHandler(arguments);
+	// rendering with none of the options applied would look like success to whatever ran this
+	if (!cmdHandler.isValid())
+		return 1;
 	
 	auto sceneDir = cmdHandler.getSceneDirectory();
 	std::string filePath = (sceneDir.size() >= 1) ? sceneDir[0] : ""; // zip or xml
 	std::string extraPath = (sceneDir.size() >= 2) ? sceneDir[1] : "";; // xml in zip
-	bool shouldTerminateAfterRenders = cmdHandler.getTerminate(); // skip interaction with window and take screenshots only
+	// renders exactly what -TERMINATE would, minus everything that isn't deterministic or isn't the renderer's own work
+	const bool benchmarkRun = !cmdHandler.getBenchmarkCSV().empty();
+	bool shouldTerminateAfterRenders = cmdHandler.getTerminate() || benchmarkRun; // skip interaction with window and take screenshots only
+	if (cmdHandler.getBenchmarkSampleSequence())
+	{
+		const uint32_t quantizedDimensions = (Renderer::DefaultPathDepth-1u)*SAMPLING_STRATEGY_COUNT;
+		return SampleSequenceGenerator::benchmark(quantizedDimensions,0x1u<<21u) ? 0:1;
+	}
+	if (cmdHandler.getBenchmarkLightSampling())
+		return LightSamplingBenchmark::run() ? 0:1;
+	if (cmdHandler.getBenchmarkAdaptiveSampling())
+		return AdaptiveSampling::benchmark() ? 0:1;
+	if (cmdHandler.getBenchmarkShaderCache())
+		return shader_cache::CCache::selfTest("ShaderCacheSelfTest") ? 0:1;
+	if (cmdHandler.getBenchmarkScrambleKeys())
+		return ScrambleKeys::benchmark() ? 0:1;
 	bool takeScreenShots = true;
 	std::string mainFileName; // std::filesystem::path(filePath).filename().string();
 
@@ -147,7 +171,8 @@ int main(int argc, char** argv)
 	nbl::SIrrlichtCreationParameters params;
 	params.Bits = 24; //may have to set to 32bit for some platforms
 	params.ZBufferBits = 24;
-	params.DriverType = video::EDT_OPENGL;
+	// the CPU intersection benchmark only needs the assets
+	params.DriverType = cmdHandler.getBenchmarkCPUIntersection() ? video::EDT_NULL:video::EDT_OPENGL;
 	params.Fullscreen = false;
 	params.Vsync = false;
 	params.Doublebuffer = true;
@@ -156,12 +181,16 @@ int main(int argc, char** argv)
 	auto device = createDeviceEx(params);
 	if (!device)
 		return 1; // could not create selected driver.
+	if (cmdHandler.getBenchmarkCubemapLayout())
+		return CubemapLayout::benchmark(device->getAssetManager(),1024u,16u) ? 0:1;
 	
 	// will leak it because there's no cross platform input!
 	std::thread cin_thread;
 
 	//
 	asset::SAssetBundle meshes;
+	std::string sceneFilePath; // the zip or xml, `filePath` ends up being the xml inside the zip
+	double sceneLoadTime = 0.0;
 	core::smart_refctd_ptr<const ext::MitsubaLoader::CMitsubaMetadata> globalMeta;
 	{
 		io::IFileSystem* fs = device->getFileSystem();
@@ -189,6 +218,7 @@ int main(int argc, char** argv)
 		mainFileName = mainFileName.substr(0u, mainFileName.find_first_of('.')); 
 		
 		std::cout << "\nSelected File = " << filePath << "\n" << std::endl;
+		sceneFilePath = filePath;
 
 		if (core::hasFileExtension(io::path(filePath.c_str()), "zip", "ZIP"))
 		{
@@ -273,7 +303,9 @@ int main(int argc, char** argv)
 		//! read cache results -- speeds up mesh generation
 		qnc->loadCacheFromFile<asset::EF_A2B10G10R10_SNORM_PACK32>(fs, "../../tmp/normalCache101010.sse");
 		//! load the mitsuba scene
+		const auto loadStart = std::chrono::steady_clock::now();
 		meshes = am->getAsset(filePath, {});
+		sceneLoadTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-loadStart).count();
 		//! cache results -- speeds up mesh generation on second run
 		qnc->saveCacheToFile<asset::EF_A2B10G10R10_SNORM_PACK32>(fs, "../../tmp/normalCache101010.sse");
 		
@@ -699,11 +731,132 @@ int main(int argc, char** argv)
 		extractAndAddToSensorData(sensor, s);
 	}
 
+	if (cmdHandler.getBenchmarkCPUIntersection())
+	{
+		if (sensors.empty())
+		{
+			printf("[ERROR] CPU Intersector: the scene has no sensors to render\n");
+			return 1;
+		}
+		CPUIntersector intersector;
+		int32_t instanceID = 0;
+		for (const auto& asset : meshes.getContents())
+		{
+			const auto* cpumesh = static_cast<const asset::ICPUMesh*>(asset.get());
+			const auto& instances = globalMeta->getAssetSpecificMetadata(cpumesh)->m_instances;
+			for (auto mb : cpumesh->getMeshBuffers())
+			{
+				uint32_t triangleCount = 0u;
+				asset::IMeshManipulator::getPolyCount(triangleCount,mb);
+				const auto mesh = intersector.addMesh(triangleCount,[mb](const uint32_t triangle, float (&vertices)[3][3]) -> void
+				{
+					const auto indices = asset::IMeshManipulator::getTriangleIndices(mb,triangle);
+					for (auto i=0u; i<3u; i++)
+					{
+						const auto position = mb->getPosition(indices[i]);
+						vertices[i][0] = position.x;
+						vertices[i][1] = position.y;
+						vertices[i][2] = position.z;
+					}
+				});
+				for (const auto& instance : instances)
+					intersector.addInstance(mesh,instance.worldTform,instanceID++);
+			}
+		}
+		intersector.build();
+
+		const auto& sensorData = sensors[0];
+		auto camera = sensorData.staticCamera;
+		camera->render();
+		const auto viewProj = core::concatenateBFollowedByA(camera->getProjectionMatrix(),camera->getViewMatrix());
+		core::matrix4SIMD viewProjInverse;
+		if (!viewProj.getInverseTransform<core::matrix4SIMD::E_MATRIX_INVERSE_PRECISION::EMIP_64BBIT>(viewProjInverse))
+		{
+			printf("[ERROR] CPU Intersector: the sensor's view projection is not invertible\n");
+			return 1;
+		}
+		const auto cameraPosition = core::vectorSIMDf().set(camera->getAbsolutePosition());
+		const float origin[3] = {cameraPosition.x,cameraPosition.y,cameraPosition.z};
+		printf("[INFO] CPU Intersector: %s at %dx%d\n",sceneFilePath.c_str(),sensorData.width,sensorData.height);
+		return CPUIntersector::benchmark(intersector,viewProjInverse,origin,sensorData.width,sensorData.height) ? 0:1;
+	}
+
 	auto driver = device->getVideoDriver();
 
+	// a benchmark's timings must not depend on what earlier runs left in the caches
+	Renderer::setShaderCacheEnabled(!benchmarkRun);
 	core::smart_refctd_ptr<Renderer> renderer = core::make_smart_refctd_ptr<Renderer>(driver,device->getAssetManager(),smgr);
-	renderer->initSceneResources(meshes,"LowDiscrepancySequenceCache.bin");
+	renderer->setCPUIntersection(cmdHandler.getCPUIntersection());
+	// tiles which don't converge can get more samples than the sensor asks for, up to a multiple of it
+	if (cmdHandler.getAdaptiveSamplingThreshold()>0.f && !benchmarkRun)
+		renderer->setAdaptiveSamplingHeadroom(AdaptiveSampling::BudgetHeadroom);
+	if (cmdHandler.getStageTimings())
+		renderer->getStageTimings().setDriver(driver);
+	auto writeStageTimings = [&](std::filesystem::path path) -> void
+	{
+		auto& timings = renderer->getStageTimings();
+		if (!timings.isEnabled())
+			return;
+		const std::string label = path.filename().string();
+		path.replace_extension();
+		path += "_timings";
+		if (timings.writeReport(path.string(),label))
+			printf("[INFO] Stage timings of %llu frames written to %s.json and .csv\n",static_cast<unsigned long long>(timings.getFrameCount()),path.string().c_str());
+		else
+			printf("[ERROR] Could not write the stage timings to %s\n",path.string().c_str());
+		timings.reset();
+	};
+	Renderer::SMeshPackingParams meshPackingParams;
+	meshPackingParams.stripVertexAttributes = cmdHandler.getStripVertexAttributes();
+	meshPackingParams.benchmark = cmdHandler.getBenchmarkMeshPacking();
+	meshPackingParams.verbose = cmdHandler.getStageTimings() || cmdHandler.getBenchmarkSceneCache() || benchmarkRun;
+	// the packing benchmark needs to actually pack, the scene cache benchmark needs the cache
+	if (!meshPackingParams.benchmark && ((!cmdHandler.getNoSceneCache() && !benchmarkRun) || cmdHandler.getBenchmarkSceneCache()))
+	{
+		meshPackingParams.sceneHash = SceneCache::hashScene(sceneFilePath,filePath);
+		char name[32];
+		sprintf(name,"%016llx.bin",static_cast<unsigned long long>(meshPackingParams.sceneHash));
+		std::error_code ec;
+		std::filesystem::create_directories("SceneCache",ec);
+		meshPackingParams.sceneCachePath = (std::filesystem::path("SceneCache")/name).string();
+		meshPackingParams.sceneCacheMaxBytes = SceneCache::DefaultMaxBytes;
+	}
+	if (cmdHandler.getBenchmarkSceneCache())
+	{
+		std::error_code ec;
+		std::filesystem::remove(meshPackingParams.sceneCachePath,ec);
+		auto initScene = [&]() -> double
+		{
+			const auto start = std::chrono::steady_clock::now();
+			renderer->initSceneResources(meshes,"LowDiscrepancySequenceCache.bin",meshPackingParams);
+			return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+		};
+		const double coldTime = initScene();
+		const bool coldFromCache = renderer->sceneLoadedFromCache();
+		const auto coldBound = renderer->getSceneBound();
+		renderer->deinitSceneResources();
+		const double warmTime = initScene();
+		const bool warmFromCache = renderer->sceneLoadedFromCache();
+		const auto warmBound = renderer->getSceneBound();
+		renderer->deinitSceneResources();
+
+		printf("[INFO] Scene Cache: loading %s took %.1f ms either way\n",sceneFilePath.c_str(),sceneLoadTime);
+		printf("[INFO] Scene Cache: scene initialization cold %.1f ms, warm %.1f ms (%.2fx)\n",coldTime,warmTime,coldTime/warmTime);
+		const bool valid = !coldFromCache && warmFromCache && coldBound.MinEdge==warmBound.MinEdge && coldBound.MaxEdge==warmBound.MaxEdge;
+		if (!valid)
+			printf("[ERROR] Scene Cache: the warm initialization %s\n",warmFromCache ? "does not match the cold one":"did not use the cache");
+		return valid ? 0:1;
+	}
+	const auto sceneInitStart = std::chrono::steady_clock::now();
+	renderer->initSceneResources(meshes,"LowDiscrepancySequenceCache.bin",meshPackingParams);
+	const double sceneInitTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-sceneInitStart).count();
 	meshes = {}; // free memory
+	if (meshPackingParams.benchmark)
+	{
+		renderer->deinitSceneResources();
+		return renderer->meshPackingChecksPassed() ? 0:1;
+	}
+	renderer->setRayReordering(cmdHandler.getRayReordering());
 	
 	RaytracerExampleEventReceiver receiver;
 	device->setEventReceiver(&receiver);
@@ -744,6 +897,114 @@ int main(int argc, char** argv)
 	}
 
 
+	if (cmdHandler.getBenchmarkRayReordering())
+	{
+		bool passed = RayReordering::benchmark();
+		if (sensors.empty())
+		{
+			printf("[ERROR] Ray Reordering: the scene has no sensors to render\n");
+			return 1;
+		}
+		const auto& sensorData = sensors[0];
+		renderer->initScreenSizedResources(sensorData.width,sensorData.height);
+		smgr->setActiveCamera(sensorData.staticCamera);
+		renderer->getStageTimings().setDriver(driver);
+		const StageTimings& timings = renderer->getStageTimings();
+
+		// both runs go through the same sample sequence and jitter, so they trace the same paths
+		constexpr uint32_t BenchmarkFrames = 32u;
+		struct SBounceTimes
+		{
+			double sortMs = 0.0;
+			double intersectMs = 0.0;
+			uint64_t rays = 0ull;
+		};
+		auto measure = [&](const bool reorder) -> core::vector<SBounceTimes>
+		{
+			renderer->setRayReordering(reorder);
+			renderer->resetSampleAndFrameCounters();
+			// the first frame waits on the shaders and warms the caches
+			for (uint32_t frame=0u; frame<=BenchmarkFrames; frame++)
+			{
+				if (frame==1u)
+					renderer->getStageTimings().reset();
+				driver->beginScene(false, false);
+				const bool rendered = renderer->render(device->getTimer(),!sensorData.envmap);
+				driver->endScene();
+				if (!rendered)
+					return {};
+			}
+			renderer->getStageTimings().collect();
+			auto milliseconds = [](const StageTimings::SStat& stat) -> double {return stat.queueCalls==stat.calls ? stat.queueMs:stat.cpuMs;};
+			core::vector<SBounceTimes> retval(timings.getBounceCount());
+			for (uint32_t bounce=0u; bounce<retval.size(); bounce++)
+			{
+				const auto& sort = timings.getStat(StageTimings::ES_RAY_SORT,bounce);
+				const auto& intersect = timings.getStat(StageTimings::ES_INTERSECT,bounce);
+				retval[bounce].sortMs = milliseconds(sort)/double(BenchmarkFrames);
+				retval[bounce].intersectMs = milliseconds(intersect)/double(BenchmarkFrames);
+				retval[bounce].rays = intersect.rays/BenchmarkFrames;
+			}
+			return retval;
+		};
+		const auto unsorted = measure(false);
+		renderer->requestRayReorderingValidation();
+		const auto sorted = measure(true);
+		renderer->setRayReordering(false);
+		renderer->deinitScreenSizedResources();
+
+		if (unsorted.empty() || sorted.empty())
+		{
+			printf("[ERROR] Ray Reordering: render failed\n");
+			return 1;
+		}
+		double unsortedTotal = 0.0, sortedTotal = 0.0;
+		for (uint32_t bounce=0u; bounce<core::min(unsorted.size(),sorted.size()); bounce++)
+		{
+			const auto& before = unsorted[bounce];
+			const auto& after = sorted[bounce];
+			if (!before.rays || !after.rays)
+				continue;
+			const double sortedCost = after.sortMs+after.intersectMs;
+			printf("[INFO] Ray Reordering: bounce %u, %llu rays per frame, intersection %.1f -> %.1f Mrays/s, %.3f ms -> %.3f ms sort + %.3f ms intersection, %s\n",
+				bounce,static_cast<unsigned long long>(after.rays),
+				double(before.rays)/(before.intersectMs*1000.0),double(after.rays)/(after.intersectMs*1000.0),
+				before.intersectMs,after.sortMs,after.intersectMs,
+				sortedCost<before.intersectMs ? "pays off":"does not pay off"
+			);
+			unsortedTotal += before.intersectMs;
+			sortedTotal += sortedCost;
+		}
+		printf("[INFO] Ray Reordering: %.3f ms per frame unsorted, %.3f ms sorted (%.2fx)\n",unsortedTotal,sortedTotal,unsortedTotal/sortedTotal);
+
+		const auto& validation = renderer->getRayReorderingValidation();
+		if (!validation.passed())
+		{
+			printf("[ERROR] Ray Reordering: GPU sort of %u rays does not match the CPU reference, %u unsorted, %u unstable, %u differing keys%s\n",
+				validation.rayCount,validation.unsortedKeys,validation.unstableKeys,validation.keyMismatches,validation.permutation ? "":", not a permutation"
+			);
+			passed = false;
+		}
+		else
+			printf("[INFO] Ray Reordering: GPU sort of %u rays matches the CPU reference (%u keys differ by rounding)\n",validation.rayCount,validation.keyMismatches);
+		return passed ? 0:1;
+	}
+
+	struct SBenchmarkRow
+	{
+		uint32_t sensor;
+		int32_t width, height;
+		uint32_t samplesPerPixel;
+		const char* status;
+		double firstSampleTime = 0.0;
+		double renderTime = 0.0;
+		uint64_t rays = 0ull;
+	};
+	core::vector<SBenchmarkRow> benchmarkRows;
+	if (benchmarkRun && cmdHandler.getBenchmarkSamples())
+	for (auto& sensorData : sensors)
+		sensorData.samplesNeeded = cmdHandler.getBenchmarkSamples();
+
 	// Render To file
 	int32_t prevWidth = 0;
 	int32_t prevHeight = 0;
@@ -755,61 +1016,135 @@ int main(int argc, char** argv)
 		const auto& sensorData = sensors[s];
 		
 		printf("[INFO] Rendering %s - Sensor(%d) to file.\n", filePath.c_str(), s);
-
-		bool needsReinit = (prevWidth != sensorData.width) || (prevHeight != sensorData.height); // >= or !=
-		prevWidth = sensorData.width;
-		prevHeight = sensorData.height;
+		const auto sensorStart = std::chrono::steady_clock::now();
+		double firstSampleTime = -1.0;
+		uint64_t sensorRays = 0ull;
+
+		// sensors bigger than the tile size get rendered a tile at a time with resources the size of one
+		const uint32_t tileSize = cmdHandler.getRenderTileSize();
+		const bool tiled = tileSize && (uint32_t(sensorData.width)>tileSize || uint32_t(sensorData.height)>tileSize);
+		const int32_t resourceWidth = tiled ? core::min<int32_t>(tileSize,sensorData.width):sensorData.width;
+		const int32_t resourceHeight = tiled ? core::min<int32_t>(tileSize,sensorData.height):sensorData.height;
+
+		bool needsReinit = (prevWidth != resourceWidth) || (prevHeight != resourceHeight); // >= or !=
+		prevWidth = resourceWidth;
+		prevHeight = resourceHeight;
 		
 		renderer->resetSampleAndFrameCounters(); // so that renderer->getTotalSamplesPerPixelComputed is 0 at the very beginning
+		renderer->getStageTimings().reset();
 		if(needsReinit) 
 		{
 			renderer->deinitScreenSizedResources();
-			renderer->initScreenSizedResources(sensorData.width,sensorData.height);
+			renderer->initScreenSizedResources(resourceWidth,resourceHeight);
 		}
 		
 		smgr->setActiveCamera(sensorData.staticCamera);
 
 		const uint32_t samplesPerPixelPerDispatch = renderer->getSamplesPerPixelPerDispatch();
 		const uint32_t maxNeededIterations = (sensorData.samplesNeeded + samplesPerPixelPerDispatch - 1) / samplesPerPixelPerDispatch;
-		
-		uint32_t itr = 0u;
-		bool takenEnoughSamples = false;
-		bool renderFailed = false;
-		while(!takenEnoughSamples && (device->run() && !receiver.isSkipKeyPressed() && receiver.keepOpen()))
+		// the sensor's sample count becomes a budget that the converged tiles hand over to the others
+		const bool adaptiveSampling = cmdHandler.getAdaptiveSamplingThreshold()>0.f && !benchmarkRun;
+		uint32_t adaptiveTilesConverged = 0u, adaptiveTileCount = 0u;
+		double adaptiveBudgetUsed = 0.0;
+
+		const uint32_t renderTilesX = (sensorData.width-1)/resourceWidth+1;
+		const uint32_t renderTileCount = renderTilesX*((sensorData.height-1)/resourceHeight+1);
+		if (tiled)
+			printf("[INFO] Rendering in %u tiles of %dx%d\n", renderTileCount, resourceWidth, resourceHeight);
+
+		// the tiles get assembled in RAM
+		bool renderFailed = tiled && uint64_t(sensorData.width)*sensorData.height>Renderer::MaxTiledCapturePixels;
+		if (renderFailed)
+			printf("[ERROR] Sensor(%d) is %dx%d, tiled renders can be at most %llu pixels because the whole image gets assembled in RAM\n", s, sensorData.width, sensorData.height, static_cast<unsigned long long>(Renderer::MaxTiledCapturePixels));
+		bool interrupted = false;
+		for(uint32_t renderTile = 0u; renderTile < renderTileCount && !renderFailed && !interrupted; ++renderTile)
 		{
-			if(itr >= maxNeededIterations)
-				std::cout << "[ERROR] Samples taken (" << renderer->getTotalSamplesPerPixelComputed() << ") must've exceeded samples needed for Sensor (" << sensorData.samplesNeeded << ") by now; something is wrong." << std::endl;
-
-			// Handle Inputs
+			// an untiled render's region is the whole image, which is a no-op unless the previous sensor was tiled
+			renderer->resetSampleAndFrameCounters();
+			renderer->setRenderRegion((renderTile%renderTilesX)*resourceWidth, (renderTile/renderTilesX)*resourceHeight, sensorData.width, sensorData.height);
 			{
-				if(receiver.isLogProgressKeyPressed())
+				AdaptiveSampling::SParams adaptiveSamplingParams;
+				if (adaptiveSampling)
 				{
-					int progress = float(renderer->getTotalSamplesPerPixelComputed())/float(sensorData.samplesNeeded) * 100;
-					printf("[INFO] Rendering in progress - %d%% Progress = %u/%u SamplesPerPixel. \n", progress, renderer->getTotalSamplesPerPixelComputed(), sensorData.samplesNeeded);
+					adaptiveSamplingParams.threshold = cmdHandler.getAdaptiveSamplingThreshold();
+					adaptiveSamplingParams.budgetFrames = maxNeededIterations;
 				}
-				receiver.resetKeys();
+				renderer->setAdaptiveSampling(adaptiveSamplingParams);
 			}
+			
+			uint32_t itr = 0u;
+			bool takenEnoughSamples = false;
+			while(!takenEnoughSamples && (device->run() && !receiver.isSkipKeyPressed() && receiver.keepOpen()))
+			{
+				if(!adaptiveSampling && itr >= maxNeededIterations)
+					std::cout << "[ERROR] Samples taken (" << renderer->getTotalSamplesPerPixelComputed() << ") must've exceeded samples needed for Sensor (" << sensorData.samplesNeeded << ") by now; something is wrong." << std::endl;
 
+				// Handle Inputs
+				{
+					if(receiver.isLogProgressKeyPressed())
+					{
+						int progress = float(renderer->getTotalSamplesPerPixelComputed())/float(sensorData.samplesNeeded) * 100;
+						printf("[INFO] Rendering in progress - %d%% Progress = %u/%u SamplesPerPixel. \n", progress, renderer->getTotalSamplesPerPixelComputed(), sensorData.samplesNeeded);
+					}
+					receiver.resetKeys();
+				}
 
-			driver->beginScene(false, false);
 
-			if(!renderer->render(device->getTimer(),!sensorData.envmap))
-			{
-				renderFailed = true;
+				driver->beginScene(false, false);
+
+				if(!renderer->render(device->getTimer(),!sensorData.envmap))
+				{
+					renderFailed = true;
+					driver->endScene();
+					break;
+				}
+
+				auto oldVP = driver->getViewPort();
+				driver->blitRenderTargets(renderer->getColorBuffer(),nullptr,false,false,{},{},true);
+				driver->setViewPort(oldVP);
+
 				driver->endScene();
-				break;
+				if (benchmarkRun && firstSampleTime<0.0)
+				{
+					renderer->finishAllWork();
+					firstSampleTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-sensorStart).count();
+				}
+				
+				if(adaptiveSampling ? renderer->getAdaptiveSampling().isDone():(renderer->getTotalSamplesPerPixelComputed() >= sensorData.samplesNeeded))
+					takenEnoughSamples = true;
+				
+				itr++;
 			}
+			// skipping or closing ends the whole sensor, not just the tile
+			interrupted = !takenEnoughSamples;
+			sensorRays += renderer->getTotalRaysCast();
 
-			auto oldVP = driver->getViewPort();
-			driver->blitRenderTargets(renderer->getColorBuffer(),nullptr,false,false,{},{},true);
-			driver->setViewPort(oldVP);
+			if (adaptiveSampling && !renderFailed)
+			{
+				const auto& adaptive = renderer->getAdaptiveSampling();
+				adaptiveTilesConverged += adaptive.getConvergedTileCount();
+				adaptiveTileCount += adaptive.getTileCount();
+				adaptiveBudgetUsed += adaptive.getBudgetUsed()/double(renderTileCount);
+			}
+			if (tiled && !renderFailed)
+			{
+				renderer->addRegionToCapture();
+				printf("[INFO] Rendered tile %u/%u\n", renderTile+1u, renderTileCount);
+			}
+		}
 
-			driver->endScene();
-			
-			if(renderer->getTotalSamplesPerPixelComputed() >= sensorData.samplesNeeded)
-				takenEnoughSamples = true;
-			
-			itr++;
+		if (benchmarkRun)
+		{
+			renderer->finishAllWork();
+			auto& row = benchmarkRows.emplace_back();
+			row.sensor = s;
+			row.width = sensorData.width;
+			row.height = sensorData.height;
+			row.samplesPerPixel = sensorData.samplesNeeded;
+			row.status = renderFailed ? "failed":(interrupted ? "interrupted":"ok");
+			row.firstSampleTime = firstSampleTime;
+			row.renderTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-sensorStart).count();
+			row.rays = sensorRays;
 		}
 
 		auto screenshotFilePath = sensorData.outputFilePath;
@@ -820,15 +1155,59 @@ int main(int argc, char** argv)
 		}
 		else
 		{
-			bool shouldDenoise = sensorData.type != ext::MitsubaLoader::CElementSensor::Type::SPHERICAL;
-			renderer->takeAndSaveScreenShot(screenshotFilePath, shouldDenoise, sensorData.denoiserInfo);
+			bool shouldDenoise = sensorData.type != ext::MitsubaLoader::CElementSensor::Type::SPHERICAL && !benchmarkRun;
+			if (tiled)
+				renderer->saveTiledCapture(screenshotFilePath, shouldDenoise, sensorData.denoiserInfo);
+			else
+				renderer->takeAndSaveScreenShot(screenshotFilePath, shouldDenoise, sensorData.denoiserInfo);
 			int progress = float(renderer->getTotalSamplesPerPixelComputed())/float(sensorData.samplesNeeded) * 100;
 			printf("[INFO] Rendered Successfully - %d%% Progress = %u/%u SamplesPerPixel - FileName = %s. \n", progress, renderer->getTotalSamplesPerPixelComputed(), sensorData.samplesNeeded, screenshotFilePath.filename().string().c_str());
+			if (adaptiveSampling)
+				printf("[INFO] Adaptive Sampling: %u/%u tiles converged, %.1f%% of the sample budget used\n",adaptiveTilesConverged,adaptiveTileCount,adaptiveBudgetUsed*100.0);
+			writeStageTimings(screenshotFilePath);
 		}
 
 		receiver.resetKeys();
 	}
 
+	if (benchmarkRun)
+	{
+		const double totalTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-processStart).count();
+		const auto& csvPath = cmdHandler.getBenchmarkCSV();
+		std::error_code ec;
+		const bool writeHeader = !std::filesystem::exists(csvPath,ec) || std::filesystem::file_size(csvPath,ec)==0u;
+		FILE* csv = fopen(csvPath.c_str(),"a");
+		if (!csv)
+		{
+			printf("[ERROR] Could not open the benchmark CSV %s\n",csvPath.c_str());
+			return 1;
+		}
+		if (writeHeader)
+			fprintf(csv,"scene,sensor,width,height,samples_per_pixel,seed,status,load_ms,init_ms,first_sample_ms,render_ms,rays,rays_per_second,total_ms\n");
+		std::string scene = sceneFilePath+(filePath!=sceneFilePath ? " "+filePath:"");
+		for (size_t pos=0u; (pos=scene.find('"',pos))!=std::string::npos; pos+=2u)
+			scene.insert(pos,1u,'"');
+		bool passed = !benchmarkRows.empty();
+		for (const auto& row : benchmarkRows)
+		{
+			fprintf(csv,"\"%s\",%u,%d,%d,%u,%u,%s,%.3f,%.3f,%.3f,%.3f,%llu,%.1f,%.3f\n",
+				scene.c_str(),row.sensor,row.width,row.height,row.samplesPerPixel,ScrambleKeys::Seed,row.status,
+				sceneLoadTime,sceneInitTime,row.firstSampleTime,row.renderTime,static_cast<unsigned long long>(row.rays),
+				row.renderTime>0.0 ? double(row.rays)*1000.0/row.renderTime:0.0,totalTime
+			);
+			passed = passed && strcmp(row.status,"ok")==0;
+		}
+		fclose(csv);
+		printf("[INFO] Benchmark: %zu sensors of %s appended to %s in %.1f ms\n",benchmarkRows.size(),scene.c_str(),csvPath.c_str(),totalTime);
+
+		renderer->deinitSceneResources();
+		renderer = nullptr;
+		// a joinable thread would terminate the process on the way out, it only waits for the choice of XML
+		if (cin_thread.joinable())
+			cin_thread.detach();
+		return passed ? 0:1;
+	}
+
 	// Denoise Cubemaps that weren't denoised seperately
 	for(uint32_t i = 0; i < cubemapRenders.size(); ++i)
 	{
@@ -841,7 +1220,7 @@ int main(int argc, char** argv)
 		for(uint32_t f = beginIdx; f < beginIdx + 6; ++f)
 		{
 			const auto & sensor = sensors[f];
-			filePaths[f] = sensor.outputFilePath;
+			filePaths[f-beginIdx] = sensor.outputFilePath;
 		}
 
 		std::string mergedFileName = "Merge_CubeMap_" + mainFileName;
@@ -861,11 +1240,14 @@ int main(int argc, char** argv)
 				activeSensor = index;
 
 				renderer->resetSampleAndFrameCounters();
+				renderer->getStageTimings().reset();
 				if(needsReinit)
 				{
 					renderer->deinitScreenSizedResources();
 					renderer->initScreenSizedResources(sensors[activeSensor].width,sensors[activeSensor].height);
 				}
+				// the camera moves around here
+				renderer->setAdaptiveSampling({});
 
 				smgr->setActiveCamera(sensors[activeSensor].interactiveCamera);
 				std::cout << "Active Sensor = " << activeSensor << std::endl;
@@ -971,7 +1353,9 @@ int main(int argc, char** argv)
 		else
 		{
 			auto extensionStr = getFileExtensionFromFormat(sensors[activeSensor].fileFormat);
-			renderer->takeAndSaveScreenShot(std::filesystem::path("LastView_" + mainFileName + "_Sensor_" + std::to_string(activeSensor) + extensionStr), true, sensors[activeSensor].denoiserInfo);
+			const std::filesystem::path lastViewFilePath("LastView_" + mainFileName + "_Sensor_" + std::to_string(activeSensor) + extensionStr);
+			renderer->takeAndSaveScreenShot(lastViewFilePath, true, sensors[activeSensor].denoiserInfo);
+			writeStageTimings(lastViewFilePath);
 		}
 
 		renderer->deinitScreenSizedResources();
@@ -53,7 +53,7 @@ void clear_raycount()
 //
 uvec3 get_triangle_indices(in nbl_glsl_ext_Mitsuba_Loader_instance_data_t batchInstanceData, in uint triangleID)
 {
-	const uint baseTriangleVertex = triangleID*3u+batchInstanceData.padding0;
+	const uint baseTriangleVertex = triangleID*3u+(batchInstanceData.padding0&VERTEX_LAYOUT_FIRST_INDEX_MASK);
 	return uvec3(
 		nbl_glsl_VG_fetchTriangleVertexIndex(baseTriangleVertex,0u),
 		nbl_glsl_VG_fetchTriangleVertexIndex(baseTriangleVertex,1u),
@@ -191,7 +191,7 @@ mat2 nbl_glsl_perturbNormal_dUVdSomething()
 
 bool needs_texture_prefetch(in nbl_glsl_ext_Mitsuba_Loader_instance_data_t batchInstanceData)
 {
-	return true;
+	return bool(batchInstanceData.padding0&VERTEX_LAYOUT_UV_BIT);
 }
 
 vec3 load_normal_and_prefetch_textures(
@@ -226,7 +226,7 @@ vec3 load_normal_and_prefetch_textures(
 
 	// while waiting for the scramble state
 	// TODO: optimize, add loads more flags to control this
-	const bool needsSmoothNormals = true;
+	const bool needsSmoothNormals = bool(batchInstanceData.padding0&VERTEX_LAYOUT_NORMAL_BIT);
 	if (needsSmoothNormals)
 	{
 		const mat3 normals = mat3(
@@ -7,6 +7,8 @@
 	#error "Hardcoded 16 should be NBL_SQRT(WORKGROUP_SIZE)"
 #endif
 #define WORKGROUP_DIM 16
+// has to match `AdaptiveSampling::TileDim`
+#define ADAPTIVE_SAMPLING_TILE_DIM 32
 
 /**
 Plan for lighting:
@@ -106,6 +108,17 @@ struct RaytraceShaderCommonData_t
 	uint	depth; // 0 if path tracing disabled
 	uint	rayCountWriteIx;
 	float	textureFootprintFactor;
+	uint	framesDispatched;
+};
+
+// has to match `RayReordering::BitsPerDimension`
+#define RAY_REORDER_BITS_PER_DIMENSION 6
+struct RayReorderShaderData_t
+{
+	vec3	boundMin;
+	uint	rayCount;
+	vec3	rcpBoundExtent;
+	uint	padding;
 };
 
 #endif
\ No newline at end of file
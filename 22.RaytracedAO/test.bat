@@ -23,7 +23,7 @@ EXIT /B %ERRORLEVEL%
 pushd bin
 
 @echo on
-%pathtracer% -SCENE=%1 -TERMINATE
+%pathtracer% -SCENE=%1 -TERMINATE -STAGE_TIMINGS
 @echo off
 
 popd
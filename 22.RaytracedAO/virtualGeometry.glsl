@@ -12,6 +12,9 @@
 // TODO: remove after Doom Eternal position quantization trick
 #define _NBL_VG_USE_SSBO_UVEC3
 #define _NBL_VG_SSBO_UVEC3_BINDING 2
+// for meshbuffers which only kept one of normal or UV
+#define _NBL_VG_USE_SSBO_UINT
+#define _NBL_VG_SSBO_UINT_BINDING 5
 #include <nbl/builtin/glsl/virtual_geometry/virtual_attribute_fetch.glsl>
 
 
@@ -27,14 +30,22 @@ vec3 nbl_glsl_fetchVtxPos(in uint vtxID, in nbl_glsl_ext_Mitsuba_Loader_instance
 vec3 nbl_glsl_fetchVtxNormal(in uint vtxID, in nbl_glsl_ext_Mitsuba_Loader_instance_data_t batchInstanceData)
 {
     nbl_glsl_VG_VirtualAttributePacked_t va = batchInstanceData.determinantSignBit;
-    const uint codedNormal = nbl_glsl_VG_attribFetch2u(va,vtxID)[0];
+    uint codedNormal;
+    if (bool(batchInstanceData.padding0&VERTEX_LAYOUT_UV_BIT))
+        codedNormal = nbl_glsl_VG_attribFetch2u(va,vtxID)[0];
+    else
+        codedNormal = nbl_glsl_VG_attribFetch1u(va,vtxID);
     return normalize(nbl_glsl_decodeRGB10A2_SNORM(codedNormal).xyz);
 }
 
 vec2 nbl_glsl_fetchVtxUV(in uint vtxID, in nbl_glsl_ext_Mitsuba_Loader_instance_data_t batchInstanceData)
 {
     nbl_glsl_VG_VirtualAttributePacked_t va = batchInstanceData.determinantSignBit;
-    const uint codedUV = nbl_glsl_VG_attribFetch2u(va,vtxID)[1];
+    uint codedUV;
+    if (bool(batchInstanceData.padding0&VERTEX_LAYOUT_NORMAL_BIT))
+        codedUV = nbl_glsl_VG_attribFetch2u(va,vtxID)[1];
+    else
+        codedUV = nbl_glsl_VG_attribFetch1u(va,vtxID);
     return unpackHalf2x16(codedUV).xy;
 }
 
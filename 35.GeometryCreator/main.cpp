@@ -9,6 +9,7 @@
 
 #include "../common/Camera.hpp"
 #include "../common/CommonAPI.h"
+#include "../common/ShaderCache.hpp"
 #include "nbl/ext/ScreenShot/ScreenShot.h"
 
 using namespace nbl;
@@ -275,10 +276,17 @@ public:
 		auto arrowGeometry = geometryCreator->createArrowMesh();
 		auto icosphereGeometry = geometryCreator->createIcoSphere(1, 3, true);
 
-		auto createSpecializedShaderFromSource = [=](const char* source, asset::IShader::E_SHADER_STAGE stage) -> core::smart_refctd_ptr<video::IGPUSpecializedShader>
+		// the sources which have includes come here resolved, so the source alone covers them
+		shader_cache::CCache shaderCache("ShaderCache");
+		const uint64_t shaderCompilerIdentity = shader_cache::getCompilerIdentity();
+		auto createSpecializedShaderFromSource = [&](const char* source, asset::IShader::E_SHADER_STAGE stage) -> core::smart_refctd_ptr<video::IGPUSpecializedShader>
 		{
-			// TODO: Update: should use the compiler set from asset manager
-			auto spirv = assetManager->getGLSLCompiler()->createSPIRVFromGLSL(source, stage, "main", "runtimeID", nullptr, true, nullptr, logger.get());
+			const auto key = shader_cache::CKeyBuilder().setSource(source, strlen(source)).setStage(stage).setEntryPoint("main").addOption("debug_info").setCompiler(shaderCompilerIdentity).build();
+			auto spirv = shader_cache::getOrCompileShader(shaderCache, key, [&]() -> core::smart_refctd_ptr<asset::ICPUShader>
+			{
+				// TODO: Update: should use the compiler set from asset manager
+				return assetManager->getGLSLCompiler()->createSPIRVFromGLSL(source, stage, "main", "runtimeID", nullptr, true, nullptr, logger.get());
+			});
 			if (!spirv)
 				return nullptr;
 
@@ -312,6 +320,7 @@ public:
 			gpuShaders[1]
 		};
 		auto gpuShadersRaw_ico = reinterpret_cast<video::IGPUSpecializedShader**>(gpuShaders_ico);
+		shaderCache.printMetrics("Shader Cache");
 
 		auto createGPUMeshBufferAndItsPipeline = [&](asset::IGeometryCreator::return_type& geometryObject, Objects::E_OBJECT_INDEX object) -> GPUObject
 		{
@@ -0,0 +1,203 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _BATCH_PIPELINE_H_INCLUDED_
+#define _BATCH_PIPELINE_H_INCLUDED_
+
+#include <nabla.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+
+//! Overlaps loading the inputs of upcoming frames and writing the outputs of finished ones with the processing of the current frame.
+//! Loader threads run `load` up to `inFlight` frames ahead of the one being processed, the processing thread (the one with the GL context)
+//! takes frames in order with `acquire` and hands the output encoding off to a writer thread with `write`, which blocks once `inFlight`
+//! writes are queued. So at most `2*inFlight+1` frames are in memory at once. With `inFlight==0` everything runs in turn on the calling thread.
+//! `load` also gets the index of the loader it runs on, so every loader can have state of its own instead of sharing it with the others.
+template<typename Input>
+class BatchPipeline
+{
+		using clock_t = std::chrono::steady_clock;
+
+	public:
+		using load_t = std::function<Input(const size_t,const uint32_t)>;
+		using write_t = std::function<void()>;
+
+		//! how many different loader indices `load` can get, with `inFlight==0` the calling thread is the only loader
+		static inline uint32_t getLoaderCount(const size_t frameCount, const uint32_t inFlight)
+		{
+			if (!inFlight)
+				return 1u;
+			return nbl::core::min<size_t>(nbl::core::min(inFlight,nbl::core::max(std::thread::hardware_concurrency(),1u)),frameCount);
+		}
+
+		BatchPipeline(const size_t frameCount, const uint32_t inFlight, load_t&& load) : m_frameCount(frameCount), m_inFlight(inFlight), m_load(std::move(load)), m_start(clock_t::now())
+		{
+			if (!m_inFlight)
+				return;
+			m_loaded.resize(m_inFlight);
+			const auto loaderCount = getLoaderCount(m_frameCount,m_inFlight);
+			for (auto i=0u; i<loaderCount; i++)
+				m_loaders.emplace_back(&BatchPipeline::loaderThread,this,i);
+			m_writer = std::thread(&BatchPipeline::writerThread,this);
+		}
+		//! waits for the queued writes, even when the batch got cut short
+		~BatchPipeline()
+		{
+			finish();
+		}
+
+		//! the inputs of frame `i`, frames must be acquired in order
+		inline Input acquire(const size_t i)
+		{
+			assert(i==m_nextToProcess);
+			if (!m_inFlight)
+			{
+				m_nextToProcess++;
+				return timed(m_loadTime,[&]() -> Input {return m_load(i,0u);});
+			}
+
+			std::unique_lock lock(m_mutex);
+			const auto waitStart = clock_t::now();
+			m_loadedCondition.wait(lock,[&]() -> bool {return m_loaded[i%m_inFlight].has_value();});
+			m_stalledOnLoad += clock_t::now()-waitStart;
+			Input input = std::move(m_loaded[i%m_inFlight].value());
+			m_loaded[i%m_inFlight].reset();
+			m_nextToProcess++;
+			lock.unlock();
+			// the slot just freed up, so the loaders can go one frame further
+			m_loadSlotCondition.notify_all();
+			return input;
+		}
+
+		//! encodes and writes a processed frame, `task` must own everything it needs
+		inline void write(write_t&& task)
+		{
+			if (!m_inFlight)
+			{
+				timed(m_writeTime,std::move(task));
+				return;
+			}
+
+			std::unique_lock lock(m_mutex);
+			const auto waitStart = clock_t::now();
+			m_writeSlotCondition.wait(lock,[&]() -> bool {return m_writes.size()<m_inFlight;});
+			m_stalledOnWrite += clock_t::now()-waitStart;
+			m_writes.push_back(std::move(task));
+			lock.unlock();
+			m_writeQueuedCondition.notify_one();
+		}
+
+		//! stops loading and waits for every queued write
+		inline void finish()
+		{
+			if (m_finished)
+				return;
+			{
+				std::lock_guard lock(m_mutex);
+				m_finished = true;
+				m_end = clock_t::now();
+			}
+			m_loadSlotCondition.notify_all();
+			m_writeQueuedCondition.notify_all();
+			for (auto& loader : m_loaders)
+				loader.join();
+			if (m_writer.joinable())
+				m_writer.join();
+			m_writesDone = clock_t::now();
+		}
+
+		//! frames per second and where the time went. The stages' work added up is only an estimate of a sequential batch, the stages get timed
+		//! while contending with each other, so compare against an actual run with `inFlight==0` to measure the speedup.
+		inline std::string getReport()
+		{
+			finish();
+			const auto ms = [](const clock_t::duration duration) -> double {return std::chrono::duration<double,std::milli>(duration).count();};
+			const double totalMs = ms(m_writesDone-m_start);
+			// whatever the processing thread didn't spend waiting
+			const double processMs = ms(m_end-m_start)-ms(m_stalledOnLoad)-ms(m_stalledOnWrite)-(m_inFlight ? 0.0:ms(m_loadTime)+ms(m_writeTime));
+			const double sequentialMs = ms(m_loadTime)+processMs+ms(m_writeTime);
+			return "Batch pipeline with "+std::to_string(m_inFlight)+" frames in flight: "+std::to_string(m_nextToProcess)+" frames in "+std::to_string(totalMs)+" ms, "+
+				std::to_string(totalMs>0.0 ? double(m_nextToProcess)*1000.0/totalMs:0.0)+" frames/s. Loading took "+std::to_string(ms(m_loadTime))+" ms, processing "+
+				std::to_string(processMs)+" ms and writing "+std::to_string(ms(m_writeTime))+" ms, added up that's "+std::to_string(sequentialMs)+" ms or an estimated "+
+				std::to_string(totalMs>0.0 ? sequentialMs/totalMs:1.0)+"x speedup over a sequential batch (not measured, rerun with -PIPELINE_DEPTH=0 for that). Processing waited "+std::to_string(ms(m_stalledOnLoad))+
+				" ms for loads and "+std::to_string(ms(m_stalledOnWrite))+" ms for writes";
+		}
+
+	private:
+		template<typename F>
+		inline auto timed(clock_t::duration& total, F&& f)
+		{
+			struct STimer
+			{
+				~STimer() {total += clock_t::now()-start;}
+				clock_t::duration& total;
+				const clock_t::time_point start;
+			} timer = {total,clock_t::now()};
+			return f();
+		}
+
+		inline void loaderThread(const uint32_t loader)
+		{
+			clock_t::duration loadTime = {};
+			std::unique_lock lock(m_mutex);
+			while (true)
+			{
+				m_loadSlotCondition.wait(lock,[&]() -> bool {return m_finished || m_nextToLoad>=m_frameCount || m_nextToLoad<m_nextToProcess+m_inFlight;});
+				if (m_finished || m_nextToLoad>=m_frameCount)
+					break;
+				// the slot is free since frame `i-inFlight` has already been acquired
+				const size_t i = m_nextToLoad++;
+				lock.unlock();
+				auto input = timed(loadTime,[&]() -> Input {return m_load(i,loader);});
+				lock.lock();
+				m_loaded[i%m_inFlight].emplace(std::move(input));
+				m_loadedCondition.notify_all();
+			}
+			m_loadTime += loadTime;
+		}
+
+		inline void writerThread()
+		{
+			std::unique_lock lock(m_mutex);
+			while (true)
+			{
+				m_writeQueuedCondition.wait(lock,[&]() -> bool {return m_finished || !m_writes.empty();});
+				if (m_writes.empty())
+					break;
+				auto task = std::move(m_writes.front());
+				m_writes.pop_front();
+				lock.unlock();
+				m_writeSlotCondition.notify_one();
+				clock_t::duration writeTime = {};
+				timed(writeTime,std::move(task));
+				lock.lock();
+				m_writeTime += writeTime;
+			}
+		}
+
+		const size_t m_frameCount;
+		const uint32_t m_inFlight;
+		const load_t m_load;
+
+		std::mutex m_mutex;
+		std::condition_variable m_loadSlotCondition, m_loadedCondition, m_writeSlotCondition, m_writeQueuedCondition;
+		nbl::core::vector<std::thread> m_loaders;
+		std::thread m_writer;
+		nbl::core::vector<std::optional<Input>> m_loaded;
+		std::deque<write_t> m_writes;
+		size_t m_nextToLoad = 0ull, m_nextToProcess = 0ull;
+		bool m_finished = false;
+
+		clock_t::time_point m_start, m_end, m_writesDone;
+		clock_t::duration m_loadTime = {}, m_writeTime = {}, m_stalledOnLoad = {}, m_stalledOnWrite = {};
+};
+
+#endif
@@ -47,6 +47,11 @@ Optional Parameters:
 -COLOR_CHANNEL_NAME=colorChannelName
 -ALBEDO_CHANNEL_NAME=albedoChannelName
 -NORMAL_CHANNEL_NAME=normalChannelName
+Switches for the whole run (not a part of any input, can go anywhere on the command line):
+-CPU_BLOOM
+-BENCHMARK_CPU_BLOOM
+-PIPELINE_DEPTH=frameCount
+-BLOOM_TILE_SIZE=fftSize
 
 Note there mustn't be any space characters!
 All files' (except the bloom kernel) resolutions must match!
@@ -108,6 +113,21 @@ or:
 OUTPUT: output file with specified extension 
 The kernel must be centered and in RGB or RGBA floating point format. Resolution should be less than the denoised image.
 If this file is not provided then we use a built-in PSF as the kernel for the convolution.
+
+CPU_BLOOM: don't use the GPU at all, only apply the bloom on the CPU and write the linear HDR result to OUTPUT.
+Denoising, autoexposure and tonemapping need the GPU and CUDA with OptiX, so they get skipped.
+This is also what happens when there's no OpenGL capable GPU or CUDA and OptiX can't be initialized.
+
+BENCHMARK_CPU_BLOOM: time the CPU bloom on synthetic 4K and 8K images with the built-in PSF, with the real FFTs it uses, the full complex ones
+and in tiles, check they all agree and against a brute force convolution and exit.
+
+PIPELINE_DEPTH: how many frames of a batch get loaded ahead of the one being denoised and how many finished ones can wait to be written out, 2 by default.
+0 does everything in turn on one thread. Every loader and the writer decode and encode with an asset manager of their own, so they all run concurrently.
+The throughput of the batch and how long loading, processing and writing took gets printed at the end.
+
+BLOOM_TILE_SIZE: make the CPU bloom convolve the image in overlapping tiles with FFTs of this size (rounded up to a power of two, and at least twice the kernel),
+so the memory it takes doesn't grow with the image. By default only images which would need an FFT bigger than 16384 get tiled, with 2048 sized FFTs.
+The GPU bloom can't tile, such images get skipped there.
 )";
 
 constexpr std::string_view COLOR_FILE = "COLOR_FILE";
@@ -129,6 +149,11 @@ constexpr std::string_view COLOR_CHANNEL_NAME = "COLOR_CHANNEL_NAME";
 constexpr std::string_view ALBEDO_CHANNEL_NAME = "ALBEDO_CHANNEL_NAME";
 constexpr std::string_view NORMAL_CHANNEL_NAME = "NORMAL_CHANNEL_NAME";
 
+constexpr std::string_view CPU_BLOOM = "CPU_BLOOM";
+constexpr std::string_view BENCHMARK_CPU_BLOOM = "BENCHMARK_CPU_BLOOM";
+constexpr std::string_view PIPELINE_DEPTH = "PIPELINE_DEPTH";
+constexpr std::string_view BLOOM_TILE_SIZE = "BLOOM_TILE_SIZE";
+
 constexpr std::array<std::string_view, MANDATORY_CMD_ARGUMENTS_AMOUNT> REQUIRED_PARAMETERS =
 {
 	COLOR_FILE,
@@ -0,0 +1,100 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _KERNEL_SPECTRUM_CACHE_H_INCLUDED_
+#define _KERNEL_SPECTRUM_CACHE_H_INCLUDED_
+
+#include <nabla.h>
+
+#include <chrono>
+
+#include "../common/CacheFile.hpp"
+
+
+//! Bloom kernel spectra already computed during a batch run, so inputs sharing a PSF (usually all of them) only pay for the kernel FFT once.
+//! A spectrum depends on the PSF's texels, the size the PSF got scaled to (which is all the relative scale affects), the FFT size
+//! and the bloom intensity which gets folded in. The least recently used entry goes when `capacity` is exceeded.
+//! Nothing is persisted to disk, the GPU spectra take milliseconds to make and the CPU ones are as big as the padded image, so reading
+//! them back would cost about as much as the FFTs.
+template<typename Spectrum>
+class KernelSpectrumCache
+{
+	public:
+		struct SKey
+		{
+			inline bool operator==(const SKey& other) const
+			{
+				return psfHash==other.psfHash && kernelExtent[0]==other.kernelExtent[0] && kernelExtent[1]==other.kernelExtent[1] &&
+					fftSize[0]==other.fftSize[0] && fftSize[1]==other.fftSize[1] && intensity==other.intensity;
+			}
+
+			uint64_t psfHash;
+			uint32_t kernelExtent[2];
+			uint32_t fftSize[2];
+			float intensity;
+		};
+
+		//! content hash of the PSF texels, salted with the format and extent
+		static inline uint64_t hashPSF(const nbl::asset::ICPUImage* psf)
+		{
+			const auto& params = psf->getCreationParameters();
+			const uint32_t salt[4] = { static_cast<uint32_t>(params.format),params.extent.width,params.extent.height,params.extent.depth };
+			const auto* buffer = psf->getBuffer();
+			return cache_file::hash(buffer->getPointer(),buffer->getSize(),cache_file::hash(salt,sizeof(salt)));
+		}
+
+		explicit KernelSpectrumCache(const uint32_t capacity) : m_capacity(capacity) {}
+
+		//! nullptr on a miss, a hit counts the time the spectrum originally took as saved
+		inline const Spectrum* find(const SKey& key)
+		{
+			for (auto& entry : m_entries)
+			if (entry.key==key)
+			{
+				entry.lastUse = ++m_useCounter;
+				m_hits++;
+				m_savedTime += entry.computeTime;
+				return &entry.spectrum;
+			}
+			return nullptr;
+		}
+
+		//! `computeTime` is how long making `spectrum` took, which is what every later `find` of it saves
+		inline const Spectrum* insert(const SKey& key, Spectrum&& spectrum, const std::chrono::nanoseconds computeTime)
+		{
+			m_misses++;
+			m_computeTime += computeTime;
+			if (m_entries.size()>=m_capacity)
+				m_entries.erase(std::min_element(m_entries.begin(),m_entries.end(),[](const SEntry& lhs, const SEntry& rhs) -> bool {return lhs.lastUse<rhs.lastUse;}));
+			m_entries.push_back({key,std::move(spectrum),computeTime,++m_useCounter});
+			return &m_entries.back().spectrum;
+		}
+
+		//! how many spectra got reused and computed, and how long the reuse saved, for the summary at the end of a batch
+		inline std::string getReport() const
+		{
+			const double savedMs = std::chrono::duration<double,std::milli>(m_savedTime).count();
+			const double computeMs = std::chrono::duration<double,std::milli>(m_computeTime).count();
+			const uint32_t images = m_hits+m_misses;
+			return "Bloom kernel spectrum cache: "+std::to_string(m_misses)+" spectra computed in "+std::to_string(computeMs)+" ms, reused "+
+				std::to_string(m_hits)+" times saving "+std::to_string(savedMs)+" ms in total, "+std::to_string(images ? savedMs/double(images):0.0)+" ms per image";
+		}
+
+	private:
+		struct SEntry
+		{
+			SKey key;
+			Spectrum spectrum;
+			std::chrono::nanoseconds computeTime;
+			uint64_t lastUse;
+		};
+
+		const uint32_t m_capacity;
+		nbl::core::vector<SEntry> m_entries;
+		uint64_t m_useCounter = 0ull;
+		uint32_t m_hits = 0u, m_misses = 0u;
+		std::chrono::nanoseconds m_savedTime = {}, m_computeTime = {};
+};
+
+#endif
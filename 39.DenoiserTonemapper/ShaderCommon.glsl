@@ -23,9 +23,10 @@ uint CommonPushConstants_getPassLog2FFTSize(in int _pass)
 {
 	return bitfieldExtract(pc.data.flags,_pass*5+2,5);
 }
+// red and green share a complex FFT as its real and imaginary part, blue gets the second one
 uint nbl_glsl_ext_FFT_Parameters_t_getMaxChannel()
 {
-	return 2u;
+	return 1u;
 }
 uint nbl_glsl_ext_FFT_Parameters_t_getPaddingType()
 {
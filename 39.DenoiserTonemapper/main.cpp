@@ -16,6 +16,10 @@
 
 #include "CommonPushConstants.h"
 
+#include "../common/CPUBloom.hpp"
+#include "KernelSpectrumCache.h"
+#include "BatchPipeline.h"
+
 using namespace nbl;
 using namespace asset;
 using namespace video;
@@ -45,6 +49,7 @@ struct ImageToDenoise
 	E_IMAGE_INPUT denoiserType = EII_COUNT;
 	VkExtent3D scaledKernelExtent;
 	float bloomIntensity;
+	uint32_t fftScratchSize = 0u;
 };
 struct DenoiserToUse
 {
@@ -68,12 +73,251 @@ constexpr uint32_t tileWidth = 1024, tileHeight = 1024;
 constexpr uint32_t denoiseTileDims[] = { tileWidth ,tileHeight };
 constexpr uint32_t denoiseTileDimsWithOverlap[] = { tileWidth+overlap*2,tileHeight+overlap*2 };
 
+constexpr const char* DefaultBloomPSF = "../../media/kernels/physical_flare_512.exr"; // TODO: make it a builtins?
+constexpr uint32_t DefaultPipelineDepth = 2u;
+constexpr uint32_t MaxBloomFFTSize = 16384u; // same as `_NBL_GLSL_EXT_FFT_MAX_DIM_SIZE_` of the FFT shaders
+constexpr uint32_t DefaultBloomTileSize = 2048u;
+
+//! picks the layer of a multilayered EXR with the best matching name, or the first image of any other bundle
+core::smart_refctd_ptr<ICPUImage> getImageAssetGivenChannelName(asset::SAssetBundle& assetBundle, const std::optional<std::string>& channelName)
+{
+	if (assetBundle.getContents().empty())
+		return nullptr;
+
+	// calculate a score for how much each channel name matches the requested
+	size_t firstChannelNameOccurence = std::string::npos;
+	uint32_t pickedChannel = 0u;
+	auto contents = assetBundle.getContents();
+	if (channelName.has_value())
+		for (auto& asset : contents)
+		{
+			assert(asset);
+			
+			const auto* bundleMeta = assetBundle.getMetadata();
+			const auto* exrmeta = static_cast<const COpenEXRMetadata*>(bundleMeta);
+			const auto* metadata = static_cast<const COpenEXRMetadata::CImage*>(exrmeta->getAssetSpecificMetadata(core::smart_refctd_ptr_static_cast<ICPUImage>(asset).get()));
+
+			if (strcmp(exrmeta->getLoaderName(), COpenEXRMetadata::LoaderName) != 0)
+				continue;
+			else
+			{
+				const auto& assetMetaChannelName = metadata->m_name;
+				auto found = assetMetaChannelName.find(channelName.value());
+				if (found >= firstChannelNameOccurence)
+					continue;
+				firstChannelNameOccurence = found;
+				pickedChannel = std::distance(contents.begin(), &asset);
+			}
+		}
+
+	return asset::IAsset::castDown<ICPUImage>(contents.begin()[pickedChannel]);
+}
+
+//! linear RGB floats of an image, alpha gets dropped
+core::vector<float> decodeRGB(const ICPUImage* image)
+{
+	const auto& params = image->getCreationParameters();
+	const auto& region = image->getRegions().begin()[0];
+	const uint32_t rowLength = region.bufferRowLength ? region.bufferRowLength:params.extent.width;
+	const auto texelSize = getTexelOrBlockBytesize(params.format);
+	const auto* data = reinterpret_cast<const uint8_t*>(image->getBuffer()->getPointer())+region.bufferOffset;
+
+	core::vector<float> rgb(size_t(params.extent.width)*params.extent.height*cpu_fft::CBloom::Channels);
+	core::vector<uint32_t> rows(params.extent.height);
+	std::iota(rows.begin(),rows.end(),0u);
+	std::for_each(core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+	{
+		for (uint32_t x=0u; x<params.extent.width; x++)
+		{
+			const void* src = data+(size_t(y)*rowLength+x)*texelSize;
+			double decoded[4] = {0.0,0.0,0.0,1.0};
+			core::vectorSIMDu32 dummy;
+			decodePixelsRuntime(params.format,&src,decoded,dummy.x,dummy.y);
+			for (auto c=0u; c<cpu_fft::CBloom::Channels; c++)
+				rgb[(size_t(y)*params.extent.width+x)*cpu_fft::CBloom::Channels+c] = static_cast<float>(decoded[c]);
+		}
+	});
+	return rgb;
+}
+
+//! The bloom on its own on the CPU, for when there's no GPU, CUDA or OptiX (or `-CPU_BLOOM` asked for it).
+//! Denoising, autoexposure and tonemapping are GPU only, so every input is written out as linear HDR in the color input's format.
+//! Inputs which would need an FFT bigger than `MaxBloomFFTSize` get tiled, as does everything else when `bloomTileSize` isn't 0.
+int bloomOnCPU(IAssetManager* am, CommandLineHandler& cmdHandler, const uint32_t bloomTileSize)
+{
+	os::Printer::log("Running the CPU bloom only, there will be no denoising, autoexposure or tonemapping!", ELL_WARNING);
+
+	const auto& colorFileNameBundle = cmdHandler.getColorFileNameBundle();
+	const auto& colorChannelNameBundle = cmdHandler.getColorChannelNameBundle();
+	const auto& bloomRelativeScaleBundle = cmdHandler.getBloomRelativeScaleBundle();
+	const auto& bloomIntensityBundle = cmdHandler.getBloomIntensityBundle();
+	const auto& outputFileBundle = cmdHandler.getOutputFileBundle();
+	const auto& bloomPsfFileBundle = cmdHandler.getBloomPsfBundle();
+
+	// a CPU spectrum is as big as the padded image, so only the last one is kept, that's enough for a batch of same sized renders
+	using CPUSpectrumCache = KernelSpectrumCache<cpu_fft::CBloom::SSpectrum>;
+	CPUSpectrumCache spectrumCache(1u);
+
+	asset::IAssetLoader::SAssetLoadParams lp(0ull,nullptr);
+	auto default_kernel_image_bundle = am->getAsset(DefaultBloomPSF,lp);
+	for (size_t i=0; i<cmdHandler.getInputFilesAmount(); i++)
+	{
+		const std::string imageIDString = "Image Input #"+std::to_string(i)+" called \""+colorFileNameBundle[i].value()+"\" ";
+
+		auto color_image_bundle = am->getAsset(colorFileNameBundle[i].value(),lp);
+		auto color = getImageAssetGivenChannelName(color_image_bundle,colorChannelNameBundle[i]);
+		if (!color)
+		{
+			os::Printer::log(imageIDString+"could not be loaded, skipping!", ELL_ERROR);
+			continue;
+		}
+		auto kernel_image_bundle = bloomPsfFileBundle[i].has_value() ? am->getAsset(bloomPsfFileBundle[i].value(),lp):default_kernel_image_bundle;
+		auto kernel = getImageAssetGivenChannelName(kernel_image_bundle,{});
+		if (!kernel)
+			kernel = getImageAssetGivenChannelName(default_kernel_image_bundle,{});
+		if (!kernel)
+		{
+			os::Printer::log(imageIDString+"could not load default Bloom Kernel Image, skipping!", ELL_ERROR);
+			continue;
+		}
+
+		const auto colorParams = color->getCreationParameters();
+		const auto& extent = colorParams.extent;
+		const auto& kerDim = kernel->getCreationParameters().extent;
+		const auto texelSize = getTexelOrBlockBytesize(colorParams.format);
+		auto buffer = core::make_smart_refctd_ptr<ICPUBuffer>(size_t(extent.width)*extent.height*texelSize);
+		// converts a `width` x `height` block of bloomed texels (`pitch` texels apart) at `x,y` to the output
+		auto encodeTexels = [&](const uint32_t x, const uint32_t y, const uint32_t width, const uint32_t height, const float* rgb, const uint32_t pitch) -> void
+		{
+			auto* data = reinterpret_cast<uint8_t*>(buffer->getPointer());
+			core::vector<uint32_t> rows(height);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t row)
+			{
+				for (uint32_t column=0u; column<width; column++)
+				{
+					const float* in = rgb+(size_t(row)*pitch+column)*cpu_fft::CBloom::Channels;
+					double encoded[4] = {in[0],in[1],in[2],1.0};
+					encodePixelsRuntime(colorParams.format,data+((size_t(y)+row)*extent.width+x+column)*texelSize,encoded);
+				}
+			});
+		};
+		{
+			auto rgb = decodeRGB(color.get());
+			const float relativeScale = bloomRelativeScaleBundle[i].value();
+			if (cpu_fft::CBloom::getKernelScale(kerDim.width,kerDim.height,extent.width,extent.height,relativeScale)>1.f)
+				os::Printer::log(imageIDString + "Bloom Kernel loose sharpness, increase resolution of bloom kernel or reduce its relative scale!", ELL_WARNING);
+			CPUSpectrumCache::SKey key = {CPUSpectrumCache::hashPSF(kernel.get()),{},{},bloomIntensityBundle[i].value()};
+			cpu_fft::CBloom::getScaledKernelExtent(kerDim.width,kerDim.height,extent.width,extent.height,relativeScale,key.kernelExtent[0],key.kernelExtent[1]);
+			cpu_fft::CBloom::getPaddedExtent(extent.width,extent.height,key.kernelExtent[0],key.kernelExtent[1],key.fftSize[0],key.fftSize[1]);
+			// overlap-save in tiles when asked to or the whole image would need too big an FFT, the tiles' spectrum is what gets cached then
+			const bool tiled = bloomTileSize || core::max(key.fftSize[0],key.fftSize[1])>MaxBloomFFTSize;
+			if (tiled)
+				cpu_fft::CBloom::getTileExtent(extent.width,extent.height,key.kernelExtent[0],key.kernelExtent[1],bloomTileSize ? bloomTileSize:DefaultBloomTileSize,key.fftSize[0],key.fftSize[1]);
+			const auto* spectrum = spectrumCache.find(key);
+			if (!spectrum)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				const auto psf = decodeRGB(kernel.get());
+				const auto scaledKernel = cpu_fft::CBloom::scaleKernel(psf.data(),kerDim.width,kerDim.height,extent.width,extent.height,relativeScale);
+				auto computed = cpu_fft::CBloom::computeSpectrum(scaledKernel,key.fftSize[0],key.fftSize[1],key.intensity);
+				spectrum = spectrumCache.insert(key,std::move(computed),std::chrono::steady_clock::now()-start);
+			}
+			if (tiled)
+			{
+				os::Printer::log(imageIDString+"bloom done in tiles of "+std::to_string(key.fftSize[0])+"x"+std::to_string(key.fftSize[1])+" FFTs", ELL_INFORMATION);
+				cpu_fft::CBloom::convolveTiled(rgb.data(),extent.width,extent.height,*spectrum,encodeTexels);
+			}
+			else
+			{
+				cpu_fft::CBloom::convolve(rgb.data(),extent.width,extent.height,*spectrum);
+				encodeTexels(0u,0u,extent.width,extent.height,rgb.data(),extent.width);
+			}
+		}
+		auto regions = core::make_refctd_dynamic_array<core::smart_refctd_dynamic_array<IImage::SBufferCopy> >(1u);
+		{
+			auto& region = regions->front();
+			region.bufferOffset = 0u;
+			region.bufferRowLength = extent.width;
+			region.bufferImageHeight = extent.height;
+			region.imageSubresource.mipLevel = 0u;
+			region.imageSubresource.baseArrayLayer = 0u;
+			region.imageSubresource.layerCount = 1u;
+			region.imageOffset = {0u,0u,0u};
+			region.imageExtent = {extent.width,extent.height,1u};
+		}
+		ICPUImage::SCreationParams imgParams;
+		imgParams.flags = static_cast<ICPUImage::E_CREATE_FLAGS>(0u);
+		imgParams.type = ICPUImage::ET_2D;
+		imgParams.format = colorParams.format;
+		imgParams.extent = {extent.width,extent.height,1u};
+		imgParams.mipLevels = 1u;
+		imgParams.arrayLayers = 1u;
+		imgParams.samples = ICPUImage::ESCF_1_BIT;
+		auto image = ICPUImage::create(std::move(imgParams));
+		image->setBufferAndRegions(std::move(buffer),regions);
+
+		ICPUImageView::SCreationParams imgViewParams;
+		imgViewParams.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
+		imgViewParams.format = colorParams.format;
+		imgViewParams.image = std::move(image);
+		imgViewParams.viewType = ICPUImageView::ET_2D;
+		imgViewParams.subresourceRange = {static_cast<IImage::E_ASPECT_FLAGS>(0u),0u,1u,0u,1u};
+		auto imageView = ICPUImageView::create(std::move(imgViewParams));
+
+		IAssetWriter::SAssetWriteParams wp(imageView.get());
+		if (!am->writeAsset(outputFileBundle[i].value().c_str(),wp))
+			os::Printer::log(imageIDString+"could not be written to "+outputFileBundle[i].value()+"!", ELL_ERROR);
+	}
+	os::Printer::log(spectrumCache.getReport(),ELL_INFORMATION);
+	return 0;
+}
+
+//! `-BENCHMARK_CPU_BLOOM`, 4K and 8K images with the built-in PSF at a relative scale small enough to keep the kernel sharp and at the one from `exampleInputArguments.txt`,
+//! the tiled bloom uses `bloomTileSize` or the default tile size
+int benchmarkCPUBloom(IAssetManager* am, const uint32_t bloomTileSize)
+{
+	asset::IAssetLoader::SAssetLoadParams lp(0ull,nullptr);
+	auto psfBundle = am->getAsset(DefaultBloomPSF,lp);
+	auto psf = getImageAssetGivenChannelName(psfBundle,{});
+	if (check_error(!psf,"Could not load default Bloom Kernel Image!"))
+		return error_code;
+	const auto& psfExtent = psf->getCreationParameters().extent;
+	const auto psfRGB = decodeRGB(psf.get());
+
+	bool passed = true;
+	for (const auto& [width,height] : {std::pair(3840u,2160u),std::pair(7680u,4320u)})
+	for (const float relativeScale : {1.f/32.f,0.235f})
+		passed = cpu_fft::CBloom::benchmark(psfRGB.data(),psfExtent.width,psfExtent.height,width,height,relativeScale,0.75f,bloomTileSize ? bloomTileSize:DefaultBloomTileSize) && passed;
+	return passed ? 0:1;
+}
+
 int main(int argc, char* argv[])
 {
+	// switches for the whole run, everything else describes the inputs
+	bool cpuBloom = false, benchmarkBloom = false;
+	uint32_t pipelineDepth = DefaultPipelineDepth, bloomTileSize = 0u;
+	core::vector<std::string> inputArguments;
+	for (auto i=1; i<argc; i++)
+	{
+		const std::string_view argument(argv[i]);
+		if (argument.size()>1u && argument.substr(1u)==CPU_BLOOM)
+			cpuBloom = true;
+		else if (argument.size()>1u && argument.substr(1u)==BENCHMARK_CPU_BLOOM)
+			benchmarkBloom = true;
+		else if (argument.size()>PIPELINE_DEPTH.size()+2u && argument.substr(1u,PIPELINE_DEPTH.size())==PIPELINE_DEPTH && argument[PIPELINE_DEPTH.size()+1u]=='=')
+			pipelineDepth = std::strtoul(argv[i]+PIPELINE_DEPTH.size()+2u,nullptr,10);
+		else if (argument.size()>BLOOM_TILE_SIZE.size()+2u && argument.substr(1u,BLOOM_TILE_SIZE.size())==BLOOM_TILE_SIZE && argument[BLOOM_TILE_SIZE.size()+1u]=='=')
+			bloomTileSize = std::strtoul(argv[i]+BLOOM_TILE_SIZE.size()+2u,nullptr,10);
+		else
+			inputArguments.emplace_back(argument);
+	}
+
 	nbl::SIrrlichtCreationParameters params;
 	params.Bits = 24;
 	params.ZBufferBits = 24;
-	params.DriverType = video::EDT_OPENGL;
+	// the CPU paths only need the asset manager
+	params.DriverType = cpuBloom||benchmarkBloom ? video::EDT_NULL:video::EDT_OPENGL;
 	params.WindowSize = core::dimension2d<uint32_t>(1280, 720);
 	params.Fullscreen = false;
 	params.Vsync = true;
@@ -83,6 +327,13 @@ int main(int argc, char* argv[])
 	params.StreamingUploadBufferSize = 1024*1024*1024; // for Color + 2 AoV of 8k images
 	params.StreamingDownloadBufferSize = core::roundUp(params.StreamingUploadBufferSize/3u,256u); // for output image
 	auto device = createDeviceEx(params);
+	if (!device && params.DriverType!=video::EDT_NULL)
+	{
+		printf("[WARNING] Could not create an OpenGL device, falling back to the CPU bloom!\n");
+		cpuBloom = true;
+		params.DriverType = video::EDT_NULL;
+		device = createDeviceEx(params);
+	}
 
 	if (check_error(!device,"Could not create Irrlicht Device!"))
 		return error_code;
@@ -94,16 +345,18 @@ int main(int argc, char* argv[])
 	auto compiler = am->getGLSLCompiler();
 	auto filesystem = device->getFileSystem();
 
+	if (benchmarkBloom)
+		return benchmarkCPUBloom(am,bloomTileSize);
+
 	auto getArgvFetchedList = [&]()
 	{
 		core::vector<std::string> arguments;
 		arguments.reserve(PROPER_CMD_ARGUMENTS_AMOUNT);
 		arguments.emplace_back(argv[0]);
-		if (argc>1)
+		if (!inputArguments.empty())
 		{
 			os::Printer::log("Guess input from Commandline arguments",ELL_INFORMATION);
-			for (auto i = 1ul; i < argc; ++i)
-				arguments.emplace_back(argv[i]);
+			arguments.insert(arguments.end(),inputArguments.begin(),inputArguments.end());
 		}
 		else
 		{
@@ -120,9 +373,12 @@ int main(int argc, char* argv[])
 	if (check_error(!cmdHandler.getStatus(),"Could not parse input commands!"))
 		return error_code;
 
+	if (cpuBloom)
+		return bloomOnCPU(am,cmdHandler,bloomTileSize);
+
 	auto m_optixManager = ext::OptiX::Manager::create(driver,device->getFileSystem());
-	if (check_error(!m_optixManager, "Could not initialize CUDA or OptiX!"))
-		return error_code;
+	if (check_error(!m_optixManager, "Could not initialize CUDA or OptiX, falling back to the CPU bloom!"))
+		return bloomOnCPU(am,cmdHandler,bloomTileSize);
 	auto m_cudaStream = m_optixManager->getDeviceStream(0);
 	if (check_error(!m_cudaStream, "Could not obtain CUDA stream!"))
 		return error_code;
@@ -176,6 +432,8 @@ int main(int argc, char* argv[])
 
 	constexpr uint32_t kComputeWGSize = FFTClass::DEFAULT_WORK_GROUP_SIZE; // if it changes, maybe it breaks stuff
 	constexpr uint32_t colorChannelsFFT = 3u;
+	// the image and the kernel are real, so red and green go through one complex FFT as its real and imaginary part, blue through another
+	constexpr uint32_t packedChannelsFFT = 2u;
 	constexpr bool usingHalfFloatFFTStorage = false;
 
 	constexpr bool usingLumaMeter = true;
@@ -226,7 +484,8 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(in ivec3 coordinate, in uint cha
 	const vec2 relativeCoords = vec2(coordinate.xy)-halfInputSize;
 	const vec2 inputSizeRcp = vec2(1.0)/inputSize;
     const vec4 texelValue = textureGrad(inputImage,(relativeCoords+vec2(0.5))*inputSizeRcp+vec2(0.5),vec2(inputSizeRcp.x,0.0),vec2(0.0,inputSizeRcp.y));
-	return nbl_glsl_complex(texelValue[channel], 0.0f);
+	// red and green packed as one complex signal, blue on its own
+	return channel!=0u ? nbl_glsl_complex(texelValue.b,0.0f):texelValue.rg;
 }
 #define _NBL_GLSL_EXT_FFT_GET_PADDED_DATA_DEFINED_
 
@@ -278,15 +537,27 @@ layout(push_constant) uniform PushConstants
 
 void main()
 {
-	nbl_glsl_complex value = inData[nbl_glsl_dot(gl_GlobalInvocationID,pc.strides.xyz)];
+	const uvec2 coord = bitfieldReverse(gl_GlobalInvocationID.xy)>>pc.bitreverse_shift;
+
+	// the first spectrum is Z = R+iG, the spectrum of a real image is conjugate symmetric so R = (Z[k]+conj(Z[-k]))/2 and G = (Z[k]-conj(Z[-k]))/2i
+	nbl_glsl_complex value;
+	if (gl_WorkGroupID.z<2u)
+	{
+		const uvec2 mirroredCoord = (uvec2(0u)-coord)&((uvec2(1u)<<(uvec2(32u)-pc.bitreverse_shift))-uvec2(1u));
+		const uvec2 mirroredID = bitfieldReverse(mirroredCoord)>>pc.bitreverse_shift;
+		const nbl_glsl_complex z = inData[nbl_glsl_dot(uvec3(gl_GlobalInvocationID.xy,0u),pc.strides.xyz)];
+		nbl_glsl_complex zMirrored = inData[nbl_glsl_dot(uvec3(mirroredID,0u),pc.strides.xyz)];
+		zMirrored.y = -zMirrored.y;
+		value = gl_WorkGroupID.z!=0u ? nbl_glsl_complex_mul(z-zMirrored,nbl_glsl_complex(0.0,-0.5)):(z+zMirrored)*0.5;
+	}
+	else
+		value = inData[nbl_glsl_dot(uvec3(gl_GlobalInvocationID.xy,1u),pc.strides.xyz)];
 	
-	// imaginary component will be 0, image shall be positive
-	vec3 avg;
-	for (uint i=0u; i<3u; i++)
-		avg[i] = inData[pc.strides.z*i].x;
+	// the DC terms are real so red and green share the first one, image shall be positive
+	const nbl_glsl_complex packedAvg = inData[0];
+	const vec3 avg = vec3(packedAvg.x,packedAvg.y,inData[pc.strides.z].x);
 	const float power = (nbl_glsl_scRGBtoXYZ*avg).y;
 
-	const uvec2 coord = bitfieldReverse(gl_GlobalInvocationID.xy)>>pc.bitreverse_shift;
 	const nbl_glsl_complex shift = nbl_glsl_expImaginary(-nbl_glsl_PI*float(coord.x+coord.y));
 	value = nbl_glsl_complex_mul(value,shift)/power;
 	value = value*pc.bloomIntensity+nbl_glsl_complex(1.0-pc.bloomIntensity,0.0);
@@ -483,22 +754,11 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 
 	const uint index = coordinate.y*pc.data.imageWidth+coordinate.x;
 
-	// rewrite this fetch at some point
-	nbl_glsl_complex retval; retval.y = 0.0;
-	switch (channel)
-	{
-		case 2u:
-			retval[0] = float(inBuffer[index].z);
-			break;
-		case 1u:
-			retval[0] = float(inBuffer[index].y);
-			break;
-		default:
-			scaledLogLuma += nbl_glsl_ext_LumaMeter_local_process(all(equal(coordinate,oldCoord)),vec3(inBuffer[index].x,inBuffer[index].y,inBuffer[index].z));
-			retval[0] = float(inBuffer[index].x);
-			break;
-	}
-	return retval;
+	// red and green packed as the real and imaginary part of one complex signal, blue on its own
+	if (channel!=0u)
+		return nbl_glsl_complex(float(inBuffer[index].z),0.0);
+	scaledLogLuma += nbl_glsl_ext_LumaMeter_local_process(all(equal(coordinate,oldCoord)),vec3(inBuffer[index].x,inBuffer[index].y,inBuffer[index].z));
+	return nbl_glsl_complex(float(inBuffer[index].x),float(inBuffer[index].y));
 }
 
 void main()
@@ -512,7 +772,7 @@ void main()
 	// Virtual Threads Calculation
 	const uint log2FFTSize = nbl_glsl_ext_FFT_Parameters_t_getLog2FFTSize();
 	const uint item_per_thread_count = 0x1u<<(log2FFTSize-_NBL_GLSL_WORKGROUP_SIZE_LOG2_);
-	for(uint channel=0u; channel<3u; channel++)
+	for(uint channel=0u; channel<=nbl_glsl_ext_FFT_Parameters_t_getMaxChannel(); channel++)
 	{
 		scaledLogLuma = 0.f;
 		// Load Values into local memory
@@ -594,7 +854,23 @@ void nbl_glsl_ext_FFT_setData(in uvec3 coordinate, in uint channel, in nbl_glsl_
 #define _NBL_GLSL_EXT_FFT_MAIN_DEFINED_
 #include "nbl/builtin/glsl/ext/FFT/default_compute_fft.comp"
 
-void convolve(in uint item_per_thread_count, in uint ch) 
+// The rows got transformed with red and green packed as Z = R+iG, and the spectrum of a real row is conjugate symmetric, so the column
+// at frequency kx holds R = (Z[kx]+conj(Z[-kx]))/2 and G = (Z[kx]-conj(Z[-kx]))/2i. Every workgroup owns the pair of mirrored columns
+// kx and -kx with kx in [0,N/2], so only half the column transforms run, and it writes the packed result back into both of them.
+uint getColumn(in uint kx)
+{
+	const uint log2Width = CommonPushConstants_getPassLog2FFTSize(0);
+	return bitfieldReverse(kx&((0x1u<<log2Width)-1u))>>(32u-log2Width);
+}
+nbl_glsl_complex loadColumn(in uint tid, in uint log2FFTSize, in uint column, in uint channel)
+{
+	const uint trueDim = nbl_glsl_ext_FFT_Parameters_t_getDimensions()[nbl_glsl_ext_FFT_Parameters_t_getDirection()];
+	ivec3 coordinate = nbl_glsl_ext_FFT_getPaddedCoordinates(tid,log2FFTSize,trueDim);
+	coordinate.x = int(column);
+	return nbl_glsl_ext_FFT_getPaddedData(coordinate,channel);
+}
+
+void convolve(in uint item_per_thread_count, in uint column, in uint ch) 
 {
 	for(uint t=0u; t<item_per_thread_count; t++)
 	{
@@ -603,7 +879,8 @@ void convolve(in uint item_per_thread_count, in uint ch)
 		nbl_glsl_complex sourceSpectrum = nbl_glsl_ext_FFT_impl_values[t];
 		
 		//
-		const uvec3 coords = nbl_glsl_ext_FFT_getCoordinates(tid);
+		uvec3 coords = nbl_glsl_ext_FFT_getCoordinates(tid);
+		coords.x = column;
         vec2 uv = vec2(bitfieldReverse(coords.xy))/vec2(4294967296.f);
 
 		uv += pc.data.kernel_half_pixel_size;
@@ -613,28 +890,46 @@ void convolve(in uint item_per_thread_count, in uint ch)
 	}
 }
 
+// red stays in registers until green is done, so both can be packed back together
+nbl_glsl_complex convolvedRed[_NBL_GLSL_EXT_FFT_MAX_DIM_SIZE_/_NBL_GLSL_WORKGROUP_SIZE_];
+
 void main()
 {
 	// Virtual Threads Calculation
 	const uint log2FFTSize = nbl_glsl_ext_FFT_Parameters_t_getLog2FFTSize();
 	const uint item_per_thread_count = 0x1u<<(log2FFTSize-_NBL_GLSL_WORKGROUP_SIZE_LOG2_);
+	const uint column = getColumn(gl_WorkGroupID.x);
+	const uint mirroredColumn = getColumn(-gl_WorkGroupID.x);
 	for(uint channel=0u; channel<3u; channel++)
 	{
-		// Load Values into local memory
+		// Load Values into local memory, red and green get told apart by the symmetry, blue had a transform of its own
 		for(uint t=0u; t<item_per_thread_count; t++)
 		{
 			const uint tid = (t<<_NBL_GLSL_WORKGROUP_SIZE_LOG2_)|gl_LocalInvocationIndex;
-			const uint trueDim = nbl_glsl_ext_FFT_Parameters_t_getDimensions()[nbl_glsl_ext_FFT_Parameters_t_getDirection()];
-			nbl_glsl_ext_FFT_impl_values[t] = nbl_glsl_ext_FFT_getPaddedData(nbl_glsl_ext_FFT_getPaddedCoordinates(tid,log2FFTSize,trueDim),channel);
+			if (channel<2u)
+			{
+				const nbl_glsl_complex z = loadColumn(tid,log2FFTSize,column,0u);
+				nbl_glsl_complex zMirrored = loadColumn(tid,log2FFTSize,mirroredColumn,0u);
+				zMirrored.y = -zMirrored.y;
+				nbl_glsl_ext_FFT_impl_values[t] = channel!=0u ? nbl_glsl_complex_mul(z-zMirrored,nbl_glsl_complex(0.0,-0.5)):(z+zMirrored)*0.5;
+			}
+			else
+				nbl_glsl_ext_FFT_impl_values[t] = loadColumn(tid,log2FFTSize,column,1u);
 		}
 		nbl_glsl_ext_FFT_preloaded(false,log2FFTSize);
 		barrier();
 
-		convolve(item_per_thread_count,channel);
+		convolve(item_per_thread_count,column,channel);
 	
 		barrier();
 		nbl_glsl_ext_FFT_preloaded(true,log2FFTSize);
-		// write out to main memory
+		if (channel==0u)
+		{
+			for(uint t=0u; t<item_per_thread_count; t++)
+				convolvedRed[t] = nbl_glsl_ext_FFT_impl_values[t];
+			continue;
+		}
+		// write out to main memory, the mirrored column of a real row's spectrum is the conjugate
 		for(uint t=0u; t<item_per_thread_count; t++)
 		{
 			const uint tid = (t<<_NBL_GLSL_WORKGROUP_SIZE_LOG2_)|gl_LocalInvocationIndex;
@@ -643,7 +938,28 @@ void main()
 			const uint padding = ((0x1u<<log2FFTSize)-trueDim)>>1u;
 			const uint shifted = tid-padding;
 			if (tid>=padding && shifted<trueDim)
-				nbl_glsl_ext_FFT_setData(ivec3(nbl_glsl_ext_FFT_getCoordinates(shifted)),channel,nbl_glsl_ext_FFT_impl_values[t]);
+			{
+				const nbl_glsl_complex value = nbl_glsl_ext_FFT_impl_values[t];
+				nbl_glsl_complex packedValue = value;
+				nbl_glsl_complex mirroredValue = nbl_glsl_complex(value.x,-value.y);
+				uint packedChannel = 1u;
+				if (channel==1u)
+				{
+					// R+iG and conj(R)+i*conj(G)
+					const nbl_glsl_complex red = convolvedRed[t];
+					packedValue = nbl_glsl_complex(red.x-value.y,red.y+value.x);
+					mirroredValue = nbl_glsl_complex(red.x+value.y,value.x-red.y);
+					packedChannel = 0u;
+				}
+				uvec3 coords = nbl_glsl_ext_FFT_getCoordinates(shifted);
+				coords.x = column;
+				nbl_glsl_ext_FFT_setData(coords,packedChannel,packedValue);
+				if (mirroredColumn!=column)
+				{
+					coords.x = mirroredColumn;
+					nbl_glsl_ext_FFT_setData(coords,packedChannel,mirroredValue);
+				}
+			}
 		}
 	}
 }
@@ -717,7 +1033,11 @@ void nbl_glsl_ext_FFT_setData(in uvec3 coordinate, in uint channel, in nbl_glsl_
 	
 	uint dataOffset = coords.y*pc.data.inImageTexelPitch[EII_COLOR]+coords.x;	
 	vec3 color = vec4(outBuffer[dataOffset]).xyz;
-	color[channel] = complex_value.x;
+	// the first spectrum was red and green packed as the real and imaginary part, the second blue
+	if (channel!=0u)
+		color.b = complex_value.x;
+	else
+		color.rg = complex_value;
 	if (channel==nbl_glsl_ext_FFT_Parameters_t_getMaxChannel())
 	{
 		color = _NBL_GLSL_EXT_LUMA_METER_XYZ_CONVERSION_MATRIX_DEFINED_*color;
@@ -762,7 +1082,7 @@ void main()
 	// Virtual Threads Calculation
 	const uint log2FFTSize = nbl_glsl_ext_FFT_Parameters_t_getLog2FFTSize();
 	const uint item_per_thread_count = 0x1u<<(log2FFTSize-_NBL_GLSL_WORKGROUP_SIZE_LOG2_);
-	for(uint channel=0u; channel<3u; channel++)
+	for(uint channel=0u; channel<=nbl_glsl_ext_FFT_Parameters_t_getMaxChannel(); channel++)
 	{
 		// Load Values into local memory
 		for(uint t=0u; t<item_per_thread_count; t++)
@@ -891,250 +1211,221 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 		return imageIDString;
 	};
 
-	core::vector<ImageToDenoise> images(inputFilesAmount);
-	// load images
-	uint32_t maxResolution[2] = { 0,0 };
-	uint32_t fftScratchSize = 0u;
+	// load and check the inputs of a frame, runs on the batch pipeline's loader threads
+	asset::IAssetLoader::SAssetLoadParams lp(0ull,nullptr);
+	// the inputs are only needed until their frame is processed, so don't let the asset cache hold on to the whole batch
+	const asset::IAssetLoader::SAssetLoadParams frameLoadParams(0ull,nullptr,static_cast<IAssetLoader::E_CACHING_FLAGS>(IAssetLoader::ECF_DONT_CACHE_TOP_LEVEL|IAssetLoader::ECF_DONT_CACHE_REFERENCES));
+	auto default_kernel_image_bundle = am->getAsset(DefaultBloomPSF,lp);
+	// The asset manager isn't thread-safe (its caches are shared state), so every loader thread and the writer thread get one of their own,
+	// the only thing they share is the file system which they just open files through. This way the decodes and encodes run concurrently,
+	// while the GL thread doesn't use `am` at all once the pipeline runs, the denoiser inputs and bloom kernels get uploaded directly.
+	// The default PSF is loaded up front and only ever read from afterwards.
+	auto createAssetManager = [filesystem]() -> core::smart_refctd_ptr<asset::IAssetManager>
 	{
-		asset::IAssetLoader::SAssetLoadParams lp(0ull,nullptr);
-		auto default_kernel_image_bundle = am->getAsset("../../media/kernels/physical_flare_512.exr",lp); // TODO: make it a builtins?
+		return core::make_smart_refctd_ptr<asset::IAssetManager>(core::smart_refctd_ptr<io::IFileSystem>(filesystem));
+	};
+	core::vector<core::smart_refctd_ptr<asset::IAssetManager>> loaderAssetManagers(BatchPipeline<ImageToDenoise>::getLoaderCount(inputFilesAmount,pipelineDepth));
+	for (auto& loaderAssetManager : loaderAssetManagers)
+		loaderAssetManager = createAssetManager();
+	const auto writerAssetManager = createAssetManager();
+	auto loadInput = [&](const size_t i, const uint32_t loader) -> ImageToDenoise
+	{
+		ImageToDenoise outParam;
+		const auto imageIDString = makeImageIDString(i, colorFileNameBundle);
 
-		for (size_t i=0; i < inputFilesAmount; i++)
+		auto* const am = loaderAssetManagers[loader].get();
+		auto color_image_bundle = am->getAsset(colorFileNameBundle[i].value(), frameLoadParams); decltype(color_image_bundle) albedo_image_bundle, normal_image_bundle;
+		if (color_image_bundle.getContents().empty())
 		{
-			const auto imageIDString = makeImageIDString(i, colorFileNameBundle);
-
-			auto color_image_bundle = am->getAsset(colorFileNameBundle[i].value(), lp); decltype(color_image_bundle) albedo_image_bundle, normal_image_bundle;
-			if (color_image_bundle.getContents().empty())
-			{
-				os::Printer::log("ERROR (" + std::to_string(__LINE__) + " line): Could not load the image from file: " + imageIDString + "!", ELL_ERROR);
-				continue;
-			}
-
-			albedo_image_bundle = albedoFileNameBundle[i].has_value() ? am->getAsset(albedoFileNameBundle[i].value(), lp) : decltype(albedo_image_bundle)();
-			normal_image_bundle = normalFileNameBundle[i].has_value() ? am->getAsset(normalFileNameBundle[i].value(), lp) : decltype(normal_image_bundle)();
+			os::Printer::log("ERROR (" + std::to_string(__LINE__) + " line): Could not load the image from file: " + imageIDString + "!", ELL_ERROR);
+			return {};
+		}
 
-			auto kernel_image_bundle = bloomPsfFileBundle[i].has_value() ? am->getAsset(bloomPsfFileBundle[i].value(),lp):default_kernel_image_bundle;
+		albedo_image_bundle = albedoFileNameBundle[i].has_value() ? am->getAsset(albedoFileNameBundle[i].value(), frameLoadParams) : decltype(albedo_image_bundle)();
+		normal_image_bundle = normalFileNameBundle[i].has_value() ? am->getAsset(normalFileNameBundle[i].value(), frameLoadParams) : decltype(normal_image_bundle)();
 
-			auto& outParam = images[i];
+		auto kernel_image_bundle = bloomPsfFileBundle[i].has_value() ? am->getAsset(bloomPsfFileBundle[i].value(),lp):default_kernel_image_bundle;
 
-			auto getImageAssetGivenChannelName = [](asset::SAssetBundle& assetBundle, const std::optional<std::string>& channelName) -> core::smart_refctd_ptr<ICPUImage>
-			{
-				if (assetBundle.getContents().empty())
-					return nullptr;
-
-				// calculate a score for how much each channel name matches the requested
-				size_t firstChannelNameOccurence = std::string::npos;
-				uint32_t pickedChannel = 0u;
-				auto contents = assetBundle.getContents();
-				if (channelName.has_value())
-					for (auto& asset : contents)
-					{
-						assert(asset);
-						
-						const auto* bundleMeta = assetBundle.getMetadata();
-						const auto* exrmeta = static_cast<const COpenEXRMetadata*>(bundleMeta);
-						const auto* metadata = static_cast<const COpenEXRMetadata::CImage*>(exrmeta->getAssetSpecificMetadata(core::smart_refctd_ptr_static_cast<ICPUImage>(asset).get()));
+		auto color = getImageAssetGivenChannelName(color_image_bundle,colorChannelNameBundle[i]);
+		decltype(color) albedo = getImageAssetGivenChannelName(albedo_image_bundle,albedoChannelNameBundle[i]);
+		decltype(color) normal = getImageAssetGivenChannelName(normal_image_bundle,normalChannelNameBundle[i]);
 
-						if (strcmp(exrmeta->getLoaderName(), COpenEXRMetadata::LoaderName) != 0)
-							continue;
-						else
-						{
-							const auto& assetMetaChannelName = metadata->m_name;
-							auto found = assetMetaChannelName.find(channelName.value());
-							if (found >= firstChannelNameOccurence)
-								continue;
-							firstChannelNameOccurence = found;
-							pickedChannel = std::distance(contents.begin(), &asset);
-						}
-					}
-
-				return asset::IAsset::castDown<ICPUImage>(contents.begin()[pickedChannel]);
-			};
-
-			auto color = getImageAssetGivenChannelName(color_image_bundle,colorChannelNameBundle[i]);
-			decltype(color) albedo = getImageAssetGivenChannelName(albedo_image_bundle,albedoChannelNameBundle[i]);
-			decltype(color) normal = getImageAssetGivenChannelName(normal_image_bundle,normalChannelNameBundle[i]);
-
-			decltype(color) kernel = getImageAssetGivenChannelName(kernel_image_bundle,{});
+		decltype(color) kernel = getImageAssetGivenChannelName(kernel_image_bundle,{});
+		if (!kernel)
+		{
+			kernel = getImageAssetGivenChannelName(default_kernel_image_bundle,{});
 			if (!kernel)
 			{
-				kernel = getImageAssetGivenChannelName(default_kernel_image_bundle,{});
-				if (!kernel)
-				{
-					os::Printer::log(imageIDString+"Could not load default Bloom Kernel Image, denoise will be skipped!", ELL_ERROR);
-					continue;
-				}
+				os::Printer::log(imageIDString+"Could not load default Bloom Kernel Image, denoise will be skipped!", ELL_ERROR);
+				return {};
 			}
+		}
 
-			auto putImageIntoImageToDenoise = [&](asset::SAssetBundle& queriedBundle, core::smart_refctd_ptr<ICPUImage>&& queriedImage, E_IMAGE_INPUT defaultEII, const std::optional<std::string>& actualWantedChannel)
+		auto putImageIntoImageToDenoise = [&](asset::SAssetBundle& queriedBundle, core::smart_refctd_ptr<ICPUImage>&& queriedImage, E_IMAGE_INPUT defaultEII, const std::optional<std::string>& actualWantedChannel)
+		{
+			outParam.image[defaultEII] = nullptr;
+			if (!queriedImage)
 			{
-				outParam.image[defaultEII] = nullptr;
-				if (!queriedImage)
+				switch (defaultEII)
 				{
-					switch (defaultEII)
+					case EII_ALBEDO:
 					{
-						case EII_ALBEDO:
-						{
-							os::Printer::log("INFO (" + std::to_string(__LINE__) + " line): Running in mode without albedo channel!", ELL_INFORMATION);
-						} break;
-						case EII_NORMAL:
-						{
-							os::Printer::log("INFO (" + std::to_string(__LINE__) + " line): Running in mode without normal channel!", ELL_INFORMATION);
-						} break;
-					}
-					return;
+						os::Printer::log("INFO (" + std::to_string(__LINE__) + " line): Running in mode without albedo channel!", ELL_INFORMATION);
+					} break;
+					case EII_NORMAL:
+					{
+						os::Printer::log("INFO (" + std::to_string(__LINE__) + " line): Running in mode without normal channel!", ELL_INFORMATION);
+					} break;
 				}
+				return;
+			}
 
-				const auto* bundleMeta = queriedBundle.getMetadata();
-				const auto* exrmeta = static_cast<const COpenEXRMetadata*>(bundleMeta);
-				const auto* metadata = static_cast<const COpenEXRMetadata::CImage*>(exrmeta->getAssetSpecificMetadata(queriedImage.get()));
+			const auto* bundleMeta = queriedBundle.getMetadata();
+			const auto* exrmeta = static_cast<const COpenEXRMetadata*>(bundleMeta);
+			const auto* metadata = static_cast<const COpenEXRMetadata::CImage*>(exrmeta->getAssetSpecificMetadata(queriedImage.get()));
 
-				if (strcmp(exrmeta->getLoaderName(), COpenEXRMetadata::LoaderName)!=0)
-					os::Printer::log("WARNING (" + std::to_string(__LINE__) + "): "+ imageIDString+" is not an EXR file, so there are no multiple layers of channels.", ELL_WARNING);
-				else if (!actualWantedChannel.has_value())
-					os::Printer::log("WARNING (" + std::to_string(__LINE__) + "): User did not specify channel choice for "+ imageIDString+" using the default (first).", ELL_WARNING);
-				else if (metadata->m_name!=actualWantedChannel.value())
-				{
-					os::Printer::log("WARNING (" + std::to_string(__LINE__) + "): Using best fit channel \""+ metadata->m_name +"\" for requested \""+actualWantedChannel.value()+"\" out of "+ imageIDString+"!", ELL_WARNING);
-				}
-				outParam.image[defaultEII] = std::move(queriedImage);
-			};
+			if (strcmp(exrmeta->getLoaderName(), COpenEXRMetadata::LoaderName)!=0)
+				os::Printer::log("WARNING (" + std::to_string(__LINE__) + "): "+ imageIDString+" is not an EXR file, so there are no multiple layers of channels.", ELL_WARNING);
+			else if (!actualWantedChannel.has_value())
+				os::Printer::log("WARNING (" + std::to_string(__LINE__) + "): User did not specify channel choice for "+ imageIDString+" using the default (first).", ELL_WARNING);
+			else if (metadata->m_name!=actualWantedChannel.value())
+			{
+				os::Printer::log("WARNING (" + std::to_string(__LINE__) + "): Using best fit channel \""+ metadata->m_name +"\" for requested \""+actualWantedChannel.value()+"\" out of "+ imageIDString+"!", ELL_WARNING);
+			}
+			outParam.image[defaultEII] = std::move(queriedImage);
+		};
+
+		putImageIntoImageToDenoise(color_image_bundle, std::move(color), EII_COLOR, colorChannelNameBundle[i]);
+		putImageIntoImageToDenoise(albedo_image_bundle, std::move(albedo), EII_ALBEDO, albedoChannelNameBundle[i]);
+		putImageIntoImageToDenoise(normal_image_bundle, std::move(normal), EII_NORMAL, normalChannelNameBundle[i]);
+		outParam.kernel = std::move(kernel);
 
-			putImageIntoImageToDenoise(color_image_bundle, std::move(color), EII_COLOR, colorChannelNameBundle[i]);
-			putImageIntoImageToDenoise(albedo_image_bundle, std::move(albedo), EII_ALBEDO, albedoChannelNameBundle[i]);
-			putImageIntoImageToDenoise(normal_image_bundle, std::move(normal), EII_NORMAL, normalChannelNameBundle[i]);
-			outParam.kernel = std::move(kernel);
-		}
-		// check inputs and set-up
-		for (size_t i=0; i<inputFilesAmount; i++)
 		{
-			auto imageIDString = makeImageIDString(i);
+			auto* colorImage = outParam.image[EII_COLOR].get();
+			if (!colorImage)
+			{
+				os::Printer::log(imageIDString+"Could not find the Color Channel for denoising, image will be skipped!", ELL_ERROR);
+				return {};
+			}
 
-			auto& outParam = images[i];
+			const auto& colorCreationParams = colorImage->getCreationParameters();
+			const auto& extent = colorCreationParams.extent;
+			// compute storage size and check if we can successfully upload
 			{
-				auto* colorImage = outParam.image[EII_COLOR].get();
-				if (!colorImage)
-				{
-					os::Printer::log(imageIDString+"Could not find the Color Channel for denoising, image will be skipped!", ELL_ERROR);
-					outParam = {};
-					continue;
-				}
+				auto regions = colorImage->getRegions();
+				assert(regions.begin()+1u==regions.end());
 
-				const auto& colorCreationParams = colorImage->getCreationParameters();
-				const auto& extent = colorCreationParams.extent;
-				// compute storage size and check if we can successfully upload
-				{
-					auto regions = colorImage->getRegions();
-					assert(regions.begin()+1u==regions.end());
+				const auto& region = regions.begin()[0];
+				assert(region.bufferRowLength);
+				outParam.colorTexelSize = asset::getTexelOrBlockBytesize(colorCreationParams.format);
+			}
 
-					const auto& region = regions.begin()[0];
-					assert(region.bufferRowLength);
-					outParam.colorTexelSize = asset::getTexelOrBlockBytesize(colorCreationParams.format);
+			const float bloomRelativeScale = bloomRelativeScaleBundle[i].value();
+			{
+				auto kerDim = outParam.kernel->getCreationParameters().extent;
+				float kernelScale,minKernelScale;
+				if (extent.width<extent.height)
+				{
+					minKernelScale = 2.f/float(kerDim.width);
+					kernelScale = float(extent.width)*bloomRelativeScale/float(kerDim.width);
 				}
-
-				const float bloomRelativeScale = bloomRelativeScaleBundle[i].value();
+				else
 				{
-					auto kerDim = outParam.kernel->getCreationParameters().extent;
-					float kernelScale,minKernelScale;
-					if (extent.width<extent.height)
-					{
-						minKernelScale = 2.f/float(kerDim.width);
-						kernelScale = float(extent.width)*bloomRelativeScale/float(kerDim.width);
-					}
-					else
-					{
-						minKernelScale = 2.f/float(kerDim.height);
-						kernelScale = float(extent.height)*bloomRelativeScale/float(kerDim.height);
-					}
-					//
-					if (kernelScale>1.f)
-						os::Printer::log(imageIDString + "Bloom Kernel loose sharpness, increase resolution of bloom kernel or reduce its relative scale!", ELL_WARNING);
-					else if (kernelScale<minKernelScale)
-						os::Printer::log(imageIDString + "Bloom Kernel relative scale pathologically small, clamping to prevent division by 0!", ELL_WARNING);
-					outParam.scaledKernelExtent.width = core::max(core::ceil(float(kerDim.width)*kernelScale),2u);
-					outParam.scaledKernelExtent.height = core::max(core::ceil(float(kerDim.height)*kernelScale),2u);
-					outParam.scaledKernelExtent.depth = 1u;
+					minKernelScale = 2.f/float(kerDim.height);
+					kernelScale = float(extent.height)*bloomRelativeScale/float(kerDim.height);
 				}
-				const auto marginSrcDim = [extent,outParam]() -> auto
+				//
+				if (kernelScale>1.f)
+					os::Printer::log(imageIDString + "Bloom Kernel loose sharpness, increase resolution of bloom kernel or reduce its relative scale!", ELL_WARNING);
+				else if (kernelScale<minKernelScale)
+					os::Printer::log(imageIDString + "Bloom Kernel relative scale pathologically small, clamping to prevent division by 0!", ELL_WARNING);
+				outParam.scaledKernelExtent.width = core::max(core::ceil(float(kerDim.width)*kernelScale),2u);
+				outParam.scaledKernelExtent.height = core::max(core::ceil(float(kerDim.height)*kernelScale),2u);
+				outParam.scaledKernelExtent.depth = 1u;
+			}
+			const auto marginSrcDim = [extent,outParam]() -> auto
+			{
+				auto tmp = extent;
+				for (auto i=0u; i<3u; i++)
 				{
-					auto tmp = extent;
-					for (auto i=0u; i<3u; i++)
-					{
-						const auto coord = (&outParam.scaledKernelExtent.width)[i];
-						if (coord>1u)
-							(&tmp.width)[i] += coord-1u;
-					}
-					return tmp;
-				}();
-				fftScratchSize = core::max(FFTClass::getOutputBufferSize(usingHalfFloatFFTStorage,outParam.scaledKernelExtent,colorChannelsFFT)*2u,fftScratchSize);
-				fftScratchSize = core::max(FFTClass::getOutputBufferSize(usingHalfFloatFFTStorage,marginSrcDim,colorChannelsFFT),fftScratchSize);
-				// TODO: maybe move them to nested loop and compute JIT
+					const auto coord = (&outParam.scaledKernelExtent.width)[i];
+					if (coord>1u)
+						(&tmp.width)[i] += coord-1u;
+				}
+				return tmp;
+			}();
+			if (core::max(core::roundUpToPoT(marginSrcDim.width),core::roundUpToPoT(marginSrcDim.height))>MaxBloomFFTSize)
+			{
+				os::Printer::log(imageIDString+"Bloom would need an FFT bigger than "+std::to_string(MaxBloomFFTSize)+", image will be skipped! Run it with -CPU_BLOOM which does the bloom in tiles.", ELL_ERROR);
+				return {};
+			}
+			outParam.fftScratchSize = core::max(FFTClass::getOutputBufferSize(usingHalfFloatFFTStorage,outParam.scaledKernelExtent,packedChannelsFFT)*2u,outParam.fftScratchSize);
+			outParam.fftScratchSize = core::max(FFTClass::getOutputBufferSize(usingHalfFloatFFTStorage,marginSrcDim,packedChannelsFFT),outParam.fftScratchSize);
+			// TODO: maybe move them to nested loop and compute JIT
+			{
+				auto* fftPushConstants = outParam.fftPushConstants;
+				auto* fftDispatchInfo = outParam.fftDispatchInfo;
+				const ISampler::E_TEXTURE_CLAMP fftPadding[2] = {ISampler::ETC_MIRROR,ISampler::ETC_MIRROR};
+				const auto passes = FFTClass::buildParameters<false>(false,packedChannelsFFT,extent,fftPushConstants,fftDispatchInfo,fftPadding,marginSrcDim);
 				{
-					auto* fftPushConstants = outParam.fftPushConstants;
-					auto* fftDispatchInfo = outParam.fftDispatchInfo;
-					const ISampler::E_TEXTURE_CLAMP fftPadding[2] = {ISampler::ETC_MIRROR,ISampler::ETC_MIRROR};
-					const auto passes = FFTClass::buildParameters<false>(false,colorChannelsFFT,extent,fftPushConstants,fftDispatchInfo,fftPadding,marginSrcDim);
+					// override for less work and storage (dont need to store the extra padding of the last axis after iFFT)
+					fftPushConstants[1].output_strides.x = fftPushConstants[0].input_strides.x;
+					fftPushConstants[1].output_strides.y = fftPushConstants[0].input_strides.y;
+					fftPushConstants[1].output_strides.z = fftPushConstants[1].input_strides.z;
+					fftPushConstants[1].output_strides.w = fftPushConstants[1].input_strides.w;
+					// iFFT
+					fftPushConstants[2].input_dimensions = fftPushConstants[1].input_dimensions;
 					{
-						// override for less work and storage (dont need to store the extra padding of the last axis after iFFT)
-						fftPushConstants[1].output_strides.x = fftPushConstants[0].input_strides.x;
-						fftPushConstants[1].output_strides.y = fftPushConstants[0].input_strides.y;
-						fftPushConstants[1].output_strides.z = fftPushConstants[1].input_strides.z;
-						fftPushConstants[1].output_strides.w = fftPushConstants[1].input_strides.w;
-						// iFFT
-						fftPushConstants[2].input_dimensions = fftPushConstants[1].input_dimensions;
-						{
-							fftPushConstants[2].input_dimensions.w = fftPushConstants[0].input_dimensions.w^0x80000000u;
-							fftPushConstants[2].input_strides = fftPushConstants[1].output_strides;
-							fftPushConstants[2].output_strides = fftPushConstants[0].input_strides;
-						}
-						fftDispatchInfo[2] = fftDispatchInfo[0];
+						fftPushConstants[2].input_dimensions.w = fftPushConstants[0].input_dimensions.w^0x80000000u;
+						fftPushConstants[2].input_strides = fftPushConstants[1].output_strides;
+						fftPushConstants[2].output_strides = fftPushConstants[0].input_strides;
 					}
-					assert(passes==2);
+					fftDispatchInfo[2] = fftDispatchInfo[0];
 				}
+				assert(passes==2);
+			}
 
-				outParam.denoiserType = EII_COLOR;
+			outParam.denoiserType = EII_COLOR;
 
-				outParam.width = extent.width;
-				outParam.height = extent.height;
+			outParam.width = extent.width;
+			outParam.height = extent.height;
 
-				outParam.bloomIntensity = bloomIntensityBundle[i].value();
+			outParam.bloomIntensity = bloomIntensityBundle[i].value();
+		}
 
-				maxResolution[0] = core::max(maxResolution[0], outParam.width);
-				maxResolution[1] = core::max(maxResolution[1], outParam.height);
+		auto& albedoImage = outParam.image[EII_ALBEDO];
+		if (albedoImage)
+		{
+			auto extent = albedoImage->getCreationParameters().extent;
+			if (extent.width!=outParam.width || extent.height!=outParam.height)
+			{
+				os::Printer::log(imageIDString + "Image extent of the Albedo Channel does not match the Color Channel, Albedo Channel will not be used!", ELL_ERROR);
+				albedoImage = nullptr;
 			}
+			else
+				outParam.denoiserType = EII_ALBEDO;
+		}
 
-			auto& albedoImage = outParam.image[EII_ALBEDO];
-			if (albedoImage)
+		auto& normalImage = outParam.image[EII_NORMAL];
+		if (normalImage)
+		{
+			auto extent = normalImage->getCreationParameters().extent;
+			if (extent.width != outParam.width || extent.height != outParam.height)
 			{
-				auto extent = albedoImage->getCreationParameters().extent;
-				if (extent.width!=outParam.width || extent.height!=outParam.height)
-				{
-					os::Printer::log(imageIDString + "Image extent of the Albedo Channel does not match the Color Channel, Albedo Channel will not be used!", ELL_ERROR);
-					albedoImage = nullptr;
-				}
-				else
-					outParam.denoiserType = EII_ALBEDO;
+				os::Printer::log(imageIDString + "Image extent of the Normal Channel does not match the Color Channel, Normal Channel will not be used!", ELL_ERROR);
+				normalImage = nullptr;
 			}
-
-			auto& normalImage = outParam.image[EII_NORMAL];
-			if (normalImage)
+			else if (!albedoImage)
 			{
-				auto extent = normalImage->getCreationParameters().extent;
-				if (extent.width != outParam.width || extent.height != outParam.height)
-				{
-					os::Printer::log(imageIDString + "Image extent of the Normal Channel does not match the Color Channel, Normal Channel will not be used!", ELL_ERROR);
-					normalImage = nullptr;
-				}
-				else if (!albedoImage)
-				{
-					os::Printer::log(imageIDString + "Invalid Albedo Channel for denoising, Normal Channel will not be used!", ELL_ERROR);
-					normalImage = nullptr;
-				}
-				else
-					outParam.denoiserType = EII_NORMAL;
+				os::Printer::log(imageIDString + "Invalid Albedo Channel for denoising, Normal Channel will not be used!", ELL_ERROR);
+				normalImage = nullptr;
 			}
+			else
+				outParam.denoiserType = EII_NORMAL;
 		}
-	}
+
+		return outParam;
+	};
 
 	// keep all CUDA links in an array (less code to map/unmap)
 	constexpr uint32_t kMaxDenoiserBuffers = calcDenoiserBuffersNeeded(EII_NORMAL);
@@ -1150,9 +1441,9 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 	auto& normalPixelBuffer = bufferLinks[5];
 	//auto denoised;
 	size_t denoiserStateBufferSize = 0ull;
+	size_t denoiserScratchSize = 0ull;
+	uint32_t maxDenoiserInputs = 0u;
 	{
-		size_t scratchBufferSize = fftScratchSize;
-		size_t tempBufferSize = fftScratchSize;
 		for (uint32_t i=0u; i<EII_COUNT; i++)
 		{
 			auto& denoiser = denoisers[i].m_denoiser;
@@ -1170,35 +1461,140 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 
 			denoisers[i].stateOffset = denoiserStateBufferSize;
 			denoiserStateBufferSize += denoisers[i].stateSize = m_denoiserMemReqs.stateSizeInBytes;
-			scratchBufferSize = core::max(scratchBufferSize, denoisers[i].scratchSize = m_denoiserMemReqs.withOverlapScratchSizeInBytes);
-			tempBufferSize = core::max(tempBufferSize,forcedOptiXFormatPixelStride*(i+1)*maxResolution[0]*maxResolution[1]);
+			denoiserScratchSize = core::max(denoiserScratchSize, denoisers[i].scratchSize = m_denoiserMemReqs.withOverlapScratchSizeInBytes);
+			maxDenoiserInputs = i+1u;
 		}
-		std::string message = "Total VRAM consumption for Denoiser algorithm: ";
-		os::Printer::log(message+std::to_string(denoiserStateBufferSize+scratchBufferSize+tempBufferSize), ELL_INFORMATION);
 
-		if (check_error(tempBufferSize==0ull,"No input files at all!"))
+		if (check_error(inputFilesAmount==0u,"No input files at all!"))
 			return error_code;
 
 		denoiserState = driver->createDeviceLocalGPUBufferOnDedMem(denoiserStateBufferSize+IntensityValuesSize);
 		if (check_error(!cuda::CCUDAHandler::defaultHandleResult(cuda::CCUDAHandler::registerBuffer(&denoiserState)),"Could not register buffer for Denoiser states!"))
 			return error_code;
+	}
+	// the inputs only get loaded as the batch goes, so the scratch and pixel buffers grow to fit the largest input so far (usually just once, batches tend to share a resolution)
+	uint32_t maxResolution[2] = { 0,0 };
+	uint32_t fftScratchSize = 0u;
+	auto reserveDenoiserBuffers = [&](const ImageToDenoise& param) -> bool
+	{
+		if (param.width<=maxResolution[0] && param.height<=maxResolution[1] && param.fftScratchSize<=fftScratchSize)
+			return true;
+		maxResolution[0] = core::max(maxResolution[0], param.width);
+		maxResolution[1] = core::max(maxResolution[1], param.height);
+		fftScratchSize = core::max(fftScratchSize, param.fftScratchSize);
+
+		const size_t scratchBufferSize = core::max<size_t>(fftScratchSize,denoiserScratchSize);
+		const size_t tempBufferSize = core::max<size_t>(fftScratchSize,forcedOptiXFormatPixelStride*maxDenoiserInputs*maxResolution[0]*maxResolution[1]);
+		std::string message = "Total VRAM consumption for Denoiser algorithm: ";
+		os::Printer::log(message+std::to_string(denoiserStateBufferSize+scratchBufferSize+tempBufferSize), ELL_INFORMATION);
 
 		temporaryPixelBuffer = driver->createDeviceLocalGPUBufferOnDedMem(tempBufferSize);
 		if (check_error(!cuda::CCUDAHandler::defaultHandleResult(cuda::CCUDAHandler::registerBuffer(&temporaryPixelBuffer)),"Could not register buffer for Denoiser scratch memory!"))
-			return error_code;
+			return false;
 		scratch = driver->createDeviceLocalGPUBufferOnDedMem(scratchBufferSize);
 		if (check_error(!cuda::CCUDAHandler::defaultHandleResult(cuda::CCUDAHandler::registerBuffer(&scratch)), "Could not register buffer for Denoiser temporary memory with CUDA natively!"))
-			return error_code;
-	}
+			return false;
+		return true;
+	};
 	const auto intensityBufferOffset = denoiserStateBufferSize;
 
-	video::CAssetPreservingGPUObjectFromAssetConverter assetConverter(am,driver);
-	// do the processing
+	// kernel spectra get reused between inputs, they're small so a handful of different PSFs or scales can stay resident
+	using GPUSpectrum = std::array<core::smart_refctd_ptr<IGPUImageView>,colorChannelsFFT>;
+	using GPUSpectrumCache = KernelSpectrumCache<GPUSpectrum>;
+	GPUSpectrumCache gpuSpectrumCache(16u);
+	// the dithering for the LDR outputs, shared by every frame's write
+	core::smart_refctd_ptr<ICPUImageView> ditheringImageView;
+	{
+		auto ditheringBundle = am->getAsset("../../media/blueNoiseDithering/LDR_RGBA.png", {});
+		const auto ditheringStatus = ditheringBundle.getContents().empty();
+		if (ditheringStatus)
+		{
+			os::Printer::log("ERROR (" + std::to_string(__LINE__) + " line): Could not load the dithering image!", ELL_ERROR);
+			assert(ditheringStatus);
+		}
+		auto ditheringImage = core::smart_refctd_ptr_static_cast<asset::ICPUImage>(ditheringBundle.getContents().begin()[0]);
+
+		ICPUImageView::SCreationParams imageViewInfo;
+		imageViewInfo.image = ditheringImage;
+		imageViewInfo.format = ditheringImage->getCreationParameters().format;
+		imageViewInfo.viewType = decltype(imageViewInfo.viewType)::ET_2D;
+		imageViewInfo.components = {};
+		imageViewInfo.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
+		imageViewInfo.subresourceRange.baseArrayLayer = 0u;
+		imageViewInfo.subresourceRange.baseMipLevel = 0u;
+		imageViewInfo.subresourceRange.layerCount = ditheringImage->getCreationParameters().arrayLayers;
+		imageViewInfo.subresourceRange.levelCount = ditheringImage->getCreationParameters().mipLevels;
+
+		ditheringImageView = ICPUImageView::create(std::move(imageViewInfo));
+	}
+	auto getConvertedImageView = [&ditheringImageView](core::smart_refctd_ptr<ICPUImage> image, const E_FORMAT& outFormat)
+	{
+		using CONVERSION_FILTER = CConvertFormatImageFilter<EF_UNKNOWN,EF_UNKNOWN,asset::CPrecomputedDither,void,true>;
+
+		core::smart_refctd_ptr<ICPUImage> newConvertedImage;
+		{
+			auto referenceImageParams = image->getCreationParameters();
+			auto referenceBuffer = image->getBuffer();
+			auto referenceRegions = image->getRegions();
+			auto referenceRegion = referenceRegions.begin();
+			const auto newTexelOrBlockByteSize = asset::getTexelOrBlockBytesize(outFormat);
+
+			auto newImageParams = referenceImageParams;
+			auto newCpuBuffer = core::make_smart_refctd_ptr<ICPUBuffer>(referenceRegion->getExtent().width * referenceRegion->getExtent().height * referenceRegion->getExtent().depth * newTexelOrBlockByteSize);
+			auto newRegions = core::make_refctd_dynamic_array<core::smart_refctd_dynamic_array<ICPUImage::SBufferCopy>>(1);
+
+			*newRegions->begin() = *referenceRegion;
+
+			newImageParams.format = outFormat;
+			newConvertedImage = ICPUImage::create(std::move(newImageParams));
+			newConvertedImage->setBufferAndRegions(std::move(newCpuBuffer), newRegions);
+
+			CONVERSION_FILTER convertFilter;
+			CONVERSION_FILTER::state_type state;
+			
+			state.ditherState = _NBL_NEW(std::remove_pointer<decltype(state.ditherState)>::type, ditheringImageView.get());
+
+			state.inImage = image.get();
+			state.outImage = newConvertedImage.get();
+			state.inOffset = { 0, 0, 0 };
+			state.inBaseLayer = 0;
+			state.outOffset = { 0, 0, 0 };
+			state.outBaseLayer = 0;
+
+			auto region = newConvertedImage->getRegions().begin();
+
+			state.extent = region->getExtent();
+			state.layerCount = region->imageSubresource.layerCount;
+			state.inMipLevel = region->imageSubresource.mipLevel;
+			state.outMipLevel = region->imageSubresource.mipLevel;
+
+			if (!convertFilter.execute(core::execution::par_unseq,&state))
+				os::Printer::log("WARNING (" + std::to_string(__LINE__) + " line): Something went wrong while converting the image!", ELL_WARNING);
+
+			_NBL_DELETE(state.ditherState);
+		}
+
+		// create image view
+		ICPUImageView::SCreationParams imgViewParams;
+		imgViewParams.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
+		imgViewParams.format = newConvertedImage->getCreationParameters().format;
+		imgViewParams.image = std::move(newConvertedImage);
+		imgViewParams.viewType = ICPUImageView::ET_2D;
+		imgViewParams.subresourceRange = { static_cast<IImage::E_ASPECT_FLAGS>(0u),0u,1u,0u,1u };
+		auto newImageView = ICPUImageView::create(std::move(imgViewParams));
+
+		return newImageView;
+	};
+
+	// do the processing, with the next frames loading and the previous ones getting written out meanwhile
+	BatchPipeline<ImageToDenoise> pipeline(inputFilesAmount,pipelineDepth,loadInput);
 	for (size_t i=0; i<inputFilesAmount; i++)
 	{
-		auto& param = images[i];
+		auto param = pipeline.acquire(i);
 		if (param.denoiserType>=EII_COUNT)
 			continue;
+		if (!reserveDenoiserBuffers(param))
+			return error_code;
 		const auto denoiserInputCount = param.denoiserType+1u;
 
 		// set up the constants (partially)
@@ -1283,12 +1679,18 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 				printf("[ERROR] Denoiser Failed, input too large to fit in VRAM, Streaming Denoise not implemented yet!");
 				return -1;
 			}
-			auto gpubuffers = driver->getGPUObjectsFromAssets(buffersToUpload,buffersToUpload+denoiserInputCount,&assetConverter);
+			// straight through the streaming staging buffer, the asset converter would need the (not thread-safe) asset manager's GPU object cache
+			core::smart_refctd_ptr<IGPUBuffer> gpubuffers[EII_COUNT];
+			for (uint32_t j=0u; j<denoiserInputCount; j++)
+			{
+				gpubuffers[j] = driver->createDeviceLocalGPUBufferOnDedMem(buffersToUpload[j]->getSize());
+				driver->updateBufferRangeViaStagingBuffer(gpubuffers[j].get(),0u,buffersToUpload[j]->getSize(),buffersToUpload[j]->getPointer());
+			}
 
 			bool skip = false;
 			auto createLinkAndRegister = [&makeImageIDString,i,&skip,&gpubuffers](auto ix) -> auto
 			{
-				cuda::CCUDAHandler::GraphicsAPIObjLink<IGPUBuffer> retval = core::smart_refctd_ptr<IGPUBuffer>(gpubuffers->operator[](ix)->getBuffer());
+				cuda::CCUDAHandler::GraphicsAPIObjLink<IGPUBuffer> retval = core::smart_refctd_ptr<IGPUBuffer>(gpubuffers[ix]);
 				if (!cuda::CCUDAHandler::defaultHandleResult(cuda::CCUDAHandler::registerBuffer(&retval)))
 				{
 					os::Printer::log(makeImageIDString(i) + "Could not register the image data buffer with CUDA, skipping image!", ELL_ERROR);
@@ -1306,129 +1708,149 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 
 			for (uint32_t j=0u; j<denoiserInputCount; j++)
 			{
-				auto offsetPair = gpubuffers->operator[](j);
-				// make sure cache doesn't retain the GPU object paired to CPU object (could have used a custom IGPUObjectFromAssetConverter derived class with overrides to achieve this)
-				am->removeCachedGPUObject(buffersToUpload[j],offsetPair);
-
 				auto image = param.image[j];
 				const auto& creationParameters = image->getCreationParameters();
 				assert(asset::getTexelOrBlockBytesize(creationParameters.format)==param.colorTexelSize);
 				// set up some image pitch and offset info
 				shaderConstants.inImageTexelPitch[j] = image->getRegions().begin()[0].bufferRowLength;
-				inImageByteOffset[j] = offsetPair->getOffset();
+				inImageByteOffset[j] = 0u;
 			}
 		}
 
 		// process
 		{
-			// get the bloom kernel FFT Spectrum
-			core::smart_refctd_ptr<IGPUImageView> kernelNormalizedSpectrums[colorChannelsFFT];
+			// get the bloom kernel FFT Spectrum, only computed for the first input with this PSF, kernel size and intensity
+			const auto paddedKernelExtent = FFTClass::padDimensions(param.scaledKernelExtent);
+			const GPUSpectrumCache::SKey kernelSpectrumKey = {
+				GPUSpectrumCache::hashPSF(param.kernel.get()),
+				{param.scaledKernelExtent.width,param.scaledKernelExtent.height},
+				{paddedKernelExtent.width,paddedKernelExtent.height},
+				param.bloomIntensity
+			};
+			const auto* cachedKernelSpectrum = gpuSpectrumCache.find(kernelSpectrumKey);
+			if (!cachedKernelSpectrum)
 			{
-				// kernel inputs
-				core::smart_refctd_ptr<IGPUImageView> kerImageView;
+				const auto kernelStart = std::chrono::steady_clock::now();
+				GPUSpectrum kernelNormalizedSpectrums;
 				{
-					auto kerGpuImages = driver->getGPUObjectsFromAssets(&param.kernel, &param.kernel + 1u, &assetConverter);
-
-
-					IGPUImageView::SCreationParams kerImgViewInfo;
-					kerImgViewInfo.flags = static_cast<IGPUImageView::E_CREATE_FLAGS>(0u);
-					kerImgViewInfo.image = kerGpuImages->operator[](0u);
-
-					// make sure cache doesn't retain the GPU object paired to CPU object (could have used a custom IGPUObjectFromAssetConverter derived class with overrides to achieve this)
-					am->removeCachedGPUObject(param.kernel.get(), kerImgViewInfo.image);
+					// kernel inputs
+					core::smart_refctd_ptr<IGPUImageView> kerImageView;
+					{
+						IGPUImageView::SCreationParams kerImgViewInfo;
+						kerImgViewInfo.flags = static_cast<IGPUImageView::E_CREATE_FLAGS>(0u);
+						// uploaded directly for the same reason as the inputs
+						{
+							const auto* kernelBuffer = param.kernel->getBuffer();
+							auto kernelStaging = driver->createFilledDeviceLocalBufferOnDedMem(kernelBuffer->getSize(),kernelBuffer->getPointer());
+							IGPUImage::SCreationParams kernelImageParams = param.kernel->getCreationParameters();
+							kerImgViewInfo.image = driver->createGPUImageOnDedMem(std::move(kernelImageParams),driver->getDeviceLocalGPUMemoryReqs());
+							const auto kernelRegions = param.kernel->getRegions();
+							driver->copyBufferToImage(kernelStaging.get(),kerImgViewInfo.image.get(),kernelRegions.size(),kernelRegions.begin());
+						}
 
-					kerImgViewInfo.viewType = IGPUImageView::ET_2D;
-					kerImgViewInfo.format = kerImgViewInfo.image->getCreationParameters().format;
-					kerImgViewInfo.subresourceRange.aspectMask = static_cast<IImage::E_ASPECT_FLAGS>(0u);
-					kerImgViewInfo.subresourceRange.baseMipLevel = 0;
-					kerImgViewInfo.subresourceRange.levelCount = kerImgViewInfo.image->getCreationParameters().mipLevels;
-					kerImgViewInfo.subresourceRange.baseArrayLayer = 0;
-					kerImgViewInfo.subresourceRange.layerCount = 1;
-					kerImageView = driver->createImageView(std::move(kerImgViewInfo));
-				}
+						kerImgViewInfo.viewType = IGPUImageView::ET_2D;
+						kerImgViewInfo.format = kerImgViewInfo.image->getCreationParameters().format;
+						kerImgViewInfo.subresourceRange.aspectMask = static_cast<IImage::E_ASPECT_FLAGS>(0u);
+						kerImgViewInfo.subresourceRange.baseMipLevel = 0;
+						kerImgViewInfo.subresourceRange.levelCount = kerImgViewInfo.image->getCreationParameters().mipLevels;
+						kerImgViewInfo.subresourceRange.baseArrayLayer = 0;
+						kerImgViewInfo.subresourceRange.layerCount = 1;
+						kerImageView = driver->createImageView(std::move(kerImgViewInfo));
+					}
 
-				// kernel outputs
-				auto paddedKernelExtent = FFTClass::padDimensions(param.scaledKernelExtent);
-				for (uint32_t i=0u; i<colorChannelsFFT; i++)
-				{
-					video::IGPUImage::SCreationParams imageParams;
-					imageParams.flags = static_cast<asset::IImage::E_CREATE_FLAGS>(0u);
-					imageParams.type = asset::IImage::ET_2D;
-					imageParams.format = EF_R32G32_SFLOAT;
-					imageParams.extent = {paddedKernelExtent.width,paddedKernelExtent.height,1u};
-					imageParams.mipLevels = 1u;
-					imageParams.arrayLayers = 1u;
-					imageParams.samples = asset::IImage::ESCF_1_BIT;
-
-					video::IGPUImageView::SCreationParams viewParams;
-					viewParams.flags = static_cast<video::IGPUImageView::E_CREATE_FLAGS>(0u);
-					viewParams.image = driver->createGPUImageOnDedMem(std::move(imageParams),driver->getDeviceLocalGPUMemoryReqs());
-					viewParams.viewType = video::IGPUImageView::ET_2D;
-					viewParams.format = EF_R32G32_SFLOAT;
-					viewParams.components = {};
-					viewParams.subresourceRange = {};
-					viewParams.subresourceRange.levelCount = 1u;
-					viewParams.subresourceRange.layerCount = 1u;
-					kernelNormalizedSpectrums[i] = driver->createImageView(std::move(viewParams));
-				}
+					// kernel outputs
+					for (uint32_t i=0u; i<colorChannelsFFT; i++)
+					{
+						video::IGPUImage::SCreationParams imageParams;
+						imageParams.flags = static_cast<asset::IImage::E_CREATE_FLAGS>(0u);
+						imageParams.type = asset::IImage::ET_2D;
+						imageParams.format = EF_R32G32_SFLOAT;
+						imageParams.extent = {paddedKernelExtent.width,paddedKernelExtent.height,1u};
+						imageParams.mipLevels = 1u;
+						imageParams.arrayLayers = 1u;
+						imageParams.samples = asset::IImage::ESCF_1_BIT;
+
+						video::IGPUImageView::SCreationParams viewParams;
+						viewParams.flags = static_cast<video::IGPUImageView::E_CREATE_FLAGS>(0u);
+						viewParams.image = driver->createGPUImageOnDedMem(std::move(imageParams),driver->getDeviceLocalGPUMemoryReqs());
+						viewParams.viewType = video::IGPUImageView::ET_2D;
+						viewParams.format = EF_R32G32_SFLOAT;
+						viewParams.components = {};
+						viewParams.subresourceRange = {};
+						viewParams.subresourceRange.levelCount = 1u;
+						viewParams.subresourceRange.layerCount = 1u;
+						kernelNormalizedSpectrums[i] = driver->createImageView(std::move(viewParams));
+					}
 
-				//
-				FFTClass::Parameters_t fftPushConstants[2];
-				FFTClass::DispatchInfo_t fftDispatchInfo[2];
-				const ISampler::E_TEXTURE_CLAMP fftPadding[2] = { ISampler::ETC_CLAMP_TO_BORDER,ISampler::ETC_CLAMP_TO_BORDER };
-				const auto passes = FFTClass::buildParameters(false,colorChannelsFFT,param.scaledKernelExtent,fftPushConstants,fftDispatchInfo,fftPadding);
+					//
+					FFTClass::Parameters_t fftPushConstants[2];
+					FFTClass::DispatchInfo_t fftDispatchInfo[2];
+					const ISampler::E_TEXTURE_CLAMP fftPadding[2] = { ISampler::ETC_CLAMP_TO_BORDER,ISampler::ETC_CLAMP_TO_BORDER };
+					const auto passes = FFTClass::buildParameters(false,packedChannelsFFT,param.scaledKernelExtent,fftPushConstants,fftDispatchInfo,fftPadding);
 
-				// the kernel's FFTs
-				{
-					auto kernelDescriptorSet = driver->createDescriptorSet(core::smart_refctd_ptr(kernelDescriptorSetLayout));
+					// the kernel's FFTs
 					{
-						IGPUDescriptorSet::SDescriptorInfo infos[kernelSetDescCount+colorChannelsFFT-1u];
-						infos[0].desc = kerImageView;
-						infos[0].image.sampler = nullptr; // immutable
-						infos[1].desc = core::smart_refctd_ptr<IGPUBuffer>(temporaryPixelBuffer.getObject());
-						infos[1].buffer = {0u,fftScratchSize>>1u};
-						infos[2].desc = core::smart_refctd_ptr<IGPUBuffer>(temporaryPixelBuffer.getObject());
-						infos[2].buffer = {fftScratchSize>>1u,fftScratchSize};
-						for (uint32_t i=0u; i<colorChannelsFFT; i++)
+						auto kernelDescriptorSet = driver->createDescriptorSet(core::smart_refctd_ptr(kernelDescriptorSetLayout));
 						{
-							infos[3+i].desc = kernelNormalizedSpectrums[i];
-							infos[3+i].image.sampler = nullptr; // storage
+							IGPUDescriptorSet::SDescriptorInfo infos[kernelSetDescCount+colorChannelsFFT-1u];
+							infos[0].desc = kerImageView;
+							infos[0].image.sampler = nullptr; // immutable
+							infos[1].desc = core::smart_refctd_ptr<IGPUBuffer>(temporaryPixelBuffer.getObject());
+							infos[1].buffer = {0u,fftScratchSize>>1u};
+							infos[2].desc = core::smart_refctd_ptr<IGPUBuffer>(temporaryPixelBuffer.getObject());
+							infos[2].buffer = {fftScratchSize>>1u,fftScratchSize};
+							for (uint32_t i=0u; i<colorChannelsFFT; i++)
+							{
+								infos[3+i].desc = kernelNormalizedSpectrums[i];
+								infos[3+i].image.sampler = nullptr; // storage
+							}
+							IGPUDescriptorSet::SWriteDescriptorSet writes[kernelSetDescCount] =
+							{
+								{kernelDescriptorSet.get(),0u,0u,1u,EDT_COMBINED_IMAGE_SAMPLER,infos+0u},
+								{kernelDescriptorSet.get(),1u,0u,1u,EDT_STORAGE_BUFFER,infos+1u},
+								{kernelDescriptorSet.get(),2u,0u,1u,EDT_STORAGE_BUFFER,infos+2u},
+								{kernelDescriptorSet.get(),3u,0u,colorChannelsFFT,EDT_STORAGE_IMAGE,infos+3u}
+							};
+							driver->updateDescriptorSets(kernelSetDescCount,writes,0u,nullptr);
 						}
-						IGPUDescriptorSet::SWriteDescriptorSet writes[kernelSetDescCount] =
-						{
-							{kernelDescriptorSet.get(),0u,0u,1u,EDT_COMBINED_IMAGE_SAMPLER,infos+0u},
-							{kernelDescriptorSet.get(),1u,0u,1u,EDT_STORAGE_BUFFER,infos+1u},
-							{kernelDescriptorSet.get(),2u,0u,1u,EDT_STORAGE_BUFFER,infos+2u},
-							{kernelDescriptorSet.get(),3u,0u,colorChannelsFFT,EDT_STORAGE_IMAGE,infos+3u}
-						};
-						driver->updateDescriptorSets(kernelSetDescCount,writes,0u,nullptr);
-					}
-					driver->bindDescriptorSets(EPBP_COMPUTE,kernelPipelineLayout.get(),0u,1u,&kernelDescriptorSet.get(),nullptr);
+						driver->bindDescriptorSets(EPBP_COMPUTE,kernelPipelineLayout.get(),0u,1u,&kernelDescriptorSet.get(),nullptr);
 
-					// Ker Image First Axis FFT
-					driver->bindComputePipeline(firstKernelFFTPipeline.get());
-					FFTClass::dispatchHelper(driver,kernelPipelineLayout.get(),fftPushConstants[0],fftDispatchInfo[0]);
+						// Ker Image First Axis FFT
+						driver->bindComputePipeline(firstKernelFFTPipeline.get());
+						FFTClass::dispatchHelper(driver,kernelPipelineLayout.get(),fftPushConstants[0],fftDispatchInfo[0]);
 
-					// Ker Image Last Axis FFT
-					driver->bindComputePipeline(lastKernelFFTPipeline.get());
-					FFTClass::dispatchHelper(driver,kernelPipelineLayout.get(),fftPushConstants[1],fftDispatchInfo[1]);
+						// Ker Image Last Axis FFT
+						driver->bindComputePipeline(lastKernelFFTPipeline.get());
+						FFTClass::dispatchHelper(driver,kernelPipelineLayout.get(),fftPushConstants[1],fftDispatchInfo[1]);
 
-					// normalization and shuffle
-					driver->bindComputePipeline(kernelNormalizationPipeline.get());
-					{
-						NormalizationPushConstants normalizationPC;
-						normalizationPC.stride = fftPushConstants[1].output_strides;
-						normalizationPC.bitreverse_shift[0] = 32-core::findMSB(paddedKernelExtent.width);
-						normalizationPC.bitreverse_shift[1] = 32-core::findMSB(paddedKernelExtent.height);
-						normalizationPC.bloomIntensity = param.bloomIntensity;
-						driver->pushConstants(kernelNormalizationPipeline->getLayout(),ICPUSpecializedShader::ESS_COMPUTE,0u,sizeof(normalizationPC),&normalizationPC);
-						const uint32_t dispatchSizeX = (paddedKernelExtent.width-1u)/16u+1u;
-						const uint32_t dispatchSizeY = (paddedKernelExtent.height-1u)/16u+1u;
-						driver->dispatch(dispatchSizeX,dispatchSizeY,colorChannelsFFT);
+						// normalization and shuffle
+						driver->bindComputePipeline(kernelNormalizationPipeline.get());
+						{
+							NormalizationPushConstants normalizationPC;
+							normalizationPC.stride = fftPushConstants[1].output_strides;
+							normalizationPC.bitreverse_shift[0] = 32-core::findMSB(paddedKernelExtent.width);
+							normalizationPC.bitreverse_shift[1] = 32-core::findMSB(paddedKernelExtent.height);
+							normalizationPC.bloomIntensity = param.bloomIntensity;
+							driver->pushConstants(kernelNormalizationPipeline->getLayout(),ICPUSpecializedShader::ESS_COMPUTE,0u,sizeof(normalizationPC),&normalizationPC);
+							const uint32_t dispatchSizeX = (paddedKernelExtent.width-1u)/16u+1u;
+							const uint32_t dispatchSizeY = (paddedKernelExtent.height-1u)/16u+1u;
+							driver->dispatch(dispatchSizeX,dispatchSizeY,colorChannelsFFT);
+						}
+						FFTClass::defaultBarrier();
 					}
-					FFTClass::defaultBarrier();
 				}
+				// wait for the kernel FFTs so the time reported as saved by the cache includes the GPU work
+				auto kernelFence = driver->placeFence(true);
+				constexpr uint64_t timeoutInNanoSeconds = 300000000000u;
+				const auto result = kernelFence->waitCPU(timeoutInNanoSeconds,true);
+				if (result==E_DRIVER_FENCE_RETVAL::EDFR_TIMEOUT_EXPIRED||result==E_DRIVER_FENCE_RETVAL::EDFR_FAIL)
+				{
+					os::Printer::log(makeImageIDString(i)+"Could not compute the Bloom Kernel Spectrum, fence not signalled!",ELL_ERROR);
+					continue;
+				}
+				cachedKernelSpectrum = gpuSpectrumCache.insert(kernelSpectrumKey,std::move(kernelNormalizedSpectrums),std::chrono::steady_clock::now()-kernelStart);
 			}
+			const auto& kernelNormalizedSpectrums = *cachedKernelSpectrum;
 
 			uint32_t outImageByteOffset[EII_COUNT];
 			// bind shader resources
@@ -1595,8 +2017,9 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 						kernel_half_pixel_size.y /= kernelImgExtent.height;
 						driver->pushConstants(convolvePipeline->getLayout(),ISpecializedShader::ESS_COMPUTE,offsetof(CommonPushConstants,kernel_half_pixel_size),sizeof(CommonPushConstants::kernel_half_pixel_size),&kernel_half_pixel_size);
 					}
-					// dispatch
-					driver->dispatch(param.fftDispatchInfo[1].workGroupCount[0],param.fftDispatchInfo[1].workGroupCount[1],1u);
+					// dispatch, one workgroup per pair of mirrored columns
+					const uint32_t columnPairs = (0x1u<<(param.fftPushConstants[0].getLog2FFTSize()-1u))+1u;
+					driver->dispatch(columnPairs,param.fftDispatchInfo[1].workGroupCount[1],1u);
 					COpenGLExtensionHandler::extGlMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
 					// bind intensity pipeline
@@ -1670,11 +2093,6 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 						region.imageOffset = { 0u,0u,0u };
 						region.imageExtent = imgParams.extent;
 					}
-					// the cpu is not touching the data yet because the custom CPUBuffer is adopting the memory (no copy)
-					auto* data = reinterpret_cast<uint8_t*>(downloadStagingArea->getBufferPointer())+address;
-					auto cpubufferalias = core::make_smart_refctd_ptr<asset::CCustomAllocatorCPUBuffer<core::null_allocator<uint8_t> > >(colorBufferBytesize, data, core::adopt_memory);
-					image->setBufferAndRegions(std::move(cpubufferalias),regions);
-
 					// wait for download fence and then invalidate the CPU cache
 					{
 						auto result = downloadFence->waitCPU(timeoutInNanoSeconds,true);
@@ -1687,6 +2105,12 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 						if (downloadStagingArea->needsManualFlushOrInvalidate())
 							driver->invalidateMappedMemoryRanges({{downloadStagingArea->getBuffer()->getBoundMemory(),address,colorBufferBytesize}});
 					}
+
+					// copy out of the staging area so it can be reused right away, the frame gets written out on another thread
+					auto cpubuffer = core::make_smart_refctd_ptr<ICPUBuffer>(colorBufferBytesize);
+					memcpy(cpubuffer->getPointer(),reinterpret_cast<uint8_t*>(downloadStagingArea->getBufferPointer())+address,colorBufferBytesize);
+					downloadStagingArea->multi_free(1u,&address,&colorBufferBytesize,nullptr);
+					image->setBufferAndRegions(std::move(cpubuffer),regions);
 				}
 
 				// create image view
@@ -1699,118 +2123,35 @@ nbl_glsl_complex nbl_glsl_ext_FFT_getPaddedData(ivec3 coordinate, in uint channe
 				imageView = ICPUImageView::create(std::move(imgViewParams));
 			}
 
-			// save as .EXR image
+			// save as .EXR image, then tonemapped as .png and .jpg
+			pipeline.write([am=writerAssetManager.get(),&getConvertedImageView,imageView,outputFile=outputFileBundle[i].value()]() -> void
 			{
-				IAssetWriter::SAssetWriteParams wp(imageView.get());
-				am->writeAsset(outputFileBundle[i].value().c_str(), wp);
-			}
-
-			auto getConvertedImageView = [&](core::smart_refctd_ptr<ICPUImage> image, const E_FORMAT& outFormat)
-			{
-				using CONVERSION_FILTER = CConvertFormatImageFilter<EF_UNKNOWN,EF_UNKNOWN,asset::CPrecomputedDither,void,true>;
-
-				core::smart_refctd_ptr<ICPUImage> newConvertedImage;
 				{
-					auto referenceImageParams = image->getCreationParameters();
-					auto referenceBuffer = image->getBuffer();
-					auto referenceRegions = image->getRegions();
-					auto referenceRegion = referenceRegions.begin();
-					const auto newTexelOrBlockByteSize = asset::getTexelOrBlockBytesize(outFormat);
-
-					auto newImageParams = referenceImageParams;
-					auto newCpuBuffer = core::make_smart_refctd_ptr<ICPUBuffer>(referenceRegion->getExtent().width * referenceRegion->getExtent().height * referenceRegion->getExtent().depth * newTexelOrBlockByteSize);
-					auto newRegions = core::make_refctd_dynamic_array<core::smart_refctd_dynamic_array<ICPUImage::SBufferCopy>>(1);
-
-					*newRegions->begin() = *referenceRegion;
-
-					newImageParams.format = outFormat;
-					newConvertedImage = ICPUImage::create(std::move(newImageParams));
-					newConvertedImage->setBufferAndRegions(std::move(newCpuBuffer), newRegions);
-
-					CONVERSION_FILTER convertFilter;
-					CONVERSION_FILTER::state_type state;
-					
-					auto ditheringBundle = am->getAsset("../../media/blueNoiseDithering/LDR_RGBA.png", {});
-					const auto ditheringStatus = ditheringBundle.getContents().empty();
-					if (ditheringStatus)
-					{
-						os::Printer::log("ERROR (" + std::to_string(__LINE__) + " line): Could not load the dithering image!", ELL_ERROR);
-						assert(ditheringStatus);
-					}
-					auto ditheringImage = core::smart_refctd_ptr_static_cast<asset::ICPUImage>(ditheringBundle.getContents().begin()[0]);
-
-					ICPUImageView::SCreationParams imageViewInfo;
-					imageViewInfo.image = ditheringImage;
-					imageViewInfo.format = ditheringImage->getCreationParameters().format;
-					imageViewInfo.viewType = decltype(imageViewInfo.viewType)::ET_2D;
-					imageViewInfo.components = {};
-					imageViewInfo.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
-					imageViewInfo.subresourceRange.baseArrayLayer = 0u;
-					imageViewInfo.subresourceRange.baseMipLevel = 0u;
-					imageViewInfo.subresourceRange.layerCount = ditheringImage->getCreationParameters().arrayLayers;
-					imageViewInfo.subresourceRange.levelCount = ditheringImage->getCreationParameters().mipLevels;
-
-					auto ditheringImageView = ICPUImageView::create(std::move(imageViewInfo));
-					state.ditherState = _NBL_NEW(std::remove_pointer<decltype(state.ditherState)>::type, ditheringImageView.get());
-
-					state.inImage = image.get();
-					state.outImage = newConvertedImage.get();
-					state.inOffset = { 0, 0, 0 };
-					state.inBaseLayer = 0;
-					state.outOffset = { 0, 0, 0 };
-					state.outBaseLayer = 0;
-
-					auto region = newConvertedImage->getRegions().begin();
-
-					state.extent = region->getExtent();
-					state.layerCount = region->imageSubresource.layerCount;
-					state.inMipLevel = region->imageSubresource.mipLevel;
-					state.outMipLevel = region->imageSubresource.mipLevel;
-
-					if (!convertFilter.execute(core::execution::par_unseq,&state))
-						os::Printer::log("WARNING (" + std::to_string(__LINE__) + " line): Something went wrong while converting the image!", ELL_WARNING);
-
-					_NBL_DELETE(state.ditherState);
+					IAssetWriter::SAssetWriteParams wp(imageView.get());
+					am->writeAsset(outputFile.c_str(), wp);
 				}
 
-				// create image view
-				ICPUImageView::SCreationParams imgViewParams;
-				imgViewParams.flags = static_cast<ICPUImageView::E_CREATE_FLAGS>(0u);
-				imgViewParams.format = newConvertedImage->getCreationParameters().format;
-				imgViewParams.image = std::move(newConvertedImage);
-				imgViewParams.viewType = ICPUImageView::ET_2D;
-				imgViewParams.subresourceRange = { static_cast<IImage::E_ASPECT_FLAGS>(0u),0u,1u,0u,1u };
-				auto newImageView = ICPUImageView::create(std::move(imgViewParams));
-
-				return newImageView;
-			};
-
-			// convert to EF_R8G8B8_SRGB and save it as .png and .jpg
-			{
-				auto newImageView = getConvertedImageView(imageView->getCreationParameters().image, EF_R8G8B8_SRGB);
-				IAssetWriter::SAssetWriteParams wp(newImageView.get());
-				std::string fileName = outputFileBundle[i].value().c_str();
-
-				while (fileName.back() != '.')
-					fileName.pop_back();
-
-				const std::string& nonFormatFileName = fileName;
-				am->writeAsset(nonFormatFileName + "png", wp);
-				am->writeAsset(nonFormatFileName + "jpg", wp);
-			}
-
-			// destroy link to CPUBuffer's data (we need to free it)
-			imageView->convertToDummyObject(~0u);
+				// convert to EF_R8G8B8_SRGB and save it as .png and .jpg
+				{
+					auto newImageView = getConvertedImageView(imageView->getCreationParameters().image, EF_R8G8B8_SRGB);
+					IAssetWriter::SAssetWriteParams wp(newImageView.get());
+					std::string fileName = outputFile;
 
-			// free the staging area allocation (no fence, we've already waited on it)
-			downloadStagingArea->multi_free(1u,&address,&colorBufferBytesize,nullptr);
+					while (fileName.back() != '.')
+						fileName.pop_back();
 
-			// destroy image (implicit)
+					const std::string& nonFormatFileName = fileName;
+					am->writeAsset(nonFormatFileName + "png", wp);
+					am->writeAsset(nonFormatFileName + "jpg", wp);
+				}
+			});
 
 			//
 			driver->endScene();
 		}
 	}
+	os::Printer::log(pipeline.getReport(),ELL_INFORMATION);
+	os::Printer::log(gpuSpectrumCache.getReport(),ELL_INFORMATION);
 
 	return 0;
 }
\ No newline at end of file
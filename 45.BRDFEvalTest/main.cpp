@@ -8,6 +8,8 @@
 #include <nabla.h>
 #include "nbl/ext/ScreenShot/ScreenShot.h"
 
+#include "../common/ShaderCache.hpp"
+
 using namespace nbl;
 using namespace core;
 
@@ -77,7 +79,27 @@ private:
     bool ss = false;
 };
 
-core::smart_refctd_ptr<video::IGPURenderpassIndependentPipeline> createGraphicsPipeline(video::IVideoDriver* _driver, core::smart_refctd_ptr<video::IGPUPipelineLayout>&& _layout, video::IGPUSpecializedShader* _vs, const std::string& _fsBaseSource, const char* _testName, const asset::IGeometryCreator::return_type& _dat)
+//! compiles to SPIR-V here instead of leaving the GLSL to the driver, so the next launch can take it from the cache
+//! `_glsl` needs its includes resolved, on failure it gets returned as is for the driver to compile and report
+core::smart_refctd_ptr<asset::ICPUShader> compileThroughShaderCache(shader_cache::CCache& _cache, asset::IGLSLCompiler* _glslc, core::smart_refctd_ptr<asset::ICPUShader>&& _glsl, asset::ISpecializedShader::E_SHADER_STAGE _stage, const char* _define, const char* _path)
+{
+    if (!_glsl)
+        return nullptr;
+    static const uint64_t compilerIdentity = shader_cache::getCompilerIdentity();
+
+    const auto* source = _glsl->getContent();
+    shader_cache::CKeyBuilder key;
+    key.setSource(source->getPointer(), source->getSize()).setStage(_stage).setEntryPoint("main").setCompiler(compilerIdentity);
+    if (_define)
+        key.addDefine(_define);
+    auto spirv = shader_cache::getOrCompileShader(_cache, key.build(), [&]() -> core::smart_refctd_ptr<asset::ICPUShader>
+    {
+        return _glslc->createSPIRVFromGLSL(reinterpret_cast<const char*>(source->getPointer()), _stage, "main", _path);
+    });
+    return spirv ? std::move(spirv) : std::move(_glsl);
+}
+
+core::smart_refctd_ptr<video::IGPURenderpassIndependentPipeline> createGraphicsPipeline(video::IVideoDriver* _driver, asset::IGLSLCompiler* _glslc, shader_cache::CCache& _shaderCache, core::smart_refctd_ptr<video::IGPUPipelineLayout>&& _layout, video::IGPUSpecializedShader* _vs, const std::string& _fsBaseSource, const char* _testName, const asset::IGeometryCreator::return_type& _dat)
 {
     using namespace std::string_literals;
 
@@ -85,7 +107,8 @@ core::smart_refctd_ptr<video::IGPURenderpassIndependentPipeline> createGraphicsP
     const size_t _2ndLine = fsSrc.find('\n');
     fsSrc.insert(_2ndLine+1u, "#define "s + _testName + "\n");
 
-    auto cpufs = core::make_smart_refctd_ptr<asset::ICPUShader>(fsSrc.c_str());
+    auto cpufs = _glslc->resolveIncludeDirectives(std::move(fsSrc), asset::ISpecializedShader::ESS_FRAGMENT, "../shader.frag");
+    cpufs = compileThroughShaderCache(_shaderCache, _glslc, std::move(cpufs), asset::ISpecializedShader::ESS_FRAGMENT, _testName, "../shader.frag");
     auto fs = _driver->createShader(std::move(cpufs));
     asset::ISpecializedShader::SInfo fsinfo(nullptr, nullptr, "main", asset::ISpecializedShader::ESS_FRAGMENT, "../shader.frag");
     auto fs_spec = _driver->createSpecializedShader(fs.get(), fsinfo);
@@ -128,6 +151,7 @@ int main()
     auto* am = device->getAssetManager();
     auto* fs = am->getFileSystem();
     auto* glslc = am->getGLSLCompiler();
+    shader_cache::CCache shaderCache("ShaderCache");
     auto* gc = am->getGeometryCreator();
 
     struct SPushConsts
@@ -169,6 +193,7 @@ int main()
 
         io::IReadFile* file = fs->createAndOpenFile("../shader.vert");
         auto cpuvs = glslc->resolveIncludeDirectives(file, asset::ISpecializedShader::ESS_VERTEX, "../shader.vert");
+        cpuvs = compileThroughShaderCache(shaderCache, glslc, std::move(cpuvs), asset::ISpecializedShader::ESS_VERTEX, nullptr, "../shader.vert");
         auto vs = driver->createShader(std::move(cpuvs));
         file->drop();
         asset::ISpecializedShader::SInfo vsinfo(nullptr, nullptr, "main", asset::ISpecializedShader::ESS_VERTEX, "../shader.vert");
@@ -180,12 +205,14 @@ int main()
         file->read(fsSrc.data(), fsSrc.size());
         file->drop();
 
-        pipeline_ggx = createGraphicsPipeline(driver, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_GGX", dat);
-        pipeline_beckmann = createGraphicsPipeline(driver, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_BECKMANN", dat);
-        pipeline_phong = createGraphicsPipeline(driver, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_PHONG", dat);
-        pipeline_as = createGraphicsPipeline(driver, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_AS", dat);
-        pipeline_orennayar = createGraphicsPipeline(driver, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_OREN_NAYAR", dat);
-        pipeline_lambert = createGraphicsPipeline(driver, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_LAMBERT", dat);
+        pipeline_ggx = createGraphicsPipeline(driver, glslc, shaderCache, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_GGX", dat);
+        pipeline_beckmann = createGraphicsPipeline(driver, glslc, shaderCache, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_BECKMANN", dat);
+        pipeline_phong = createGraphicsPipeline(driver, glslc, shaderCache, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_PHONG", dat);
+        pipeline_as = createGraphicsPipeline(driver, glslc, shaderCache, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_AS", dat);
+        pipeline_orennayar = createGraphicsPipeline(driver, glslc, shaderCache, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_OREN_NAYAR", dat);
+        pipeline_lambert = createGraphicsPipeline(driver, glslc, shaderCache, core::smart_refctd_ptr(layout), vs_spec.get(), fsSrc, "TEST_LAMBERT", dat);
+
+        shaderCache.printMetrics("Shader Cache");
 
         sphere = driver->getGPUObjectsFromAssets(&cpusphere.get(), &cpusphere.get()+1)->front();
     }
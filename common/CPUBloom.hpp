@@ -0,0 +1,507 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _COMMON_CPU_BLOOM_HPP_INCLUDED_
+#define _COMMON_CPU_BLOOM_HPP_INCLUDED_
+
+#include "CPUFFT.hpp"
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+
+namespace cpu_fft
+{
+
+//! CPU version of the bloom of 39.DenoiserTonemapper, a convolution with a Point Spread Function through the FFT, for the examples
+//! which need a reference to check the GPU against or a fallback when there is no GPU. Same semantics as the GPU path:
+//! - the kernel is scaled relative to the smaller image dimension and normalized so its luma sums to 1
+//! - the image is mirror padded by the kernel size up to the next power of two and the kernel's center is put at the origin
+//! - the result is `(1-intensity)*color+intensity*(color*kernel)`, folded into the kernel spectrum like the normalization shader does
+//! The only deliberate difference is the kernel spectrum, the GPU transforms the kernel at its own padded size and interpolates the spectrum,
+//! here the kernel is zero padded to the image's FFT size so this is the exact convolution the GPU approximates.
+//! All images are tightly packed, interleaved linear RGB floats.
+class CBloom
+{
+	public:
+		static inline constexpr uint32_t Channels = 3u;
+
+		struct SKernel
+		{
+			inline const float* texel(const uint32_t x, const uint32_t y) const { return rgb.data()+(size_t(y)*width+x)*Channels; }
+
+			//! where the GPU ends up putting the origin, the kernel gets sampled centered in a power of two sized buffer whose middle is then shifted to 0
+			inline uint32_t getCenterX() const { return getKernelCenter(width); }
+			inline uint32_t getCenterY() const { return getKernelCenter(height); }
+
+			uint32_t width = 0u;
+			uint32_t height = 0u;
+			nbl::core::vector<float> rgb;
+		};
+
+		static inline uint32_t getKernelCenter(const uint32_t kernelExtent)
+		{
+			return kernelExtent-kernelExtent/2u;
+		}
+
+		static inline float luma(const float* rgb)
+		{
+			return rgb[0]*0.2126f+rgb[1]*0.7152f+rgb[2]*0.0722f;
+		}
+
+		//! ratio of the scaled kernel to the PSF, above 1 the kernel looses sharpness
+		static inline float getKernelScale(const uint32_t psfWidth, const uint32_t psfHeight, const uint32_t width, const uint32_t height, const float relativeScale)
+		{
+			return width<height ? float(width)*relativeScale/float(psfWidth):float(height)*relativeScale/float(psfHeight);
+		}
+
+		//! size of the kernel `scaleKernel` makes, without having to decode the PSF
+		static inline void getScaledKernelExtent(const uint32_t psfWidth, const uint32_t psfHeight, const uint32_t width, const uint32_t height, const float relativeScale, uint32_t& kernelWidth, uint32_t& kernelHeight)
+		{
+			const float kernelScale = getKernelScale(psfWidth,psfHeight,width,height,relativeScale);
+			kernelWidth = nbl::core::max(uint32_t(std::ceil(float(psfWidth)*kernelScale)),2u);
+			kernelHeight = nbl::core::max(uint32_t(std::ceil(float(psfHeight)*kernelScale)),2u);
+		}
+
+		//! box filter resample of the PSF to `relativeScale` of the smaller image dimension, normalized to a luma sum of 1
+		static inline SKernel scaleKernel(const float* psf, const uint32_t psfWidth, const uint32_t psfHeight, const uint32_t width, const uint32_t height, const float relativeScale)
+		{
+			SKernel kernel;
+			getScaledKernelExtent(psfWidth,psfHeight,width,height,relativeScale,kernel.width,kernel.height);
+			kernel.rgb.resize(size_t(kernel.width)*kernel.height*Channels,0.f);
+
+			const float scaleX = float(psfWidth)/float(kernel.width);
+			const float scaleY = float(psfHeight)/float(kernel.height);
+			double lumaSum = 0.0;
+			for (uint32_t y=0u; y<kernel.height; y++)
+			for (uint32_t x=0u; x<kernel.width; x++)
+			{
+				// every output texel averages the source texels it covers, or takes the nearest one when magnifying
+				const uint32_t beginX = nbl::core::min(uint32_t(float(x)*scaleX),psfWidth-1u);
+				const uint32_t beginY = nbl::core::min(uint32_t(float(y)*scaleY),psfHeight-1u);
+				const uint32_t endX = nbl::core::max(nbl::core::min(uint32_t(float(x+1u)*scaleX),psfWidth),beginX+1u);
+				const uint32_t endY = nbl::core::max(nbl::core::min(uint32_t(float(y+1u)*scaleY),psfHeight),beginY+1u);
+				float* out = kernel.rgb.data()+(size_t(y)*kernel.width+x)*Channels;
+				for (uint32_t sy=beginY; sy<endY; sy++)
+				for (uint32_t sx=beginX; sx<endX; sx++)
+				for (auto c=0u; c<Channels; c++)
+					out[c] += psf[(size_t(sy)*psfWidth+sx)*Channels+c];
+				const float rcpCount = 1.f/float((endX-beginX)*(endY-beginY));
+				for (auto c=0u; c<Channels; c++)
+					out[c] *= rcpCount;
+				lumaSum += luma(out);
+			}
+
+			const float normalization = lumaSum>0.0 ? float(1.0/lumaSum):0.f;
+			for (auto& value : kernel.rgb)
+				value *= normalization;
+			return kernel;
+		}
+
+		//! power of two FFT size with room for the kernel's reach on every side, same as `FFT::padDimensions` of the image plus the kernel margin
+		static inline void getPaddedExtent(const uint32_t width, const uint32_t height, const uint32_t kernelWidth, const uint32_t kernelHeight, uint32_t& paddedWidth, uint32_t& paddedHeight)
+		{
+			paddedWidth = nbl::core::roundUpToPoT(width+kernelWidth-1u);
+			paddedHeight = nbl::core::roundUpToPoT(height+kernelHeight-1u);
+		}
+		static inline void getPaddedExtent(const uint32_t width, const uint32_t height, const SKernel& kernel, uint32_t& paddedWidth, uint32_t& paddedHeight)
+		{
+			getPaddedExtent(width,height,kernel.width,kernel.height,paddedWidth,paddedHeight);
+		}
+
+		//! power of two FFT extent of the tiles `convolveTiled` splits an image into, `tileSize` rounded up but big enough for every tile to keep at least
+		//! as many texels as the kernel is wide, and never bigger than what the whole image would need
+		static inline void getTileExtent(const uint32_t width, const uint32_t height, const uint32_t kernelWidth, const uint32_t kernelHeight, const uint32_t tileSize, uint32_t& tileWidth, uint32_t& tileHeight)
+		{
+			uint32_t paddedWidth,paddedHeight;
+			getPaddedExtent(width,height,kernelWidth,kernelHeight,paddedWidth,paddedHeight);
+			tileWidth = nbl::core::min(nbl::core::max(nbl::core::roundUpToPoT(tileSize),nbl::core::roundUpToPoT(kernelWidth*2u-1u)),paddedWidth);
+			tileHeight = nbl::core::min(nbl::core::max(nbl::core::roundUpToPoT(tileSize),nbl::core::roundUpToPoT(kernelHeight*2u-1u)),paddedHeight);
+		}
+
+		//! elements per row of a kernel spectrum, with `realInput` only the half which isn't redundant gets stored and transformed
+		static inline uint32_t getSpectrumWidth(const uint32_t paddedWidth, const bool realInput)
+		{
+			return realInput ? getHalfSpectrumWidth(paddedWidth):paddedWidth;
+		}
+
+		//! spectrum of one channel of the kernel with the intensity blend already applied, `out` has `getSpectrumWidth(paddedWidth,realInput)*paddedHeight` elements
+		static inline void computeSpectrum(const SKernel& kernel, const uint32_t channel, const uint32_t paddedWidth, const uint32_t paddedHeight, const float intensity, complex_t* out, const bool realInput=true)
+		{
+			// kernel center goes to the origin, wrapping around, plus the dirac delta at the origin so the spectrum is `intensity*K+(1-intensity)`
+			auto loadRow = [&](const uint32_t y, float* row) -> void
+			{
+				std::fill_n(row,paddedWidth,0.f);
+				const uint32_t ky = (y+kernel.getCenterY())%paddedHeight;
+				if (ky<kernel.height)
+				for (uint32_t kx=0u; kx<kernel.width; kx++)
+					row[(kx+paddedWidth-kernel.getCenterX())%paddedWidth] = kernel.texel(kx,ky)[channel]*intensity;
+				if (y==0u)
+					row[0] += 1.f-intensity;
+			};
+			if (realInput)
+			{
+				transform2DReal(out,paddedWidth,paddedHeight,loadRow);
+				return;
+			}
+			nbl::core::vector<uint32_t> rows(paddedHeight);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				nbl::core::vector<float> row(paddedWidth);
+				loadRow(y,row.data());
+				std::copy(row.begin(),row.end(),out+size_t(y)*paddedWidth);
+			});
+			transform2D(out,paddedWidth,paddedHeight,false);
+		}
+
+		//! every channel's spectrum, worth keeping around when many images of the same size get the same kernel
+		struct SSpectrum
+		{
+			uint32_t paddedWidth = 0u;
+			uint32_t paddedHeight = 0u;
+			uint32_t kernelWidth = 0u;
+			uint32_t kernelHeight = 0u;
+			bool realInput = true;
+			nbl::core::vector<complex_t> channels[Channels];
+		};
+		static inline SSpectrum computeSpectrum(const SKernel& kernel, const uint32_t paddedWidth, const uint32_t paddedHeight, const float intensity, const bool realInput=true)
+		{
+			SSpectrum spectrum;
+			spectrum.paddedWidth = paddedWidth;
+			spectrum.paddedHeight = paddedHeight;
+			spectrum.kernelWidth = kernel.width;
+			spectrum.kernelHeight = kernel.height;
+			spectrum.realInput = realInput;
+			for (auto c=0u; c<Channels; c++)
+			{
+				spectrum.channels[c].resize(size_t(getSpectrumWidth(paddedWidth,realInput))*paddedHeight);
+				computeSpectrum(kernel,c,paddedWidth,paddedHeight,intensity,spectrum.channels[c].data(),realInput);
+			}
+			return spectrum;
+		}
+
+		//! in-place bloom of a `width` x `height` image with a precomputed spectrum, which needs to have been made for the same image size
+		static inline void convolve(float* rgb, const uint32_t width, const uint32_t height, const SSpectrum& spectrum)
+		{
+			nbl::core::vector<complex_t> image(spectrum.channels[0].size());
+			for (auto c=0u; c<Channels; c++)
+				convolveChannel(rgb,width,height,c,spectrum.channels[c].data(),spectrum.paddedWidth,spectrum.paddedHeight,image.data(),spectrum.realInput);
+		}
+
+		//! in-place bloom of a `width` x `height` image, only ever holds one channel's spectrum,
+		//! `realInput` uses half spectra and the real transforms, the full complex transforms are only there to check them against
+		static inline void convolve(float* rgb, const uint32_t width, const uint32_t height, const SKernel& kernel, const float intensity, const bool realInput=true)
+		{
+			uint32_t paddedWidth,paddedHeight;
+			getPaddedExtent(width,height,kernel,paddedWidth,paddedHeight);
+			const size_t spectrumSize = size_t(getSpectrumWidth(paddedWidth,realInput))*paddedHeight;
+			nbl::core::vector<complex_t> image(spectrumSize), spectrum(spectrumSize);
+			for (auto c=0u; c<Channels; c++)
+			{
+				computeSpectrum(kernel,c,paddedWidth,paddedHeight,intensity,spectrum.data(),realInput);
+				convolveChannel(rgb,width,height,c,spectrum.data(),paddedWidth,paddedHeight,image.data(),realInput);
+			}
+		}
+
+		//! one channel of the bloom given that channel's kernel spectrum from `computeSpectrum`, `scratch` has as many elements as the spectrum
+		static inline void convolveChannel(float* rgb, const uint32_t width, const uint32_t height, const uint32_t channel, const complex_t* spectrum, const uint32_t paddedWidth, const uint32_t paddedHeight, complex_t* scratch, const bool realInput=true)
+		{
+			const int32_t marginX = (paddedWidth-width)/2u;
+			const int32_t marginY = (paddedHeight-height)/2u;
+			auto loadRow = [&](const uint32_t y, float* out) -> void
+			{
+				const float* row = rgb+size_t(mirror(int32_t(y)-marginY,height))*width*Channels;
+				for (uint32_t x=0u; x<paddedWidth; x++)
+					out[x] = row[mirror(int32_t(x)-marginX,width)*Channels+channel];
+			};
+			// only the unpadded center gets written back
+			auto storeRow = [&](const uint32_t y, const float* in) -> void
+			{
+				if (y<uint32_t(marginY) || y>=marginY+height)
+					return;
+				float* out = rgb+size_t(y-marginY)*width*Channels+channel;
+				for (uint32_t x=0u; x<width; x++)
+					out[x*Channels] = in[marginX+x];
+			};
+			const size_t spectrumSize = size_t(getSpectrumWidth(paddedWidth,realInput))*paddedHeight;
+			auto multiply = [&]() -> void
+			{
+				std::transform(nbl::core::execution::par_unseq,scratch,scratch+spectrumSize,spectrum,scratch,std::multiplies<complex_t>());
+			};
+
+			if (realInput)
+			{
+				// rows get loaded on demand, the image is never padded in memory
+				transform2DReal(scratch,paddedWidth,paddedHeight,loadRow);
+				multiply();
+				inverseTransform2DReal(scratch,paddedWidth,paddedHeight,storeRow);
+				return;
+			}
+
+			nbl::core::vector<uint32_t> rows(paddedHeight);
+			std::iota(rows.begin(),rows.end(),0u);
+			std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				nbl::core::vector<float> row(paddedWidth);
+				loadRow(y,row.data());
+				std::copy(row.begin(),row.end(),scratch+size_t(y)*paddedWidth);
+			});
+			transform2D(scratch,paddedWidth,paddedHeight,false);
+			multiply();
+			transform2D(scratch,paddedWidth,paddedHeight,true);
+			std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+			{
+				nbl::core::vector<float> row(paddedWidth);
+				const complex_t* in = scratch+size_t(y)*paddedWidth;
+				for (uint32_t x=0u; x<paddedWidth; x++)
+					row[x] = in[x].real();
+				storeRow(y,row.data());
+			});
+		}
+
+		//! Overlap-save bloom of images too big for one FFT, or to bound the memory it takes, with a spectrum of `getTileExtent`'s size.
+		//! Every tile's texels get transformed together with the kernel's reach around them (mirrored at the image's edges, just like the padding)
+		//! and only the part the circular convolution doesn't wrap around on is kept, so the result is the same as `convolve`'s. The image isn't
+		//! modified, `storeTile(x,y,tileWidth,tileHeight,rgb,pitch)` gets every finished tile instead, so besides the image only the spectrum,
+		//! the FFT scratch and one tile are ever in memory however big the image is.
+		template<typename StoreTile>
+		static inline void convolveTiled(const float* rgb, const uint32_t width, const uint32_t height, const SSpectrum& spectrum, StoreTile&& storeTile)
+		{
+			assert(spectrum.realInput);
+			const uint32_t fftWidth = spectrum.paddedWidth;
+			const uint32_t fftHeight = spectrum.paddedHeight;
+			// how far before a texel the kernel reaches, the first texels of a tile's FFT get the neighbours from the other end wrapped onto them
+			const uint32_t reachX = spectrum.kernelWidth-1u-getKernelCenter(spectrum.kernelWidth);
+			const uint32_t reachY = spectrum.kernelHeight-1u-getKernelCenter(spectrum.kernelHeight);
+			const uint32_t tileWidth = fftWidth-spectrum.kernelWidth+1u;
+			const uint32_t tileHeight = fftHeight-spectrum.kernelHeight+1u;
+
+			nbl::core::vector<complex_t> scratch(spectrum.channels[0].size());
+			nbl::core::vector<float> tile(size_t(tileWidth)*tileHeight*Channels);
+			for (uint32_t tileY=0u; tileY<height; tileY+=tileHeight)
+			for (uint32_t tileX=0u; tileX<width; tileX+=tileWidth)
+			{
+				const uint32_t texelsX = nbl::core::min(tileWidth,width-tileX);
+				const uint32_t texelsY = nbl::core::min(tileHeight,height-tileY);
+				for (auto c=0u; c<Channels; c++)
+				{
+					auto loadRow = [&](const uint32_t y, float* out) -> void
+					{
+						const float* row = rgb+size_t(mirror(int32_t(tileY+y)-int32_t(reachY),height))*width*Channels;
+						for (uint32_t x=0u; x<fftWidth; x++)
+							out[x] = row[mirror(int32_t(tileX+x)-int32_t(reachX),width)*Channels+c];
+					};
+					auto storeRow = [&](const uint32_t y, const float* in) -> void
+					{
+						if (y<reachY || y>=reachY+texelsY)
+							return;
+						float* out = tile.data()+size_t(y-reachY)*tileWidth*Channels+c;
+						for (uint32_t x=0u; x<texelsX; x++)
+							out[x*Channels] = in[reachX+x];
+					};
+					transform2DReal(scratch.data(),fftWidth,fftHeight,loadRow);
+					std::transform(nbl::core::execution::par_unseq,scratch.begin(),scratch.end(),spectrum.channels[c].begin(),scratch.begin(),std::multiplies<complex_t>());
+					inverseTransform2DReal(scratch.data(),fftWidth,fftHeight,storeRow);
+				}
+				storeTile(tileX,tileY,texelsX,texelsY,static_cast<const float*>(tile.data()),tileWidth);
+			}
+		}
+		//! tiled bloom of `rgb` into `out`, which must not be the same image
+		static inline void convolveTiled(const float* rgb, float* out, const uint32_t width, const uint32_t height, const SSpectrum& spectrum)
+		{
+			convolveTiled(rgb,width,height,spectrum,[&](const uint32_t x, const uint32_t y, const uint32_t tileWidth, const uint32_t tileHeight, const float* tile, const uint32_t pitch) -> void
+			{
+				for (uint32_t row=0u; row<tileHeight; row++)
+					std::copy_n(tile+size_t(row)*pitch*Channels,size_t(tileWidth)*Channels,out+(size_t(y+row)*width+x)*Channels);
+			});
+		}
+
+		//! brute force value of one texel of the bloom, wraps around the padded image exactly like the circular convolution of the FFT does
+		static inline void convolveTexel(const float* rgb, const uint32_t width, const uint32_t height, const SKernel& kernel, const float intensity, const uint32_t x, const uint32_t y, float (&out)[Channels])
+		{
+			uint32_t paddedWidth,paddedHeight;
+			getPaddedExtent(width,height,kernel,paddedWidth,paddedHeight);
+			const uint32_t marginX = (paddedWidth-width)/2u;
+			const uint32_t marginY = (paddedHeight-height)/2u;
+			double sum[Channels] = {0.0,0.0,0.0};
+			for (uint32_t ky=0u; ky<kernel.height; ky++)
+			{
+				const uint32_t py = (y+marginY+paddedHeight+kernel.getCenterY()-ky)%paddedHeight;
+				const float* row = rgb+size_t(mirror(int32_t(py)-int32_t(marginY),height))*width*Channels;
+				for (uint32_t kx=0u; kx<kernel.width; kx++)
+				{
+					const uint32_t px = (x+marginX+paddedWidth+kernel.getCenterX()-kx)%paddedWidth;
+					const float* texel = row+mirror(int32_t(px)-int32_t(marginX),width)*Channels;
+					const float* weight = kernel.texel(kx,ky);
+					for (auto c=0u; c<Channels; c++)
+						sum[c] += double(weight[c])*double(texel[c]);
+				}
+			}
+			const float* center = rgb+(size_t(y)*width+x)*Channels;
+			for (auto c=0u; c<Channels; c++)
+				out[c] = (1.f-intensity)*center[c]+intensity*float(sum[c]);
+		}
+
+		//! Times the bloom of a synthetic `width` x `height` HDR image with `psf` through the real and the complex FFTs, checks the two agree everywhere
+		//! and that the result matches `convolveTexel` on the corners, the edges and a scattered set of texels. The tiled bloom with `tileSize` has to match it over the whole image too.
+		//! Errors are relative to the texel's value plus the image's mean luma.
+		static inline bool benchmark(const float* psf, const uint32_t psfWidth, const uint32_t psfHeight, const uint32_t width, const uint32_t height, const float relativeScale, const float intensity, const uint32_t tileSize)
+		{
+			constexpr uint32_t Iterations = 3u;
+			constexpr uint32_t ScatteredSamples = 56u;
+			constexpr float Tolerance = 1.f/1024.f;
+
+			// dim gradient with a sparse sprinkle of very bright texels so the flare has something to spread
+			nbl::core::vector<float> source(size_t(width)*height*Channels);
+			double lumaSum = 0.0;
+			for (uint32_t y=0u; y<height; y++)
+			for (uint32_t x=0u; x<width; x++)
+			{
+				float* texel = source.data()+(size_t(y)*width+x)*Channels;
+				const uint32_t hash = (x*0x9e3779b1u)^(y*0x85ebca77u);
+				const bool highlight = ((hash^(hash>>15u))*0x2c1b3c6du>>20u)==0u;
+				texel[0] = highlight ? 256.f:0.05f+0.45f*float(x)/float(width);
+				texel[1] = highlight ? 192.f:0.05f+0.45f*float(y)/float(height);
+				texel[2] = highlight ? 128.f:0.25f;
+				lumaSum += luma(texel);
+			}
+			const float meanLuma = float(lumaSum/double(size_t(width)*height));
+
+			auto now = []() { return std::chrono::steady_clock::now(); };
+			auto milliseconds = [](auto duration) -> double { return std::chrono::duration<double,std::milli>(duration).count(); };
+
+			auto start = now();
+			const auto kernel = scaleKernel(psf,psfWidth,psfHeight,width,height,relativeScale);
+			const double kernelMs = milliseconds(now()-start);
+
+			// the real transforms the bloom uses against the full complex ones, a kernel spectrum and the scratch the image gets transformed in are all the memory either needs
+			uint32_t paddedWidth,paddedHeight;
+			getPaddedExtent(width,height,kernel,paddedWidth,paddedHeight);
+			struct SMode
+			{
+				double spectrumMs = DBL_MAX, convolutionMs = DBL_MAX;
+				size_t bytes = 0ull;
+				nbl::core::vector<float> result;
+			} modes[2];
+			for (const bool realInput : {false,true})
+			{
+				auto& mode = modes[realInput];
+				const size_t spectrumSize = size_t(getSpectrumWidth(paddedWidth,realInput))*paddedHeight;
+				mode.bytes = spectrumSize*sizeof(complex_t)*2ull;
+				nbl::core::vector<complex_t> spectrum(spectrumSize), scratch(spectrumSize);
+				for (auto i=0u; i<Iterations; i++)
+				{
+					mode.result = source;
+					double spectrumTotal = 0.0, convolutionTotal = 0.0;
+					for (auto c=0u; c<Channels; c++)
+					{
+						start = now();
+						computeSpectrum(kernel,c,paddedWidth,paddedHeight,intensity,spectrum.data(),realInput);
+						const auto spectrumDone = now();
+						convolveChannel(mode.result.data(),width,height,c,spectrum.data(),paddedWidth,paddedHeight,scratch.data(),realInput);
+						spectrumTotal += milliseconds(spectrumDone-start);
+						convolutionTotal += milliseconds(now()-spectrumDone);
+					}
+					mode.spectrumMs = nbl::core::min(mode.spectrumMs,spectrumTotal);
+					mode.convolutionMs = nbl::core::min(mode.convolutionMs,convolutionTotal);
+				}
+			}
+			const auto& complexMode = modes[false];
+			const auto& realMode = modes[true];
+			const auto& result = realMode.result;
+
+			// the whole image has to agree between the two
+			auto getMaxDifference = [&](const nbl::core::vector<float>& actual, const nbl::core::vector<float>& expected) -> float
+			{
+				nbl::core::vector<float> rowDifferences(height);
+				nbl::core::vector<uint32_t> rows(height);
+				std::iota(rows.begin(),rows.end(),0u);
+				std::for_each(nbl::core::execution::par_unseq,rows.begin(),rows.end(),[&](const uint32_t y)
+				{
+					float difference = 0.f;
+					for (size_t i=size_t(y)*width*Channels; i<size_t(y+1u)*width*Channels; i++)
+						difference = nbl::core::max(difference,std::abs(actual[i]-expected[i])/(std::abs(expected[i])+meanLuma));
+					rowDifferences[y] = difference;
+				});
+				return *std::max_element(rowDifferences.begin(),rowDifferences.end());
+			};
+			const float maxDifference = getMaxDifference(realMode.result,complexMode.result);
+
+			// the tiled bloom against the whole image in one FFT, both with every channel's spectrum at hand like 39.DenoiserTonemapper does
+			uint32_t tileFFTWidth,tileFFTHeight;
+			getTileExtent(width,height,kernel.width,kernel.height,tileSize,tileFFTWidth,tileFFTHeight);
+			const uint32_t tileWidth = tileFFTWidth-kernel.width+1u;
+			const uint32_t tileHeight = tileFFTHeight-kernel.height+1u;
+			const size_t tiledBytes = size_t(getHalfSpectrumWidth(tileFFTWidth))*tileFFTHeight*sizeof(complex_t)*(Channels+1u)+size_t(tileWidth)*tileHeight*Channels*sizeof(float);
+			const size_t wholeBytes = size_t(getHalfSpectrumWidth(paddedWidth))*paddedHeight*sizeof(complex_t)*(Channels+1u);
+			double tiledSpectrumMs = DBL_MAX, tiledConvolutionMs = DBL_MAX;
+			nbl::core::vector<float> tiled(source.size());
+			for (auto i=0u; i<Iterations; i++)
+			{
+				start = now();
+				const auto tileSpectrum = computeSpectrum(kernel,tileFFTWidth,tileFFTHeight,intensity);
+				const auto spectrumDone = now();
+				convolveTiled(source.data(),tiled.data(),width,height,tileSpectrum);
+				tiledSpectrumMs = nbl::core::min(tiledSpectrumMs,milliseconds(spectrumDone-start));
+				tiledConvolutionMs = nbl::core::min(tiledConvolutionMs,milliseconds(now()-spectrumDone));
+			}
+			const float maxTiledDifference = getMaxDifference(tiled,realMode.result);
+
+			nbl::core::vector<std::pair<uint32_t,uint32_t>> samples = {
+				{0u,0u},{width-1u,0u},{0u,height-1u},{width-1u,height-1u},
+				{width/2u,0u},{width/2u,height-1u},{0u,height/2u},{width-1u,height/2u}
+			};
+			nbl::core::RandomSampler rng(0xdeadbeefu);
+			for (auto i=0u; i<ScatteredSamples; i++)
+				samples.emplace_back(rng.nextSample()%width,rng.nextSample()%height);
+			nbl::core::vector<uint32_t> sampleIDs(samples.size());
+			std::iota(sampleIDs.begin(),sampleIDs.end(),0u);
+			nbl::core::vector<float> errors(samples.size());
+			start = now();
+			std::for_each(nbl::core::execution::par_unseq,sampleIDs.begin(),sampleIDs.end(),[&](const uint32_t i)
+			{
+				const auto [x,y] = samples[i];
+				float expected[Channels];
+				convolveTexel(source.data(),width,height,kernel,intensity,x,y,expected);
+				const float* actual = result.data()+(size_t(y)*width+x)*Channels;
+				errors[i] = 0.f;
+				for (auto c=0u; c<Channels; c++)
+					errors[i] = nbl::core::max(errors[i],std::abs(actual[c]-expected[c])/(std::abs(expected[c])+meanLuma));
+			});
+			const double referenceMs = milliseconds(now()-start);
+			const float maxError = *std::max_element(errors.begin(),errors.end());
+
+			const bool passed = maxError<=Tolerance && maxDifference<=Tolerance && maxTiledDifference<=Tolerance;
+
+			constexpr double MiB = 1024.0*1024.0;
+			printf("[INFO] CPU Bloom: %ux%u image, %ux%u kernel, %ux%u FFT, kernel resample %.1f ms\n",width,height,kernel.width,kernel.height,paddedWidth,paddedHeight,kernelMs);
+			printf("[INFO] CPU Bloom: complex FFTs kernel spectrum %.1f ms, convolution %.1f ms, %.0f MiB\n",complexMode.spectrumMs,complexMode.convolutionMs,double(complexMode.bytes)/MiB);
+			printf("[INFO] CPU Bloom: real FFTs kernel spectrum %.1f ms, convolution %.1f ms (%.1f Mpixels/s), %.0f MiB, %.2fx faster and %.0f MiB less\n",
+				realMode.spectrumMs,realMode.convolutionMs,double(width)*double(height)*1e-3/realMode.convolutionMs,double(realMode.bytes)/MiB,
+				(complexMode.spectrumMs+complexMode.convolutionMs)/(realMode.spectrumMs+realMode.convolutionMs),double(complexMode.bytes-realMode.bytes)/MiB
+			);
+			printf("[INFO] CPU Bloom: %ux%u tiles of %ux%u texels in %ux%u FFTs, kernel spectrum %.1f ms, convolution %.1f ms, %.1f MiB against %.1f MiB for the whole image in one FFT\n",
+				(width+tileWidth-1u)/tileWidth,(height+tileHeight-1u)/tileHeight,tileWidth,tileHeight,tileFFTWidth,tileFFTHeight,tiledSpectrumMs,tiledConvolutionMs,double(tiledBytes)/MiB,double(wholeBytes)/MiB
+			);
+			printf("[%s] CPU Bloom: max relative difference %.2e between the real and complex FFTs, %.2e between tiled and whole, max relative error %.2e against brute force convolution of %u texels (%.1f ms)\n",
+				passed ? "INFO":"ERROR",maxDifference,maxTiledDifference,maxError,uint32_t(samples.size()),referenceMs
+			);
+			return passed;
+		}
+
+		//! mirror addressing of the padding, same as `ISampler::ETC_MIRROR`
+		static inline uint32_t mirror(int32_t coord, const uint32_t size)
+		{
+			const int32_t period = int32_t(size)*2;
+			coord %= period;
+			if (coord<0)
+				coord += period;
+			return coord<int32_t(size) ? coord:period-1-coord;
+		}
+};
+
+}
+
+#endif
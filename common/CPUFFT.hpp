@@ -0,0 +1,306 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _COMMON_CPU_FFT_HPP_INCLUDED_
+#define _COMMON_CPU_FFT_HPP_INCLUDED_
+
+#include <nabla.h>
+
+#include <complex>
+#include <cstdint>
+#include <numeric>
+
+//! CPU Fast Fourier Transform for the examples which need a reference or a fallback for the GPU FFT,
+//! radix-2 and power of two sizes only, same as `ext::FFT`.
+namespace cpu_fft
+{
+
+using complex_t = std::complex<float>;
+
+//! twiddles and bit reversal permutation for one transform length, build once and reuse for every row or column of that length
+class CPlan
+{
+	public:
+		//! lines transformed together by the SIMD overload of `transform`, one per `vectorSIMDf` component
+		static inline constexpr uint32_t Lanes = 4u;
+
+		explicit CPlan(const uint32_t size) : m_size(size), m_bitReversal(size), m_twiddles(size/2u)
+		{
+			assert(size && (size&(size-1u))==0u);
+			const uint32_t log2Size = nbl::core::findMSB(size);
+			for (uint32_t i=0u; i<size; i++)
+			{
+				uint32_t reversed = 0u;
+				for (uint32_t b=0u; b<log2Size; b++)
+					reversed |= ((i>>b)&0x1u)<<(log2Size-1u-b);
+				m_bitReversal[i] = reversed;
+			}
+			// computed in double so long transforms don't accumulate the error of a recurrence
+			for (uint32_t i=0u; i<size/2u; i++)
+			{
+				const double angle = -2.0*nbl::core::PI<double>()*double(i)/double(size);
+				m_twiddles[i] = complex_t(float(std::cos(angle)),float(std::sin(angle)));
+			}
+		}
+
+		inline uint32_t getSize() const { return m_size; }
+
+		//! in-place, the inverse is scaled by `1/size` so a forward and inverse pair round trips
+		inline void transform(complex_t* data, const bool inverse) const
+		{
+			for (uint32_t i=0u; i<m_size; i++)
+			if (i<m_bitReversal[i])
+				std::swap(data[i],data[m_bitReversal[i]]);
+
+			for (uint32_t half=1u; half<m_size; half<<=1u)
+			{
+				const uint32_t twiddleStride = m_size/(half<<1u);
+				for (uint32_t base=0u; base<m_size; base+=half<<1u)
+				for (uint32_t k=0u; k<half; k++)
+				{
+					const auto& w = m_twiddles[k*twiddleStride];
+					const complex_t twiddle = inverse ? std::conj(w):w;
+					const complex_t odd = data[base+k+half]*twiddle;
+					data[base+k+half] = data[base+k]-odd;
+					data[base+k] += odd;
+				}
+			}
+
+			if (inverse)
+			{
+				const float scale = 1.f/float(m_size);
+				for (uint32_t i=0u; i<m_size; i++)
+					data[i] *= scale;
+			}
+		}
+
+		//! same as above for `Lanes` lines at once, every `vectorSIMDf` holds the same element of different lines
+		inline void transform(nbl::core::vectorSIMDf* real, nbl::core::vectorSIMDf* imaginary, const bool inverse) const
+		{
+			for (uint32_t i=0u; i<m_size; i++)
+			if (i<m_bitReversal[i])
+			{
+				std::swap(real[i],real[m_bitReversal[i]]);
+				std::swap(imaginary[i],imaginary[m_bitReversal[i]]);
+			}
+
+			for (uint32_t half=1u; half<m_size; half<<=1u)
+			{
+				const uint32_t twiddleStride = m_size/(half<<1u);
+				for (uint32_t k=0u; k<half; k++)
+				{
+					const auto& w = m_twiddles[k*twiddleStride];
+					const nbl::core::vectorSIMDf twiddleReal(w.real());
+					const nbl::core::vectorSIMDf twiddleImaginary(inverse ? -w.imag():w.imag());
+					for (uint32_t even=k; even<m_size; even+=half<<1u)
+					{
+						const uint32_t odd = even+half;
+						const nbl::core::vectorSIMDf oddReal = real[odd]*twiddleReal-imaginary[odd]*twiddleImaginary;
+						const nbl::core::vectorSIMDf oddImaginary = real[odd]*twiddleImaginary+imaginary[odd]*twiddleReal;
+						real[odd] = real[even]-oddReal;
+						imaginary[odd] = imaginary[even]-oddImaginary;
+						real[even] += oddReal;
+						imaginary[even] += oddImaginary;
+					}
+				}
+			}
+
+			if (inverse)
+			{
+				const nbl::core::vectorSIMDf scale(1.f/float(m_size));
+				for (uint32_t i=0u; i<m_size; i++)
+				{
+					real[i] *= scale;
+					imaginary[i] *= scale;
+				}
+			}
+		}
+
+	private:
+		uint32_t m_size;
+		nbl::core::vector<uint32_t> m_bitReversal;
+		nbl::core::vector<complex_t> m_twiddles;
+};
+
+//! in-place transform of the first `columns` columns of a row-major array with rows `pitch` elements apart,
+//! the columns get gathered in batches so every cacheline read from a row gets used
+inline void transformColumns(complex_t* data, const uint32_t columns, const uint32_t height, const uint32_t pitch, const bool inverse)
+{
+	using lanes_t = nbl::core::vectorSIMDf;
+	constexpr uint32_t Lanes = CPlan::Lanes;
+	constexpr uint32_t ColumnBatch = Lanes*2u;
+	const CPlan columnPlan(height);
+
+	nbl::core::vector<uint32_t> batches((columns+ColumnBatch-1u)/ColumnBatch);
+	std::iota(batches.begin(),batches.end(),0u);
+	std::for_each(nbl::core::execution::par_unseq,batches.begin(),batches.end(),[&](const uint32_t batch)
+	{
+		const uint32_t begin = batch*ColumnBatch;
+		const uint32_t count = nbl::core::min(ColumnBatch,columns-begin);
+		// lane `c%Lanes` of the `c/Lanes`-th group of columns
+		nbl::core::vector<lanes_t> real(size_t(height)*ColumnBatch/Lanes,lanes_t(0.f)), imaginary(real.size(),lanes_t(0.f));
+		for (uint32_t y=0u; y<height; y++)
+		for (uint32_t c=0u; c<count; c++)
+		{
+			const complex_t& value = data[size_t(y)*pitch+begin+c];
+			const size_t ix = size_t(c/Lanes)*height+y;
+			real[ix].pointer[c%Lanes] = value.real();
+			imaginary[ix].pointer[c%Lanes] = value.imag();
+		}
+		for (uint32_t group=0u; group*Lanes<count; group++)
+			columnPlan.transform(real.data()+size_t(group)*height,imaginary.data()+size_t(group)*height,inverse);
+		for (uint32_t y=0u; y<height; y++)
+		for (uint32_t c=0u; c<count; c++)
+		{
+			const size_t ix = size_t(c/Lanes)*height+y;
+			data[size_t(y)*pitch+begin+c] = complex_t(real[ix].pointer[c%Lanes],imaginary[ix].pointer[c%Lanes]);
+		}
+	});
+}
+
+//! in-place 2D transform of a row-major `width` x `height` array, rows first then columns, each pass spread over all threads
+//! and `CPlan::Lanes` rows or columns go through the butterflies together in SIMD registers
+inline void transform2D(complex_t* data, const uint32_t width, const uint32_t height, const bool inverse)
+{
+	using lanes_t = nbl::core::vectorSIMDf;
+	constexpr uint32_t Lanes = CPlan::Lanes;
+	const CPlan rowPlan(width);
+
+	nbl::core::vector<uint32_t> rowGroups((height+Lanes-1u)/Lanes);
+	std::iota(rowGroups.begin(),rowGroups.end(),0u);
+	std::for_each(nbl::core::execution::par_unseq,rowGroups.begin(),rowGroups.end(),[&](const uint32_t group)
+	{
+		const uint32_t begin = group*Lanes;
+		const uint32_t count = nbl::core::min(Lanes,height-begin);
+		nbl::core::vector<lanes_t> real(width,lanes_t(0.f)), imaginary(width,lanes_t(0.f));
+		for (uint32_t l=0u; l<count; l++)
+		{
+			const complex_t* row = data+size_t(begin+l)*width;
+			for (uint32_t x=0u; x<width; x++)
+			{
+				real[x].pointer[l] = row[x].real();
+				imaginary[x].pointer[l] = row[x].imag();
+			}
+		}
+		rowPlan.transform(real.data(),imaginary.data(),inverse);
+		for (uint32_t l=0u; l<count; l++)
+		{
+			complex_t* row = data+size_t(begin+l)*width;
+			for (uint32_t x=0u; x<width; x++)
+				row[x] = complex_t(real[x].pointer[l],imaginary[x].pointer[l]);
+		}
+	});
+
+	transformColumns(data,width,height,width,inverse);
+}
+
+//! columns of the spectrum of a real `width` wide signal worth storing, the others are the complex conjugates of these mirrored
+inline uint32_t getHalfSpectrumWidth(const uint32_t width)
+{
+	return width/2u+1u;
+}
+
+//! Spectrum of a real `width` x `height` image, only the `getHalfSpectrumWidth(width)` x `height` half which isn't redundant goes into `halfSpectrum`
+//! (row pitch of `getHalfSpectrumWidth(width)`). `loadRow(y,row)` has to fill `row` with the `width` values of image row `y`, so the caller never
+//! needs the whole real image in memory. Two rows go through one complex row transform as its real and imaginary part and get told apart by
+//! the symmetry of real spectra, then only the half of the columns is transformed, so it's half the work and memory of `transform2D`.
+template<typename LoadRow>
+inline void transform2DReal(complex_t* halfSpectrum, const uint32_t width, const uint32_t height, LoadRow&& loadRow)
+{
+	using lanes_t = nbl::core::vectorSIMDf;
+	constexpr uint32_t Lanes = CPlan::Lanes;
+	assert(height%2u==0u);
+	const uint32_t halfWidth = getHalfSpectrumWidth(width);
+	const CPlan rowPlan(width);
+
+	// every lane holds a pair of rows
+	const uint32_t rowPairs = height/2u;
+	nbl::core::vector<uint32_t> pairGroups((rowPairs+Lanes-1u)/Lanes);
+	std::iota(pairGroups.begin(),pairGroups.end(),0u);
+	std::for_each(nbl::core::execution::par_unseq,pairGroups.begin(),pairGroups.end(),[&](const uint32_t group)
+	{
+		const uint32_t begin = group*Lanes;
+		const uint32_t count = nbl::core::min(Lanes,rowPairs-begin);
+		nbl::core::vector<lanes_t> real(width,lanes_t(0.f)), imaginary(width,lanes_t(0.f));
+		nbl::core::vector<float> row(width);
+		for (uint32_t l=0u; l<count; l++)
+		{
+			loadRow((begin+l)*2u,row.data());
+			for (uint32_t x=0u; x<width; x++)
+				real[x].pointer[l] = row[x];
+			loadRow((begin+l)*2u+1u,row.data());
+			for (uint32_t x=0u; x<width; x++)
+				imaginary[x].pointer[l] = row[x];
+		}
+		rowPlan.transform(real.data(),imaginary.data(),false);
+		// Z = A+iB with A and B the spectra of the real rows, so A = (Z[k]+conj(Z[-k]))/2 and B = (Z[k]-conj(Z[-k]))/2i
+		for (uint32_t l=0u; l<count; l++)
+		{
+			complex_t* even = halfSpectrum+size_t((begin+l)*2u)*halfWidth;
+			complex_t* odd = even+halfWidth;
+			for (uint32_t k=0u; k<halfWidth; k++)
+			{
+				const uint32_t mirrored = (width-k)&(width-1u);
+				const complex_t z(real[k].pointer[l],imaginary[k].pointer[l]);
+				const complex_t zMirrored(real[mirrored].pointer[l],-imaginary[mirrored].pointer[l]);
+				even[k] = (z+zMirrored)*0.5f;
+				odd[k] = (z-zMirrored)*complex_t(0.f,-0.5f);
+			}
+		}
+	});
+
+	transformColumns(halfSpectrum,halfWidth,height,halfWidth,false);
+}
+
+//! Inverse of `transform2DReal`, consumes `halfSpectrum` and hands every row of the real image to `storeRow(y,row)` as `width` values.
+template<typename StoreRow>
+inline void inverseTransform2DReal(complex_t* halfSpectrum, const uint32_t width, const uint32_t height, StoreRow&& storeRow)
+{
+	using lanes_t = nbl::core::vectorSIMDf;
+	constexpr uint32_t Lanes = CPlan::Lanes;
+	assert(height%2u==0u);
+	const uint32_t halfWidth = getHalfSpectrumWidth(width);
+	const CPlan rowPlan(width);
+
+	transformColumns(halfSpectrum,halfWidth,height,halfWidth,true);
+
+	const uint32_t rowPairs = height/2u;
+	nbl::core::vector<uint32_t> pairGroups((rowPairs+Lanes-1u)/Lanes);
+	std::iota(pairGroups.begin(),pairGroups.end(),0u);
+	std::for_each(nbl::core::execution::par_unseq,pairGroups.begin(),pairGroups.end(),[&](const uint32_t group)
+	{
+		const uint32_t begin = group*Lanes;
+		const uint32_t count = nbl::core::min(Lanes,rowPairs-begin);
+		nbl::core::vector<lanes_t> real(width,lanes_t(0.f)), imaginary(width,lanes_t(0.f));
+		// rebuild Z = A+iB over the whole row, the missing half of A and B is the conjugate of the stored one
+		for (uint32_t l=0u; l<count; l++)
+		{
+			const complex_t* even = halfSpectrum+size_t((begin+l)*2u)*halfWidth;
+			const complex_t* odd = even+halfWidth;
+			for (uint32_t k=0u; k<width; k++)
+			{
+				const bool stored = k<halfWidth;
+				const uint32_t ix = stored ? k:width-k;
+				const complex_t a = stored ? even[ix]:std::conj(even[ix]);
+				const complex_t b = stored ? odd[ix]:std::conj(odd[ix]);
+				real[k].pointer[l] = a.real()-b.imag();
+				imaginary[k].pointer[l] = a.imag()+b.real();
+			}
+		}
+		rowPlan.transform(real.data(),imaginary.data(),true);
+		nbl::core::vector<float> row(width);
+		for (uint32_t l=0u; l<count; l++)
+		{
+			for (uint32_t x=0u; x<width; x++)
+				row[x] = real[x].pointer[l];
+			storeRow((begin+l)*2u,row.data());
+			for (uint32_t x=0u; x<width; x++)
+				row[x] = imaginary[x].pointer[l];
+			storeRow((begin+l)*2u+1u,row.data());
+		}
+	});
+}
+}
+
+#endif
@@ -0,0 +1,214 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _COMMON_CACHE_FILE_HPP_INCLUDED_
+#define _COMMON_CACHE_FILE_HPP_INCLUDED_
+
+#include <nabla.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+
+#ifdef _NBL_PLATFORM_WINDOWS_
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+//! Helpers shared by the examples which persist precomputed data between runs:
+//! a content hash for cache keys and checksums, a read-only memory mapping and an atomic file write.
+namespace cache_file
+{
+
+//! XXH64, fast enough to hash a whole HDR envmap or sample sequence on every startup
+inline uint64_t hash(const void* data, const size_t size, const uint64_t seed=0ull)
+{
+	constexpr uint64_t Prime1 = 11400714785074694791ull;
+	constexpr uint64_t Prime2 = 14029467366897019727ull;
+	constexpr uint64_t Prime3 = 1609587929392839161ull;
+	constexpr uint64_t Prime4 = 9650029242287828579ull;
+	constexpr uint64_t Prime5 = 2870177450012600261ull;
+	auto rotl = [](const uint64_t x, const int r) -> uint64_t {return (x<<r)|(x>>(64-r));};
+	auto round = [rotl](uint64_t acc, const uint64_t input) -> uint64_t
+	{
+		acc += input*Prime2;
+		acc = rotl(acc,31);
+		return acc*Prime1;
+	};
+	auto read64 = [](const uint8_t* p) -> uint64_t {uint64_t v; memcpy(&v,p,sizeof(v)); return v;};
+	auto read32 = [](const uint8_t* p) -> uint64_t {uint32_t v; memcpy(&v,p,sizeof(v)); return v;};
+
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+	const uint8_t* const end = p+size;
+	uint64_t h;
+	if (size>=32ull)
+	{
+		uint64_t v[4] = {seed+Prime1+Prime2,seed+Prime2,seed,seed-Prime1};
+		for (const uint8_t* const limit=end-32; p<=limit; p+=32)
+		for (auto i=0; i<4; i++)
+			v[i] = round(v[i],read64(p+i*8));
+		h = rotl(v[0],1)+rotl(v[1],7)+rotl(v[2],12)+rotl(v[3],18);
+		for (auto i=0; i<4; i++)
+		{
+			h ^= round(0ull,v[i]);
+			h = h*Prime1+Prime4;
+		}
+	}
+	else
+		h = seed+Prime5;
+	h += size;
+
+	for (; p+8<=end; p+=8)
+	{
+		h ^= round(0ull,read64(p));
+		h = rotl(h,27)*Prime1+Prime4;
+	}
+	if (p+4<=end)
+	{
+		h ^= read32(p)*Prime1;
+		h = rotl(h,23)*Prime2+Prime3;
+		p += 4;
+	}
+	for (; p<end; p++)
+	{
+		h ^= (*p)*Prime5;
+		h = rotl(h,11)*Prime1;
+	}
+
+	h ^= h>>33;
+	h *= Prime2;
+	h ^= h>>29;
+	h *= Prime3;
+	h ^= h>>32;
+	return h;
+}
+
+//! Read-only mapping of a whole file, the pages only get read when touched
+class MappedFile
+{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) { operator=(std::move(other)); }
+		~MappedFile() { close(); }
+
+		MappedFile& operator=(const MappedFile&) = delete;
+		inline MappedFile& operator=(MappedFile&& other)
+		{
+			std::swap(m_data,other.m_data);
+			std::swap(m_size,other.m_size);
+			return *this;
+		}
+
+		inline bool open(const std::string& path)
+		{
+			close();
+			#ifdef _NBL_PLATFORM_WINDOWS_
+				HANDLE file = CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_DELETE,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+				if (file==INVALID_HANDLE_VALUE)
+					return false;
+				LARGE_INTEGER size;
+				if (GetFileSizeEx(file,&size) && size.QuadPart>0)
+				{
+					HANDLE mapping = CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+					if (mapping)
+					{
+						m_data = reinterpret_cast<const uint8_t*>(MapViewOfFile(mapping,FILE_MAP_READ,0,0,0));
+						CloseHandle(mapping);
+					}
+					if (m_data)
+						m_size = size.QuadPart;
+				}
+				CloseHandle(file);
+			#else
+				const int fd = ::open(path.c_str(),O_RDONLY);
+				if (fd<0)
+					return false;
+				struct stat info;
+				if (fstat(fd,&info)==0 && info.st_size>0)
+				{
+					void* mapped = mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+					if (mapped!=MAP_FAILED)
+					{
+						m_data = reinterpret_cast<const uint8_t*>(mapped);
+						m_size = info.st_size;
+					}
+				}
+				::close(fd);
+			#endif
+			return m_data;
+		}
+
+		inline void close()
+		{
+			if (!m_data)
+				return;
+			#ifdef _NBL_PLATFORM_WINDOWS_
+				UnmapViewOfFile(m_data);
+			#else
+				munmap(const_cast<uint8_t*>(m_data),m_size);
+			#endif
+			m_data = nullptr;
+			m_size = 0ull;
+		}
+
+		inline const uint8_t* data() const { return m_data; }
+		inline size_t size() const { return m_size; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0ull;
+};
+
+//! Writes into a uniquely named temporary next to `path` and renames it over, so readers in other processes never see a partial file
+template<typename WriteFunc>
+inline bool writeAtomically(const std::filesystem::path& path, WriteFunc&& write)
+{
+	std::filesystem::path tmpPath = path;
+	tmpPath += "."+std::to_string(std::random_device()())+".tmp";
+	{
+		std::ofstream file(tmpPath,std::ios::binary|std::ios::trunc);
+		if (!file || !write(file))
+		{
+			file.close();
+			std::error_code ec;
+			std::filesystem::remove(tmpPath,ec);
+			return false;
+		}
+		file.flush();
+		if (!file)
+		{
+			file.close();
+			std::error_code ec;
+			std::filesystem::remove(tmpPath,ec);
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpPath,path,ec);
+	if (ec)
+	{
+		std::filesystem::remove(tmpPath,ec);
+		return false;
+	}
+	return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,612 @@
+// Copyright (C) 2018-2020 - DevSH Graphics Programming Sp. z O.O.
+// This file is part of the "Nabla Engine".
+// For conditions of distribution and use, see copyright notice in nabla.h
+
+#ifndef _COMMON_SHADER_CACHE_HPP_INCLUDED_
+#define _COMMON_SHADER_CACHE_HPP_INCLUDED_
+
+#include "CacheFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+//! Persistent, content addressed cache of compiled SPIR-V so the examples don't run the GLSL compiler on every launch.
+//! Every entry is one file named after its key, written atomically and carrying checksums of itself, so any number of processes
+//! can share the directory: a reader sees either a whole entry or none, concurrent writers of the same key write the same bytes
+//! and a file deleted by another process's eviction is just a miss. The directory is kept under a byte budget by evicting
+//! the least recently used entries, a hit bumps the modification time which serves as the LRU timestamp.
+namespace shader_cache
+{
+
+//! 128 bit, two XXH64 with different seeds over the same canonical description of the compilation
+struct SKey
+{
+	uint64_t hash[2] = {0ull,0ull};
+
+	inline bool operator==(const SKey& other) const { return hash[0]==other.hash[0] && hash[1]==other.hash[1]; }
+	inline bool operator!=(const SKey& other) const { return !operator==(other); }
+
+	inline std::string toString() const
+	{
+		char retval[33];
+		sprintf(retval,"%016llx%016llx",static_cast<unsigned long long>(hash[0]),static_cast<unsigned long long>(hash[1]));
+		return retval;
+	}
+};
+
+//! Everything which can change the SPIR-V has to go in, every field is tagged and length prefixed so no two different descriptions serialize the same.
+//! The source should be the one with the includes resolved, callers which key on the raw source have to add every include they know of.
+class CKeyBuilder
+{
+	public:
+		inline CKeyBuilder& setSource(const void* source, const size_t size) { return add('S',source,size); }
+		inline CKeyBuilder& setSource(const std::string& source) { return setSource(source.data(),source.size()); }
+		//! defines injected by the caller, ones written in the source are already covered by it
+		inline CKeyBuilder& addDefine(const std::string& name, const std::string& value="")
+		{
+			add('D',name.data(),name.size());
+			return add('V',value.data(),value.size());
+		}
+		inline CKeyBuilder& addInclude(const std::string& path, const uint64_t contentHash)
+		{
+			add('I',path.data(),path.size());
+			return add('H',&contentHash,sizeof(contentHash));
+		}
+		//! compiler flags which aren't spelled out in the source, debug info, optimization level and such
+		inline CKeyBuilder& addOption(const std::string& option) { return add('O',option.data(),option.size()); }
+		inline CKeyBuilder& setStage(const uint32_t stage) { return add('T',&stage,sizeof(stage)); }
+		inline CKeyBuilder& setEntryPoint(const std::string& entryPoint) { return add('E',entryPoint.data(),entryPoint.size()); }
+		inline CKeyBuilder& setCompiler(const uint64_t compilerIdentity) { return add('C',&compilerIdentity,sizeof(compilerIdentity)); }
+
+		inline SKey build() const
+		{
+			SKey retval;
+			retval.hash[0] = cache_file::hash(m_description.data(),m_description.size(),0x5350495256ull);
+			retval.hash[1] = cache_file::hash(m_description.data(),m_description.size(),0xcafef00dd15ea5e5ull);
+			return retval;
+		}
+
+	private:
+		inline CKeyBuilder& add(const char tag, const void* data, const size_t size)
+		{
+			const uint64_t size64 = size;
+			m_description.push_back(tag);
+			m_description.append(reinterpret_cast<const char*>(&size64),sizeof(size64));
+			m_description.append(reinterpret_cast<const char*>(data),size);
+			return *this;
+		}
+
+		std::string m_description;
+};
+
+//! The GLSL compiler is linked into every example, so any change to it comes with a new executable.
+//! Keying on the executable's path, size and modification time costs a `stat` and never hands out SPIR-V from another compiler,
+//! the price is that rebuilding an example starts its cache over.
+inline uint64_t getCompilerIdentity()
+{
+	std::filesystem::path executable;
+	std::error_code ec;
+	#ifdef _NBL_PLATFORM_WINDOWS_
+		char path[MAX_PATH];
+		const DWORD length = GetModuleFileNameA(nullptr,path,MAX_PATH);
+		if (length && length<MAX_PATH)
+			executable = std::string(path,length);
+	#elif defined(_NBL_PLATFORM_LINUX_) || defined(__linux__)
+		executable = std::filesystem::read_symlink("/proc/self/exe",ec);
+	#endif
+	// no way to find the executable, fall back to when this was compiled
+	constexpr char buildTime[] = __DATE__ " " __TIME__;
+	uint64_t retval = cache_file::hash(buildTime,sizeof(buildTime));
+	if (!executable.empty() && std::filesystem::exists(executable,ec))
+	{
+		const auto path = executable.generic_string();
+		const uint64_t stats[2] = {uint64_t(std::filesystem::file_size(executable,ec)),uint64_t(std::filesystem::last_write_time(executable,ec).time_since_epoch().count())};
+		retval = cache_file::hash(path.data(),path.size());
+		retval = cache_file::hash(stats,sizeof(stats),retval);
+	}
+	return retval;
+}
+
+class CCache
+{
+	public:
+		//! bump whenever the entry layout changes
+		static inline constexpr uint32_t Version = 1u;
+		static inline constexpr uint32_t Magic = 0x43565053u; // "SPVC"
+		static inline constexpr uint64_t DefaultMaxBytes = 64ull<<20ull;
+		static inline constexpr const char* Extension = ".spvc";
+
+		//! snapshot of the counters, they only cover what this instance did, not the other processes sharing the directory
+		struct SMetrics
+		{
+			uint64_t hits = 0ull;
+			uint64_t misses = 0ull;
+			uint64_t stores = 0ull;
+			uint64_t failedStores = 0ull;
+			//! entries which were there but corrupted or from an older `Version`, they count as misses too
+			uint64_t rejected = 0ull;
+			uint64_t evictions = 0ull;
+			uint64_t bytesRead = 0ull;
+			uint64_t bytesWritten = 0ull;
+			//! time spent in `lookup` on hits and in the compile callback of `getOrCompile` on misses
+			double hitMs = 0.0;
+			double compileMs = 0.0;
+
+			inline double getHitRate() const { return hits+misses ? double(hits)/double(hits+misses):0.0; }
+		};
+
+		CCache(const std::filesystem::path& directory, const uint64_t maxBytes=DefaultMaxBytes) : m_directory(directory), m_maxBytes(maxBytes)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(m_directory,ec);
+		}
+
+		inline const std::filesystem::path& getDirectory() const { return m_directory; }
+		inline std::filesystem::path getPath(const SKey& key) const { return m_directory/(key.toString()+Extension); }
+
+		//! fills `spirv` and bumps the entry to most recently used on a hit
+		inline bool lookup(const SKey& key, nbl::core::vector<uint8_t>& spirv)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const auto path = getPath(key);
+			cache_file::MappedFile file;
+			if (!file.open(path.string()))
+			{
+				m_misses++;
+				return false;
+			}
+
+			const auto* header = reinterpret_cast<const SEntryHeader*>(file.data());
+			const bool valid = file.size()>=sizeof(SEntryHeader) && header->magic==Magic && header->version==Version &&
+				header->key[0]==key.hash[0] && header->key[1]==key.hash[1] && computeHeaderChecksum(*header)==header->headerChecksum &&
+				sizeof(SEntryHeader)+header->spirvSize==file.size() && cache_file::hash(file.data()+sizeof(SEntryHeader),header->spirvSize)==header->spirvChecksum;
+			if (!valid)
+			{
+				file.close();
+				// whatever replaces it will be whole, at worst we remove a good entry another process just wrote
+				std::error_code ec;
+				std::filesystem::remove(path,ec);
+				m_rejected++;
+				m_misses++;
+				return false;
+			}
+			spirv.assign(file.data()+sizeof(SEntryHeader),file.data()+file.size());
+			file.close();
+
+			touch(path);
+			m_hits++;
+			m_bytesRead += spirv.size();
+			addMs(m_hitMicroseconds,start);
+			return true;
+		}
+
+		//! entries bigger than the whole budget are not kept
+		inline bool store(const SKey& key, const void* spirv, const size_t size)
+		{
+			if (sizeof(SEntryHeader)+size>m_maxBytes)
+			{
+				m_failedStores++;
+				return false;
+			}
+
+			SEntryHeader header = {};
+			header.magic = Magic;
+			header.version = Version;
+			header.key[0] = key.hash[0];
+			header.key[1] = key.hash[1];
+			header.spirvSize = size;
+			header.spirvChecksum = cache_file::hash(spirv,size);
+			header.headerChecksum = computeHeaderChecksum(header);
+
+			const auto path = getPath(key);
+			const bool written = cache_file::writeAtomically(path,[&](std::ofstream& file) -> bool
+			{
+				file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+				file.write(reinterpret_cast<const char*>(spirv),size);
+				return bool(file);
+			});
+			if (!written)
+			{
+				m_failedStores++;
+				return false;
+			}
+			touch(path);
+			m_stores++;
+			m_bytesWritten += sizeof(SEntryHeader)+size;
+			trim();
+			return true;
+		}
+
+		//! `compile(spirv)` only runs on a miss and returns false on failure, failed compilations are not cached
+		template<typename CompileFunc>
+		inline bool getOrCompile(const SKey& key, nbl::core::vector<uint8_t>& spirv, CompileFunc&& compile)
+		{
+			if (lookup(key,spirv))
+				return true;
+			const auto start = std::chrono::steady_clock::now();
+			spirv.clear();
+			const bool compiled = compile(spirv);
+			addMs(m_compileMicroseconds,start);
+			if (!compiled)
+				return false;
+			store(key,spirv.data(),spirv.size());
+			return true;
+		}
+
+		//! Evicts the least recently used entries until the directory fits in the budget, also sweeps temporaries left behind by crashed writers.
+		//! Runs after every store, misses are rare and a directory listing is cheap next to a compilation.
+		inline void trim()
+		{
+			struct SEntry
+			{
+				std::filesystem::path path;
+				std::filesystem::file_time_type lastUse;
+				uint64_t size;
+			};
+			nbl::core::vector<SEntry> entries;
+			uint64_t totalSize = 0ull;
+
+			std::error_code ec;
+			const auto now = std::filesystem::file_time_type::clock::now();
+			for (const auto& entry : std::filesystem::directory_iterator(m_directory,ec))
+			{
+				std::error_code entryEC;
+				if (!entry.is_regular_file(entryEC))
+					continue;
+				const auto& path = entry.path();
+				const auto lastUse = entry.last_write_time(entryEC);
+				if (entryEC)
+					continue;
+				if (path.extension()==".tmp")
+				{
+					// a live writer finishes in well under a minute
+					if (now-lastUse>std::chrono::minutes(10))
+						std::filesystem::remove(path,entryEC);
+					continue;
+				}
+				if (path.extension()!=Extension)
+					continue;
+				const uint64_t size = entry.file_size(entryEC);
+				if (entryEC)
+					continue;
+				entries.push_back({path,lastUse,size});
+				totalSize += size;
+			}
+			if (totalSize<=m_maxBytes)
+				return;
+
+			std::sort(entries.begin(),entries.end(),[](const SEntry& lhs, const SEntry& rhs) -> bool
+			{
+				if (lhs.lastUse!=rhs.lastUse)
+					return lhs.lastUse<rhs.lastUse;
+				return lhs.path<rhs.path;
+			});
+			for (auto it=entries.begin(); it!=entries.end() && totalSize>m_maxBytes; it++)
+			{
+				totalSize -= it->size;
+				// another process evicting the same entry is fine, only count our own removals
+				std::error_code removeEC;
+				if (std::filesystem::remove(it->path,removeEC))
+					m_evictions++;
+			}
+		}
+
+		inline SMetrics getMetrics() const
+		{
+			SMetrics retval;
+			retval.hits = m_hits;
+			retval.misses = m_misses;
+			retval.stores = m_stores;
+			retval.failedStores = m_failedStores;
+			retval.rejected = m_rejected;
+			retval.evictions = m_evictions;
+			retval.bytesRead = m_bytesRead;
+			retval.bytesWritten = m_bytesWritten;
+			retval.hitMs = double(m_hitMicroseconds)*1e-3;
+			retval.compileMs = double(m_compileMicroseconds)*1e-3;
+			return retval;
+		}
+		inline void printMetrics(const char* label) const
+		{
+			const auto metrics = getMetrics();
+			printf("[INFO] %s: %llu hits (%.1f ms), %llu misses (%.1f ms compiling), %llu rejected, %llu evicted\n",label,
+				static_cast<unsigned long long>(metrics.hits),metrics.hitMs,static_cast<unsigned long long>(metrics.misses),metrics.compileMs,
+				static_cast<unsigned long long>(metrics.rejected),static_cast<unsigned long long>(metrics.evictions)
+			);
+		}
+
+		//! Exercises the cache with a stand-in compiler in `directory` (which gets wiped), no GPU or GLSL compiler involved:
+		//! restarts, key sensitivity, corrupted entries, LRU eviction order and several instances hammering one directory
+		//! from different threads the same way separate processes would, checking the metrics and the returned SPIR-V at every step.
+		static inline bool selfTest(const std::filesystem::path& directory);
+
+	private:
+		struct SEntryHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key[2];
+			uint64_t spirvSize;
+			uint64_t spirvChecksum;
+			//! hash of this header with the field zeroed
+			uint64_t headerChecksum;
+		};
+
+		static inline uint64_t computeHeaderChecksum(SEntryHeader header)
+		{
+			header.headerChecksum = 0ull;
+			return cache_file::hash(&header,sizeof(header));
+		}
+
+		//! explicit rather than relying on the write, filesystem timestamps are often only as fine as the scheduler tick
+		static inline void touch(const std::filesystem::path& path)
+		{
+			std::error_code ec;
+			std::filesystem::last_write_time(path,std::filesystem::file_time_type::clock::now(),ec);
+		}
+
+		static inline void addMs(std::atomic<uint64_t>& counter, const std::chrono::steady_clock::time_point start)
+		{
+			counter += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start).count();
+		}
+
+		const std::filesystem::path m_directory;
+		const uint64_t m_maxBytes;
+		// examples compile on worker threads
+		std::atomic<uint64_t> m_hits = 0ull;
+		std::atomic<uint64_t> m_misses = 0ull;
+		std::atomic<uint64_t> m_stores = 0ull;
+		std::atomic<uint64_t> m_failedStores = 0ull;
+		std::atomic<uint64_t> m_rejected = 0ull;
+		std::atomic<uint64_t> m_evictions = 0ull;
+		std::atomic<uint64_t> m_bytesRead = 0ull;
+		std::atomic<uint64_t> m_bytesWritten = 0ull;
+		std::atomic<uint64_t> m_hitMicroseconds = 0ull;
+		std::atomic<uint64_t> m_compileMicroseconds = 0ull;
+};
+
+//! Glue for the examples, `compile()` returns the SPIR-V `asset::ICPUShader` (or null) and only runs on a miss,
+//! on a hit the shader gets made straight from the cached words.
+template<typename CompileFunc>
+inline nbl::core::smart_refctd_ptr<nbl::asset::ICPUShader> getOrCompileShader(CCache& cache, const SKey& key, CompileFunc&& compile)
+{
+	nbl::core::vector<uint8_t> spirv;
+	nbl::core::smart_refctd_ptr<nbl::asset::ICPUShader> compiled;
+	const bool success = cache.getOrCompile(key,spirv,[&](nbl::core::vector<uint8_t>& out) -> bool
+	{
+		compiled = compile();
+		if (!compiled)
+			return false;
+		const auto* content = compiled->getContent();
+		const auto* begin = reinterpret_cast<const uint8_t*>(content->getPointer());
+		out.assign(begin,begin+content->getSize());
+		return true;
+	});
+	if (!success)
+		return nullptr;
+	if (compiled)
+		return compiled;
+	auto buffer = nbl::core::make_smart_refctd_ptr<nbl::asset::ICPUBuffer>(spirv.size());
+	memcpy(buffer->getPointer(),spirv.data(),spirv.size());
+	return nbl::core::make_smart_refctd_ptr<nbl::asset::ICPUShader>(std::move(buffer));
+}
+
+
+inline bool CCache::selfTest(const std::filesystem::path& directory)
+{
+	std::error_code ec;
+	std::filesystem::remove_all(directory,ec);
+
+	bool passed = true;
+	auto check = [&passed](const bool condition, const char* what) -> void
+	{
+		if (!condition)
+		{
+			printf("[ERROR] Shader Cache: %s\n",what);
+			passed = false;
+		}
+	};
+
+	// the stand-in compiler, output depends on every input and the cost scales with the source like a real one
+	struct SCompilation
+	{
+		std::string source;
+		std::string define;
+		uint32_t stage;
+		uint64_t includeHash;
+
+		inline SKey getKey(const uint64_t compiler) const
+		{
+			CKeyBuilder builder;
+			builder.setSource(source).addDefine(define).addInclude("common.glsl",includeHash).setStage(stage).setEntryPoint("main").setCompiler(compiler);
+			return builder.build();
+		}
+		inline bool compile(nbl::core::vector<uint8_t>& spirv) const
+		{
+			const uint64_t seed = cache_file::hash(define.data(),define.size(),cache_file::hash(source.data(),source.size(),stage^includeHash));
+			spirv.resize((source.size()/4u+16u)*4u);
+			uint64_t state = seed;
+			for (auto i=0u; i<64u; i++)
+				state = cache_file::hash(source.data(),source.size(),state);
+			for (size_t i=0u; i<spirv.size(); i++)
+			{
+				state = state*6364136223846793005ull+1442695040888963407ull;
+				spirv[i] = uint8_t(state>>56u);
+			}
+			const uint32_t magic = 0x07230203u;
+			memcpy(spirv.data(),&magic,sizeof(magic));
+			return true;
+		}
+	};
+	constexpr uint64_t Compiler = 0x1234u;
+	constexpr uint32_t ShaderCount = 48u;
+	nbl::core::vector<SCompilation> compilations(ShaderCount);
+	for (auto i=0u; i<ShaderCount; i++)
+	{
+		auto& compilation = compilations[i];
+		compilation.source = "#version 430 core\n// shader "+std::to_string(i)+"\n"+std::string(1024u+i*97u,char('a'+i%26u))+"\nvoid main() {}\n";
+		compilation.define = "SHADER_"+std::to_string(i%5u);
+		compilation.stage = i%3u;
+		compilation.includeHash = 0xabcdull*(i%7u);
+	}
+	auto expected = [&](const SCompilation& compilation) -> nbl::core::vector<uint8_t>
+	{
+		nbl::core::vector<uint8_t> retval;
+		compilation.compile(retval);
+		return retval;
+	};
+	auto runAll = [&](CCache& cache, uint32_t& compiles, bool& allMatch) -> double
+	{
+		compiles = 0u;
+		allMatch = true;
+		const auto start = std::chrono::steady_clock::now();
+		nbl::core::vector<uint8_t> spirv;
+		for (const auto& compilation : compilations)
+		{
+			cache.getOrCompile(compilation.getKey(Compiler),spirv,[&](nbl::core::vector<uint8_t>& out) -> bool {compiles++; return compilation.compile(out);});
+			allMatch = allMatch && spirv==expected(compilation);
+		}
+		return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+	};
+
+	// cold start, then a restart which must not compile anything
+	{
+		uint32_t compiles;
+		bool allMatch;
+		CCache cold(directory);
+		const double coldMs = runAll(cold,compiles,allMatch);
+		const auto coldMetrics = cold.getMetrics();
+		check(compiles==ShaderCount && coldMetrics.misses==ShaderCount && coldMetrics.stores==ShaderCount && coldMetrics.hits==0ull,"cold run did not compile every shader once");
+		check(allMatch,"cold run returned wrong SPIR-V");
+
+		CCache warm(directory);
+		const double warmMs = runAll(warm,compiles,allMatch);
+		const auto warmMetrics = warm.getMetrics();
+		check(compiles==0u && warmMetrics.hits==ShaderCount && warmMetrics.misses==0ull,"restarted cache compiled again");
+		check(allMatch,"cached SPIR-V differs from the compiled");
+		printf("[INFO] Shader Cache: %u shaders cold %.2f ms, warm %.2f ms, %.1f us per hit\n",ShaderCount,coldMs,warmMs,warmMetrics.hitMs*1000.0/double(ShaderCount));
+	}
+
+	// every input has to be part of the key
+	{
+		const auto& base = compilations.front();
+		const SKey baseKey = base.getKey(Compiler);
+		auto changed = base;
+		changed.source.back() = ' ';
+		const bool source = changed.getKey(Compiler)!=baseKey;
+		changed = base;
+		changed.define += "_OTHER";
+		const bool define = changed.getKey(Compiler)!=baseKey;
+		changed = base;
+		changed.includeHash++;
+		const bool include = changed.getKey(Compiler)!=baseKey;
+		changed = base;
+		changed.stage++;
+		const bool stage = changed.getKey(Compiler)!=baseKey;
+		const bool compiler = base.getKey(Compiler+1u)!=baseKey;
+		// moving bytes between fields must not collide either
+		const bool fields = CKeyBuilder().setSource("ab").setEntryPoint("c").build()!=CKeyBuilder().setSource("a").setEntryPoint("bc").build();
+		check(source && define && include && stage && compiler && fields,"key ignores one of its inputs");
+
+		CCache cache(directory);
+		nbl::core::vector<uint8_t> spirv;
+		check(!cache.lookup(changed.getKey(Compiler+1u),spirv) && cache.getMetrics().misses==1ull,"lookup under another compiler hit");
+	}
+
+	// a damaged entry gets rejected, recompiled and then hits again
+	{
+		const auto& compilation = compilations[1];
+		const SKey key = compilation.getKey(Compiler);
+		CCache cache(directory);
+		const auto path = cache.getPath(key);
+		{
+			std::fstream file(path,std::ios::binary|std::ios::in|std::ios::out);
+			file.seekp(sizeof(SEntryHeader)+7u);
+			file.put('\xff');
+		}
+		nbl::core::vector<uint8_t> spirv;
+		uint32_t compiles = 0u;
+		auto compile = [&](nbl::core::vector<uint8_t>& out) -> bool {compiles++; return compilation.compile(out);};
+		cache.getOrCompile(key,spirv,compile);
+		const bool recompiled = compiles==1u && spirv==expected(compilation);
+		cache.getOrCompile(key,spirv,compile);
+		{
+			std::ofstream truncated(cache.getPath(compilations[2].getKey(Compiler)),std::ios::binary|std::ios::trunc);
+			truncated.write("SPVC",4);
+		}
+		const bool truncatedRejected = !cache.lookup(compilations[2].getKey(Compiler),spirv);
+		const auto metrics = cache.getMetrics();
+		check(recompiled && compiles==1u && metrics.rejected==2ull && metrics.hits==1ull && truncatedRejected,"corrupted entries were not rejected");
+	}
+
+	// LRU: fill a fresh directory to the budget, use the oldest and the next insertion has to evict the second oldest
+	{
+		const auto lruDirectory = directory/"lru";
+		constexpr uint32_t Capacity = 8u;
+		nbl::core::vector<SCompilation> fixed(Capacity+1u,compilations.front());
+		for (auto i=0u; i<=Capacity; i++)
+			fixed[i].define = "LRU_"+std::to_string(i);
+		const uint64_t entrySize = sizeof(SEntryHeader)+expected(fixed[0]).size();
+		CCache cache(lruDirectory,entrySize*Capacity);
+		nbl::core::vector<uint8_t> spirv;
+		for (auto i=0u; i<Capacity; i++)
+			cache.getOrCompile(fixed[i].getKey(Compiler),spirv,[&](nbl::core::vector<uint8_t>& out) -> bool {return fixed[i].compile(out);});
+		const bool filled = cache.getMetrics().evictions==0ull;
+		const bool firstHit = cache.lookup(fixed[0].getKey(Compiler),spirv);
+		cache.getOrCompile(fixed[Capacity].getKey(Compiler),spirv,[&](nbl::core::vector<uint8_t>& out) -> bool {return fixed[Capacity].compile(out);});
+		const bool evictedSecond = !std::filesystem::exists(cache.getPath(fixed[1].getKey(Compiler)),ec);
+		const bool keptFirst = std::filesystem::exists(cache.getPath(fixed[0].getKey(Compiler)),ec);
+		check(filled && firstHit && cache.getMetrics().evictions==1ull && evictedSecond && keptFirst,"eviction is not least recently used first");
+
+		CCache tiny(lruDirectory,entrySize/2u);
+		check(!tiny.store(fixed[0].getKey(Compiler),spirv.data(),spirv.size()) && tiny.getMetrics().failedStores==1ull,"an entry larger than the budget was stored");
+	}
+
+	// separate instances share nothing but the directory, the budget is small enough to evict all the time
+	{
+		const auto sharedDirectory = directory/"shared";
+		const uint32_t threadCount = std::max(std::thread::hardware_concurrency(),4u);
+		constexpr uint32_t Iterations = 256u;
+		std::atomic<uint32_t> mismatches = 0u;
+		std::atomic<uint64_t> hits = 0u, rejected = 0u, evictions = 0u;
+		nbl::core::vector<std::thread> threads;
+		for (auto t=0u; t<threadCount; t++)
+		threads.emplace_back([&,t]()
+		{
+			CCache cache(sharedDirectory,64ull<<10ull);
+			nbl::core::vector<uint8_t> spirv;
+			uint64_t state = t+1u;
+			for (auto i=0u; i<Iterations; i++)
+			{
+				state = state*6364136223846793005ull+1442695040888963407ull;
+				const auto& compilation = compilations[(state>>33u)%ShaderCount];
+				const bool success = cache.getOrCompile(compilation.getKey(Compiler),spirv,[&](nbl::core::vector<uint8_t>& out) -> bool {return compilation.compile(out);});
+				if (!success || spirv!=expected(compilation))
+					mismatches++;
+			}
+			const auto metrics = cache.getMetrics();
+			hits += metrics.hits;
+			rejected += metrics.rejected;
+			evictions += metrics.evictions;
+		});
+		for (auto& thread : threads)
+			thread.join();
+		printf("[INFO] Shader Cache: %u concurrent instances, %llu hits out of %u lookups, %llu evictions\n",threadCount,
+			static_cast<unsigned long long>(hits),threadCount*Iterations,static_cast<unsigned long long>(evictions)
+		);
+		check(mismatches==0u,"concurrent instances got wrong SPIR-V");
+		check(rejected==0u,"concurrent instances saw partial entries");
+		check(hits>0u && evictions>0u,"concurrent test did not exercise both hits and evictions");
+	}
+
+	std::filesystem::remove_all(directory,ec);
+	printf("[INFO] Shader Cache: self test %s\n",passed ? "passed":"FAILED");
+	return passed;
+}
+
+}
+
+#endif